@@ -0,0 +1,548 @@
+/*--------------------------------------------------------------------*/
+/* arena.c                                                            */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef THREADSAFE
+#include <pthread.h>
+#endif
+
+#include "arena.h"
+
+/* Alignment that satisfies every object an arena may hold */
+union align {
+   void *pv;
+   long l;
+   size_t ul;
+   double d;
+   long double ld;
+};
+
+/* Rounds ulSize up to a multiple of the alignment */
+#define ARENA_ROUND(ulSize) \
+   (((ulSize) + sizeof(union align) - 1) / sizeof(union align) * \
+    sizeof(union align))
+
+enum {
+   /* the size of the smallest size class (a power of 2) */
+   MIN_BLOCK = 16,
+   /* the number of size classes: MIN_BLOCK, 2*MIN_BLOCK, ... */
+   NUM_CLASSES = 8,
+   /* the largest block carved from a slab */
+   MAX_SMALL = MIN_BLOCK << (NUM_CLASSES - 1),
+   /* the number of bytes carved into blocks per slab */
+   SLAB_SIZE = 64 * 1024,
+   /* the number of buckets the interned blocks start with (a power of 2) */
+   MIN_BUCKETS = 64
+};
+
+/* A released small block, linked into its size class's free list */
+struct freeBlock {
+   /* the next free block of the same size class */
+   struct freeBlock *psNext;
+};
+
+/* A slab of memory from which small blocks are carved off in order */
+struct slab {
+   /* the previously allocated slab */
+   struct slab *psPrev;
+};
+
+/* A large block, allocated on its own and followed by its contents */
+struct large {
+   /* the neighbouring large blocks of the same arena */
+   struct large *psPrev;
+   struct large *psNext;
+};
+
+/* A malloc'd block that the arena has adopted */
+struct adopted {
+   /* the neighbouring adopted blocks of the same arena */
+   struct adopted *psPrev;
+   struct adopted *psNext;
+   /* the block itself */
+   void *pv;
+};
+
+/* A block that Arena_intern shares, followed by its contents */
+struct interned {
+   /* the next interned block in the same bucket */
+   struct interned *psNext;
+   /* the hash of the contents, and their size */
+   size_t ulHash;
+   size_t ulSize;
+   /* the number of references to the block */
+   size_t ulRefs;
+};
+
+/* An arena: its free lists, its slabs, and its large blocks */
+struct Arena {
+   /* the free list of each size class */
+   struct freeBlock *apsFree[NUM_CLASSES];
+   /* the most recently allocated slab */
+   struct slab *psSlabs;
+   /* the next free byte in the slab being carved, and its end */
+   char *pcAvail;
+   char *pcLimit;
+   /* the most recently allocated large block */
+   struct large *psLarge;
+   /* the most recently adopted block */
+   struct adopted *psAdopted;
+   /* the interned blocks, chained by hash, their number, and the number
+      of buckets (a power of 2, or 0 until the first is interned) */
+   struct interned **ppsBuckets;
+   size_t ulInterned;
+   size_t ulBuckets;
+#ifdef THREADSAFE
+   /* serializes the threads that share the arena */
+   pthread_mutex_t sMutex;
+#endif
+};
+
+#ifdef THREADSAFE
+#define ARENA_LOCK(oArena) ((void) pthread_mutex_lock(&(oArena)->sMutex))
+#define ARENA_UNLOCK(oArena) ((void) pthread_mutex_unlock(&(oArena)->sMutex))
+#else
+#define ARENA_LOCK(oArena) ((void) 0)
+#define ARENA_UNLOCK(oArena) ((void) 0)
+#endif
+
+/* Returns the size class of a small block of ulSize bytes. */
+static size_t Arena_class(size_t ulSize) {
+   size_t ulClass = 0;
+   size_t ulBlock = MIN_BLOCK;
+
+   assert(ulSize <= MAX_SMALL);
+
+   while(ulBlock < ulSize) {
+      ulBlock <<= 1;
+      ulClass++;
+   }
+   return ulClass;
+}
+
+/*
+  Carves a block of size class ulClass from the current slab, starting
+  a new slab if needed. Returns NULL if memory could not be allocated.
+*/
+static void *Arena_carve(Arena_T oArena, size_t ulClass) {
+   size_t ulBlock = (size_t) MIN_BLOCK << ulClass;
+   void *pvResult;
+
+   assert(oArena != NULL);
+
+   if(ulBlock > (size_t)(oArena->pcLimit - oArena->pcAvail)) {
+      struct slab *psNew = malloc(ARENA_ROUND(sizeof(struct slab)) +
+                                  SLAB_SIZE);
+      if(psNew == NULL)
+         return NULL;
+      psNew->psPrev = oArena->psSlabs;
+      oArena->psSlabs = psNew;
+      oArena->pcAvail = (char *)psNew + ARENA_ROUND(sizeof(struct slab));
+      oArena->pcLimit = oArena->pcAvail + SLAB_SIZE;
+   }
+
+   pvResult = oArena->pcAvail;
+   oArena->pcAvail += ulBlock;
+   return pvResult;
+}
+
+/* Returns the header of the large block whose contents begin at pv. */
+static struct large *Arena_largeHeader(void *pv) {
+   assert(pv != NULL);
+
+   return (struct large *)((char *)pv - ARENA_ROUND(sizeof(struct large)));
+}
+
+Arena_T Arena_new(void) {
+   /* every free list, slab pointer and large pointer starts out NULL */
+   Arena_T oArena = calloc(1, sizeof(struct Arena));
+
+#ifdef THREADSAFE
+   if(oArena != NULL && pthread_mutex_init(&oArena->sMutex, NULL) != 0) {
+      free(oArena);
+      return NULL;
+   }
+#endif
+   return oArena;
+}
+
+void Arena_free(Arena_T oArena) {
+   struct slab *psSlab;
+   struct large *psLarge;
+   struct adopted *psAdopted;
+
+   if(oArena == NULL)
+      return;
+
+   /* the adoption records live in the slabs, so go through them first */
+   for(psAdopted = oArena->psAdopted; psAdopted != NULL;
+       psAdopted = psAdopted->psPrev)
+      free(psAdopted->pv);
+
+   psSlab = oArena->psSlabs;
+   while(psSlab != NULL) {
+      struct slab *psPrev = psSlab->psPrev;
+      free(psSlab);
+      psSlab = psPrev;
+   }
+
+   psLarge = oArena->psLarge;
+   while(psLarge != NULL) {
+      struct large *psPrev = psLarge->psPrev;
+      free(psLarge);
+      psLarge = psPrev;
+   }
+
+   /* the interned blocks themselves went with the slabs and large blocks */
+   free(oArena->ppsBuckets);
+
+#ifdef THREADSAFE
+   (void) pthread_mutex_destroy(&oArena->sMutex);
+#endif
+   free(oArena);
+}
+
+/*
+  The bodies of Arena_alloc, Arena_resize and Arena_release, for a
+  caller that holds oArena's lock.
+*/
+static void *Arena_allocBlock(Arena_T oArena, size_t ulSize) {
+   assert(oArena != NULL);
+
+   if(ulSize <= MAX_SMALL) {
+      size_t ulClass = Arena_class(ulSize);
+      struct freeBlock *psBlock = oArena->apsFree[ulClass];
+
+      /* reuse a released block of the same class before carving */
+      if(psBlock != NULL) {
+         oArena->apsFree[ulClass] = psBlock->psNext;
+         return psBlock;
+      }
+      return Arena_carve(oArena, ulClass);
+   }
+   else {
+      struct large *psLarge;
+
+      if(ulSize > (size_t) -1 - ARENA_ROUND(sizeof(struct large)))
+         return NULL;
+      psLarge = malloc(ARENA_ROUND(sizeof(struct large)) + ulSize);
+      if(psLarge == NULL)
+         return NULL;
+
+      psLarge->psPrev = oArena->psLarge;
+      psLarge->psNext = NULL;
+      if(oArena->psLarge != NULL)
+         oArena->psLarge->psNext = psLarge;
+      oArena->psLarge = psLarge;
+      return (char *)psLarge + ARENA_ROUND(sizeof(struct large));
+   }
+}
+
+static void Arena_releaseBlock(Arena_T oArena, void *pv, size_t ulSize) {
+   assert(oArena != NULL);
+
+   if(pv == NULL)
+      return;
+
+   if(ulSize <= MAX_SMALL) {
+      size_t ulClass = Arena_class(ulSize);
+      struct freeBlock *psBlock = pv;
+
+      psBlock->psNext = oArena->apsFree[ulClass];
+      oArena->apsFree[ulClass] = psBlock;
+   }
+   else {
+      struct large *psLarge = Arena_largeHeader(pv);
+
+      if(psLarge->psPrev != NULL)
+         psLarge->psPrev->psNext = psLarge->psNext;
+      if(psLarge->psNext != NULL)
+         psLarge->psNext->psPrev = psLarge->psPrev;
+      else
+         oArena->psLarge = psLarge->psPrev;
+      free(psLarge);
+   }
+}
+
+static void *Arena_resizeBlock(Arena_T oArena, void *pv, size_t ulOldSize,
+                               size_t ulNewSize) {
+   void *pvNew;
+
+   assert(oArena != NULL);
+
+   if(pv == NULL)
+      return Arena_allocBlock(oArena, ulNewSize);
+
+   /* a small block already has room for anything in its class */
+   if(ulOldSize <= MAX_SMALL && ulNewSize <= MAX_SMALL &&
+      Arena_class(ulOldSize) == Arena_class(ulNewSize))
+      return pv;
+
+   /* a large block can grow or shrink in place */
+   if(ulOldSize > MAX_SMALL && ulNewSize > MAX_SMALL) {
+      struct large *psOld = Arena_largeHeader(pv);
+      struct large *psNew;
+
+      if(ulNewSize > (size_t) -1 - ARENA_ROUND(sizeof(struct large)))
+         return NULL;
+      psNew = realloc(psOld, ARENA_ROUND(sizeof(struct large)) +
+                      ulNewSize);
+      if(psNew == NULL)
+         return NULL;
+
+      if(psNew->psPrev != NULL)
+         psNew->psPrev->psNext = psNew;
+      if(psNew->psNext != NULL)
+         psNew->psNext->psPrev = psNew;
+      else
+         oArena->psLarge = psNew;
+      return (char *)psNew + ARENA_ROUND(sizeof(struct large));
+   }
+
+   /* otherwise the block changes kind, so it must move */
+   pvNew = Arena_allocBlock(oArena, ulNewSize);
+   if(pvNew == NULL)
+      return NULL;
+   memcpy(pvNew, pv, ulOldSize < ulNewSize ? ulOldSize : ulNewSize);
+   Arena_releaseBlock(oArena, pv, ulOldSize);
+   return pvNew;
+}
+
+void *Arena_alloc(Arena_T oArena, size_t ulSize) {
+   void *pv;
+
+   assert(oArena != NULL);
+
+   ARENA_LOCK(oArena);
+   pv = Arena_allocBlock(oArena, ulSize);
+   ARENA_UNLOCK(oArena);
+   return pv;
+}
+
+void *Arena_resize(Arena_T oArena, void *pv, size_t ulOldSize,
+                   size_t ulNewSize) {
+   void *pvNew;
+
+   assert(oArena != NULL);
+
+   ARENA_LOCK(oArena);
+   pvNew = Arena_resizeBlock(oArena, pv, ulOldSize, ulNewSize);
+   ARENA_UNLOCK(oArena);
+   return pvNew;
+}
+
+void Arena_release(Arena_T oArena, void *pv, size_t ulSize) {
+   assert(oArena != NULL);
+
+   ARENA_LOCK(oArena);
+   Arena_releaseBlock(oArena, pv, ulSize);
+   ARENA_UNLOCK(oArena);
+}
+
+void *Arena_adopt(Arena_T oArena, void *pv) {
+   struct adopted *psAdopted;
+
+   assert(oArena != NULL);
+   assert(pv != NULL);
+
+   ARENA_LOCK(oArena);
+   psAdopted = Arena_allocBlock(oArena, sizeof(struct adopted));
+   if(psAdopted != NULL) {
+      psAdopted->pv = pv;
+      psAdopted->psPrev = oArena->psAdopted;
+      psAdopted->psNext = NULL;
+      if(oArena->psAdopted != NULL)
+         oArena->psAdopted->psNext = psAdopted;
+      oArena->psAdopted = psAdopted;
+   }
+   ARENA_UNLOCK(oArena);
+   return psAdopted;
+}
+
+void Arena_releaseAdopted(Arena_T oArena, void *pvHandle) {
+   struct adopted *psAdopted = pvHandle;
+
+   assert(oArena != NULL);
+   assert(pvHandle != NULL);
+
+   ARENA_LOCK(oArena);
+   if(psAdopted->psPrev != NULL)
+      psAdopted->psPrev->psNext = psAdopted->psNext;
+   if(psAdopted->psNext != NULL)
+      psAdopted->psNext->psPrev = psAdopted->psPrev;
+   else
+      oArena->psAdopted = psAdopted->psPrev;
+
+   free(psAdopted->pv);
+   Arena_releaseBlock(oArena, psAdopted, sizeof(struct adopted));
+   ARENA_UNLOCK(oArena);
+}
+
+/* Returns the number of bytes taken by an interned block of ulSize bytes. */
+static size_t Arena_internedSize(size_t ulSize) {
+   return ARENA_ROUND(sizeof(struct interned)) + ulSize;
+}
+
+/* Returns where the contents of the interned block psBlock begin. */
+static void *Arena_internedContents(struct interned *psBlock) {
+   assert(psBlock != NULL);
+
+   return (char *)psBlock + ARENA_ROUND(sizeof(struct interned));
+}
+
+/* Returns the header of the interned block whose contents begin at pv. */
+static struct interned *Arena_internedHeader(void *pv) {
+   assert(pv != NULL);
+
+   return (struct interned *)((char *)pv -
+                              ARENA_ROUND(sizeof(struct interned)));
+}
+
+/* Steps of Arena_hash: the primes and rounds of xxHash64 */
+#define ARENA_PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define ARENA_PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define ARENA_PRIME3 UINT64_C(0x165667B19E3779F9)
+#define ARENA_PRIME4 UINT64_C(0x85EBCA77C2B2AE63)
+#define ARENA_PRIME5 UINT64_C(0x27D4EB2F165667C5)
+#define ARENA_ROTATE(ul, iBits) (((ul) << (iBits)) | ((ul) >> (64 - (iBits))))
+
+/*
+  Returns a hash of the ulSize bytes at pv: xxHash64 with seed 0 for
+  fewer than 32 bytes, and beyond that its way with the last few bytes
+  applied 8 at a time throughout, rather than in 4 lanes.
+*/
+static size_t Arena_hash(const void *pv, size_t ulSize) {
+   const unsigned char *puc = pv;
+   uint64_t ulHash = ARENA_PRIME5 + (uint64_t) ulSize;
+   uint64_t ulWord;
+
+   for(; ulSize >= sizeof(ulWord); ulSize -= sizeof(ulWord)) {
+      /* memcpy, since the bytes need not be aligned */
+      memcpy(&ulWord, puc, sizeof(ulWord));
+      puc += sizeof(ulWord);
+      ulHash ^= ARENA_ROTATE(ulWord * ARENA_PRIME2, 31) * ARENA_PRIME1;
+      ulHash = ARENA_ROTATE(ulHash, 27) * ARENA_PRIME1 + ARENA_PRIME4;
+   }
+   for(; ulSize > 0; ulSize--) {
+      ulHash ^= *puc++ * ARENA_PRIME5;
+      ulHash = ARENA_ROTATE(ulHash, 11) * ARENA_PRIME1;
+   }
+
+   /* every bit of the input affects every bit of the bucket index */
+   ulHash ^= ulHash >> 33;
+   ulHash *= ARENA_PRIME2;
+   ulHash ^= ulHash >> 29;
+   ulHash *= ARENA_PRIME3;
+   ulHash ^= ulHash >> 32;
+   return (size_t) ulHash;
+}
+
+/*
+  Doubles the number of buckets of oArena's interned blocks, whose
+  lock the caller holds. Returns 0 if memory could not be allocated,
+  leaving the buckets as they were, and 1 otherwise.
+*/
+static int Arena_growBuckets(Arena_T oArena) {
+   size_t ulNewBuckets = oArena->ulBuckets == 0 ?
+                         MIN_BUCKETS : 2 * oArena->ulBuckets;
+   struct interned **ppsNew;
+   size_t i;
+
+   if(ulNewBuckets > (size_t) -1 / sizeof(struct interned *))
+      return 0;
+   ppsNew = calloc(ulNewBuckets, sizeof(struct interned *));
+   if(ppsNew == NULL)
+      return 0;
+
+   for(i = 0; i < oArena->ulBuckets; i++) {
+      struct interned *psBlock = oArena->ppsBuckets[i];
+
+      while(psBlock != NULL) {
+         struct interned *psNext = psBlock->psNext;
+         size_t ulBucket = psBlock->ulHash & (ulNewBuckets - 1);
+
+         psBlock->psNext = ppsNew[ulBucket];
+         ppsNew[ulBucket] = psBlock;
+         psBlock = psNext;
+      }
+   }
+   free(oArena->ppsBuckets);
+   oArena->ppsBuckets = ppsNew;
+   oArena->ulBuckets = ulNewBuckets;
+   return 1;
+}
+
+void *Arena_intern(Arena_T oArena, const void *pv, size_t ulSize) {
+   size_t ulHash;
+   struct interned *psBlock = NULL;
+
+   assert(oArena != NULL);
+   assert(pv != NULL);
+   assert(ulSize > 0);
+
+   if(ulSize > (size_t) -1 - ARENA_ROUND(sizeof(struct interned)))
+      return NULL;
+
+   /* hashing needs no lock */
+   ulHash = Arena_hash(pv, ulSize);
+
+   ARENA_LOCK(oArena);
+   if(oArena->ulBuckets > 0)
+      psBlock = oArena->ppsBuckets[ulHash & (oArena->ulBuckets - 1)];
+   while(psBlock != NULL &&
+         (psBlock->ulHash != ulHash || psBlock->ulSize != ulSize ||
+          memcmp(Arena_internedContents(psBlock), pv, ulSize) != 0))
+      psBlock = psBlock->psNext;
+
+   if(psBlock != NULL) {
+      psBlock->ulRefs++;
+      ARENA_UNLOCK(oArena);
+      return Arena_internedContents(psBlock);
+   }
+
+   /* a table that cannot grow gets fuller, but still works */
+   if(oArena->ulInterned >= oArena->ulBuckets &&
+      !Arena_growBuckets(oArena) && oArena->ulBuckets == 0) {
+      ARENA_UNLOCK(oArena);
+      return NULL;
+   }
+   psBlock = Arena_allocBlock(oArena, Arena_internedSize(ulSize));
+   if(psBlock != NULL) {
+      size_t ulBucket = ulHash & (oArena->ulBuckets - 1);
+
+      psBlock->ulHash = ulHash;
+      psBlock->ulSize = ulSize;
+      psBlock->ulRefs = 1;
+      psBlock->psNext = oArena->ppsBuckets[ulBucket];
+      oArena->ppsBuckets[ulBucket] = psBlock;
+      oArena->ulInterned++;
+      memcpy(Arena_internedContents(psBlock), pv, ulSize);
+   }
+   ARENA_UNLOCK(oArena);
+   return psBlock == NULL ? NULL : Arena_internedContents(psBlock);
+}
+
+void Arena_releaseInterned(Arena_T oArena, void *pv) {
+   struct interned *psBlock = Arena_internedHeader(pv);
+   struct interned **ppsLink;
+
+   assert(oArena != NULL);
+
+   ARENA_LOCK(oArena);
+   assert(psBlock->ulRefs > 0);
+   if(--psBlock->ulRefs == 0) {
+      ppsLink = &oArena->ppsBuckets[psBlock->ulHash &
+                                    (oArena->ulBuckets - 1)];
+      while(*ppsLink != psBlock)
+         ppsLink = &(*ppsLink)->psNext;
+      *ppsLink = psBlock->psNext;
+      oArena->ulInterned--;
+      Arena_releaseBlock(oArena, psBlock,
+                         Arena_internedSize(psBlock->ulSize));
+   }
+   ARENA_UNLOCK(oArena);
+}
@@ -0,0 +1,87 @@
+/*--------------------------------------------------------------------*/
+/* arena.h                                                            */
+/*--------------------------------------------------------------------*/
+
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+#include <stddef.h>
+
+/*
+  An Arena_T object is a pool of memory from which many small objects
+  are carved. Small blocks come from fixed-size slabs with one free
+  list per size class, so releasing and reallocating them never calls
+  free or malloc; large blocks are allocated individually. All of an
+  arena's memory is returned to the system at once by Arena_free, no
+  matter how many blocks were allocated from it. When compiled with
+  THREADSAFE, the allocation functions may be called on one arena from
+  several threads at once; Arena_new and Arena_free may not.
+*/
+typedef struct Arena *Arena_T;
+
+/*
+  Returns a new, empty Arena_T object, or NULL if insufficient memory
+  is available.
+*/
+Arena_T Arena_new(void);
+
+/*
+  Frees oArena and every block ever allocated from it, without
+  visiting the blocks individually.
+*/
+void Arena_free(Arena_T oArena);
+
+/*
+  Returns a block of at least ulSize bytes from oArena, suitably
+  aligned for any object, or NULL if insufficient memory is available.
+  The contents of the block are unspecified.
+*/
+void *Arena_alloc(Arena_T oArena, size_t ulSize);
+
+/*
+  Changes the size of the block pv, which was allocated from oArena
+  with size ulOldSize, to ulNewSize bytes, preserving its contents up
+  to the smaller of the two sizes. Returns the (possibly moved) block,
+  or NULL if insufficient memory is available, in which case pv is
+  left unchanged.
+*/
+void *Arena_resize(Arena_T oArena, void *pv, size_t ulOldSize,
+                   size_t ulNewSize);
+
+/*
+  Returns the block pv, which was allocated from oArena with size
+  ulSize, to oArena for reuse. Does nothing if pv is NULL.
+*/
+void Arena_release(Arena_T oArena, void *pv, size_t ulSize);
+
+/*
+  Makes oArena the owner of pv, a block allocated by malloc, which is
+  then freed by Arena_free or Arena_releaseAdopted. Returns a handle
+  for Arena_releaseAdopted, or NULL if insufficient memory is
+  available, in which case ownership of pv stays with the caller.
+*/
+void *Arena_adopt(Arena_T oArena, void *pv);
+
+/*
+  Frees the block that oArena adopted with handle pvHandle, which
+  Arena_adopt returned, without waiting for Arena_free.
+*/
+void Arena_releaseAdopted(Arena_T oArena, void *pvHandle);
+
+/*
+  Returns a block of oArena holding a copy of the ulSize bytes at pv,
+  ulSize > 0, taking a reference to it, or NULL if insufficient memory
+  is available. Blocks are looked up by a hash of their contents, so
+  that equal contents share one block for as long as it has a
+  reference: a duplicate costs a hash and a comparison, not a copy.
+  The block must not be written to.
+*/
+void *Arena_intern(Arena_T oArena, const void *pv, size_t ulSize);
+
+/*
+  Drops a reference to the block pv, which Arena_intern returned. With
+  its last reference the block is returned to oArena for reuse.
+*/
+void Arena_releaseInterned(Arena_T oArena, void *pv);
+
+#endif
@@ -0,0 +1,247 @@
+/*--------------------------------------------------------------------*/
+/* atom.c                                                             */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef THREADSAFE
+#include <pthread.h>
+#endif
+
+#include "atom.h"
+
+/* An interned string, followed in memory by its characters */
+struct atom {
+   /* the next atom in the same hash bucket */
+   struct atom *psNext;
+   /* the hash of the atom's characters */
+   size_t ulHash;
+   /* the number of characters, not including the trailing '\0' */
+   size_t ulLength;
+   /* the number of references to the atom */
+   size_t ulRefs;
+   /* the characters themselves */
+   char acString[];
+};
+
+enum {
+   /* the initial number of hash buckets (a power of 2) */
+   INITIAL_BUCKETS = 1024
+};
+
+/* The hash table of all atoms */
+static struct atom **ppsBuckets = NULL;
+/* The number of buckets in ppsBuckets */
+static size_t ulNumBuckets = 0;
+/* The number of atoms in ppsBuckets */
+static size_t ulNumAtoms = 0;
+
+#ifdef THREADSAFE
+/* Serializes every use of the table, which all threads share */
+static pthread_mutex_t sTableMutex = PTHREAD_MUTEX_INITIALIZER;
+#define ATOM_LOCK() ((void) pthread_mutex_lock(&sTableMutex))
+#define ATOM_UNLOCK() ((void) pthread_mutex_unlock(&sTableMutex))
+#else
+#define ATOM_LOCK() ((void) 0)
+#define ATOM_UNLOCK() ((void) 0)
+#endif
+
+/*
+  Doubles the number of hash buckets (or creates the initial ones).
+  Returns 1 (TRUE) if successful, or 0 (FALSE) if memory could not be
+  allocated, in which case the table is left unchanged.
+*/
+static int Atom_grow(void) {
+   struct atom **ppsNew;
+   size_t ulNewBuckets;
+   size_t i;
+
+   if(ulNumBuckets == 0)
+      ulNewBuckets = INITIAL_BUCKETS;
+   else
+      ulNewBuckets = 2 * ulNumBuckets;
+
+   ppsNew = calloc(ulNewBuckets, sizeof(struct atom *));
+   if(ppsNew == NULL)
+      return 0;
+
+   /* rehash every atom into the new buckets */
+   for(i = 0; i < ulNumBuckets; i++) {
+      struct atom *psAtom = ppsBuckets[i];
+      while(psAtom != NULL) {
+         struct atom *psNext = psAtom->psNext;
+         size_t ulBucket = psAtom->ulHash & (ulNewBuckets - 1);
+         psAtom->psNext = ppsNew[ulBucket];
+         ppsNew[ulBucket] = psAtom;
+         psAtom = psNext;
+      }
+   }
+
+   free(ppsBuckets);
+   ppsBuckets = ppsNew;
+   ulNumBuckets = ulNewBuckets;
+   return 1;
+}
+
+/* Returns the atom whose characters begin at pcAtom. */
+static struct atom *Atom_header(const char *pcAtom) {
+   assert(pcAtom != NULL);
+
+   return (struct atom *)(pcAtom - offsetof(struct atom, acString));
+}
+
+size_t Atom_hashString(const char *pcStr, size_t ulLength) {
+   size_t ulHash = 2166136261u;
+   size_t i;
+
+   assert(pcStr != NULL);
+
+   /* FNV-1a */
+   for(i = 0; i < ulLength; i++) {
+      ulHash ^= (unsigned char) pcStr[i];
+      ulHash *= 16777619u;
+   }
+   return ulHash;
+}
+
+/*
+  Returns the atom for the ulLength characters at pcStr, whose hash is
+  ulHash, or NULL if there is no such atom. The caller holds the table
+  lock.
+*/
+static struct atom *Atom_lookup(const char *pcStr, size_t ulLength,
+                                size_t ulHash) {
+   struct atom *psAtom;
+
+   assert(pcStr != NULL);
+
+   if(ulNumBuckets == 0)
+      return NULL;
+
+   for(psAtom = ppsBuckets[ulHash & (ulNumBuckets - 1)];
+       psAtom != NULL; psAtom = psAtom->psNext) {
+      if(psAtom->ulHash == ulHash && psAtom->ulLength == ulLength &&
+         memcmp(psAtom->acString, pcStr, ulLength) == 0)
+         return psAtom;
+   }
+   return NULL;
+}
+
+/*
+  Returns the atom for the ulLength characters at pcStr, whose hash is
+  ulHash, creating it if necessary, and takes a reference to it, or
+  returns NULL if memory could not be allocated. The caller holds the
+  table lock.
+*/
+static const char *Atom_intern(const char *pcStr, size_t ulLength,
+                               size_t ulHash) {
+   struct atom *psAtom;
+   size_t ulBucket;
+
+   assert(pcStr != NULL);
+
+   psAtom = Atom_lookup(pcStr, ulLength, ulHash);
+   if(psAtom != NULL) {
+      psAtom->ulRefs++;
+      return psAtom->acString;
+   }
+
+   /* keep the load factor at most 1 */
+   if(ulNumAtoms >= ulNumBuckets && !Atom_grow())
+      return NULL;
+
+   psAtom = malloc(offsetof(struct atom, acString) + ulLength + 1);
+   if(psAtom == NULL)
+      return NULL;
+
+   psAtom->ulHash = ulHash;
+   psAtom->ulLength = ulLength;
+   psAtom->ulRefs = 1;
+   memcpy(psAtom->acString, pcStr, ulLength);
+   psAtom->acString[ulLength] = '\0';
+
+   ulBucket = ulHash & (ulNumBuckets - 1);
+   psAtom->psNext = ppsBuckets[ulBucket];
+   ppsBuckets[ulBucket] = psAtom;
+   ulNumAtoms++;
+
+   return psAtom->acString;
+}
+
+const char *Atom_new(const char *pcStr, size_t ulLength) {
+   size_t ulHash;
+   const char *pcAtom;
+
+   assert(pcStr != NULL);
+
+   /* hash outside the lock: it touches nothing shared */
+   ulHash = Atom_hashString(pcStr, ulLength);
+   ATOM_LOCK();
+   pcAtom = Atom_intern(pcStr, ulLength, ulHash);
+   ATOM_UNLOCK();
+   return pcAtom;
+}
+
+const char *Atom_string(const char *pcStr) {
+   assert(pcStr != NULL);
+
+   return Atom_new(pcStr, strlen(pcStr));
+}
+
+const char *Atom_find(const char *pcStr, size_t ulLength) {
+   size_t ulHash;
+   struct atom *psAtom;
+
+   assert(pcStr != NULL);
+
+   ulHash = Atom_hashString(pcStr, ulLength);
+   ATOM_LOCK();
+   psAtom = Atom_lookup(pcStr, ulLength, ulHash);
+   if(psAtom != NULL)
+      psAtom->ulRefs++;
+   ATOM_UNLOCK();
+   return psAtom == NULL ? NULL : psAtom->acString;
+}
+
+void Atom_retain(const char *pcAtom) {
+   assert(pcAtom != NULL);
+
+   ATOM_LOCK();
+   Atom_header(pcAtom)->ulRefs++;
+   ATOM_UNLOCK();
+}
+
+void Atom_release(const char *pcAtom) {
+   struct atom *psAtom;
+   struct atom **ppsLink;
+
+   if(pcAtom == NULL)
+      return;
+
+   psAtom = Atom_header(pcAtom);
+   ATOM_LOCK();
+   assert(psAtom->ulRefs > 0);
+   if(--psAtom->ulRefs == 0) {
+      ppsLink = &ppsBuckets[psAtom->ulHash & (ulNumBuckets - 1)];
+      while(*ppsLink != psAtom)
+         ppsLink = &(*ppsLink)->psNext;
+      *ppsLink = psAtom->psNext;
+      ulNumAtoms--;
+      free(psAtom);
+   }
+   ATOM_UNLOCK();
+}
+
+size_t Atom_length(const char *pcAtom) {
+   assert(pcAtom != NULL);
+
+   return Atom_header(pcAtom)->ulLength;
+}
+
+size_t Atom_hash(const char *pcAtom) {
+   assert(pcAtom != NULL);
+
+   return Atom_header(pcAtom)->ulHash;
+}
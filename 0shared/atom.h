@@ -0,0 +1,62 @@
+/*--------------------------------------------------------------------*/
+/* atom.h                                                             */
+/*--------------------------------------------------------------------*/
+
+#ifndef ATOM_INCLUDED
+#define ATOM_INCLUDED
+
+#include <stddef.h>
+
+/*
+  An atom is a unique, immutable, '\0'-terminated string: interning
+  the same sequence of characters twice yields the same pointer, so
+  atoms can be compared for equality with ==. An atom is reference
+  counted: each function below that returns one takes a reference for
+  the caller, and the atom is freed with its last Atom_release. All
+  path components share one atom table, which is safe to use from
+  several threads at once when compiled with THREADSAFE.
+*/
+
+/*
+  Returns the atom for the ulLength characters at pcStr, which need not
+  be '\0'-terminated, creating it if necessary. Returns NULL if memory
+  could not be allocated to create the atom.
+*/
+const char *Atom_new(const char *pcStr, size_t ulLength);
+
+/*
+  Returns the atom for the '\0'-terminated string pcStr, creating it if
+  necessary. Returns NULL if memory could not be allocated.
+*/
+const char *Atom_string(const char *pcStr);
+
+/*
+  Returns the atom for the ulLength characters at pcStr if it already
+  exists, or NULL if it does not. Never allocates memory, so it suits
+  a lookup: characters that are no atom are held by no one.
+*/
+const char *Atom_find(const char *pcStr, size_t ulLength);
+
+/* Takes another reference to pcAtom, which must be an atom. */
+void Atom_retain(const char *pcAtom);
+
+/*
+  Drops a reference to pcAtom, which must be an atom, freeing it with
+  its last. Does nothing if pcAtom is NULL.
+*/
+void Atom_release(const char *pcAtom);
+
+/* Returns the length of pcAtom, which must be an atom, in O(1) time. */
+size_t Atom_length(const char *pcAtom);
+
+/*
+  Returns the hash of the ulLength characters at pcStr. For any atom
+  pcAtom, Atom_hash(pcAtom) is equal to
+  Atom_hashString(pcAtom, Atom_length(pcAtom)).
+*/
+size_t Atom_hashString(const char *pcStr, size_t ulLength);
+
+/* Returns the hash of pcAtom, which must be an atom, in O(1) time. */
+size_t Atom_hash(const char *pcAtom);
+
+#endif
@@ -0,0 +1,528 @@
+/*--------------------------------------------------------------------*/
+/* bench.c                                                            */
+/*--------------------------------------------------------------------*/
+
+/* clock_gettime, getrusage, fork and waitpid are POSIX, not C99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+enum {
+   /* the workload size when "-n" does not give one */
+   BENCH_DEFAULT_OPS = 100000,
+   /* children per directory in the generated trees */
+   BENCH_FANOUT = 32,
+   /* the longest path any workload generates, '\0' included */
+   BENCH_MAX_PATH = 8192,
+   /* the size of each file of the bigfile workload */
+   BENCH_FILE_SIZE = 1 << 20
+};
+
+/* The allocator calls made since the process started */
+static size_t ulMallocs;
+static size_t ulFrees;
+
+/* The real allocator, which the linker's --wrap renames */
+void *__real_malloc(size_t ulSize);
+void *__real_calloc(size_t ulCount, size_t ulSize);
+void *__real_realloc(void *pv, size_t ulSize);
+void __real_free(void *pv);
+
+void *__wrap_malloc(size_t ulSize) {
+   ulMallocs++;
+   return __real_malloc(ulSize);
+}
+
+void *__wrap_calloc(size_t ulCount, size_t ulSize) {
+   ulMallocs++;
+   return __real_calloc(ulCount, ulSize);
+}
+
+void *__wrap_realloc(void *pv, size_t ulSize) {
+   ulMallocs++;
+   return __real_realloc(pv, ulSize);
+}
+
+void __wrap_free(void *pv) {
+   if(pv != NULL)
+      ulFrees++;
+   __real_free(pv);
+}
+
+/* The measurements of one workload run */
+struct Bench_Run {
+   /* the tree under test */
+   const struct Bench_Ops *psOps;
+   /* the number of operations the workload is scaled to */
+   size_t ulScale;
+   /* the latency of each timed operation, in nanoseconds */
+   uint64_t *puiSamples;
+   size_t ulSamples;
+   size_t ulSampleSlots;
+   /* when the operation being timed started */
+   struct timespec sStart;
+   /* allocator calls made by timed operations */
+   size_t ulMallocs;
+   size_t ulFrees;
+   /* allocator counts when the operation being timed started */
+   size_t ulMallocsAtStart;
+   size_t ulFreesAtStart;
+   /* the number of operations that did not do what was expected */
+   size_t ulFailures;
+   /* the state of the workload's random number generator */
+   uint64_t uiSeed;
+};
+
+/* One workload: a tree to build and the operations to time on it */
+struct Bench_Workload {
+   const char *pcName;
+   const char *pcDescription;
+   /* TRUE if it needs files, FALSE if it needs unlimited fanout */
+   boolean bFiles;
+   boolean bWide;
+   void (*pfRun)(struct Bench_Run *psRun);
+};
+
+/* Returns the next number from psRun's generator (xorshift64*). */
+static uint64_t Bench_random(struct Bench_Run *psRun) {
+   psRun->uiSeed ^= psRun->uiSeed >> 12;
+   psRun->uiSeed ^= psRun->uiSeed << 25;
+   psRun->uiSeed ^= psRun->uiSeed >> 27;
+   return psRun->uiSeed * 2685821657736338717ULL;
+}
+
+/* Starts timing one operation. */
+static void Bench_begin(struct Bench_Run *psRun) {
+   psRun->ulMallocsAtStart = ulMallocs;
+   psRun->ulFreesAtStart = ulFrees;
+   (void) clock_gettime(CLOCK_MONOTONIC, &psRun->sStart);
+}
+
+/*
+  Stops timing the operation that Bench_begin started, and counts it
+  as failed unless bOk.
+*/
+static void Bench_end(struct Bench_Run *psRun, boolean bOk) {
+   struct timespec sEnd;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &sEnd);
+   psRun->ulMallocs += ulMallocs - psRun->ulMallocsAtStart;
+   psRun->ulFrees += ulFrees - psRun->ulFreesAtStart;
+   if(!bOk)
+      psRun->ulFailures++;
+
+   if(psRun->ulSamples == psRun->ulSampleSlots) {
+      size_t ulNewSlots = psRun->ulSampleSlots == 0 ?
+         1024 : 2 * psRun->ulSampleSlots;
+      uint64_t *puiNew = realloc(psRun->puiSamples,
+                                 ulNewSlots * sizeof(uint64_t));
+      /* Keep going without the sample, which only thins the statistics */
+      if(puiNew == NULL)
+         return;
+      psRun->puiSamples = puiNew;
+      psRun->ulSampleSlots = ulNewSlots;
+   }
+   psRun->puiSamples[psRun->ulSamples++] =
+      (uint64_t) (sEnd.tv_sec - psRun->sStart.tv_sec) * 1000000000u +
+      (uint64_t) sEnd.tv_nsec - (uint64_t) psRun->sStart.tv_nsec;
+}
+
+/* qsort comparison of two latencies */
+static int Bench_compareSamples(const void *pv1, const void *pv2) {
+   uint64_t ui1 = *(const uint64_t *) pv1;
+   uint64_t ui2 = *(const uint64_t *) pv2;
+
+   return (ui1 > ui2) - (ui1 < ui2);
+}
+
+/*
+  Returns the number of levels that a tree of fanout ulFanout needs to
+  have at least ulLeaves leaves.
+*/
+static size_t Bench_levels(size_t ulLeaves, size_t ulFanout) {
+   size_t ulLevels = 1;
+   size_t ulCapacity = ulFanout;
+
+   assert(ulFanout >= 2);
+
+   while(ulCapacity < ulLeaves) {
+      ulCapacity *= ulFanout;
+      ulLevels++;
+   }
+   return ulLevels;
+}
+
+/*
+  Writes to pcBuf the path of leaf ulLeaf of a tree of fanout ulFanout
+  and ulLevels levels below the directory pcDir, naming each level by
+  its digit of ulLeaf in base ulFanout, most significant first, and
+  the leaf itself with pcLeafPrefix.
+*/
+static void Bench_leafPath(char *pcBuf, const char *pcDir, size_t ulLeaf,
+                           size_t ulFanout, size_t ulLevels,
+                           const char *pcLeafPrefix) {
+   size_t aulDigits[64];
+   size_t ulLevel;
+   char *pcEnd;
+
+   assert(ulLevels <= sizeof(aulDigits) / sizeof(aulDigits[0]));
+
+   for(ulLevel = ulLevels; ulLevel > 0; ulLevel--) {
+      aulDigits[ulLevel - 1] = ulLeaf % ulFanout;
+      ulLeaf /= ulFanout;
+   }
+
+   pcEnd = pcBuf + sprintf(pcBuf, "%s", pcDir);
+   for(ulLevel = 0; ulLevel + 1 < ulLevels; ulLevel++)
+      pcEnd += sprintf(pcEnd, "/d%lu", (unsigned long) aulDigits[ulLevel]);
+   (void) sprintf(pcEnd, "/%s%lu", pcLeafPrefix,
+                  (unsigned long) aulDigits[ulLevels - 1]);
+}
+
+/* Returns the fanout that psRun's tree allows in generated trees. */
+static size_t Bench_fanout(const struct Bench_Run *psRun) {
+   return psRun->psOps->ulMaxChildren != 0 &&
+      psRun->psOps->ulMaxChildren < BENCH_FANOUT ?
+      psRun->psOps->ulMaxChildren : BENCH_FANOUT;
+}
+
+/* wide: one directory with ulScale children, inserted in name order */
+static void Bench_runWide(struct Bench_Run *psRun) {
+   char acPath[BENCH_MAX_PATH];
+   size_t i;
+
+   (void) (*psRun->psOps->pfInsertDir)("w");
+   for(i = 0; i < psRun->ulScale; i++) {
+      sprintf(acPath, "w/c%07lu", (unsigned long) i);
+      Bench_begin(psRun);
+      Bench_end(psRun, (*psRun->psOps->pfInsertDir)(acPath) == SUCCESS);
+   }
+}
+
+/* deep: one chain of directories, each inserted below the last */
+static void Bench_runDeep(struct Bench_Run *psRun) {
+   char acPath[BENCH_MAX_PATH];
+   size_t ulLength;
+   size_t ulDepth = psRun->ulScale / 50;
+   size_t i;
+
+   /* Each insert walks the whole chain, so it stays shorter */
+   if(ulDepth > (BENCH_MAX_PATH - 1) / 3)
+      ulDepth = (BENCH_MAX_PATH - 1) / 3;
+   if(ulDepth < 2)
+      ulDepth = 2;
+
+   strcpy(acPath, "dd");
+   ulLength = 2;
+   for(i = 0; i < ulDepth; i++) {
+      Bench_begin(psRun);
+      Bench_end(psRun, (*psRun->psOps->pfInsertDir)(acPath) == SUCCESS);
+      strcpy(acPath + ulLength, "/dd");
+      ulLength += 3;
+   }
+}
+
+/*
+  Inserts ulScale leaf directories of a tree of the tree's fanout
+  below "r", in name order if !bShuffle and in random order otherwise,
+  timing each insert if bTime.
+*/
+static void Bench_buildTree(struct Bench_Run *psRun, const char *pcDir,
+                            boolean bShuffle, boolean bTime) {
+   char acPath[BENCH_MAX_PATH];
+   size_t ulFanout = Bench_fanout(psRun);
+   size_t ulLevels = Bench_levels(psRun->ulScale, ulFanout);
+   size_t *pulOrder = NULL;
+   size_t i;
+
+   if(bShuffle) {
+      pulOrder = malloc(psRun->ulScale * sizeof(size_t));
+      if(pulOrder == NULL) {
+         psRun->ulFailures++;
+         return;
+      }
+      for(i = 0; i < psRun->ulScale; i++)
+         pulOrder[i] = i;
+      for(i = psRun->ulScale; i > 1; i--) {
+         size_t ulSwap = (size_t) (Bench_random(psRun) % i);
+         size_t ulTemp = pulOrder[i - 1];
+         pulOrder[i - 1] = pulOrder[ulSwap];
+         pulOrder[ulSwap] = ulTemp;
+      }
+   }
+
+   for(i = 0; i < psRun->ulScale; i++) {
+      int iStatus;
+
+      Bench_leafPath(acPath, pcDir, pulOrder != NULL ? pulOrder[i] : i,
+                     ulFanout, ulLevels, "l");
+      if(bTime)
+         Bench_begin(psRun);
+      iStatus = (*psRun->psOps->pfInsertDir)(acPath);
+      if(bTime)
+         Bench_end(psRun, iStatus == SUCCESS);
+      else if(iStatus != SUCCESS)
+         psRun->ulFailures++;
+   }
+   free(pulOrder);
+}
+
+/* sorted: a bushy tree of directories, inserted in name order */
+static void Bench_runSorted(struct Bench_Run *psRun) {
+   Bench_buildTree(psRun, "r", FALSE, TRUE);
+}
+
+/* random: the same tree, inserted in random order */
+static void Bench_runRandom(struct Bench_Run *psRun) {
+   Bench_buildTree(psRun, "r", TRUE, TRUE);
+}
+
+/*
+  lookup: on the sorted workload's tree, 90% lookups (half of them
+  misses), 5% inserts and 5% removals of leaves
+*/
+static void Bench_runLookup(struct Bench_Run *psRun) {
+   char acPath[BENCH_MAX_PATH];
+   size_t ulFanout = Bench_fanout(psRun);
+   size_t ulLevels = Bench_levels(psRun->ulScale, ulFanout);
+   size_t i;
+
+   Bench_buildTree(psRun, "r", FALSE, FALSE);
+
+   for(i = 0; i < psRun->ulScale; i++) {
+      size_t ulLeaf = (size_t) (Bench_random(psRun) % psRun->ulScale);
+      unsigned uChoice = (unsigned) (Bench_random(psRun) % 100);
+
+      if(uChoice < 45) {
+         Bench_leafPath(acPath, "r", ulLeaf, ulFanout, ulLevels, "l");
+         Bench_begin(psRun);
+         Bench_end(psRun, (*psRun->psOps->pfContains)(acPath));
+      }
+      else if(uChoice < 90) {
+         Bench_leafPath(acPath, "r", ulLeaf, ulFanout, ulLevels, "m");
+         Bench_begin(psRun);
+         Bench_end(psRun, !(*psRun->psOps->pfContains)(acPath));
+      }
+      else {
+         /* Inserts and removals of the same names, which may be there */
+         int iStatus;
+
+         Bench_leafPath(acPath, "r", ulLeaf, ulFanout, ulLevels, "n");
+         Bench_begin(psRun);
+         if(uChoice < 95) {
+            iStatus = (*psRun->psOps->pfInsertDir)(acPath);
+            Bench_end(psRun, iStatus == SUCCESS || iStatus == ALREADY_IN_TREE);
+         }
+         else {
+            iStatus = (*psRun->psOps->pfRmDir)(acPath);
+            Bench_end(psRun, iStatus == SUCCESS || iStatus == NO_SUCH_PATH);
+         }
+      }
+   }
+}
+
+/* bigfile: files of BENCH_FILE_SIZE bytes each, one per directory */
+static void Bench_runBigFile(struct Bench_Run *psRun) {
+   char acPath[BENCH_MAX_PATH];
+   size_t ulFiles = psRun->ulScale / 2000;
+   char *pcContents;
+   size_t i;
+
+   if(ulFiles < 8)
+      ulFiles = 8;
+   if(ulFiles > 64)
+      ulFiles = 64;
+
+   pcContents = malloc(BENCH_FILE_SIZE);
+   if(pcContents == NULL) {
+      psRun->ulFailures++;
+      return;
+   }
+   for(i = 0; i < BENCH_FILE_SIZE; i++)
+      pcContents[i] = (char) ('a' + i % 26);
+
+   for(i = 0; i < ulFiles; i++) {
+      sprintf(acPath, "b/d%lu/file", (unsigned long) i);
+      Bench_begin(psRun);
+      Bench_end(psRun, (*psRun->psOps->pfInsertFile)(acPath, pcContents,
+                                                     BENCH_FILE_SIZE)
+                == SUCCESS);
+   }
+   free(pcContents);
+}
+
+/*
+  rmdir: a few rounds of building a subtree of ulScale leaves next to a
+  small sibling, then timing its removal
+*/
+static void Bench_runRmDir(struct Bench_Run *psRun) {
+   enum { ROUNDS = 5 };
+   int iRound;
+
+   (void) (*psRun->psOps->pfInsertDir)("x/keep");
+   for(iRound = 0; iRound < ROUNDS; iRound++) {
+      Bench_buildTree(psRun, "x/big", FALSE, FALSE);
+      Bench_begin(psRun);
+      Bench_end(psRun, (*psRun->psOps->pfRmDir)("x/big") == SUCCESS);
+   }
+}
+
+static const struct Bench_Workload asWorkloads[] = {
+   { "wide", "one directory with N children, in name order",
+     FALSE, TRUE, Bench_runWide },
+   { "deep", "a chain of N/50 directories, each below the last",
+     FALSE, FALSE, Bench_runDeep },
+   { "sorted", "N leaves of a bushy tree, in name order",
+     FALSE, FALSE, Bench_runSorted },
+   { "random", "the same N leaves, in random order",
+     FALSE, FALSE, Bench_runRandom },
+   { "lookup", "N operations: 90% lookups, 5% inserts, 5% removals",
+     FALSE, FALSE, Bench_runLookup },
+   { "bigfile", "up to 64 files of 1 MiB each",
+     TRUE, FALSE, Bench_runBigFile },
+   { "rmdir", "removals of a subtree of N leaves",
+     FALSE, FALSE, Bench_runRmDir }
+};
+
+enum { BENCH_NUM_WORKLOADS = sizeof(asWorkloads) / sizeof(asWorkloads[0]) };
+
+/*
+  Runs psWorkload against psOps's tree, scaled to ulScale operations,
+  and prints its report line. Returns TRUE if every operation did what
+  was expected.
+*/
+static boolean Bench_run(const struct Bench_Workload *psWorkload,
+                         const struct Bench_Ops *psOps, size_t ulScale) {
+   struct Bench_Run sRun;
+   struct rusage sUsage;
+   uint64_t uiTotal = 0;
+   size_t i;
+
+   memset(&sRun, 0, sizeof(sRun));
+   sRun.psOps = psOps;
+   sRun.ulScale = ulScale;
+   sRun.uiSeed = 0x9E3779B97F4A7C15ULL;
+
+   if((*psOps->pfInit)() != SUCCESS) {
+      printf("%-8s could not initialize the tree\n", psWorkload->pcName);
+      return FALSE;
+   }
+   (*psWorkload->pfRun)(&sRun);
+   (void) (*psOps->pfDestroy)();
+
+   (void) getrusage(RUSAGE_SELF, &sUsage);
+   for(i = 0; i < sRun.ulSamples; i++)
+      uiTotal += sRun.puiSamples[i];
+   qsort(sRun.puiSamples, sRun.ulSamples, sizeof(uint64_t),
+         Bench_compareSamples);
+
+   if(sRun.ulSamples == 0)
+      printf("%-8s no operations were timed\n", psWorkload->pcName);
+   else
+      printf("%-8s %9lu %12.0f %9lu %9lu %10ld %10lu %10lu %6lu\n",
+             psWorkload->pcName, (unsigned long) sRun.ulSamples,
+             uiTotal == 0 ? 0.0 : sRun.ulSamples * 1e9 / (double) uiTotal,
+             (unsigned long) sRun.puiSamples[sRun.ulSamples / 2],
+             (unsigned long) sRun.puiSamples[sRun.ulSamples * 99 / 100],
+             sUsage.ru_maxrss, (unsigned long) sRun.ulMallocs,
+             (unsigned long) sRun.ulFrees, (unsigned long) sRun.ulFailures);
+   free(sRun.puiSamples);
+   return (boolean) (sRun.ulFailures == 0 && sRun.ulSamples > 0);
+}
+
+/*
+  Runs psWorkload in a child process, so that the peak RSS it reports
+  is its own. Returns TRUE if the child reported success.
+*/
+static boolean Bench_fork(const struct Bench_Workload *psWorkload,
+                          const struct Bench_Ops *psOps, size_t ulScale) {
+   pid_t iPid;
+   int iWaitStatus;
+
+   (void) fflush(stdout);
+   iPid = fork();
+   if(iPid < 0)
+      return Bench_run(psWorkload, psOps, ulScale);
+   if(iPid == 0) {
+      boolean bOk = Bench_run(psWorkload, psOps, ulScale);
+      (void) fflush(stdout);
+      _exit(bOk ? EXIT_SUCCESS : EXIT_FAILURE);
+   }
+
+   if(waitpid(iPid, &iWaitStatus, 0) != iPid || !WIFEXITED(iWaitStatus)) {
+      printf("%-8s did not finish\n", psWorkload->pcName);
+      return FALSE;
+   }
+   return (boolean) (WEXITSTATUS(iWaitStatus) == EXIT_SUCCESS);
+}
+
+int Bench_main(int argc, char *argv[], const struct Bench_Ops *psOps) {
+   boolean abSelected[BENCH_NUM_WORKLOADS];
+   boolean bAny = FALSE;
+   boolean bOk = TRUE;
+   size_t ulScale = BENCH_DEFAULT_OPS;
+   size_t w;
+   int i;
+
+   assert(psOps != NULL);
+
+   memset(abSelected, 0, sizeof(abSelected));
+   for(i = 1; i < argc; i++) {
+      if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         char *pcEnd;
+         unsigned long ulValue = strtoul(argv[++i], &pcEnd, 10);
+         if(*pcEnd != '\0' || ulValue == 0) {
+            fprintf(stderr, "%s: bad count %s\n", argv[0], argv[i]);
+            return EXIT_FAILURE;
+         }
+         ulScale = (size_t) ulValue;
+      }
+      else if(strcmp(argv[i], "-l") == 0) {
+         for(w = 0; w < BENCH_NUM_WORKLOADS; w++)
+            printf("%-8s %s\n", asWorkloads[w].pcName,
+                   asWorkloads[w].pcDescription);
+         return EXIT_SUCCESS;
+      }
+      else {
+         for(w = 0; w < BENCH_NUM_WORKLOADS; w++)
+            if(strcmp(argv[i], asWorkloads[w].pcName) == 0)
+               break;
+         if(w == BENCH_NUM_WORKLOADS) {
+            fprintf(stderr, "usage: %s [-l] [-n N] [workload...]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+         }
+         abSelected[w] = TRUE;
+         bAny = TRUE;
+      }
+   }
+
+   printf("%s, N = %lu\n", psOps->pcName, (unsigned long) ulScale);
+   printf("%-8s %9s %12s %9s %9s %10s %10s %10s %6s\n", "workload",
+          "ops", "ops/sec", "p50 ns", "p99 ns", "maxRSS KB", "mallocs",
+          "frees", "failed");
+   for(w = 0; w < BENCH_NUM_WORKLOADS; w++) {
+      const struct Bench_Workload *psWorkload = &asWorkloads[w];
+
+      if(bAny && !abSelected[w])
+         continue;
+      if((psWorkload->bFiles && psOps->pfInsertFile == NULL) ||
+         (psWorkload->bWide && psOps->ulMaxChildren != 0)) {
+         printf("%-8s not supported by this tree\n", psWorkload->pcName);
+         continue;
+      }
+      if(!Bench_fork(psWorkload, psOps, ulScale))
+         bOk = FALSE;
+   }
+   return bOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,55 @@
+/*--------------------------------------------------------------------*/
+/* bench.h                                                            */
+/*--------------------------------------------------------------------*/
+
+#ifndef BENCH_INCLUDED
+#define BENCH_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A benchmark harness shared by the BDT, DT and FT: each part's driver
+  fills in a Bench_Ops with its tree's global API and hands it to
+  Bench_main, which runs a set of generated workloads against it and
+  prints, for each, its throughput, median and 99th percentile
+  latency, peak resident set size and the number of allocator calls
+  made while it ran. Each workload runs in a process of its own, so
+  that its peak RSS is its own.
+
+  Allocator calls are counted by wrapping malloc, calloc, realloc and
+  free at link time: a bench binary must be linked with
+  -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free.
+*/
+
+/* The operations of the tree under test. pfInsertFile may be NULL. */
+struct Bench_Ops {
+   /* the name that heads the report */
+   const char *pcName;
+   int (*pfInit)(void);
+   int (*pfDestroy)(void);
+   /* inserts a directory, or a node of a tree without files */
+   int (*pfInsertDir)(const char *pcPath);
+   /* inserts a file with the ulLength bytes at pvContents */
+   int (*pfInsertFile)(const char *pcPath, void *pvContents,
+                       size_t ulLength);
+   /* returns TRUE if a node (of any type) has path pcPath */
+   boolean (*pfContains)(const char *pcPath);
+   /* removes the directory at pcPath and its whole subtree */
+   int (*pfRmDir)(const char *pcPath);
+   /* the most children a directory may have, or 0 if unlimited;
+      generated trees are no bushier, and "wide" is skipped if not 0 */
+   size_t ulMaxChildren;
+};
+
+/*
+  Runs the workloads named by argv[1..argc-1], or all of them if none
+  are, against psOps's tree and prints their reports to stdout.
+  "-n N" scales every workload to about N operations (the default is
+  100000), and "-l" lists the workloads instead of running them.
+  Returns EXIT_SUCCESS, or EXIT_FAILURE if an argument was not
+  understood or a workload saw an operation fail.
+*/
+int Bench_main(int argc, char *argv[], const struct Bench_Ops *psOps);
+
+#endif
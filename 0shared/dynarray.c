@@ -4,8 +4,10 @@
 /*--------------------------------------------------------------------*/
 
 #include "dynarray.h"
+#include "stats.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*--------------------------------------------------------------------*/
 
@@ -15,6 +17,14 @@ static const size_t MIN_PHYS_LENGTH = 2;
 
 /*--------------------------------------------------------------------*/
 
+#ifdef STATS
+/* The counts reported by DynArray_getStats. */
+
+static struct DynArray_Stats sStats;
+#endif
+
+/*--------------------------------------------------------------------*/
+
 /* A DynArray consists of an array, along with its logical and
    physical lengths. */
 
@@ -30,6 +40,69 @@ struct DynArray
 
    /* The array that underlies the DynArray. */
    const void **ppvArray;
+
+   /* The source of the DynArray's memory, and the pool it is
+      passed. */
+   const struct DynArray_Allocator *psAllocator;
+   void *pvPool;
+
+   /* The number of elements that apvInline holds.  While they fit
+      there, ppvArray is apvInline and uPhysLength is uInline. */
+   size_t uInline;
+
+   /* Storage allocated along with the DynArray itself, so that a
+      small one needs no separate array. */
+   const void *apvInline[];
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 (TRUE) iff oDynArray's elements are in its inline
+   storage. */
+
+static int DynArray_isInline(DynArray_T oDynArray)
+{
+   return oDynArray->ppvArray == oDynArray->apvInline;
+}
+
+/* Return the size of the block that holds oDynArray itself. */
+
+static size_t DynArray_size(DynArray_T oDynArray)
+{
+   return sizeof(struct DynArray) + sizeof(void*) * oDynArray->uInline;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The default allocator's functions, which use the standard heap. */
+
+static void *DynArray_heapAlloc(void *pvPool, size_t uSize)
+{
+   (void)pvPool;
+   return malloc(uSize);
+}
+
+static void *DynArray_heapResize(void *pvPool, void *pvBlock,
+                                 size_t uOldSize, size_t uNewSize)
+{
+   (void)pvPool;
+   (void)uOldSize;
+   return realloc(pvBlock, uNewSize);
+}
+
+static void DynArray_heapFree(void *pvPool, void *pvBlock,
+                              size_t uSize)
+{
+   (void)pvPool;
+   (void)uSize;
+   free(pvBlock);
+}
+
+/* The allocator used by DynArray_new. */
+
+static const struct DynArray_Allocator DynArray_heap =
+{
+   DynArray_heapAlloc, DynArray_heapResize, DynArray_heapFree
 };
 
 /*--------------------------------------------------------------------*/
@@ -44,6 +117,9 @@ static int DynArray_isValid(DynArray_T oDynArray)
    if (oDynArray->uPhysLength < MIN_PHYS_LENGTH) return 0;
    if (oDynArray->uLength > oDynArray->uPhysLength) return 0;
    if (oDynArray->ppvArray == NULL) return 0;
+   if (oDynArray->psAllocator == NULL) return 0;
+   if (DynArray_isInline(oDynArray) &&
+       oDynArray->uPhysLength != oDynArray->uInline) return 0;
    return 1;
 }
 
@@ -51,22 +127,55 @@ static int DynArray_isValid(DynArray_T oDynArray)
 
 /*--------------------------------------------------------------------*/
 
-/* Increase the physical length of oDynArray.  Return 1 (TRUE) if
-   successful and 0 (FALSE) if insufficient memory is available. */
+/* Change the physical length of oDynArray to uNewLength, which is at
+   least its length and MIN_PHYS_LENGTH, moving its elements between
+   its inline storage and a separate array as needed.  Return 1 (TRUE)
+   if successful and 0 (FALSE), leaving oDynArray unchanged, if
+   insufficient memory is available. */
 
-static int DynArray_grow(DynArray_T oDynArray)
+static int DynArray_resize(DynArray_T oDynArray, size_t uNewLength)
 {
-   const size_t GROWTH_FACTOR = 2;
-
-   size_t uNewLength;
+   const struct DynArray_Allocator *psAllocator;
    const void **ppvNewArray;
 
    assert(oDynArray != NULL);
+   assert(uNewLength >= oDynArray->uLength);
+   assert(uNewLength >= MIN_PHYS_LENGTH);
 
-   uNewLength = GROWTH_FACTOR * oDynArray->uPhysLength;
+   psAllocator = oDynArray->psAllocator;
+
+   if (uNewLength <= oDynArray->uInline)
+   {
+      /* Back into the inline storage, if not already there */
+      if (! DynArray_isInline(oDynArray))
+      {
+         memcpy((void*)oDynArray->apvInline, (void*)oDynArray->ppvArray,
+                sizeof(void*) * oDynArray->uLength);
+         (*psAllocator->pfFree)(oDynArray->pvPool,
+                                (void*)oDynArray->ppvArray,
+                                sizeof(void*) * oDynArray->uPhysLength);
+         oDynArray->ppvArray = oDynArray->apvInline;
+         oDynArray->uPhysLength = oDynArray->uInline;
+      }
+      return 1;
+   }
 
-   ppvNewArray = (const void**)
-      realloc(oDynArray->ppvArray, sizeof(void*) * uNewLength);
+   if (DynArray_isInline(oDynArray))
+   {
+      /* Spill out of the inline storage */
+      ppvNewArray = (const void**)
+         (*psAllocator->pfAlloc)(oDynArray->pvPool,
+                                 sizeof(void*) * uNewLength);
+      if (ppvNewArray != NULL)
+         memcpy((void*)ppvNewArray, (void*)oDynArray->apvInline,
+                sizeof(void*) * oDynArray->uLength);
+   }
+   else
+      ppvNewArray = (const void**)
+         (*psAllocator->pfResize)(oDynArray->pvPool,
+                                  (void*)oDynArray->ppvArray,
+                                  sizeof(void*) * oDynArray->uPhysLength,
+                                  sizeof(void*) * uNewLength);
    if (ppvNewArray == NULL)
       return 0;
 
@@ -77,27 +186,95 @@ static int DynArray_grow(DynArray_T oDynArray)
 
 /*--------------------------------------------------------------------*/
 
+/* Increase the physical length of oDynArray.  Return 1 (TRUE) if
+   successful and 0 (FALSE) if insufficient memory is available. */
+
+static int DynArray_grow(DynArray_T oDynArray)
+{
+   const size_t GROWTH_FACTOR = 2;
+
+   assert(oDynArray != NULL);
+
+   if (! DynArray_resize(oDynArray,
+                         GROWTH_FACTOR * oDynArray->uPhysLength))
+      return 0;
+
+   STATS_ADD(sStats.uGrows, 1);
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
 DynArray_T DynArray_new(size_t uLength)
+{
+   return DynArray_newIn(uLength, &DynArray_heap, NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+DynArray_T DynArray_newIn(size_t uLength,
+                          const struct DynArray_Allocator *psAllocator,
+                          void *pvPool)
+{
+   return DynArray_newInlineIn(uLength, 0, psAllocator, pvPool);
+}
+
+/*--------------------------------------------------------------------*/
+
+DynArray_T DynArray_newInline(size_t uLength, size_t uInline)
+{
+   return DynArray_newInlineIn(uLength, uInline, &DynArray_heap, NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+DynArray_T DynArray_newInlineIn(size_t uLength, size_t uInline,
+                                const struct DynArray_Allocator *psAllocator,
+                                void *pvPool)
 {
    DynArray_T oDynArray;
 
-   oDynArray = (struct DynArray*)malloc(sizeof(struct DynArray));
+   assert(psAllocator != NULL);
+
+   /* Inline storage too small to hold an array is no use */
+   if (uInline != 0 && uInline < MIN_PHYS_LENGTH)
+      uInline = MIN_PHYS_LENGTH;
+
+   oDynArray = (struct DynArray*)
+      (*psAllocator->pfAlloc)(pvPool, sizeof(struct DynArray) +
+                                         sizeof(void*) * uInline);
    if (oDynArray == NULL)
       return NULL;
 
+   oDynArray->psAllocator = psAllocator;
+   oDynArray->pvPool = pvPool;
+   oDynArray->uInline = uInline;
+
    oDynArray->uLength = uLength;
-   if (uLength > MIN_PHYS_LENGTH)
-      oDynArray->uPhysLength = uLength;
+   if (uInline != 0 && uLength <= uInline)
+   {
+      oDynArray->uPhysLength = uInline;
+      oDynArray->ppvArray = oDynArray->apvInline;
+   }
    else
-      oDynArray->uPhysLength = MIN_PHYS_LENGTH;
-
-   oDynArray->ppvArray =
-      (const void**)calloc(oDynArray->uPhysLength, sizeof(void*));
-   if (oDynArray->ppvArray == NULL)
    {
-      free(oDynArray);
-      return NULL;
+      if (uLength > MIN_PHYS_LENGTH)
+         oDynArray->uPhysLength = uLength;
+      else
+         oDynArray->uPhysLength = MIN_PHYS_LENGTH;
+
+      oDynArray->ppvArray = (const void**)
+         (*psAllocator->pfAlloc)(pvPool,
+                                 sizeof(void*) * oDynArray->uPhysLength);
+      if (oDynArray->ppvArray == NULL)
+      {
+         (*psAllocator->pfFree)(pvPool, oDynArray,
+                                DynArray_size(oDynArray));
+         return NULL;
+      }
    }
+   memset((void*)oDynArray->ppvArray, 0,
+          sizeof(void*) * oDynArray->uPhysLength);
 
    return oDynArray;
 }
@@ -109,8 +286,45 @@ void DynArray_free(DynArray_T oDynArray)
    assert(oDynArray != NULL);
    assert(DynArray_isValid(oDynArray));
 
-   free(oDynArray->ppvArray);
-   free(oDynArray);
+   if (! DynArray_isInline(oDynArray))
+      (*oDynArray->psAllocator->pfFree)(oDynArray->pvPool,
+                                        (void*)oDynArray->ppvArray,
+                                        sizeof(void*) *
+                                           oDynArray->uPhysLength);
+   (*oDynArray->psAllocator->pfFree)(oDynArray->pvPool, oDynArray,
+                                     DynArray_size(oDynArray));
+}
+
+/*--------------------------------------------------------------------*/
+
+int DynArray_reserve(DynArray_T oDynArray, size_t uPhysLength)
+{
+   assert(oDynArray != NULL);
+   assert(DynArray_isValid(oDynArray));
+
+   if (uPhysLength <= oDynArray->uPhysLength)
+      return 1;
+   return DynArray_resize(oDynArray, uPhysLength);
+}
+
+/*--------------------------------------------------------------------*/
+
+void DynArray_shrinkToFit(DynArray_T oDynArray)
+{
+   size_t uNewLength;
+
+   assert(oDynArray != NULL);
+   assert(DynArray_isValid(oDynArray));
+
+   uNewLength = oDynArray->uLength;
+   if (uNewLength < MIN_PHYS_LENGTH)
+      uNewLength = MIN_PHYS_LENGTH;
+
+   /* If even shrinking fails, the array just stays as large */
+   if (uNewLength < oDynArray->uPhysLength)
+      (void) DynArray_resize(oDynArray, uNewLength);
+
+   assert(DynArray_isValid(oDynArray));
 }
 
 /*--------------------------------------------------------------------*/
@@ -187,6 +401,8 @@ int DynArray_addAt(DynArray_T oDynArray, size_t uIndex,
       if (! DynArray_grow(oDynArray))
          return 0;
 
+   STATS_ADD(sStats.uBytesMoved,
+             sizeof(void*) * (oDynArray->uLength - uIndex));
    for (u = oDynArray->uLength; u > uIndex; u--)
       oDynArray->ppvArray[u] = oDynArray->ppvArray[u-1];
 
@@ -213,6 +429,8 @@ void *DynArray_removeAt(DynArray_T oDynArray, size_t uIndex)
 
    oDynArray->uLength--;
 
+   STATS_ADD(sStats.uBytesMoved,
+             sizeof(void*) * (oDynArray->uLength - uIndex));
    for (u = uIndex; u < oDynArray->uLength; u++)
       oDynArray->ppvArray[u] = oDynArray->ppvArray[u+1];
 
@@ -435,3 +653,13 @@ int DynArray_bsearch(DynArray_T oDynArray,
    *puIndex = (size_t)(ppvElement - &oDynArray->ppvArray[0]);
    return 1;
 }
+
+/*--------------------------------------------------------------------*/
+
+void DynArray_getStats(struct DynArray_Stats *psStats)
+{
+   assert(psStats != NULL);
+
+   psStats->uGrows = STATS_READ(sStats.uGrows);
+   psStats->uBytesMoved = STATS_READ(sStats.uBytesMoved);
+}
@@ -13,6 +13,34 @@
 
 typedef struct DynArray *DynArray_T;
 
+/* A DynArray_Allocator supplies the memory for a DynArray object and
+   its underlying array.  Each function receives the pvPool given to
+   DynArray_newIn.  pfAlloc and pfResize return NULL if insufficient
+   memory is available; pfResize then leaves the block unchanged.
+   pfResize and pfFree are given the size the block was allocated
+   with. */
+
+struct DynArray_Allocator
+{
+   void *(*pfAlloc)(void *pvPool, size_t uSize);
+   void *(*pfResize)(void *pvPool, void *pvBlock, size_t uOldSize,
+                     size_t uNewSize);
+   void (*pfFree)(void *pvPool, void *pvBlock, size_t uSize);
+};
+
+/* Counts of the work done by every DynArray object of the process. */
+
+struct DynArray_Stats
+{
+   /* The number of times an underlying array was reallocated to
+      grow. */
+   size_t uGrows;
+
+   /* The number of bytes of elements shifted by DynArray_addAt and
+      DynArray_removeAt. */
+   size_t uBytesMoved;
+};
+
 /*--------------------------------------------------------------------*/
 
 /* Return a new DynArray_T object whose length is uLength, or
@@ -22,6 +50,35 @@ DynArray_T DynArray_new(size_t uLength);
 
 /*--------------------------------------------------------------------*/
 
+/* Return a new DynArray_T object whose length is uLength, or
+   NULL if insufficient memory is available.  All memory for the
+   object is obtained from *psAllocator, passing pvPool along. */
+
+DynArray_T DynArray_newIn(size_t uLength,
+                          const struct DynArray_Allocator *psAllocator,
+                          void *pvPool);
+
+/*--------------------------------------------------------------------*/
+
+/* Return a new DynArray_T object whose length is uLength, or
+   NULL if insufficient memory is available.  Room for uInline
+   elements is allocated along with the object itself, so that while
+   the object fits there it needs no separate array; only when it
+   outgrows them does it move its elements to one. */
+
+DynArray_T DynArray_newInline(size_t uLength, size_t uInline);
+
+/*--------------------------------------------------------------------*/
+
+/* Like DynArray_newInline, but obtain all memory for the object from
+   *psAllocator, passing pvPool along. */
+
+DynArray_T DynArray_newInlineIn(size_t uLength, size_t uInline,
+                                const struct DynArray_Allocator *psAllocator,
+                                void *pvPool);
+
+/*--------------------------------------------------------------------*/
+
 /* Free oDynArray. */
 
 void DynArray_free(DynArray_T oDynArray);
@@ -65,6 +122,23 @@ int DynArray_addAt(DynArray_T oDynArray, size_t uIndex,
 
 /*--------------------------------------------------------------------*/
 
+/* Make room in oDynArray for at least uPhysLength elements, so that
+   adding up to that many causes no further allocation.  Return 1
+   (TRUE) if successful, or 0 (FALSE), leaving oDynArray unchanged, if
+   insufficient memory is available. */
+
+int DynArray_reserve(DynArray_T oDynArray, size_t uPhysLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Give back the room in oDynArray beyond what its elements need,
+   moving them back to its inline storage if they now fit there.  If
+   insufficient memory is available, oDynArray keeps the room. */
+
+void DynArray_shrinkToFit(DynArray_T oDynArray);
+
+/*--------------------------------------------------------------------*/
+
 /* Remove and return the uIndex'th element of oDynArray. */
 
 void *DynArray_removeAt(DynArray_T oDynArray, size_t uIndex);
@@ -129,4 +203,11 @@ int DynArray_bsearch(DynArray_T oDynArray,
                      int (*pfCompare)(const void *pvElement1,
                                       const void *pvElement2));
 
+/*--------------------------------------------------------------------*/
+
+/* Fill *psStats with the counts so far.  They are kept only in a
+   build with -DSTATS (see stats.h), and are all 0 in any other. */
+
+void DynArray_getStats(struct DynArray_Stats *psStats);
+
 #endif
@@ -0,0 +1,269 @@
+/*--------------------------------------------------------------------*/
+/* epoch.c                                                            */
+/*--------------------------------------------------------------------*/
+
+#ifdef RCU
+/* pthreads and sched_yield are POSIX, not C99 */
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#ifdef RCU
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "epoch.h"
+
+#ifdef RCU
+
+enum {
+   /* the number of retired callbacks that makes Epoch_poll reclaim */
+   EPOCH_BATCH = 256,
+   /* the size of a cache line, so that no two records share one */
+   EPOCH_LINE = 64
+};
+
+/* A thread's record of the walk it is in, if any */
+struct thread {
+   /* the epoch in which the thread's walk began, or 0 outside one */
+   unsigned long ulActive;
+   /* whether a live thread owns the record */
+   boolean bInUse;
+   /* the next record */
+   struct thread *psNext;
+   /* keeps every other record's ulActive off this one's cache line */
+   char acPad[EPOCH_LINE];
+};
+
+/* A callback waiting for a grace period */
+struct retired {
+   void (*pfFree)(void *pv);
+   void *pv;
+   /* the callback retired after this one */
+   struct retired *psNext;
+};
+
+/* The current epoch; only a reclaiming thread advances it */
+static unsigned long ulEpoch = 1;
+
+/* Every thread record; guarded by sRecordMutex */
+static struct thread *psThreads = NULL;
+/* Threads inside a walk without a record of their own */
+static unsigned long ulUnrecorded = 0;
+/* Guards psThreads, and makes reclaiming threads take turns */
+static pthread_mutex_t sRecordMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The retired callbacks, oldest first; guarded by sRetiredMutex */
+static struct retired *psOldest = NULL;
+static struct retired *psNewest = NULL;
+static size_t ulNumRetired = 0;
+static pthread_mutex_t sRetiredMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Frees a thread's record for reuse when the thread exits */
+static pthread_key_t sRecordKey;
+static pthread_once_t sRecordOnce = PTHREAD_ONCE_INIT;
+
+/* The calling thread's record, and how deeply its walks are nested */
+static __thread struct thread *psSelf = NULL;
+static __thread size_t ulNesting = 0;
+/* Whether the calling thread's current walk is counted in ulUnrecorded */
+static __thread boolean bUnrecorded = FALSE;
+
+/* Hands an exiting thread's record back for reuse. */
+static void Epoch_releaseRecord(void *pvRecord) {
+   struct thread *psRecord = pvRecord;
+
+   (void) pthread_mutex_lock(&sRecordMutex);
+   __atomic_store_n(&psRecord->ulActive, 0, __ATOMIC_RELAXED);
+   psRecord->bInUse = FALSE;
+   (void) pthread_mutex_unlock(&sRecordMutex);
+}
+
+static void Epoch_makeKey(void) {
+   (void) pthread_key_create(&sRecordKey, Epoch_releaseRecord);
+}
+
+/*
+  Gives the calling thread a record, reusing one whose thread has
+  exited if possible. Leaves psSelf NULL if memory ran out.
+*/
+static void Epoch_record(void) {
+   struct thread *psRecord;
+
+   (void) pthread_once(&sRecordOnce, Epoch_makeKey);
+
+   (void) pthread_mutex_lock(&sRecordMutex);
+   for(psRecord = psThreads; psRecord != NULL; psRecord = psRecord->psNext)
+      if(!psRecord->bInUse)
+         break;
+   if(psRecord == NULL) {
+      psRecord = calloc(1, sizeof(struct thread));
+      if(psRecord != NULL) {
+         psRecord->psNext = psThreads;
+         psThreads = psRecord;
+      }
+   }
+   if(psRecord != NULL)
+      psRecord->bInUse = TRUE;
+   (void) pthread_mutex_unlock(&sRecordMutex);
+
+   if(psRecord != NULL &&
+      pthread_setspecific(sRecordKey, psRecord) != 0) {
+      Epoch_releaseRecord(psRecord);
+      psRecord = NULL;
+   }
+   psSelf = psRecord;
+}
+
+void Epoch_enter(void) {
+   if(ulNesting++ > 0)
+      return;
+
+   if(psSelf == NULL)
+      Epoch_record();
+
+   if(psSelf != NULL)
+      __atomic_store_n(&psSelf->ulActive,
+                       __atomic_load_n(&ulEpoch, __ATOMIC_RELAXED),
+                       __ATOMIC_RELAXED);
+   else {
+      /* without a record of its own, the thread is counted instead */
+      (void) __atomic_add_fetch(&ulUnrecorded, 1, __ATOMIC_RELAXED);
+      bUnrecorded = TRUE;
+   }
+
+   /* the announcement must be visible before anything is read */
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void Epoch_leave(void) {
+   assert(ulNesting > 0);
+
+   if(--ulNesting > 0)
+      return;
+
+   if(bUnrecorded) {
+      (void) __atomic_sub_fetch(&ulUnrecorded, 1, __ATOMIC_RELEASE);
+      bUnrecorded = FALSE;
+   }
+   else
+      __atomic_store_n(&psSelf->ulActive, 0, __ATOMIC_RELEASE);
+}
+
+/*
+  Waits until every walk that began before the call has ended. The
+  caller holds sRecordMutex.
+*/
+static void Epoch_synchronize(void) {
+   struct thread *psRecord;
+   unsigned long ulTarget;
+
+   /* everything unlinked so far must be visible before the new epoch */
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   ulTarget = __atomic_add_fetch(&ulEpoch, 1, __ATOMIC_SEQ_CST);
+
+   for(psRecord = psThreads; psRecord != NULL; psRecord = psRecord->psNext) {
+      for(;;) {
+         unsigned long ulActive =
+            __atomic_load_n(&psRecord->ulActive, __ATOMIC_ACQUIRE);
+         if(ulActive == 0 || ulActive >= ulTarget)
+            break;
+         (void) sched_yield();
+      }
+   }
+
+   /* unrecorded walks cannot be told apart, so wait for all of them */
+   while(__atomic_load_n(&ulUnrecorded, __ATOMIC_ACQUIRE) != 0)
+      (void) sched_yield();
+}
+
+/*
+  Runs the retired callbacks, oldest first, after a grace period.
+  Reclaiming threads take turns, so that callbacks retired later never
+  run before those retired earlier.
+*/
+static void Epoch_reclaim(void) {
+   struct retired *psRetired;
+
+   (void) pthread_mutex_lock(&sRecordMutex);
+
+   (void) pthread_mutex_lock(&sRetiredMutex);
+   psRetired = psOldest;
+   psOldest = psNewest = NULL;
+   __atomic_store_n(&ulNumRetired, 0, __ATOMIC_RELAXED);
+   (void) pthread_mutex_unlock(&sRetiredMutex);
+
+   if(psRetired != NULL)
+      Epoch_synchronize();
+
+   while(psRetired != NULL) {
+      struct retired *psNext = psRetired->psNext;
+      (*psRetired->pfFree)(psRetired->pv);
+      free(psRetired);
+      psRetired = psNext;
+   }
+
+   (void) pthread_mutex_unlock(&sRecordMutex);
+}
+
+boolean Epoch_retire(void (*pfFree)(void *pv), void *pv) {
+   struct retired *psRetired;
+
+   assert(pfFree != NULL);
+
+   psRetired = malloc(sizeof(struct retired));
+   if(psRetired == NULL)
+      return FALSE;
+   psRetired->pfFree = pfFree;
+   psRetired->pv = pv;
+   psRetired->psNext = NULL;
+
+   (void) pthread_mutex_lock(&sRetiredMutex);
+   if(psNewest != NULL)
+      psNewest->psNext = psRetired;
+   else
+      psOldest = psRetired;
+   psNewest = psRetired;
+   (void) __atomic_add_fetch(&ulNumRetired, 1, __ATOMIC_RELAXED);
+   (void) pthread_mutex_unlock(&sRetiredMutex);
+   return TRUE;
+}
+
+void Epoch_poll(void) {
+   assert(ulNesting == 0);
+
+   /* a stale count only delays reclamation until the next poll */
+   if(__atomic_load_n(&ulNumRetired, __ATOMIC_RELAXED) >= EPOCH_BATCH)
+      Epoch_reclaim();
+}
+
+void Epoch_barrier(void) {
+   assert(ulNesting == 0);
+
+   Epoch_reclaim();
+}
+
+#else
+
+void Epoch_enter(void) {
+}
+
+void Epoch_leave(void) {
+}
+
+boolean Epoch_retire(void (*pfFree)(void *pv), void *pv) {
+   assert(pfFree != NULL);
+
+   (*pfFree)(pv);
+   return TRUE;
+}
+
+void Epoch_poll(void) {
+}
+
+void Epoch_barrier(void) {
+}
+
+#endif
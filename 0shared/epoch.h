@@ -0,0 +1,67 @@
+/*--------------------------------------------------------------------*/
+/* epoch.h                                                            */
+/*--------------------------------------------------------------------*/
+
+#ifndef EPOCH_INCLUDED
+#define EPOCH_INCLUDED
+
+#include "a4def.h"
+
+/*
+  Epoch-based reclamation, for data that readers walk without taking
+  any lock. A reader brackets each walk with Epoch_enter and
+  Epoch_leave. A writer that unlinks something readers may still be
+  looking at hands it to Epoch_retire instead of freeing it, and it is
+  freed once every thread that was inside a walk at that moment has
+  left it. Entering and leaving write only to the calling thread's own
+  record, so readers never contend with each other for a cache line.
+
+  This is compiled in only with RCU. Otherwise no reader runs without
+  a lock, so Epoch_retire frees at once and the rest do nothing.
+*/
+
+/*
+  Pointers that lock-free readers follow are published with
+  EPOCH_PUBLISH, once what they point to is complete, and read with
+  EPOCH_READ, which then sees it complete. Without RCU they are plain
+  assignments and reads.
+*/
+#ifdef RCU
+#define EPOCH_PUBLISH(lvalue, value) \
+   __atomic_store_n(&(lvalue), (value), __ATOMIC_RELEASE)
+#define EPOCH_READ(lvalue) __atomic_load_n(&(lvalue), __ATOMIC_ACQUIRE)
+#else
+#define EPOCH_PUBLISH(lvalue, value) ((void) ((lvalue) = (value)))
+#define EPOCH_READ(lvalue) (lvalue)
+#endif
+
+/*
+  Marks the calling thread as inside a walk until the matching
+  Epoch_leave. Calls may nest; only the outermost pair counts.
+*/
+void Epoch_enter(void);
+
+/* Ends the walk that the matching Epoch_enter began. */
+void Epoch_leave(void);
+
+/*
+  Arranges for (*pfFree)(pv) to be called once no thread can still be
+  inside a walk that began before this call. Callbacks run in the
+  order in which they were retired. Returns TRUE, or FALSE if memory
+  could not be allocated, in which case pfFree is never called.
+*/
+boolean Epoch_retire(void (*pfFree)(void *pv), void *pv);
+
+/*
+  Runs the callbacks retired so far if enough of them have piled up.
+  Must not be called from inside a walk.
+*/
+void Epoch_poll(void);
+
+/*
+  Waits for every walk in progress to end and runs every callback
+  retired so far. Must not be called from inside a walk.
+*/
+void Epoch_barrier(void);
+
+#endif
@@ -0,0 +1,585 @@
+/*--------------------------------------------------------------------*/
+/* journal.c                                                          */
+/*--------------------------------------------------------------------*/
+
+/* fsync, mmap and friends are POSIX, not C99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+/*
+  A journal is a header followed by records, back to back and with no
+  padding. All numbers are 64-bit in the writer's byte order, which
+  Journal_readerNew checks through ulVersion.
+*/
+
+enum {
+   /* the version of the format */
+   JOURNAL_VERSION = 1,
+   /* the number of buffered bytes that is written out without waiting
+      for the group to fill */
+   JOURNAL_MAX_BUFFER = 1 << 20,
+   /* the number of bytes of a base read at a time to checksum it */
+   JOURNAL_CHUNK = 4096
+};
+
+/* The first eight bytes of every journal */
+static const char acMagic[8] = "JOURNAL";
+
+/* The FNV-1a offset basis and prime, from which checksums start */
+static const uint64_t ulSumStart = UINT64_C(14695981039346656037);
+static const uint64_t ulSumPrime = UINT64_C(1099511628211);
+
+/* What a journal starts with */
+struct header {
+   /* acMagic */
+   char acMagic[8];
+   /* JOURNAL_VERSION */
+   uint64_t ulVersion;
+   /* the size and checksum of the base the journal follows */
+   uint64_t ulBaseSize;
+   uint64_t ulBaseSum;
+};
+
+/* What a record starts with; its two strings follow it */
+struct record {
+   uint64_t ulType;
+   /* the lengths of the first and second strings */
+   uint64_t ulFirst;
+   uint64_t ulSecond;
+   /* the checksum of the three fields above and the two strings */
+   uint64_t ulSum;
+};
+
+struct Journal {
+   /* the names of the base and of the journal */
+   char *pcBase;
+   char *pcFile;
+   /* the journal, open for writing at its end, or -1 */
+   int iFd;
+   /* the journal's size, counting what is still buffered */
+   size_t ulSize;
+   /* records not yet written: ulBuffered of ulBufferSlots bytes */
+   unsigned char *pucBuffer;
+   size_t ulBuffered;
+   size_t ulBufferSlots;
+   /* the number of records buffered, and the number in a group */
+   size_t ulPending;
+   size_t ulGroup;
+   /* the size at which the journal is compacted, how much it grows
+      between compactions, or 0 for both if it never is */
+   size_t ulCompactAt;
+   size_t ulCompactBytes;
+   /* writes a new base */
+   int (*pfWriteBase)(const char *pcTemp, void *pvExtra);
+   void *pvExtra;
+   /* SUCCESS, or what made the journal stop keeping records */
+   int iError;
+};
+
+struct Journal_Reader {
+   /* the journal, mapped privately, and its size */
+   unsigned char *pucMap;
+   size_t ulSize;
+   /* where the next record starts */
+   size_t ulNext;
+};
+
+/* Returns ulSum, a checksum, extended by the ulLength bytes at pv. */
+static uint64_t Journal_sum(uint64_t ulSum, const void *pv, size_t ulLength) {
+   const unsigned char *puc = pv;
+   size_t i;
+
+   for(i = 0; i < ulLength; i++) {
+      ulSum ^= puc[i];
+      ulSum *= ulSumPrime;
+   }
+   return ulSum;
+}
+
+/* Returns the checksum of *psRecord and the strings that follow it. */
+static uint64_t Journal_recordSum(const struct record *psRecord,
+                                  const void *pvFirst, const void *pvSecond) {
+   uint64_t ulSum = ulSumStart;
+
+   ulSum = Journal_sum(ulSum, &psRecord->ulType, sizeof(psRecord->ulType));
+   ulSum = Journal_sum(ulSum, &psRecord->ulFirst, sizeof(psRecord->ulFirst));
+   ulSum = Journal_sum(ulSum, &psRecord->ulSecond,
+                       sizeof(psRecord->ulSecond));
+   ulSum = Journal_sum(ulSum, pvFirst, (size_t) psRecord->ulFirst);
+   return Journal_sum(ulSum, pvSecond, (size_t) psRecord->ulSecond);
+}
+
+/* Returns a new string of pcFirst and pcSecond, or NULL if out of memory. */
+static char *Journal_concat(const char *pcFirst, const char *pcSecond) {
+   size_t ulFirst = strlen(pcFirst);
+   size_t ulSecond = strlen(pcSecond);
+   char *pcResult;
+
+   pcResult = malloc(ulFirst + ulSecond + 1);
+   if(pcResult == NULL)
+      return NULL;
+   memcpy(pcResult, pcFirst, ulFirst);
+   memcpy(pcResult + ulFirst, pcSecond, ulSecond + 1);
+   return pcResult;
+}
+
+/*
+  Writes the ulLength bytes at pv to iFd, however many calls that takes.
+  Returns SUCCESS or IO_ERROR.
+*/
+static int Journal_writeAll(int iFd, const void *pv, size_t ulLength) {
+   const unsigned char *puc = pv;
+
+   while(ulLength > 0) {
+      ssize_t lWritten = write(iFd, puc, ulLength);
+
+      if(lWritten < 0 && errno == EINTR)
+         continue;
+      if(lWritten <= 0)
+         return IO_ERROR;
+      puc += lWritten;
+      ulLength -= (size_t) lWritten;
+   }
+   return SUCCESS;
+}
+
+/*
+  Sets *pulSize and *pulSum to the size and checksum of the file named
+  pcFile. Returns SUCCESS or IO_ERROR.
+*/
+static int Journal_sumFile(const char *pcFile, uint64_t *pulSize,
+                           uint64_t *pulSum) {
+   unsigned char aucChunk[JOURNAL_CHUNK];
+   uint64_t ulSize = 0;
+   uint64_t ulSum = ulSumStart;
+   int iFd;
+
+   iFd = open(pcFile, O_RDONLY);
+   if(iFd < 0)
+      return IO_ERROR;
+   for(;;) {
+      ssize_t lRead = read(iFd, aucChunk, sizeof(aucChunk));
+
+      if(lRead < 0 && errno == EINTR)
+         continue;
+      if(lRead < 0) {
+         (void) close(iFd);
+         return IO_ERROR;
+      }
+      if(lRead == 0)
+         break;
+      ulSum = Journal_sum(ulSum, aucChunk, (size_t) lRead);
+      ulSize += (uint64_t) lRead;
+   }
+   (void) close(iFd);
+
+   *pulSize = ulSize;
+   *pulSum = ulSum;
+   return SUCCESS;
+}
+
+/*
+  Syncs the file named pcFile, or the directory that holds it if bDir
+  is TRUE, so that a rename into it survives a crash. Returns SUCCESS
+  or IO_ERROR.
+*/
+static int Journal_syncPath(const char *pcFile, boolean bDir) {
+   const char *pcSlash = strrchr(pcFile, '/');
+   char *pcDir = NULL;
+   int iFd;
+   int iStatus = SUCCESS;
+
+   if(bDir) {
+      size_t ulLength = pcSlash == NULL ? 0 :
+                        pcSlash == pcFile ? 1 : (size_t) (pcSlash - pcFile);
+
+      pcDir = malloc(ulLength + 2);
+      if(pcDir == NULL)
+         return MEMORY_ERROR;
+      if(ulLength == 0)
+         strcpy(pcDir, ".");
+      else {
+         memcpy(pcDir, pcFile, ulLength);
+         pcDir[ulLength] = '\0';
+      }
+      pcFile = pcDir;
+   }
+
+   iFd = open(pcFile, O_RDONLY);
+   if(iFd < 0 || fsync(iFd) != 0)
+      iStatus = IO_ERROR;
+   if(iFd >= 0)
+      (void) close(iFd);
+   free(pcDir);
+   return iStatus;
+}
+
+/*
+  Writes the records oJournal buffers and syncs them. Returns SUCCESS,
+  or sets oJournal's error and returns it.
+*/
+static int Journal_flush(Journal_T oJournal) {
+   if(oJournal->iError != SUCCESS || oJournal->ulBuffered == 0)
+      return oJournal->iError;
+
+   if(Journal_writeAll(oJournal->iFd, oJournal->pucBuffer,
+                       oJournal->ulBuffered) != SUCCESS ||
+      fsync(oJournal->iFd) != 0)
+      oJournal->iError = IO_ERROR;
+   oJournal->ulBuffered = 0;
+   oJournal->ulPending = 0;
+   return oJournal->iError;
+}
+
+/*
+  Writes a new base for oJournal and starts it again, empty. Returns
+  SUCCESS, or the statuses of Journal_open; on failure before the new
+  base is in place, the files are as they were.
+*/
+static int Journal_compact(Journal_T oJournal) {
+   struct header sHeader;
+   char *pcBaseTemp;
+   char *pcFileTemp;
+   int iFd = -1;
+   int iStatus;
+
+   assert(oJournal != NULL);
+
+   /* Should this fail, the old journal is still whole */
+   (void) Journal_flush(oJournal);
+
+   pcBaseTemp = Journal_concat(oJournal->pcBase, ".tmp");
+   pcFileTemp = Journal_concat(oJournal->pcFile, ".tmp");
+   if(pcBaseTemp == NULL || pcFileTemp == NULL) {
+      free(pcBaseTemp);
+      free(pcFileTemp);
+      return MEMORY_ERROR;
+   }
+
+   iStatus = (*oJournal->pfWriteBase)(pcBaseTemp, oJournal->pvExtra);
+   if(iStatus == SUCCESS)
+      iStatus = Journal_syncPath(pcBaseTemp, FALSE);
+   if(iStatus == SUCCESS)
+      iStatus = Journal_sumFile(pcBaseTemp, &sHeader.ulBaseSize,
+                                &sHeader.ulBaseSum);
+
+   if(iStatus == SUCCESS) {
+      memcpy(sHeader.acMagic, acMagic, sizeof(acMagic));
+      sHeader.ulVersion = JOURNAL_VERSION;
+      iFd = open(pcFileTemp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if(iFd < 0 ||
+         Journal_writeAll(iFd, &sHeader, sizeof(sHeader)) != SUCCESS ||
+         fsync(iFd) != 0)
+         iStatus = IO_ERROR;
+   }
+
+   /* Until the base is renamed, the old base and journal still hold */
+   if(iStatus == SUCCESS && rename(pcBaseTemp, oJournal->pcBase) != 0)
+      iStatus = IO_ERROR;
+   if(iStatus != SUCCESS) {
+      if(iFd >= 0)
+         (void) close(iFd);
+      (void) remove(pcFileTemp);
+      (void) remove(pcBaseTemp);
+      free(pcBaseTemp);
+      free(pcFileTemp);
+      return iStatus;
+   }
+
+   /* From here on, the old journal follows the old base, so it is
+      never replayed; the new base holds everything */
+   if(rename(pcFileTemp, oJournal->pcFile) != 0) {
+      (void) close(iFd);
+      (void) remove(pcFileTemp);
+      iFd = -1;
+      iStatus = IO_ERROR;
+   }
+   free(pcBaseTemp);
+   free(pcFileTemp);
+
+   if(oJournal->iFd >= 0)
+      (void) close(oJournal->iFd);
+   oJournal->iFd = iFd;
+   oJournal->ulSize = sizeof(sHeader);
+   oJournal->ulBuffered = 0;
+   oJournal->ulPending = 0;
+   oJournal->ulCompactAt = oJournal->ulCompactBytes;
+   oJournal->iError = iStatus;
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   iStatus = Journal_syncPath(oJournal->pcBase, TRUE);
+   if(iStatus == SUCCESS)
+      iStatus = Journal_syncPath(oJournal->pcFile, TRUE);
+   return iStatus;
+}
+
+int Journal_checkpoint(Journal_T oJournal) {
+   int iStatus;
+
+   assert(oJournal != NULL);
+
+   iStatus = Journal_compact(oJournal);
+   if(iStatus != SUCCESS && oJournal->iError == SUCCESS)
+      oJournal->iError = iStatus;
+   return iStatus;
+}
+
+int Journal_open(const char *pcBase, const char *pcFile, size_t ulGroup,
+                 size_t ulCompactBytes,
+                 int (*pfWriteBase)(const char *pcTemp, void *pvExtra),
+                 void *pvExtra, Journal_T *poJournal) {
+   Journal_T oJournal;
+   int iStatus;
+
+   assert(pcBase != NULL);
+   assert(pcFile != NULL);
+   assert(pfWriteBase != NULL);
+   assert(poJournal != NULL);
+
+   oJournal = calloc(1, sizeof(struct Journal));
+   if(oJournal == NULL)
+      return MEMORY_ERROR;
+   oJournal->pcBase = Journal_concat(pcBase, "");
+   oJournal->pcFile = Journal_concat(pcFile, "");
+   if(oJournal->pcBase == NULL || oJournal->pcFile == NULL) {
+      free(oJournal->pcBase);
+      free(oJournal->pcFile);
+      free(oJournal);
+      return MEMORY_ERROR;
+   }
+   oJournal->iFd = -1;
+   oJournal->ulGroup = ulGroup > 0 ? ulGroup : 1;
+   oJournal->ulCompactBytes = ulCompactBytes;
+   oJournal->pfWriteBase = pfWriteBase;
+   oJournal->pvExtra = pvExtra;
+   oJournal->iError = SUCCESS;
+
+   /* The journal starts out empty, after a base of its own */
+   iStatus = Journal_compact(oJournal);
+   if(iStatus != SUCCESS) {
+      if(oJournal->iFd >= 0)
+         (void) close(oJournal->iFd);
+      free(oJournal->pcBase);
+      free(oJournal->pcFile);
+      free(oJournal);
+      return iStatus;
+   }
+
+   *poJournal = oJournal;
+   return SUCCESS;
+}
+
+int Journal_append(Journal_T oJournal, unsigned int uType,
+                   const void *pvFirst, size_t ulFirst,
+                   const void *pvSecond, size_t ulSecond) {
+   struct record sRecord;
+   size_t ulLength;
+
+   assert(oJournal != NULL);
+   assert(pvFirst != NULL || ulFirst == 0);
+   assert(pvSecond != NULL || ulSecond == 0);
+
+   if(oJournal->iError != SUCCESS)
+      return oJournal->iError;
+
+   /* Make room for the record, doubling the buffer as needed */
+   if(ulFirst > (size_t) -1 - sizeof(sRecord) ||
+      ulSecond > (size_t) -1 - sizeof(sRecord) - ulFirst) {
+      oJournal->iError = MEMORY_ERROR;
+      return MEMORY_ERROR;
+   }
+   ulLength = sizeof(sRecord) + ulFirst + ulSecond;
+   if(oJournal->ulBufferSlots - oJournal->ulBuffered < ulLength) {
+      size_t ulSlots = oJournal->ulBufferSlots > 0 ?
+                       oJournal->ulBufferSlots : 256;
+      unsigned char *pucNew;
+
+      while(ulSlots - oJournal->ulBuffered < ulLength) {
+         if(ulSlots > (size_t) -1 / 2) {
+            ulSlots = oJournal->ulBuffered + ulLength;
+            break;
+         }
+         ulSlots *= 2;
+      }
+      pucNew = realloc(oJournal->pucBuffer, ulSlots);
+      if(pucNew == NULL) {
+         oJournal->iError = MEMORY_ERROR;
+         return MEMORY_ERROR;
+      }
+      oJournal->pucBuffer = pucNew;
+      oJournal->ulBufferSlots = ulSlots;
+   }
+
+   sRecord.ulType = uType;
+   sRecord.ulFirst = ulFirst;
+   sRecord.ulSecond = ulSecond;
+   sRecord.ulSum = Journal_recordSum(&sRecord, pvFirst, pvSecond);
+   memcpy(oJournal->pucBuffer + oJournal->ulBuffered, &sRecord,
+          sizeof(sRecord));
+   if(ulFirst > 0)
+      memcpy(oJournal->pucBuffer + oJournal->ulBuffered + sizeof(sRecord),
+             pvFirst, ulFirst);
+   if(ulSecond > 0)
+      memcpy(oJournal->pucBuffer + oJournal->ulBuffered + sizeof(sRecord) +
+             ulFirst, pvSecond, ulSecond);
+   oJournal->ulBuffered += ulLength;
+   oJournal->ulSize += ulLength;
+   oJournal->ulPending++;
+
+   if((oJournal->ulPending >= oJournal->ulGroup ||
+       oJournal->ulBuffered >= JOURNAL_MAX_BUFFER) &&
+      Journal_flush(oJournal) != SUCCESS)
+      return oJournal->iError;
+
+   /* A failed compaction leaves the record in the old journal */
+   if(oJournal->ulCompactAt != 0 &&
+      oJournal->ulSize >= oJournal->ulCompactAt &&
+      Journal_compact(oJournal) != SUCCESS && oJournal->iError == SUCCESS)
+      oJournal->ulCompactAt = oJournal->ulSize + oJournal->ulCompactBytes;
+   return oJournal->iError;
+}
+
+int Journal_sync(Journal_T oJournal) {
+   assert(oJournal != NULL);
+
+   return Journal_flush(oJournal);
+}
+
+int Journal_close(Journal_T oJournal) {
+   int iStatus;
+
+   if(oJournal == NULL)
+      return SUCCESS;
+
+   iStatus = Journal_sync(oJournal);
+   if(oJournal->iFd >= 0 && close(oJournal->iFd) != 0 && iStatus == SUCCESS)
+      iStatus = IO_ERROR;
+   free(oJournal->pucBuffer);
+   free(oJournal->pcBase);
+   free(oJournal->pcFile);
+   free(oJournal);
+   return iStatus;
+}
+
+int Journal_readerNew(const char *pcBase, const char *pcFile,
+                      Journal_Reader_T *poReader) {
+   struct header sHeader;
+   struct stat sStat;
+   Journal_Reader_T oReader;
+   unsigned char *pucMap;
+   uint64_t ulBaseSize;
+   uint64_t ulBaseSum;
+   size_t ulSize;
+   int iFd;
+
+   assert(pcBase != NULL);
+   assert(pcFile != NULL);
+   assert(poReader != NULL);
+
+   *poReader = NULL;
+
+   iFd = open(pcFile, O_RDONLY);
+   if(iFd < 0)
+      return errno == ENOENT ? SUCCESS : IO_ERROR;
+   if(fstat(iFd, &sStat) != 0 ||
+      sStat.st_size < (off_t) sizeof(sHeader) ||
+      (uintmax_t) sStat.st_size > (size_t) -1) {
+      (void) close(iFd);
+      return IO_ERROR;
+   }
+   ulSize = (size_t) sStat.st_size;
+
+   /* A private writable mapping lets the client use the bytes in place */
+   pucMap = mmap(NULL, ulSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, iFd, 0);
+   (void) close(iFd);
+   if(pucMap == MAP_FAILED)
+      return IO_ERROR;
+
+   memcpy(&sHeader, pucMap, sizeof(sHeader));
+   if(memcmp(sHeader.acMagic, acMagic, sizeof(acMagic)) != 0 ||
+      sHeader.ulVersion != JOURNAL_VERSION ||
+      Journal_sumFile(pcBase, &ulBaseSize, &ulBaseSum) != SUCCESS) {
+      (void) munmap(pucMap, ulSize);
+      return IO_ERROR;
+   }
+   if(sHeader.ulBaseSize != ulBaseSize || sHeader.ulBaseSum != ulBaseSum) {
+      (void) munmap(pucMap, ulSize);
+      return SUCCESS;
+   }
+
+   oReader = malloc(sizeof(struct Journal_Reader));
+   if(oReader == NULL) {
+      (void) munmap(pucMap, ulSize);
+      return MEMORY_ERROR;
+   }
+   oReader->pucMap = pucMap;
+   oReader->ulSize = ulSize;
+   oReader->ulNext = sizeof(sHeader);
+   *poReader = oReader;
+   return SUCCESS;
+}
+
+boolean Journal_readerNext(Journal_Reader_T oReader, unsigned int *puType,
+                           void **ppvFirst, size_t *pulFirst,
+                           void **ppvSecond, size_t *pulSecond) {
+   struct record sRecord;
+   unsigned char *pucFirst;
+   unsigned char *pucSecond;
+   size_t ulRest;
+
+   assert(oReader != NULL);
+   assert(puType != NULL);
+   assert(ppvFirst != NULL);
+   assert(pulFirst != NULL);
+   assert(ppvSecond != NULL);
+   assert(pulSecond != NULL);
+
+   ulRest = oReader->ulSize - oReader->ulNext;
+   if(ulRest < sizeof(sRecord))
+      return FALSE;
+   memcpy(&sRecord, oReader->pucMap + oReader->ulNext, sizeof(sRecord));
+   ulRest -= sizeof(sRecord);
+
+   /* A record cut short, or garbled, ends the journal */
+   pucFirst = oReader->pucMap + oReader->ulNext + sizeof(sRecord);
+   if(sRecord.ulFirst > ulRest ||
+      sRecord.ulSecond > ulRest - sRecord.ulFirst ||
+      sRecord.ulType > UINT_MAX)
+      pucSecond = NULL;
+   else
+      pucSecond = pucFirst + sRecord.ulFirst;
+   if(pucSecond == NULL ||
+      Journal_recordSum(&sRecord, pucFirst, pucSecond) != sRecord.ulSum) {
+      oReader->ulNext = oReader->ulSize;
+      return FALSE;
+   }
+
+   *puType = (unsigned int) sRecord.ulType;
+   *pulFirst = (size_t) sRecord.ulFirst;
+   *ppvFirst = sRecord.ulFirst > 0 ? pucFirst : NULL;
+   *pulSecond = (size_t) sRecord.ulSecond;
+   *ppvSecond = sRecord.ulSecond > 0 ? pucSecond : NULL;
+   oReader->ulNext += sizeof(sRecord) + *pulFirst + *pulSecond;
+   return TRUE;
+}
+
+void Journal_readerFree(Journal_Reader_T oReader) {
+   if(oReader == NULL)
+      return;
+   (void) munmap(oReader->pucMap, oReader->ulSize);
+   free(oReader);
+}
@@ -0,0 +1,120 @@
+/*--------------------------------------------------------------------*/
+/* journal.h                                                          */
+/*--------------------------------------------------------------------*/
+
+#ifndef JOURNAL_INCLUDED
+#define JOURNAL_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A Journal_T object appends records to a write-ahead journal: a file
+  that says what has happened since its base, a file holding the whole
+  state as of some moment, was written. Each record is a type and two
+  byte strings, and carries a checksum, so that a record that a crash
+  cut short ends the journal instead of corrupting it. Records are
+  buffered and written in groups, with one write and one fsync per
+  group, so a crash loses at most the group still being collected.
+
+  When the journal grows past a given size, it is compacted: a new base
+  is written and the journal starts again, empty. The new base and the
+  new, empty journal are written under temporary names and renamed
+  into place, base first, and a journal records the checksum of the
+  base that it follows, so that it is never replayed on top of a newer
+  one.
+
+  Nothing here locks: a client that shares a Journal_T between threads
+  must keep them from using it at the same time.
+*/
+typedef struct Journal *Journal_T;
+
+/*
+  Starts a journal in the file named pcFile that follows a new base,
+  which (*pfWriteBase)(pcTemp, pvExtra) must write to the file named
+  pcTemp and return SUCCESS, or else return the status that is then
+  passed on. Replaces both files if they exist. Whenever the journal
+  reaches ulCompactBytes bytes (never, if ulCompactBytes is 0), it is
+  compacted by writing a new base with pfWriteBase. Records are written
+  and synced ulGroup at a time (each on its own, if ulGroup is 0 or 1).
+  Returns SUCCESS and sets *poJournal, or returns:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * IO_ERROR if either file could not be written
+*/
+int Journal_open(const char *pcBase, const char *pcFile, size_t ulGroup,
+                 size_t ulCompactBytes,
+                 int (*pfWriteBase)(const char *pcTemp, void *pvExtra),
+                 void *pvExtra, Journal_T *poJournal);
+
+/*
+  Appends to oJournal a record of type uType holding the ulFirst bytes
+  at pvFirst and the ulSecond bytes at pvSecond (either may be NULL if
+  its length is 0), writing and syncing the group it completes, and
+  compacting the journal if it has grown large enough.
+  Returns SUCCESS, or MEMORY_ERROR or IO_ERROR if the record could not
+  be kept. Once that has happened, every further call returns the same
+  status and drops its record, until Journal_checkpoint succeeds. A
+  compaction that fails is not such an error: the record is kept, and
+  compacting is tried again once another ulCompactBytes have been
+  appended.
+*/
+int Journal_append(Journal_T oJournal, unsigned int uType,
+                   const void *pvFirst, size_t ulFirst,
+                   const void *pvSecond, size_t ulSecond);
+
+/*
+  Writes and syncs whatever records oJournal still buffers. Returns
+  SUCCESS, or the status that Journal_append would return.
+*/
+int Journal_sync(Journal_T oJournal);
+
+/*
+  Compacts oJournal now: writes a new base and starts again, empty,
+  for a client whose state has changed in a way it has not logged.
+  Returns SUCCESS, or the statuses of Journal_open; on failure, the
+  files no longer say what the state is, so oJournal keeps no more
+  records, as if Journal_append had failed.
+*/
+int Journal_checkpoint(Journal_T oJournal);
+
+/*
+  Syncs oJournal as Journal_sync does, closes its file and frees it,
+  returning what Journal_sync returned. Does nothing and returns
+  SUCCESS if oJournal is NULL.
+*/
+int Journal_close(Journal_T oJournal);
+
+/*
+  A Journal_Reader_T object hands out, in order, the records of a
+  journal as it was left, up to the first one that was cut short.
+*/
+typedef struct Journal_Reader *Journal_Reader_T;
+
+/*
+  Opens the journal in the file named pcFile for replay on top of the
+  base in the file named pcBase. Returns SUCCESS and sets *poReader to
+  a new reader, or to NULL if there is nothing to replay: pcFile does
+  not exist, or it follows some other base, an older one that a crash
+  during compaction left it with. Otherwise, returns:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * IO_ERROR if either file could not be read, or pcFile is not a
+             journal
+*/
+int Journal_readerNew(const char *pcBase, const char *pcFile,
+                      Journal_Reader_T *poReader);
+
+/*
+  Sets *puType, *ppvFirst, *pulFirst, *ppvSecond and *pulSecond to
+  what the next record of oReader holds and returns TRUE, or returns
+  FALSE if there are no more records. A string of length 0 is given as
+  NULL. The bytes may be written to, and stay valid until
+  Journal_readerFree.
+*/
+boolean Journal_readerNext(Journal_Reader_T oReader, unsigned int *puType,
+                           void **ppvFirst, size_t *pulFirst,
+                           void **ppvSecond, size_t *pulSecond);
+
+/* Frees oReader. Does nothing if oReader is NULL. */
+void Journal_readerFree(Journal_Reader_T oReader);
+
+#endif
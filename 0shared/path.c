@@ -7,233 +7,220 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "dynarray.h"
+#include "atom.h"
 #include "path.h"
+#include "stats.h"
 
-/* An absolute path */
+/*
+  An absolute path. The structure, its component table and its string
+  representation are one block of memory, allocated at once.
+*/
 struct path {
    /* The string representation of the path,
       which uses '/' as the component delimiter */
    const char *pcPath;
    /* The string length of pcPath */
    size_t ulLength;
-   /* The ordered collection of component strings in the path */
-   DynArray_T oDComponents;
+   /* The number of components in the path */
+   size_t ulDepth;
+   /* TRUE if the block is a caller's Path_Buffer, not the heap's */
+   boolean bBuffered;
+   /* The components in order, each an atom shared with every other
+      path, which also knows its own length; pcPath follows */
+   const char *apcComponents[];
 };
 
-/*
-  Frees pcStr. This wrapper is used to match the requirements of the
-  callback function pointer passed to DynArray_map. pvExtra is unused.
-*/
-static void Path_freeString(char *pcStr, void *pvExtra) {
-   /* pcStr may be NULL, as this is a no-op to free.
-      pvExtra may be NULL, as it is unused. */
-   free(pcStr);
-}
+#ifdef STATS
+/* The counts reported by Path_getStats */
+static struct Path_Stats sStats;
+#endif
 
 /*
-  Sets *poDComponents to be an ordered collection of component strings
-  in pcPath, or NULL if an error occurs.
-  Returns one of the following statuses:
-  * SUCCESS if no error occurrs
+  Validates pcPath, and sets *pulDepth to its number of components and
+  *pulLength to its string length. Returns one of the following statuses:
+  * SUCCESS if pcPath is well-formatted
   * BAD_PATH if pcPath is the empty string,
              or begins or ends with a '/',
              or contains consecutive '/' delimiters
-  * MEMORY_ERROR if memory could not be allocated to complete request
 */
-static int Path_split(const char *pcPath, DynArray_T *poDComponents) {
-   const char *pcStart = pcPath;
-   const char *pcEnd = pcPath;
-   char *pcCopy;
-   DynArray_T oDSubstrings;
+static int Path_scan(const char *pcPath, size_t *pulDepth,
+                     size_t *pulLength) {
+   const char *pcStart;
+   const char *pcEnd;
+   size_t ulDepth = 1;
 
    assert(pcPath != NULL);
-   assert(poDComponents != NULL);
+   assert(pulDepth != NULL);
+   assert(pulLength != NULL);
 
-   /* path cannot be empty string */
-   if(*pcPath == '\0') {
-      *poDComponents = NULL;
+   /* path cannot be empty string, nor start with delimiter */
+   if(*pcPath == '\0' || *pcPath == '/')
       return BAD_PATH;
-   }
-
-   oDSubstrings = DynArray_new(0);
-   if(oDSubstrings == NULL) {
-      *poDComponents = NULL;
-      return MEMORY_ERROR;
-   }
 
-   /* validate and split pcPath */
-   while(*pcEnd != '\0') {
-      pcEnd = pcStart;
-      /* component can't start with delimiter */
-      if(*pcEnd == '/') {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
+   /* the library's scans jump from one delimiter to the next */
+   for(pcStart = pcPath; (pcEnd = strchr(pcStart, '/')) != NULL;
+       pcStart = pcEnd + 1) {
+      /* component can't start with delimiter, nor can the final
+         component end with one */
+      if(pcEnd[1] == '/' || pcEnd[1] == '\0')
          return BAD_PATH;
-      }
-
-      /* advance pcEnd to end of next token */
-      while(*pcEnd != '/' && *pcEnd != '\0')
-         pcEnd++;
-
-      /* final component can't end with slash */
-      if(*pcEnd == '\0' && *(pcEnd-1) == '/') {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
-         return BAD_PATH;
-      }
+      ulDepth++;
+   }
 
-      pcCopy = calloc((size_t)(pcEnd-pcStart+1), sizeof(char));
-      if(pcCopy == NULL) {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
-         return MEMORY_ERROR;
-      }
+   *pulDepth = ulDepth;
+   *pulLength = (size_t)(pcStart - pcPath) + strlen(pcStart);
+   return SUCCESS;
+}
 
-      if( DynArray_add(oDSubstrings, pcCopy) == 0) {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
-         return MEMORY_ERROR;
-      }
+/*
+  Returns a new path with room for ulDepth components and a string of
+  ulLength characters, put in *psBuffer if it fits there (and psBuffer
+  is not NULL) and allocated otherwise. Only its string and its
+  components are left to fill in. Returns NULL if memory could not be
+  allocated; *pbAllocated tells the caller whether it was.
+*/
+static struct path *Path_alloc(size_t ulDepth, size_t ulLength,
+                               struct Path_Buffer *psBuffer,
+                               boolean *pbAllocated) {
+   struct path *psNew;
+   size_t ulSize = sizeof(struct path) + ulDepth * sizeof(const char *) +
+      ulLength + 1;
 
-      while(pcStart != pcEnd) {
-         *pcCopy = *pcStart;
-         pcCopy++;
-         pcStart++;
-      }
+   assert(pbAllocated != NULL);
 
-      pcStart++;
+   *pbAllocated = (boolean) (psBuffer == NULL || ulSize > sizeof(*psBuffer));
+   if(*pbAllocated) {
+      psNew = malloc(ulSize);
+      if(psNew == NULL)
+         return NULL;
    }
+   else
+      psNew = (struct path *) psBuffer->u.acBytes;
 
-   *poDComponents = oDSubstrings;
-   return SUCCESS;
+   psNew->pcPath = (const char *) &psNew->apcComponents[ulDepth];
+   psNew->ulLength = ulLength;
+   psNew->ulDepth = ulDepth;
+   psNew->bBuffered = (boolean) !*pbAllocated;
+   return psNew;
 }
 
-
-int Path_new(const char *pcPath, Path_T *poPResult) {
+/*
+  Builds the path pcPath in *psBuffer or on the heap, as Path_newIn
+  does, taking a reference to the atom of each component: through
+  Atom_new if bCreate is TRUE, and otherwise through Atom_find, in
+  which case a component that is not yet an atom makes the path one
+  that nothing can hold, and NO_SUCH_PATH is returned.
+*/
+static int Path_build(const char *pcPath, struct Path_Buffer *psBuffer,
+                      boolean bCreate, Path_T *poPResult) {
    struct path *psNew;
-   int iSplitResult;
+   const char *pcStart;
+   const char *pcEnd;
+   size_t ulDepth, ulLength, ulLevel;
+   boolean bAllocated;
+   int iStatus;
 
    assert(pcPath != NULL);
    assert(poPResult != NULL);
 
-   psNew = calloc(1, sizeof(struct path));
-   if(psNew == NULL) {
-      *poPResult = NULL;
-      return MEMORY_ERROR;
-   }
+   *poPResult = NULL;
 
-   /* instantiate and fill list of components */
-   iSplitResult = Path_split(pcPath, &psNew->oDComponents);
-   if(iSplitResult != SUCCESS) {
-      Path_free(psNew);
-      *poPResult = NULL;
-      return iSplitResult;
-   }
+   /* one pass to validate and measure, so that one block holds it all */
+   iStatus = Path_scan(pcPath, &ulDepth, &ulLength);
+   if(iStatus != SUCCESS)
+      return iStatus;
 
-   psNew->ulLength = strlen(pcPath);
-   psNew->pcPath = malloc(psNew->ulLength+1);
-   if(psNew->pcPath == NULL) {
-      Path_free(psNew);
-      *poPResult = NULL;
+   psNew = Path_alloc(ulDepth, ulLength, psBuffer, &bAllocated);
+   if(bAllocated)
+      STATS_ADD(sStats.ulNews, 1);
+   if(psNew == NULL)
       return MEMORY_ERROR;
+   memcpy((char *) psNew->pcPath, pcPath, ulLength + 1);
+
+   /* and one to intern the components, which are known to be valid */
+   pcStart = pcPath;
+   for(ulLevel = 0; ulLevel < ulDepth; ulLevel++) {
+      pcEnd = pcStart + strcspn(pcStart, "/");
+      if(bCreate)
+         psNew->apcComponents[ulLevel] =
+            Atom_new(pcStart, (size_t)(pcEnd - pcStart));
+      else
+         psNew->apcComponents[ulLevel] =
+            Atom_find(pcStart, (size_t)(pcEnd - pcStart));
+      if(psNew->apcComponents[ulLevel] == NULL) {
+         /* let go of only the components taken so far */
+         psNew->ulDepth = ulLevel;
+         Path_free(psNew);
+         return bCreate ? MEMORY_ERROR : NO_SUCH_PATH;
+      }
+      pcStart = pcEnd + 1;
    }
-   strcpy((char *)psNew->pcPath, pcPath);
 
    *poPResult = psNew;
    return SUCCESS;
 }
 
-int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
+int Path_newIn(const char *pcPath, struct Path_Buffer *psBuffer,
+               Path_T *poPResult) {
+   return Path_build(pcPath, psBuffer, TRUE, poPResult);
+}
+
+int Path_findIn(const char *pcPath, struct Path_Buffer *psBuffer,
+                Path_T *poPResult) {
+   return Path_build(pcPath, psBuffer, FALSE, poPResult);
+}
+
+int Path_new(const char *pcPath, Path_T *poPResult) {
+   return Path_newIn(pcPath, NULL, poPResult);
+}
+
+int Path_prefixIn(Path_T oPPath, size_t ulDepth,
+                  struct Path_Buffer *psBuffer, Path_T *poPResult) {
    struct path *psNew;
-   size_t ulIndex, ulLength, ulSum;
-   const char *pcComponent;
-   char *pcCopy;
-   char *pcBuild;
-   char *pcInsert;
+   size_t ulLength = 0;
+   size_t ulIndex;
+   boolean bAllocated;
 
    assert(oPPath != NULL);
    assert(poPResult != NULL);
 
+   *poPResult = NULL;
+
    /* cannot build empty path */
-   if(ulDepth == 0) {
-      *poPResult = NULL;
+   if(ulDepth == 0)
       return NO_SUCH_PATH;
-   }
 
    /* cannot have a prefix longer than oPPath */
-   if(Path_getDepth(oPPath) < ulDepth) {
-      *poPResult = NULL;
+   if(Path_getDepth(oPPath) < ulDepth)
       return NO_SUCH_PATH;
-   }
 
-   psNew = calloc(1, sizeof(struct path));
-   if(psNew == NULL) {
-      *poPResult = NULL;
-      return MEMORY_ERROR;
-   }
+   /* the prefix's pathname is a prefix of oPPath's */
+   for(ulIndex = 0; ulIndex < ulDepth; ulIndex++)
+      ulLength += Atom_length(oPPath->apcComponents[ulIndex]) + 1;
+   ulLength--;
 
-   psNew->oDComponents = DynArray_new(ulDepth);
-   if(psNew->oDComponents == NULL) {
-      Path_free(psNew);
-      *poPResult = NULL;
+   psNew = Path_alloc(ulDepth, ulLength, psBuffer, &bAllocated);
+   if(bAllocated)
+      STATS_ADD(sStats.ulPrefixes, 1);
+   if(psNew == NULL)
       return MEMORY_ERROR;
-   }
 
-   pcBuild = calloc(Path_getStrLength(oPPath)+1, sizeof(char));
-   if(pcBuild == NULL) {
-      Path_free(psNew);
-      *poPResult = NULL;
-      return MEMORY_ERROR;
-   }
-
-   pcInsert = pcBuild;
-   ulSum = 0;
-
-   for(ulIndex = 0; ulIndex < ulDepth; ulIndex++) {
-      /* deep copy each component to new DynArray */
-      pcComponent = Path_getComponent(oPPath, ulIndex);
-      ulLength = strlen(pcComponent);
-      pcCopy = calloc(ulLength + 1, sizeof(char));
-      if(pcCopy == NULL) {
-         free(pcBuild);
-         Path_free(psNew);
-         *poPResult = NULL;
-         return MEMORY_ERROR;
-      }
-      strcpy(pcCopy, pcComponent);
-      (void) DynArray_set(psNew->oDComponents, ulIndex, pcCopy);
-      /* construct prefix's pathname string */
-      strcpy(pcInsert, pcComponent);
-      pcInsert[ulLength] = '/';
-      ulSum += ulLength + 1;
-      pcInsert += ulLength + 1;
-   }
-   pcBuild[ulSum-1] = '\0';
-
-   /* shrink allocation to fit prefix's pathname string if needed */
-   pcInsert = realloc(pcBuild, ulSum);
-   if(pcInsert == NULL) {
-      free(pcBuild);
-      Path_free(psNew);
-      *poPResult = NULL;
-      return MEMORY_ERROR;
-   }
-   psNew->ulLength = ulSum-1;
-   psNew->pcPath = pcInsert;
+   /* components are atoms, so the new path can share them */
+   memcpy(psNew->apcComponents, oPPath->apcComponents,
+          ulDepth * sizeof(const char *));
+   for(ulIndex = 0; ulIndex < ulDepth; ulIndex++)
+      Atom_retain(psNew->apcComponents[ulIndex]);
+   memcpy((char *) psNew->pcPath, oPPath->pcPath, ulLength);
+   ((char *) psNew->pcPath)[ulLength] = '\0';
 
    *poPResult = psNew;
    return SUCCESS;
 }
 
+int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
+   return Path_prefixIn(oPPath, ulDepth, NULL, poPResult);
+}
+
 int Path_dup(Path_T oPPath, Path_T *poPResult) {
    assert(oPPath != NULL);
    assert(poPResult != NULL);
@@ -242,16 +229,16 @@ int Path_dup(Path_T oPPath, Path_T *poPResult) {
 }
 
 void Path_free(Path_T oPPath) {
-   if(oPPath != NULL) {
-      free((char *)oPPath->pcPath);
+   size_t ulLevel;
 
-      if(oPPath->oDComponents != NULL) {
-         DynArray_map(oPPath->oDComponents,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oPPath->oDComponents);
-      }
-   }
-   free((struct path*) oPPath);
+   if(oPPath == NULL)
+      return;
+
+   /* each component is an atom that the path holds a reference to */
+   for(ulLevel = 0; ulLevel < oPPath->ulDepth; ulLevel++)
+      Atom_release(oPPath->apcComponents[ulLevel]);
+   if(!oPPath->bBuffered)
+      free((struct path *) oPPath);
 }
 
 const char *Path_getPathname(Path_T oPPath) {
@@ -283,7 +270,7 @@ int Path_compareString(Path_T oPPath, const char *pcStr) {
 size_t Path_getDepth(Path_T oPPath) {
    assert(oPPath != NULL);
 
-   return DynArray_getLength(oPPath->oDComponents);
+   return oPPath->ulDepth;
 }
 
 size_t Path_getSharedPrefixDepth(Path_T oPPath1, Path_T oPPath2) {
@@ -298,9 +285,9 @@ size_t Path_getSharedPrefixDepth(Path_T oPPath1, Path_T oPPath2) {
       ulMin = ulDepth1;
    else
       ulMin = ulDepth2;
+   /* equal components are the same atom */
    for(i = 0; i < ulMin; i++) {
-      if(strcmp(Path_getComponent(oPPath1, i),
-                Path_getComponent(oPPath2, i)))
+      if(Path_getComponent(oPPath1, i) != Path_getComponent(oPPath2, i))
          return i;
    }
    return ulMin;
@@ -312,5 +299,12 @@ const char *Path_getComponent(Path_T oPPath, size_t ulLevel) {
    if(ulLevel >= Path_getDepth(oPPath))
       return NULL;
 
-   return DynArray_get(oPPath->oDComponents, ulLevel);
+   return oPPath->apcComponents[ulLevel];
+}
+
+void Path_getStats(struct Path_Stats *psStats) {
+   assert(psStats != NULL);
+
+   psStats->ulNews = STATS_READ(sStats.ulNews);
+   psStats->ulPrefixes = STATS_READ(sStats.ulPrefixes);
 }
@@ -13,7 +13,9 @@
 typedef const struct path * Path_T;
 
 /*
-  Creates a new path object representing the absolute path in pcPath.
+  Creates a new path object representing the absolute path in pcPath,
+  in a single allocation that holds its string representation and a
+  table of its components.
   Returns an int SUCCESS status and sets *poPResult to be the new path
   if successful. Otherwise, sets *poPResult to NULL and returns status:
   * MEMORY_ERROR if memory could not be allocated to complete request
@@ -23,6 +25,41 @@ typedef const struct path * Path_T;
 */
 int Path_new(const char *pcPath, Path_T *poPResult);
 
+/*
+  Room for a path that is needed only briefly, such as one built for a
+  single lookup, so that it can live on the stack rather than the
+  heap (see Path_newIn). The fields are declared here only so that
+  clients can place a buffer on the stack; they must not be used.
+*/
+enum { PATH_BUFFER_SIZE = 512 };
+struct Path_Buffer {
+   /* the storage, aligned for the pointers and sizes a path holds */
+   union {
+      const char *pcAlign;
+      size_t ulAlign;
+      char acBytes[PATH_BUFFER_SIZE];
+   } u;
+};
+
+/*
+  Like Path_new, but builds the path in *psBuffer instead of allocating
+  it, if it fits there. The path must not be used once *psBuffer goes
+  away or is reused, but must still be passed to Path_free, which lets
+  go of its components and frees it only if it did not fit. psBuffer
+  may be NULL, which is the same as calling Path_new.
+*/
+int Path_newIn(const char *pcPath, struct Path_Buffer *psBuffer,
+               Path_T *poPResult);
+
+/*
+  Like Path_newIn, for a path that is only looked up: adds nothing to
+  the atoms that components share, and so returns NO_SUCH_PATH, in
+  place of MEMORY_ERROR, if one of pcPath's components is not already
+  part of some other path, since nothing can then be stored under it.
+*/
+int Path_findIn(const char *pcPath, struct Path_Buffer *psBuffer,
+                Path_T *poPResult);
+
 /*
   Creates a "deep copy" of oPPath, duplicating all its contents.
   Returns an int SUCCESS status and sets *poPResult to be the new path
@@ -43,6 +80,13 @@ int Path_dup(Path_T oPPath, Path_T *poPResult);
 */
 int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult);
 
+/*
+  Like Path_prefix, but builds the prefix in *psBuffer if it fits
+  there, as Path_newIn does.
+*/
+int Path_prefixIn(Path_T oPPath, size_t ulDepth,
+                  struct Path_Buffer *psBuffer, Path_T *poPResult);
+
 /* Destroys and frees all memory allocated for oPPath. */
 void Path_free(Path_T oPPath);
 
@@ -93,6 +137,24 @@ size_t Path_getSharedPrefixDepth(Path_T oPPath1, Path_T oPPath2);
 */
 const char *Path_getComponent(Path_T oPPath, size_t ulLevel);
 
+/*
+  Counts of path allocations made by the whole process. Each path is
+  one allocation, unless it was built in a Path_Buffer, which is not
+  counted.
+*/
+struct Path_Stats {
+   /* paths allocated by Path_new and Path_newIn */
+   size_t ulNews;
+   /* paths allocated by Path_prefix, Path_prefixIn and Path_dup */
+   size_t ulPrefixes;
+};
+
+/*
+  Fills in *psStats with the counts so far. They are kept only in a
+  build with -DSTATS (see stats.h), and are all 0 in any other.
+*/
+void Path_getStats(struct Path_Stats *psStats);
+
 /* Creates a Path_T from a string, returns NULL on failure */
 Path_T Path_create(const char *pcPath);
 
@@ -0,0 +1,120 @@
+/*--------------------------------------------------------------------*/
+/* pathcursor.c                                                       */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <string.h>
+
+#include "pathcursor.h"
+
+/*
+  Returns the length of the component beginning at pcStart, i.e., the
+  number of characters before the next '/' delimiter or '\0'. The C
+  library's string scans compare many characters at a time, with the
+  widest instructions the CPU turns out to have.
+*/
+static size_t PathCursor_scan(const char *pcStart) {
+   assert(pcStart != NULL);
+
+   return strcspn(pcStart, "/");
+}
+
+int PathCursor_init(PathCursor_T oCursor, const char *pcPath) {
+   const char *pc;
+   size_t ulDepth = 1;
+
+   assert(oCursor != NULL);
+   assert(pcPath != NULL);
+
+   /* path cannot be empty string or begin with a delimiter */
+   if(*pcPath == '\0' || *pcPath == '/')
+      return BAD_PATH;
+
+   /* validate the delimiters and count the components in one pass,
+      jumping from each delimiter straight to the next */
+   for(pc = strchr(pcPath, '/'); pc != NULL; pc = strchr(pc + 1, '/')) {
+      /* component can't be empty, nor can the final component */
+      if(pc[1] == '/' || pc[1] == '\0')
+         return BAD_PATH;
+      ulDepth++;
+   }
+
+   oCursor->pcComponent = pcPath;
+   oCursor->ulLength = PathCursor_scan(pcPath);
+   oCursor->ulLevel = 0;
+   oCursor->ulDepth = ulDepth;
+   return SUCCESS;
+}
+
+void PathCursor_initFromPath(PathCursor_T oCursor, Path_T oPPath) {
+   const char *pcPath;
+
+   assert(oCursor != NULL);
+   assert(oPPath != NULL);
+
+   /* a Path_T's pathname was validated when it was created */
+   pcPath = Path_getPathname(oPPath);
+   oCursor->pcComponent = pcPath;
+   oCursor->ulLength = PathCursor_scan(pcPath);
+   oCursor->ulLevel = 0;
+   oCursor->ulDepth = Path_getDepth(oPPath);
+}
+
+boolean PathCursor_next(PathCursor_T oCursor) {
+   assert(oCursor != NULL);
+
+   if(PathCursor_isLast(oCursor))
+      return FALSE;
+
+   /* skip past the current component and its trailing delimiter */
+   oCursor->pcComponent += oCursor->ulLength + 1;
+   oCursor->ulLength = PathCursor_scan(oCursor->pcComponent);
+   oCursor->ulLevel++;
+   return TRUE;
+}
+
+boolean PathCursor_isLast(PathCursor_T oCursor) {
+   assert(oCursor != NULL);
+
+   return (boolean) (oCursor->ulLevel + 1 == oCursor->ulDepth);
+}
+
+const char *PathCursor_getComponent(PathCursor_T oCursor) {
+   assert(oCursor != NULL);
+
+   return oCursor->pcComponent;
+}
+
+size_t PathCursor_getLength(PathCursor_T oCursor) {
+   assert(oCursor != NULL);
+
+   return oCursor->ulLength;
+}
+
+size_t PathCursor_getLevel(PathCursor_T oCursor) {
+   assert(oCursor != NULL);
+
+   return oCursor->ulLevel;
+}
+
+size_t PathCursor_getDepth(PathCursor_T oCursor) {
+   assert(oCursor != NULL);
+
+   return oCursor->ulDepth;
+}
+
+int PathCursor_compareString(PathCursor_T oCursor, const char *pcStr) {
+   int iCompare;
+
+   assert(oCursor != NULL);
+   assert(pcStr != NULL);
+
+   iCompare = strncmp(oCursor->pcComponent, pcStr, oCursor->ulLength);
+   if(iCompare != 0)
+      return iCompare;
+
+   /* equal through the component's length: the shorter one is less */
+   if(pcStr[oCursor->ulLength] == '\0')
+      return 0;
+   return -1;
+}
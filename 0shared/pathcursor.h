@@ -0,0 +1,89 @@
+/*--------------------------------------------------------------------*/
+/* pathcursor.h                                                       */
+/*--------------------------------------------------------------------*/
+
+#ifndef PATHCURSOR_INCLUDED
+#define PATHCURSOR_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "path.h"
+
+/*
+  A cursor over the components of an absolute path, resolved one
+  component at a time straight from the path's string representation.
+  A cursor never allocates memory: it only points into the string it
+  was initialized with, which must outlive the cursor.
+
+  The fields are declared here only so that clients can place a
+  cursor on the stack; they must be accessed through the functions
+  below.
+*/
+struct PathCursor {
+   /* the start of the current component within the path string */
+   const char *pcComponent;
+   /* the length of the current component */
+   size_t ulLength;
+   /* the level of the current component, counting from 0 */
+   size_t ulLevel;
+   /* the number of components in the whole path */
+   size_t ulDepth;
+};
+
+typedef struct PathCursor *PathCursor_T;
+
+/*
+  Validates pcPath and positions oCursor at its first (root)
+  component. Returns SUCCESS if pcPath is well-formatted. Otherwise,
+  leaves oCursor unusable and returns status:
+  * BAD_PATH if pcPath is the empty string
+             or begins with or ends with a '/'
+             or contains consecutive '/' delimiters
+*/
+int PathCursor_init(PathCursor_T oCursor, const char *pcPath);
+
+/*
+  Positions oCursor at the first (root) component of oPPath, which
+  must remain valid for as long as oCursor is used.
+*/
+void PathCursor_initFromPath(PathCursor_T oCursor, Path_T oPPath);
+
+/*
+  Advances oCursor to the next component. Returns TRUE if successful,
+  or FALSE (leaving oCursor unchanged) if oCursor is already at the
+  path's last component.
+*/
+boolean PathCursor_next(PathCursor_T oCursor);
+
+/* Returns TRUE if oCursor is at the last component of its path. */
+boolean PathCursor_isLast(PathCursor_T oCursor);
+
+/*
+  Returns the start of oCursor's current component. The component is
+  NOT '\0'-terminated; use PathCursor_getLength for its extent.
+*/
+const char *PathCursor_getComponent(PathCursor_T oCursor);
+
+/* Returns the length of oCursor's current component. */
+size_t PathCursor_getLength(PathCursor_T oCursor);
+
+/*
+  Returns the level of oCursor's current component, counting from 0
+  as in Path_getComponent.
+*/
+size_t PathCursor_getLevel(PathCursor_T oCursor);
+
+/*
+  Returns the number of components in oCursor's path, as in
+  Path_getDepth.
+*/
+size_t PathCursor_getDepth(PathCursor_T oCursor);
+
+/*
+  Compares oCursor's current component with pcStr lexicographically.
+  Returns <0, 0, or >0 if the component is "less than", "equal to", or
+  "greater than" pcStr, respectively.
+*/
+int PathCursor_compareString(PathCursor_T oCursor, const char *pcStr);
+
+#endif
@@ -0,0 +1,60 @@
+/*--------------------------------------------------------------------*/
+/* stats.h                                                            */
+/*--------------------------------------------------------------------*/
+
+#ifndef STATS_INCLUDED
+#define STATS_INCLUDED
+
+#include <stddef.h>
+
+/*
+  Event counters for a build with -DSTATS; in any other build they
+  compile to nothing. Each counter is a size_t lvalue. STATS_ADD adds
+  ulAmount to one (which may wrap, to subtract), STATS_MAX raises one
+  to ulValue if it is smaller, STATS_SET sets one and STATS_READ
+  returns one's value. In a THREADSAFE build they are
+  atomic but impose no ordering, so a reader sees each counter whole
+  but a set of them only roughly at the same moment.
+*/
+
+#ifdef STATS
+#ifdef THREADSAFE
+#define STATS_ADD(ulCounter, ulAmount) \
+   ((void) __atomic_fetch_add(&(ulCounter), (size_t) (ulAmount), \
+                              __ATOMIC_RELAXED))
+#define STATS_SET(ulCounter, ulValue) \
+   __atomic_store_n(&(ulCounter), (size_t) (ulValue), __ATOMIC_RELAXED)
+#define STATS_READ(ulCounter) \
+   __atomic_load_n(&(ulCounter), __ATOMIC_RELAXED)
+#define STATS_MAX(ulCounter, ulValue) \
+   do { \
+      size_t ulStatsSeen_ = STATS_READ(ulCounter); \
+      size_t ulStatsValue_ = (ulValue); \
+      while(ulStatsSeen_ < ulStatsValue_ && \
+            !__atomic_compare_exchange_n(&(ulCounter), &ulStatsSeen_, \
+                                         ulStatsValue_, 1, \
+                                         __ATOMIC_RELAXED, \
+                                         __ATOMIC_RELAXED)) \
+         ; \
+   } while(0)
+#else
+#define STATS_ADD(ulCounter, ulAmount) \
+   ((void) ((ulCounter) += (size_t) (ulAmount)))
+#define STATS_SET(ulCounter, ulValue) \
+   ((void) ((ulCounter) = (size_t) (ulValue)))
+#define STATS_READ(ulCounter) (ulCounter)
+#define STATS_MAX(ulCounter, ulValue) \
+   do { \
+      size_t ulStatsValue_ = (ulValue); \
+      if((ulCounter) < ulStatsValue_) \
+         (ulCounter) = ulStatsValue_; \
+   } while(0)
+#endif
+#else
+#define STATS_ADD(ulCounter, ulAmount) ((void) 0)
+#define STATS_SET(ulCounter, ulValue) ((void) 0)
+#define STATS_READ(ulCounter) ((size_t) 0)
+#define STATS_MAX(ulCounter, ulValue) ((void) 0)
+#endif
+
+#endif
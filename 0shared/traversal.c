@@ -0,0 +1,177 @@
+/*--------------------------------------------------------------------*/
+/* traversal.c                                                        */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "traversal.h"
+
+/*
+  Pushes a frame for pvNode onto oTraversal's stack, growing the stack
+  onto the heap if needed. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int Traversal_push(Traversal_T oTraversal, void *pvNode) {
+   struct TraversalFrame *psFrame;
+
+   assert(oTraversal != NULL);
+   assert(pvNode != NULL);
+
+   if(oTraversal->ulDepth == oTraversal->ulCapacity) {
+      size_t ulNewCapacity = 2 * oTraversal->ulCapacity;
+      struct TraversalFrame *psNew;
+
+      if(oTraversal->psFrames == oTraversal->asInline) {
+         psNew = malloc(ulNewCapacity * sizeof(struct TraversalFrame));
+         if(psNew == NULL)
+            return MEMORY_ERROR;
+         memcpy(psNew, oTraversal->asInline, sizeof(oTraversal->asInline));
+      }
+      else {
+         psNew = realloc(oTraversal->psFrames,
+                         ulNewCapacity * sizeof(struct TraversalFrame));
+         if(psNew == NULL)
+            return MEMORY_ERROR;
+      }
+      oTraversal->psFrames = psNew;
+      oTraversal->ulCapacity = ulNewCapacity;
+   }
+
+   psFrame = &oTraversal->psFrames[oTraversal->ulDepth++];
+   psFrame->pvNode = pvNode;
+   psFrame->ulNext = 0;
+   psFrame->ulNumChildren = (*oTraversal->pfNumChildren)(pvNode);
+   return SUCCESS;
+}
+
+/*
+  Finds the next child of the top frame that is not skipped and
+  pushes it. Returns SUCCESS and sets *ppvChild to that child, or to
+  NULL if the top frame has no children left. Returns MEMORY_ERROR,
+  leaving the stack unchanged, if the child could not be pushed.
+*/
+static int Traversal_descend(Traversal_T oTraversal, void **ppvChild) {
+   struct TraversalFrame *psTop;
+
+   assert(oTraversal != NULL);
+   assert(oTraversal->ulDepth > 0);
+   assert(ppvChild != NULL);
+
+   psTop = &oTraversal->psFrames[oTraversal->ulDepth - 1];
+   while(psTop->ulNext < psTop->ulNumChildren) {
+      void *pvChild = (*oTraversal->pfGetChild)(psTop->pvNode,
+                                               psTop->ulNext);
+      if(pvChild != NULL) {
+         if(Traversal_push(oTraversal, pvChild) != SUCCESS)
+            return MEMORY_ERROR;
+         /* the push may have moved the stack */
+         oTraversal->psFrames[oTraversal->ulDepth - 2].ulNext++;
+         *ppvChild = pvChild;
+         return SUCCESS;
+      }
+      psTop->ulNext++;
+   }
+
+   *ppvChild = NULL;
+   return SUCCESS;
+}
+
+void Traversal_init(Traversal_T oTraversal, void *pvRoot,
+                    enum TraversalOrder eOrder,
+                    size_t (*pfNumChildren)(void *pvNode),
+                    void *(*pfGetChild)(void *pvNode, size_t ulIndex)) {
+   assert(oTraversal != NULL);
+   assert(pfNumChildren != NULL);
+   assert(pfGetChild != NULL);
+
+   oTraversal->pfNumChildren = pfNumChildren;
+   oTraversal->pfGetChild = pfGetChild;
+   oTraversal->eOrder = eOrder;
+   oTraversal->pvRoot = pvRoot;
+   oTraversal->bStarted = FALSE;
+   oTraversal->ulLastDepth = 0;
+   oTraversal->psFrames = oTraversal->asInline;
+   oTraversal->ulDepth = 0;
+   oTraversal->ulCapacity = TRAVERSAL_INLINE_FRAMES;
+}
+
+int Traversal_next(Traversal_T oTraversal, void **ppvNode) {
+   void *pvChild;
+
+   assert(oTraversal != NULL);
+   assert(ppvNode != NULL);
+
+   *ppvNode = NULL;
+
+   if(!oTraversal->bStarted) {
+      if(oTraversal->pvRoot != NULL) {
+         if(Traversal_push(oTraversal, oTraversal->pvRoot) != SUCCESS)
+            return MEMORY_ERROR;
+      }
+      oTraversal->bStarted = TRUE;
+
+      /* pre-order returns the root before anything else */
+      if(oTraversal->eOrder == TRAVERSAL_PREORDER &&
+         oTraversal->ulDepth > 0) {
+         oTraversal->ulLastDepth = 1;
+         *ppvNode = oTraversal->pvRoot;
+         return SUCCESS;
+      }
+   }
+
+   while(oTraversal->ulDepth > 0) {
+      if(Traversal_descend(oTraversal, &pvChild) != SUCCESS)
+         return MEMORY_ERROR;
+
+      if(pvChild != NULL) {
+         /* pre-order returns each node on the way down */
+         if(oTraversal->eOrder == TRAVERSAL_PREORDER) {
+            oTraversal->ulLastDepth = oTraversal->ulDepth;
+            *ppvNode = pvChild;
+            return SUCCESS;
+         }
+      }
+      else {
+         /* the top node is finished: post-order returns it now */
+         void *pvDone =
+            oTraversal->psFrames[--oTraversal->ulDepth].pvNode;
+         if(oTraversal->eOrder == TRAVERSAL_POSTORDER) {
+            oTraversal->ulLastDepth = oTraversal->ulDepth + 1;
+            *ppvNode = pvDone;
+            return SUCCESS;
+         }
+      }
+   }
+
+   return SUCCESS;
+}
+
+void Traversal_skipChildren(Traversal_T oTraversal) {
+   struct TraversalFrame *psLast;
+
+   assert(oTraversal != NULL);
+   assert(oTraversal->eOrder == TRAVERSAL_PREORDER);
+   assert(oTraversal->ulLastDepth > 0);
+   /* the node most recently returned is still on top of the stack */
+   assert(oTraversal->ulDepth == oTraversal->ulLastDepth);
+
+   psLast = &oTraversal->psFrames[oTraversal->ulDepth - 1];
+   psLast->ulNext = psLast->ulNumChildren;
+}
+
+size_t Traversal_getDepth(Traversal_T oTraversal) {
+   assert(oTraversal != NULL);
+
+   return oTraversal->ulLastDepth;
+}
+
+void Traversal_free(Traversal_T oTraversal) {
+   assert(oTraversal != NULL);
+
+   if(oTraversal->psFrames != oTraversal->asInline)
+      free(oTraversal->psFrames);
+   oTraversal->psFrames = oTraversal->asInline;
+   oTraversal->ulDepth = 0;
+   oTraversal->ulCapacity = TRAVERSAL_INLINE_FRAMES;
+}
@@ -0,0 +1,100 @@
+/*--------------------------------------------------------------------*/
+/* traversal.h                                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef TRAVERSAL_INCLUDED
+#define TRAVERSAL_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A Traversal walks a tree of any node type in pre-order or post-order
+  without recursion: the path from the root to the current node is
+  kept on an explicit stack, so the depth of the tree is limited only
+  by available memory, and the walk can be stopped after any node and
+  resumed later. The tree is seen only through two functions:
+  pfNumChildren(pvNode) returns the number of child slots of pvNode,
+  and pfGetChild(pvNode, ulIndex) returns the child in slot ulIndex,
+  or NULL to skip that slot. The tree must not change during a walk,
+  except that post-order clients may free each node as it is returned.
+*/
+
+/* The order in which a Traversal returns nodes */
+enum TraversalOrder { TRAVERSAL_PREORDER, TRAVERSAL_POSTORDER };
+
+/* Number of stack frames held inside struct Traversal itself */
+enum { TRAVERSAL_INLINE_FRAMES = 16 };
+
+/* One level of the path from the root to the current node */
+struct TraversalFrame {
+   /* the node at this level */
+   void *pvNode;
+   /* the next child slot of pvNode to visit */
+   size_t ulNext;
+   /* the number of child slots of pvNode */
+   size_t ulNumChildren;
+};
+
+/*
+  The state of a walk. The struct is public so that a walk can live on
+  the caller's stack and cost no allocation for trees of modest depth;
+  clients must only use it through the functions below.
+*/
+struct Traversal {
+   size_t (*pfNumChildren)(void *pvNode);
+   void *(*pfGetChild)(void *pvNode, size_t ulIndex);
+   enum TraversalOrder eOrder;
+   /* the root, until the walk has started */
+   void *pvRoot;
+   boolean bStarted;
+   /* the depth of the node most recently returned */
+   size_t ulLastDepth;
+   /* the stack: asInline until it outgrows it, then a heap array */
+   struct TraversalFrame *psFrames;
+   size_t ulDepth;
+   size_t ulCapacity;
+   struct TraversalFrame asInline[TRAVERSAL_INLINE_FRAMES];
+};
+
+typedef struct Traversal *Traversal_T;
+
+/*
+  Sets up oTraversal to walk the tree rooted at pvRoot (which may be
+  NULL for an empty tree) in order eOrder, using pfNumChildren and
+  pfGetChild to find each node's children.
+*/
+void Traversal_init(Traversal_T oTraversal, void *pvRoot,
+                    enum TraversalOrder eOrder,
+                    size_t (*pfNumChildren)(void *pvNode),
+                    void *(*pfGetChild)(void *pvNode, size_t ulIndex));
+
+/*
+  Advances oTraversal. Returns SUCCESS and sets *ppvNode to the next
+  node, or to NULL once every node has been returned. Returns
+  MEMORY_ERROR if the stack could not grow, leaving oTraversal where it
+  was so that the call may be retried.
+*/
+int Traversal_next(Traversal_T oTraversal, void **ppvNode);
+
+/*
+  Makes a pre-order oTraversal pass over the descendants of the node
+  that Traversal_next most recently returned, so that a walk can prune
+  the subtrees it has no use for. Must be called before the next call
+  of Traversal_next.
+*/
+void Traversal_skipChildren(Traversal_T oTraversal);
+
+/*
+  Returns the depth of the node most recently returned by
+  Traversal_next: 1 for the root, 2 for its children, and so on.
+*/
+size_t Traversal_getDepth(Traversal_T oTraversal);
+
+/*
+  Frees the memory that oTraversal allocated for its stack, but not
+  oTraversal itself. The walk may not be continued afterwards.
+*/
+void Traversal_free(Traversal_T oTraversal);
+
+#endif
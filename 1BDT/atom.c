@@ -0,0 +1 @@
+../0shared/atom.c
\ No newline at end of file
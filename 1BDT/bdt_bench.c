@@ -0,0 +1,18 @@
+/*--------------------------------------------------------------------*/
+/* bdt_bench.c                                                        */
+/*--------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include "bdt.h"
+#include "bench.h"
+
+/* Runs the benchmark workloads named on the command line on the BDT,
+   whose directories have at most two children. */
+int main(int argc, char *argv[]) {
+   static const struct Bench_Ops sOps = {
+      "BDT", BDT_init, BDT_destroy, BDT_insert, NULL, BDT_contains,
+      BDT_rm, 2
+   };
+
+   return Bench_main(argc, argv, &sOps);
+}
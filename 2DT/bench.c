@@ -0,0 +1 @@
+../0shared/bench.c
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "checkerDT.h"
+#include "traversal.h"
 
 boolean CheckerDT_Node_isValid(Node_T oNNode) {
    Node_T oNParent;
@@ -13,7 +14,7 @@ boolean CheckerDT_Node_isValid(Node_T oNNode) {
    Path_T oPPPath;
 
    size_t ulNumChildren;
-   size_t i, j;
+   size_t i;
 
    Node_T oneNode;
    Node_T twoNode;
@@ -65,25 +66,9 @@ boolean CheckerDT_Node_isValid(Node_T oNNode) {
       }
    }
 
-   /* Check for duplicate children */
-   for(i = 0; i < ulNumChildren; i++) {
-      Node_T oNChild1 = NULL;
-      Node_getChild(oNNode, i, &oNChild1);
-      for(j = i + 1; j < ulNumChildren; j++) {
-         Node_T oNChild2 = NULL;
-         Node_getChild(oNNode, j, &oNChild2);
-         if(Path_comparePath(Node_getPath(oNChild1),
-                             Node_getPath(oNChild2)) == 0) {
-            fprintf(stderr, "Duplicate child path found under node %s: %s\n",
-                    Path_getPathname(oPNPath),
-                    Path_getPathname(Node_getPath(oNChild1)));
-            return FALSE;
-         }
-      }
-   }
-
-   /* Check for lexicographic children order */
-   for (i = 0; i < ulNumChildren - 1; i++) {
+   /* Check for lexicographic children order: in a sorted list any
+      duplicates are neighbors, so this finds them too, in linear time */
+   for (i = 0; i + 1 < ulNumChildren; i++) {
       if (Node_getChild(oNNode, i, &oneNode) != SUCCESS || oneNode == NULL ||
           Node_getChild(oNNode, i + 1, &twoNode) != SUCCESS || twoNode == NULL) {
          fprintf(stderr, "Failed to retrieve children at indices %lu and %lu for lexicographic check.\n",
@@ -97,6 +82,12 @@ boolean CheckerDT_Node_isValid(Node_T oNNode) {
       }
 
       cmp = Path_comparePath(Node_getPath(oneNode), Node_getPath(twoNode));
+      if (cmp == 0) {
+         fprintf(stderr, "Duplicate child path found under node %s: %s\n",
+                 Path_getPathname(oPNPath),
+                 Path_getPathname(Node_getPath(oneNode)));
+         return FALSE;
+      }
       if (cmp > 0){
          fprintf(stderr, "Children are not in lexicographic order: %s > %s\n",
                  Path_getPathname(Node_getPath(oneNode)),
@@ -108,40 +99,70 @@ boolean CheckerDT_Node_isValid(Node_T oNNode) {
    return TRUE;
 }
 
+/* Traversal functions that present a node's children */
+static size_t CheckerDT_numChildren(void *pvNode) {
+   return Node_getNumChildren(pvNode);
+}
+
+static void *CheckerDT_getChild(void *pvNode, size_t ulIndex) {
+   Node_T oNChild = NULL;
+
+   if(Node_getChild(pvNode, ulIndex, &oNChild) != SUCCESS ||
+      oNChild == NULL) {
+      /* leave a NULL child for CheckerDT_Node_isValid on the parent to
+         report; the walk simply skips it */
+      return NULL;
+   }
+   return oNChild;
+}
+
+/*
+  Checks every node of the tree rooted at oNNode in pre-order, adding
+  the number of nodes visited to *pulCount. Returns FALSE as soon as a
+  node is invalid, or if memory for the walk runs out.
+*/
 static boolean CheckerDT_treeCheck(Node_T oNNode, size_t *pulCount) {
-   size_t i;
-   size_t ulNumChildren;
+   struct Traversal sWalk;
+   void *pvNode;
+   boolean bValid = TRUE;
    assert (pulCount != NULL);
 
-   if(oNNode != NULL) {
-      if(!CheckerDT_Node_isValid(oNNode)) {
-         return FALSE;
+   /* an explicit stack, so that deep trees cannot overflow the call stack */
+   Traversal_init(&sWalk, oNNode, TRAVERSAL_PREORDER,
+                  CheckerDT_numChildren, CheckerDT_getChild);
+   for(;;) {
+      if(Traversal_next(&sWalk, &pvNode) != SUCCESS) {
+         fprintf(stderr, "Out of memory in traversal\n");
+         bValid = FALSE;
+         break;
       }
+      if(pvNode == NULL)
+         break;
 
-      (*pulCount)++;
-
-      ulNumChildren = Node_getNumChildren(oNNode);
-      for(i = 0; i < ulNumChildren; i++) {
-         Node_T oNChild = NULL;
-         if(Node_getChild(oNNode, i, &oNChild) != SUCCESS || oNChild == NULL) {
-            fprintf(stderr, "Failed to fetch child %lu in traversal\n",
-                    (unsigned long)i);
-            return FALSE;
-         }
-
-         if(!CheckerDT_treeCheck(oNChild, pulCount)) {
-            return FALSE;
-         }
+      /* a node's children are only reached after it has been checked */
+      if(!CheckerDT_Node_isValid(pvNode)) {
+         bValid = FALSE;
+         break;
       }
+
+      (*pulCount)++;
    }
-   return TRUE;
+   Traversal_free(&sWalk);
+   return bValid;
 }
 
-boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
-                          size_t ulCount) {
-   size_t ulTraverseCount = 0;
+/*
+  Checks the hierarchy's state variables against each other and the
+  root, without looking below it. Sets *pbDone to TRUE if there is
+  nothing further to check (the DT is not initialized).
+*/
+static boolean CheckerDT_stateCheck(boolean bIsInitialized, Node_T oNRoot,
+                                    size_t ulCount, boolean *pbDone) {
+   assert(pbDone != NULL);
 
+   *pbDone = FALSE;
    if(!bIsInitialized) {
+      *pbDone = TRUE;
       if(ulCount != 0) {
          fprintf(stderr, "Not initialized, but count is not 0\n");
          return FALSE;
@@ -163,6 +184,24 @@ boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
       return FALSE;
    }
 
+   if(oNRoot != NULL && Node_getParent(oNRoot) != NULL) {
+      fprintf(stderr, "The root has a parent\n");
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
+                          size_t ulCount) {
+   size_t ulTraverseCount = 0;
+   boolean bDone;
+
+   if(!CheckerDT_stateCheck(bIsInitialized, oNRoot, ulCount, &bDone))
+      return FALSE;
+   if(bDone)
+      return TRUE;
+
    if(!CheckerDT_treeCheck(oNRoot, &ulTraverseCount)) {
       return FALSE;
    }
@@ -175,3 +214,83 @@ boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
 
    return TRUE;
 }
+
+/* Every how many calls CheckerDT_isValidAfter does a full check, or 0 */
+static size_t ulSampleEvery = 0;
+
+/* Calls of CheckerDT_isValidAfter since its last full check */
+static size_t ulSinceFull = 0;
+
+void CheckerDT_setSampleRate(size_t ulEvery) {
+   ulSampleEvery = ulEvery;
+   ulSinceFull = 0;
+}
+
+/*
+  Checks that each ancestor of oNNode has it among its children, where
+  a lookup of its path would find it, and that the topmost is oNRoot.
+*/
+static boolean CheckerDT_chainCheck(Node_T oNRoot, Node_T oNNode) {
+   Node_T oNParent;
+
+   while((oNParent = Node_getParent(oNNode)) != NULL) {
+      Node_T oNChild = NULL;
+      size_t ulIndex;
+
+      /* oNParent's other children are as they were before the change,
+         so only oNNode's place among them needs checking */
+      if(!Node_hasChild(oNParent, Node_getPath(oNNode), &ulIndex) ||
+         Node_getChild(oNParent, ulIndex, &oNChild) != SUCCESS ||
+         oNChild != oNNode) {
+         fprintf(stderr, "Node is not among its parent's children: %s\n",
+                 Path_getPathname(Node_getPath(oNNode)));
+         return FALSE;
+      }
+
+      if(Path_getSharedPrefixDepth(Node_getPath(oNNode),
+                                   Node_getPath(oNParent)) !=
+         Path_getDepth(Node_getPath(oNNode)) - 1) {
+         fprintf(stderr, "P-C nodes don't have P-C paths: (%s) (%s)\n",
+                 Path_getPathname(Node_getPath(oNParent)),
+                 Path_getPathname(Node_getPath(oNNode)));
+         return FALSE;
+      }
+      oNNode = oNParent;
+   }
+
+   if(oNNode != oNRoot) {
+      fprintf(stderr, "Node's ancestors do not lead to the root: %s\n",
+              Path_getPathname(Node_getPath(oNNode)));
+      return FALSE;
+   }
+   return TRUE;
+}
+
+boolean CheckerDT_isValidAfter(boolean bIsInitialized, Node_T oNRoot,
+                               size_t ulCount, Node_T oNTouched) {
+   boolean bDone;
+
+   if(ulSampleEvery != 0 && ++ulSinceFull >= ulSampleEvery) {
+      ulSinceFull = 0;
+      return CheckerDT_isValid(bIsInitialized, oNRoot, ulCount);
+   }
+
+   if(!CheckerDT_stateCheck(bIsInitialized, oNRoot, ulCount, &bDone))
+      return FALSE;
+   if(bDone || oNTouched == NULL)
+      return TRUE;
+
+   if(oNRoot == NULL) {
+      fprintf(stderr, "A node was touched, but root is NULL\n");
+      return FALSE;
+   }
+
+   if(Path_getDepth(Node_getPath(oNTouched)) > ulCount) {
+      fprintf(stderr, "Node is deeper than the count allows: %s\n",
+              Path_getPathname(Node_getPath(oNTouched)));
+      return FALSE;
+   }
+
+   return CheckerDT_Node_isValid(oNTouched) &&
+          CheckerDT_chainCheck(oNRoot, oNTouched);
+}
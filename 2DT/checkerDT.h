@@ -29,4 +29,28 @@ boolean CheckerDT_isValid(boolean bIsInitialized,
                           Node_T oNRoot,
                           size_t ulCount);
 
+/*
+   Like CheckerDT_isValid, but for a hierarchy that was valid before
+   an operation that changed it only at oNTouched: the directory that
+   lost a child, or the deepest of those just inserted. Checks the
+   state variables, oNTouched and its children, and oNTouched's place
+   among its ancestors', in time proportional to the depth of
+   oNTouched and its number of children, rather than to the size of
+   the hierarchy. oNTouched may be NULL if no node was touched, or if
+   the root itself was removed.
+   Every ulEvery'th call (see CheckerDT_setSampleRate) does the full
+   check instead, so that damage elsewhere is still found in time.
+*/
+boolean CheckerDT_isValidAfter(boolean bIsInitialized,
+                               Node_T oNRoot,
+                               size_t ulCount,
+                               Node_T oNTouched);
+
+/*
+   Makes every ulEvery'th call to CheckerDT_isValidAfter a full
+   CheckerDT_isValid. 0, the default, makes none of them one; 1 makes
+   them all one.
+*/
+void CheckerDT_setSampleRate(size_t ulEvery);
+
 #endif
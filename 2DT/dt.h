@@ -73,4 +73,29 @@ int DT_destroy(void);
 */
 char *DT_toString(void);
 
+/*
+  A DT_T is a Directory Tree object of its own. Any number of them may
+  exist at once, independent of each other and of the global DT that
+  the functions above work on.
+*/
+typedef struct DT *DT_T;
+
+/*
+  Returns a new, empty DT_T, which is ready for use without an init
+  call, or NULL if memory could not be allocated.
+*/
+DT_T DT_new(void);
+
+/* Frees oDT and all of its contents. Does nothing if oDT is NULL. */
+void DT_free(DT_T oDT);
+
+/*
+  Each function below does what the global function of the same name,
+  without "In", does, but to the DT oDT.
+*/
+int DT_insertIn(DT_T oDT, const char *pcPath);
+boolean DT_containsIn(DT_T oDT, const char *pcPath);
+int DT_rmIn(DT_T oDT, const char *pcPath);
+char *DT_toStringIn(DT_T oDT);
+
 #endif
@@ -14,19 +14,24 @@
 #include "nodeDT.h"
 #include "checkerDT.h"
 #include "dt.h"
+#include "traversal.h"
 
 
 /*
   A Directory Tree is a representation of a hierarchy of directories,
-  represented as an AO with 3 state variables:
+  represented as an object with 3 state variables:
 */
+struct DT {
+   /* 1. a flag for being in an initialized state (TRUE) or not (FALSE) */
+   boolean bIsInitialized;
+   /* 2. a pointer to the root node in the hierarchy */
+   Node_T oNRoot;
+   /* 3. a counter of the number of nodes in the hierarchy */
+   size_t ulCount;
+};
 
-/* 1. a flag for being in an initialized state (TRUE) or not (FALSE) */
-static boolean bIsInitialized;
-/* 2. a pointer to the root node in the hierarchy */
-static Node_T oNRoot;
-/* 3. a counter of the number of nodes in the hierarchy */
-static size_t ulCount;
+/* The DT behind the global functions, initialized by DT_init */
+static struct DT sGlobal;
 
 
 
@@ -47,9 +52,10 @@ static size_t ulCount;
   * CONFLICTING_PATH if the root's path is not a prefix of oPPath
   * MEMORY_ERROR if memory could not be allocated to complete request
 */
-static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
+static int DT_traversePath(DT_T oDT, Path_T oPPath, Node_T *poNFurthest) {
    int iStatus;
    Path_T oPPrefix = NULL;
+   struct Path_Buffer sPrefix;
    Node_T oNCurr;
    Node_T oNChild = NULL;
    size_t ulDepth;
@@ -60,18 +66,18 @@ static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
    assert(poNFurthest != NULL);
 
    /* root is NULL -> won't find anything */
-   if(oNRoot == NULL) {
+   if(oDT->oNRoot == NULL) {
       *poNFurthest = NULL;
       return SUCCESS;
    }
 
-   iStatus = Path_prefix(oPPath, 1, &oPPrefix);
+   iStatus = Path_prefixIn(oPPath, 1, &sPrefix, &oPPrefix);
    if(iStatus != SUCCESS) {
       *poNFurthest = NULL;
       return iStatus;
    }
 
-   if(Path_comparePath(Node_getPath(oNRoot), oPPrefix)) {
+   if(Path_comparePath(Node_getPath(oDT->oNRoot), oPPrefix)) {
       Path_free(oPPrefix);
       *poNFurthest = NULL;
       return CONFLICTING_PATH;
@@ -79,10 +85,10 @@ static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
    Path_free(oPPrefix);
    oPPrefix = NULL;
 
-   oNCurr = oNRoot;
+   oNCurr = oDT->oNRoot;
    ulDepth = Path_getDepth(oPPath);
    for(i = 2; i <= ulDepth; i++) {
-      iStatus = Path_prefix(oPPath, i, &oPPrefix);
+      iStatus = Path_prefixIn(oPPath, i, &sPrefix, &oPPrefix);
       if(iStatus != SUCCESS) {
          *poNFurthest = NULL;
          return iStatus;
@@ -110,6 +116,25 @@ static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
    return SUCCESS;
 }
 
+/*
+  Returns TRUE if the first component of pcPath is the name of the
+  root of oDT, which must not be NULL.
+*/
+static boolean DT_isUnderRoot(DT_T oDT, const char *pcPath) {
+   Path_T oPRoot;
+   size_t ulLength;
+
+   assert(oDT->oNRoot != NULL);
+   assert(pcPath != NULL);
+
+   /* the root's path is its name */
+   oPRoot = Node_getPath(oDT->oNRoot);
+   ulLength = Path_getStrLength(oPRoot);
+   return (boolean) (strncmp(pcPath, Path_getPathname(oPRoot),
+                             ulLength) == 0 &&
+                     (pcPath[ulLength] == '/' || pcPath[ulLength] == '\0'));
+}
+
 /*
   Traverses the DT to find a node with absolute path pcPath. Returns a
   int SUCCESS status and sets *poNResult to be the node, if found.
@@ -120,26 +145,31 @@ static int DT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
   * NO_SUCH_PATH if no node with pcPath exists in the hierarchy
   * MEMORY_ERROR if memory could not be allocated to complete request
  */
-static int DT_findNode(const char *pcPath, Node_T *poNResult) {
+static int DT_findNode(DT_T oDT, const char *pcPath, Node_T *poNResult) {
    Path_T oPPath = NULL;
+   struct Path_Buffer sPath;
    Node_T oNFound = NULL;
    int iStatus;
 
    assert(pcPath != NULL);
    assert(poNResult != NULL);
 
-   if(!bIsInitialized) {
+   if(!oDT->bIsInitialized) {
       *poNResult = NULL;
       return INITIALIZATION_ERROR;
    }
 
-   iStatus = Path_new(pcPath, &oPPath);
+   /* a component that no path holds cannot be in the DT */
+   iStatus = Path_findIn(pcPath, &sPath, &oPPath);
+   if(iStatus == NO_SUCH_PATH && oDT->oNRoot != NULL &&
+      !DT_isUnderRoot(oDT, pcPath))
+      iStatus = CONFLICTING_PATH;
    if(iStatus != SUCCESS) {
       *poNResult = NULL;
       return iStatus;
    }
 
-   iStatus = DT_traversePath(oPPath, &oNFound);
+   iStatus = DT_traversePath(oDT, oPPath, &oNFound);
    if(iStatus != SUCCESS)
    {
       Path_free(oPPath);
@@ -166,36 +196,43 @@ static int DT_findNode(const char *pcPath, Node_T *poNResult) {
 /*--------------------------------------------------------------------*/
 
 
-int DT_insert(const char *pcPath) {
+int DT_insertIn(DT_T oDT, const char *pcPath) {
    int iStatus;
    Path_T oPPath = NULL;
+   struct Path_Buffer sPath;
    Node_T oNFirstNew = NULL;
    Node_T oNCurr = NULL;
+   Node_T oNFurthest;
    size_t ulDepth, ulIndex;
    size_t ulNewNodes = 0;
 
    assert(pcPath != NULL);
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(CheckerDT_isValidAfter(oDT->bIsInitialized, oDT->oNRoot,
+                                 oDT->ulCount, NULL));
 
    /* validate pcPath and generate a Path_T for it */
-   if(!bIsInitialized)
+   if(!oDT->bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   iStatus = Path_new(pcPath, &oPPath);
+   iStatus = Path_newIn(pcPath, &sPath, &oPPath);
    if(iStatus != SUCCESS)
       return iStatus;
 
    /* find the closest ancestor of oPPath already in the tree */
-   iStatus= DT_traversePath(oPPath, &oNCurr);
+   iStatus= DT_traversePath(oDT, oPPath, &oNCurr);
    if(iStatus != SUCCESS)
    {
       Path_free(oPPath);
       return iStatus;
    }
 
+   /* the tree is left as it is below here on failure */
+   oNFurthest = oNCurr;
+   (void) oNFurthest;
+
    /* no ancestor node found, so if root is not NULL,
       pcPath isn't underneath root. */
-   if(oNCurr == NULL && oNRoot != NULL) {
+   if(oNCurr == NULL && oDT->oNRoot != NULL) {
       Path_free(oPPath);
       return CONFLICTING_PATH;
    }
@@ -217,15 +254,17 @@ int DT_insert(const char *pcPath) {
    /* starting at oNCurr, build rest of the path one level at a time */
    while(ulIndex <= ulDepth) {
       Path_T oPPrefix = NULL;
+      struct Path_Buffer sPrefix;
       Node_T oNNewNode = NULL;
 
       /* generate a Path_T for this level */
-      iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
+      iStatus = Path_prefixIn(oPPath, ulIndex, &sPrefix, &oPPrefix);
       if(iStatus != SUCCESS) {
          Path_free(oPPath);
          if(oNFirstNew != NULL)
             (void) Node_free(oNFirstNew);
-         assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+         assert(CheckerDT_isValidAfter(oDT->bIsInitialized, oDT->oNRoot,
+                                       oDT->ulCount, oNFurthest));
          return iStatus;
       }
 
@@ -236,7 +275,8 @@ int DT_insert(const char *pcPath) {
          Path_free(oPPrefix);
          if(oNFirstNew != NULL)
             (void) Node_free(oNFirstNew);
-         assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+         assert(CheckerDT_isValidAfter(oDT->bIsInitialized, oDT->oNRoot,
+                                       oDT->ulCount, oNFurthest));
          return iStatus;
       }
 
@@ -251,73 +291,115 @@ int DT_insert(const char *pcPath) {
 
    Path_free(oPPath);
    /* update DT state variables to reflect insertion */
-   if(oNRoot == NULL)
-      oNRoot = oNFirstNew;
-   ulCount += ulNewNodes;
+   if(oDT->oNRoot == NULL)
+      oDT->oNRoot = oNFirstNew;
+   oDT->ulCount += ulNewNodes;
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(CheckerDT_isValidAfter(oDT->bIsInitialized, oDT->oNRoot,
+                                 oDT->ulCount, oNCurr));
    return SUCCESS;
 }
 
-boolean DT_contains(const char *pcPath) {
+boolean DT_containsIn(DT_T oDT, const char *pcPath) {
    int iStatus;
    Node_T oNFound = NULL;
 
    assert(pcPath != NULL);
 
-   iStatus = DT_findNode(pcPath, &oNFound);
+   iStatus = DT_findNode(oDT, pcPath, &oNFound);
    return (boolean) (iStatus == SUCCESS);
 }
 
 
-int DT_rm(const char *pcPath) {
+int DT_rmIn(DT_T oDT, const char *pcPath) {
    int iStatus;
    Node_T oNFound = NULL;
+   Node_T oNParent;
 
    assert(pcPath != NULL);
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(CheckerDT_isValidAfter(oDT->bIsInitialized, oDT->oNRoot,
+                                 oDT->ulCount, NULL));
 
-   iStatus = DT_findNode(pcPath, &oNFound);
+   iStatus = DT_findNode(oDT, pcPath, &oNFound);
 
    if(iStatus != SUCCESS)
        return iStatus;
 
-   ulCount -= Node_free(oNFound);
-   if(ulCount == 0)
-      oNRoot = NULL;
+   oNParent = Node_getParent(oNFound);
+   oDT->ulCount -= Node_free(oNFound);
+   if(oDT->ulCount == 0)
+      oDT->oNRoot = NULL;
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(CheckerDT_isValidAfter(oDT->bIsInitialized, oDT->oNRoot,
+                                 oDT->ulCount, oNParent));
+   (void) oNParent;
    return SUCCESS;
 }
 
+DT_T DT_new(void) {
+   DT_T oDT;
+
+   oDT = malloc(sizeof(struct DT));
+   if(oDT == NULL)
+      return NULL;
+
+   oDT->bIsInitialized = TRUE;
+   oDT->oNRoot = NULL;
+   oDT->ulCount = 0;
+
+   assert(CheckerDT_isValid(oDT->bIsInitialized, oDT->oNRoot,
+                            oDT->ulCount));
+   return oDT;
+}
+
+void DT_free(DT_T oDT) {
+   if(oDT == NULL)
+      return;
+
+   assert(CheckerDT_isValid(oDT->bIsInitialized, oDT->oNRoot,
+                            oDT->ulCount));
+
+   if(oDT->oNRoot != NULL)
+      (void) Node_free(oDT->oNRoot);
+   free(oDT);
+}
+
 int DT_init(void) {
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   DT_T oDT = &sGlobal;
 
-   if(bIsInitialized)
+   assert(CheckerDT_isValid(oDT->bIsInitialized, oDT->oNRoot,
+                            oDT->ulCount));
+
+   if(oDT->bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   bIsInitialized = TRUE;
-   oNRoot = NULL;
-   ulCount = 0;
+   oDT->bIsInitialized = TRUE;
+   oDT->oNRoot = NULL;
+   oDT->ulCount = 0;
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(CheckerDT_isValid(oDT->bIsInitialized, oDT->oNRoot,
+                            oDT->ulCount));
    return SUCCESS;
 }
 
 int DT_destroy(void) {
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   DT_T oDT = &sGlobal;
+
+   assert(CheckerDT_isValid(oDT->bIsInitialized, oDT->oNRoot,
+                            oDT->ulCount));
 
-   if(!bIsInitialized)
+   if(!oDT->bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   if(oNRoot) {
-      ulCount -= Node_free(oNRoot);
-      oNRoot = NULL;
+   if(oDT->oNRoot) {
+      oDT->ulCount -= Node_free(oDT->oNRoot);
+      oDT->oNRoot = NULL;
    }
 
-   bIsInitialized = FALSE;
+   oDT->bIsInitialized = FALSE;
 
-   assert(CheckerDT_isValid(bIsInitialized, oNRoot, ulCount));
+   assert(CheckerDT_isValid(oDT->bIsInitialized, oDT->oNRoot,
+                            oDT->ulCount));
    return SUCCESS;
 }
 
@@ -328,27 +410,41 @@ int DT_destroy(void) {
   string representation of the DT.
 */
 
+/* Traversal functions that present a DT node's children */
+static size_t DT_numChildren(void *pvNode) {
+   return Node_getNumChildren(pvNode);
+}
+
+static void *DT_getChild(void *pvNode, size_t ulIndex) {
+   Node_T oNChild = NULL;
+   int iStatus;
+
+   iStatus = Node_getChild(pvNode, ulIndex, &oNChild);
+   assert(iStatus == SUCCESS);
+   (void) iStatus;
+   return oNChild;
+}
+
 /*
   Performs a pre-order traversal of the tree rooted at n,
   inserting each payload to DynArray_T d beginning at index i.
-  Returns the next unused index in d after the insertion(s).
+  Returns the next unused index in d after the insertion(s), which
+  falls short of the number of nodes if memory runs out.
 */
 static size_t DT_preOrderTraversal(Node_T n, DynArray_T d, size_t i) {
-   size_t c;
+   struct Traversal sWalk;
+   void *pvNode;
 
    assert(d != NULL);
 
-   if(n != NULL) {
-      (void) DynArray_set(d, i, n);
+   /* an explicit stack, so that deep trees cannot overflow the call stack */
+   Traversal_init(&sWalk, n, TRAVERSAL_PREORDER,
+                  DT_numChildren, DT_getChild);
+   while(Traversal_next(&sWalk, &pvNode) == SUCCESS && pvNode != NULL) {
+      (void) DynArray_set(d, i, pvNode);
       i++;
-      for(c = 0; c < Node_getNumChildren(n); c++) {
-         int iStatus;
-         Node_T oNChild = NULL;
-         iStatus = Node_getChild(n,c, &oNChild);
-         assert(iStatus == SUCCESS);
-         i = DT_preOrderTraversal(oNChild, d, i);
-      }
    }
+   Traversal_free(&sWalk);
    return i;
 }
 
@@ -365,30 +461,41 @@ static void DT_strlenAccumulate(Node_T oNNode, size_t *pulAcc) {
 }
 
 /*
-  Alternate version of strcat that inverts the typical argument
-  order, appending oNNode's path onto pcAcc, and also always adds one
-  newline at the end of the concatenated string.
+  Alternate version of strcat that appends oNNode's path and one
+  newline at *ppcCursor, then advances *ppcCursor past them. Unlike
+  strcat, it never rescans the accumulated string, so building the
+  whole result is linear in its length.
 */
-static void DT_strcatAccumulate(Node_T oNNode, char *pcAcc) {
-   assert(pcAcc != NULL);
+static void DT_strcatAccumulate(Node_T oNNode, char **ppcCursor) {
+   size_t ulLength;
+
+   assert(ppcCursor != NULL);
 
    if(oNNode != NULL) {
-      strcat(pcAcc, Path_getPathname(Node_getPath(oNNode)));
-      strcat(pcAcc, "\n");
+      ulLength = Path_getStrLength(Node_getPath(oNNode));
+      memcpy(*ppcCursor, Path_getPathname(Node_getPath(oNNode)), ulLength);
+      *ppcCursor += ulLength;
+      *(*ppcCursor)++ = '\n';
    }
 }
 /*--------------------------------------------------------------------*/
 
-char *DT_toString(void) {
+char *DT_toStringIn(DT_T oDT) {
    DynArray_T nodes;
    size_t totalStrlen = 1;
    char *result = NULL;
+   char *cursor;
 
-   if(!bIsInitialized)
+   if(!oDT->bIsInitialized)
       return NULL;
 
-   nodes = DynArray_new(ulCount);
-   (void) DT_preOrderTraversal(oNRoot, nodes, 0);
+   nodes = DynArray_new(oDT->ulCount);
+   if(nodes == NULL)
+      return NULL;
+   if(DT_preOrderTraversal(oDT->oNRoot, nodes, 0) != oDT->ulCount) {
+      DynArray_free(nodes);
+      return NULL;
+   }
 
    DynArray_map(nodes, (void (*)(void *, void*)) DT_strlenAccumulate,
                 (void*) &totalStrlen);
@@ -398,12 +505,36 @@ char *DT_toString(void) {
       DynArray_free(nodes);
       return NULL;
    }
-   *result = '\0';
+   cursor = result;
 
    DynArray_map(nodes, (void (*)(void *, void*)) DT_strcatAccumulate,
-                (void *) result);
+                (void *) &cursor);
+   *cursor = '\0';
 
    DynArray_free(nodes);
 
    return result;
 }
+
+
+/* --------------------------------------------------------------------
+
+  The global functions are thin wrappers that run their "In"
+  counterparts on sGlobal.
+*/
+
+int DT_insert(const char *pcPath) {
+   return DT_insertIn(&sGlobal, pcPath);
+}
+
+boolean DT_contains(const char *pcPath) {
+   return DT_containsIn(&sGlobal, pcPath);
+}
+
+int DT_rm(const char *pcPath) {
+   return DT_rmIn(&sGlobal, pcPath);
+}
+
+char *DT_toString(void) {
+   return DT_toStringIn(&sGlobal);
+}
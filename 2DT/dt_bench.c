@@ -0,0 +1,16 @@
+/*--------------------------------------------------------------------*/
+/* dt_bench.c                                                         */
+/*--------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include "dt.h"
+#include "bench.h"
+
+/* Runs the benchmark workloads named on the command line on the DT. */
+int main(int argc, char *argv[]) {
+   static const struct Bench_Ops sOps = {
+      "DT", DT_init, DT_destroy, DT_insert, NULL, DT_contains, DT_rm, 0
+   };
+
+   return Bench_main(argc, argv, &sOps);
+}
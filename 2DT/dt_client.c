@@ -9,12 +9,19 @@
 #include <stdio.h>
 #include <string.h>
 #include "dt.h"
+#include "checkerDT.h"
+#include "nodeDT.h"
+#include "path.h"
 
 /* Tests the DT implementation with an assortment of checks.
    Prints the status of the data structure along the way to stderr.
    Returns 0. */
 int main(void) {
   char* temp;
+  Path_T oPPath;
+  Node_T oNRoot;
+  Node_T oNChild;
+  Node_T oNStray;
 
   /* Before the data structure is initialized:
      * insert, rm, and destroy should each return INITIALIZATION_ERROR
@@ -165,5 +172,42 @@ int main(void) {
   assert(DT_contains("a") == FALSE);
   assert((temp = DT_toString()) == NULL);
 
+  /* the checker accepts a valid hierarchy and explains what is wrong
+     with an invalid one; checking just the node a change touched
+     misses damage elsewhere, unless a sampled full check comes due */
+  assert(Path_new("1a", &oPPath) == SUCCESS);
+  assert(Node_new(oPPath, NULL, &oNRoot) == SUCCESS);
+  Path_free(oPPath);
+  assert(Path_new("1a/2b", &oPPath) == SUCCESS);
+  assert(Node_new(oPPath, oNRoot, &oNChild) == SUCCESS);
+  Path_free(oPPath);
+  assert(Path_new("1z", &oPPath) == SUCCESS);
+  assert(Node_new(oPPath, NULL, &oNStray) == SUCCESS);
+  Path_free(oPPath);
+  assert(CheckerDT_isValid(TRUE, oNRoot, 2) == TRUE);
+  assert(CheckerDT_isValid(FALSE, NULL, 0) == TRUE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 2, oNChild) == TRUE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 2, oNRoot) == TRUE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 2, NULL) == TRUE);
+  assert(CheckerDT_isValid(TRUE, oNRoot, 3) == FALSE);
+  assert(CheckerDT_isValid(FALSE, oNRoot, 2) == FALSE);
+  assert(CheckerDT_isValid(TRUE, NULL, 2) == FALSE);
+  assert(CheckerDT_isValidAfter(FALSE, oNRoot, 2, oNChild) == FALSE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 1, oNChild) == FALSE);
+  assert(CheckerDT_isValidAfter(TRUE, NULL, 0, oNChild) == FALSE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 2, oNStray) == FALSE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 3, oNChild) == TRUE);
+  CheckerDT_setSampleRate(1);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 3, oNChild) == FALSE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 2, oNChild) == TRUE);
+  CheckerDT_setSampleRate(2);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 3, oNChild) == TRUE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 3, oNChild) == FALSE);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 3, oNChild) == TRUE);
+  CheckerDT_setSampleRate(0);
+  assert(CheckerDT_isValidAfter(TRUE, oNRoot, 3, oNChild) == TRUE);
+  assert(Node_free(oNRoot) == 2);
+  assert(Node_free(oNStray) == 1);
+
   return 0;
 }
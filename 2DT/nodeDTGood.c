@@ -134,8 +134,8 @@ int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult) {
    }
    psNew->oNParent = oNParent;
 
-   /* initialize the new node */
-   psNew->oDChildren = DynArray_new(0);
+   /* initialize the new node, with room for a few children inline */
+   psNew->oDChildren = DynArray_newInline(0, 4);
    if(psNew->oDChildren == NULL) {
       Path_free(psNew->oPPath);
       free(psNew);
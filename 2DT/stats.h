@@ -0,0 +1 @@
+../0shared/stats.h
\ No newline at end of file
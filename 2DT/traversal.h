@@ -0,0 +1 @@
+../0shared/traversal.h
\ No newline at end of file
@@ -0,0 +1 @@
+../0shared/arena.c
\ No newline at end of file
@@ -0,0 +1,329 @@
+/*--------------------------------------------------------------------*/
+/* checkerFT.c                                                        */
+/*--------------------------------------------------------------------*/
+
+#ifdef THREADSAFE
+/* pthread rwlocks are POSIX, not C99 */
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkerFT.h"
+#include "traversal.h"
+
+/* Every how many calls CheckerFT_isValidAfter does a full check, or 0 */
+static size_t ulSampleEvery = 0;
+
+/* Calls of CheckerFT_isValidAfter since its last full check */
+static size_t ulSinceFull = 0;
+
+/*
+  Prints pcProblem to stderr, followed by the absolute path of oNNode,
+  or just its name if there is no memory to spell out the path.
+*/
+static void CheckerFT_report(const char *pcProblem, Node_T oNNode) {
+    char *pcPath;
+
+    assert(pcProblem != NULL);
+    assert(oNNode != NULL);
+
+    pcPath = malloc(Node_getPathLength(oNNode) + 1);
+    if (pcPath == NULL) {
+        fprintf(stderr, "%s: .../%s\n", pcProblem, Node_getName(oNNode));
+        return;
+    }
+    (void) Node_writePath(oNNode, pcPath);
+    fprintf(stderr, "%s: %s\n", pcProblem, pcPath);
+    free(pcPath);
+}
+
+/* Returns TRUE if *psFirst and *psSecond are the same totals. */
+static boolean CheckerFT_sameTotals(const struct Node_Totals *psFirst,
+                                    const struct Node_Totals *psSecond) {
+    return (boolean) (psFirst->ulFiles == psSecond->ulFiles &&
+                      psFirst->ulDirs == psSecond->ulDirs &&
+                      psFirst->ulBytes == psSecond->ulBytes);
+}
+
+boolean CheckerFT_Node_isValid(Node_T oNNode) {
+    const char *pcName;
+    Node_T oNParent;
+    Node_T oNPrev = NULL;
+    struct Node_Totals sTotals;
+    struct Node_Totals sSum = {0, 0, 0};
+    size_t ulNumChildren;
+    size_t i;
+
+    if (oNNode == NULL) {
+        fprintf(stderr, "A node is a NULL pointer\n");
+        return FALSE;
+    }
+
+    pcName = Node_getName(oNNode);
+    if (pcName == NULL || *pcName == '\0' || strchr(pcName, '/') != NULL) {
+        fprintf(stderr, "A node has no name, or one with a '/' in it\n");
+        return FALSE;
+    }
+
+    oNParent = Node_getParent(oNNode);
+    if (oNParent != NULL && Node_getType(oNParent) != FT_DIR) {
+        CheckerFT_report("A file has a child", oNNode);
+        return FALSE;
+    }
+
+    if (Node_getType(oNNode) == FT_FILE) {
+        if (Node_getContents(oNNode) == NULL &&
+            Node_getContentsLength(oNNode) != 0) {
+            CheckerFT_report("A file without contents has a length", oNNode);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    if (Node_getType(oNNode) != FT_DIR) {
+        CheckerFT_report("A node is neither a file nor a directory", oNNode);
+        return FALSE;
+    }
+
+    ulNumChildren = Node_getNumChildren(oNNode);
+    for (i = 0; i < ulNumChildren; i++) {
+        Node_T oNChild = NULL;
+        Node_T oNFound = NULL;
+        struct Node_Totals sChild;
+
+        if (Node_getChild(oNNode, i, &oNChild) != SUCCESS ||
+            oNChild == NULL) {
+            CheckerFT_report("A child cannot be fetched from", oNNode);
+            return FALSE;
+        }
+
+        if (Node_getParent(oNChild) != oNNode) {
+            CheckerFT_report("A child's parent pointer is wrong", oNChild);
+            return FALSE;
+        }
+
+        /* Sorted children have any duplicates next to each other */
+        if (oNPrev != NULL && Node_compare(oNPrev, oNChild) >= 0) {
+            CheckerFT_report(Node_compare(oNPrev, oNChild) == 0 ?
+                             "Duplicate child" :
+                             "Children are not in lexicographic order at",
+                             oNChild);
+            return FALSE;
+        }
+        oNPrev = oNChild;
+
+        /* The hash index, if any, must agree with the array */
+        if (Node_getChildByName(oNNode, Node_getName(oNChild),
+                                strlen(Node_getName(oNChild)),
+                                &oNFound) != SUCCESS ||
+            oNFound != oNChild) {
+            CheckerFT_report("A child cannot be looked up by name", oNChild);
+            return FALSE;
+        }
+
+        Node_getTotals(oNChild, &sChild);
+        sSum.ulFiles += sChild.ulFiles;
+        sSum.ulDirs += sChild.ulDirs;
+        sSum.ulBytes += sChild.ulBytes;
+    }
+
+    /* The directory counts itself as well as what is below it */
+    sSum.ulDirs++;
+    Node_getTotals(oNNode, &sTotals);
+    if (!CheckerFT_sameTotals(&sTotals, &sSum)) {
+        CheckerFT_report("A directory's totals do not add up", oNNode);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Traversal functions that present a node's children */
+static size_t CheckerFT_numChildren(void *pvNode) {
+    if (Node_getType(pvNode) != FT_DIR)
+        return 0;
+    return Node_getNumChildren(pvNode);
+}
+
+static void *CheckerFT_getChild(void *pvNode, size_t ulIndex) {
+    Node_T oNChild = NULL;
+
+    /* CheckerFT_Node_isValid on the parent reports a missing child */
+    if (Node_getChild(pvNode, ulIndex, &oNChild) != SUCCESS)
+        return NULL;
+    return oNChild;
+}
+
+/*
+  Checks every node of the tree rooted at oNNode in pre-order, adding
+  what they hold to *psTotals. Returns FALSE as soon as a node is
+  invalid, or if memory for the walk runs out.
+*/
+static boolean CheckerFT_treeCheck(Node_T oNNode,
+                                   struct Node_Totals *psTotals) {
+    struct Traversal sWalk;
+    void *pvNode;
+    boolean bValid = TRUE;
+
+    assert(psTotals != NULL);
+
+    /* An explicit stack, so that deep trees cannot overflow the call stack */
+    Traversal_init(&sWalk, oNNode, TRAVERSAL_PREORDER,
+                   CheckerFT_numChildren, CheckerFT_getChild);
+    for (;;) {
+        if (Traversal_next(&sWalk, &pvNode) != SUCCESS) {
+            fprintf(stderr, "Out of memory in traversal\n");
+            bValid = FALSE;
+            break;
+        }
+        if (pvNode == NULL)
+            break;
+
+        /* A node's children are only reached after it has been checked */
+        if (!CheckerFT_Node_isValid(pvNode)) {
+            bValid = FALSE;
+            break;
+        }
+
+        if (Node_getType(pvNode) == FT_FILE) {
+            psTotals->ulFiles++;
+            psTotals->ulBytes += Node_getContentsLength(pvNode);
+        }
+        else
+            psTotals->ulDirs++;
+    }
+    Traversal_free(&sWalk);
+    return bValid;
+}
+
+/*
+  Checks what can be checked of the hierarchy without looking below its
+  root. Sets *pbDone to TRUE if there is nothing further to check.
+*/
+static boolean CheckerFT_rootCheck(boolean bIsInitialized, Node_T oNRoot,
+                                   boolean *pbDone) {
+    assert(pbDone != NULL);
+
+    *pbDone = (boolean) (!bIsInitialized || oNRoot == NULL);
+    if (!bIsInitialized && oNRoot != NULL) {
+        fprintf(stderr, "Not initialized, but root is not NULL\n");
+        return FALSE;
+    }
+    if (oNRoot == NULL)
+        return TRUE;
+
+    if (Node_getParent(oNRoot) != NULL) {
+        CheckerFT_report("The root has a parent", oNRoot);
+        return FALSE;
+    }
+    if (Node_getType(oNRoot) != FT_DIR) {
+        CheckerFT_report("The root is not a directory", oNRoot);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+boolean CheckerFT_isValid(boolean bIsInitialized, Node_T oNRoot) {
+    struct Node_Totals sTotals;
+    struct Node_Totals sCounted = {0, 0, 0};
+    boolean bDone;
+
+    if (!CheckerFT_rootCheck(bIsInitialized, oNRoot, &bDone))
+        return FALSE;
+    if (bDone)
+        return TRUE;
+
+    if (!CheckerFT_treeCheck(oNRoot, &sCounted))
+        return FALSE;
+
+    Node_getTotals(oNRoot, &sTotals);
+    if (!CheckerFT_sameTotals(&sTotals, &sCounted)) {
+        fprintf(stderr, "Root totals mismatch: expected %lu files, %lu "
+                "directories, %lu bytes, counted %lu, %lu, %lu\n",
+                (unsigned long) sTotals.ulFiles,
+                (unsigned long) sTotals.ulDirs,
+                (unsigned long) sTotals.ulBytes,
+                (unsigned long) sCounted.ulFiles,
+                (unsigned long) sCounted.ulDirs,
+                (unsigned long) sCounted.ulBytes);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void CheckerFT_setSampleRate(size_t ulEvery) {
+    ulSampleEvery = ulEvery;
+    ulSinceFull = 0;
+}
+
+/*
+  Checks that each ancestor of oNNode has it among its children, where
+  a lookup of its name would find it, and totals at least as large as
+  its, and that the topmost ancestor is oNRoot.
+*/
+static boolean CheckerFT_chainCheck(Node_T oNRoot, Node_T oNNode) {
+    Node_T oNParent;
+
+    while ((oNParent = Node_getParent(oNNode)) != NULL) {
+        Node_T oNFound = NULL;
+        struct Node_Totals sNode;
+        struct Node_Totals sParent;
+
+        /* oNParent's other children are as they were before the change,
+           so only oNNode's place among them needs checking */
+        if (Node_getChildByName(oNParent, Node_getName(oNNode),
+                                strlen(Node_getName(oNNode)),
+                                &oNFound) != SUCCESS ||
+            oNFound != oNNode) {
+            CheckerFT_report("A node is not among its parent's children",
+                             oNNode);
+            return FALSE;
+        }
+
+        Node_getTotals(oNNode, &sNode);
+        Node_getTotals(oNParent, &sParent);
+        if (sParent.ulFiles < sNode.ulFiles ||
+            sParent.ulDirs <= sNode.ulDirs ||
+            sParent.ulBytes < sNode.ulBytes) {
+            CheckerFT_report("A directory's totals are less than its child's",
+                             oNParent);
+            return FALSE;
+        }
+        oNNode = oNParent;
+    }
+
+    if (oNNode != oNRoot) {
+        CheckerFT_report("A node's ancestors do not lead to the root",
+                         oNNode);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+boolean CheckerFT_isValidAfter(boolean bIsInitialized, Node_T oNRoot,
+                               Node_T oNTouched) {
+    boolean bDone;
+
+    if (ulSampleEvery != 0 && ++ulSinceFull >= ulSampleEvery) {
+        ulSinceFull = 0;
+        return CheckerFT_isValid(bIsInitialized, oNRoot);
+    }
+
+    if (!CheckerFT_rootCheck(bIsInitialized, oNRoot, &bDone))
+        return FALSE;
+    if (oNTouched == NULL)
+        return TRUE;
+
+    if (bDone) {
+        CheckerFT_report("A node was touched, but there is no root",
+                         oNTouched);
+        return FALSE;
+    }
+
+    return (boolean) (CheckerFT_Node_isValid(oNTouched) &&
+                      CheckerFT_chainCheck(oNRoot, oNTouched));
+}
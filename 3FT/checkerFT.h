@@ -0,0 +1,57 @@
+/*--------------------------------------------------------------------*/
+/* checkerFT.h                                                        */
+/*--------------------------------------------------------------------*/
+
+#ifndef CHECKERFT_INCLUDED
+#define CHECKERFT_INCLUDED
+
+#include "nodeFT.h"
+
+/*
+  The FT's counterpart of the DT's checker: checks a File Tree's nodes
+  against the invariants that the FT keeps, printing an explanation to
+  stderr for the first one found broken. Nobody may change the tree
+  while a check runs.
+*/
+
+/*
+  Returns TRUE if oNNode is in a valid state: it is named, its parent
+  (if any) is a directory, and, if it is a directory, its children are
+  sorted by name without duplicates, each has it as its parent and can
+  be looked up by name, and its totals add up to theirs. Returns
+  FALSE otherwise. Takes time linear in oNNode's number of children.
+*/
+boolean CheckerFT_Node_isValid(Node_T oNNode);
+
+/*
+  Returns TRUE if the hierarchy rooted at oNRoot (NULL if empty) is in
+  a valid state, or FALSE otherwise: every node of it is valid, and
+  the root is a directory without a parent, whose totals account for
+  every node. An FT that is not initialized (bIsInitialized is FALSE)
+  must have no root.
+*/
+boolean CheckerFT_isValid(boolean bIsInitialized, Node_T oNRoot);
+
+/*
+  Like CheckerFT_isValid, but for a hierarchy that was valid before an
+  operation that changed it only at oNTouched: the directory that lost
+  a child, the file whose contents changed, or the deepest of the
+  nodes just inserted. Checks oNTouched as CheckerFT_Node_isValid does,
+  and each of its ancestors only for having the node below it as a
+  child and totals at least as large as that child's, which takes
+  O(depth) time rather than time linear in the hierarchy. oNTouched
+  may be NULL if no node was touched, or if the root itself was
+  removed. Every ulEvery'th call (see CheckerFT_setSampleRate) does
+  the full check instead, so that damage elsewhere is still found.
+*/
+boolean CheckerFT_isValidAfter(boolean bIsInitialized, Node_T oNRoot,
+                               Node_T oNTouched);
+
+/*
+  Makes every ulEvery'th call to CheckerFT_isValidAfter a full
+  CheckerFT_isValid. 0, the default, makes none of them one; 1 makes
+  them all one.
+*/
+void CheckerFT_setSampleRate(size_t ulEvery);
+
+#endif
@@ -1,5 +1,5 @@
 /*--------------------------------------------------------------------*/
-/* ft.h                                                               */
+/* ft.c                                                               */
 /* Author:                                                            */
 /*--------------------------------------------------------------------*/
 
@@ -9,1238 +9,5897 @@
   may be internal nodes or leaves, and files are always leaves.
 */
 
+/* mmap and friends are POSIX, not C99 */
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef THREADSAFE
+#include <pthread.h>
+#endif
 #include "a4def.h"
 #include "path.h"
+#include "pathcursor.h"
+#include "atom.h"
+#include "arena.h"
+#include "traversal.h"
+#include "epoch.h"
+#include "stats.h"
 #include "dynarray.h"
+#include "journal.h"
 #include "nodeFT.h"
+#include "checkerFT.h"
 #include "ft.h"
 #include <string.h>
 
-/* Forward declaration since path.h doesn't expose it */
-int Path_comparePath(Path_T oPPath1, Path_T oPPath2);
+#if defined(RCU) && !defined(THREADSAFE)
+#error "RCU builds on THREADSAFE"
+#endif
+
+#if defined(CHECKER) && defined(THREADSAFE)
+#error "CHECKER needs a single-threaded FT; call FT_check from a thread instead"
+#endif
+
+/* An arena, and the image it was loaded from, that snapshots share */
+struct FT_Generation {
+    Arena_T oArena;          /* The arena, once the tree has moved on from it */
+    void *pvImage;           /* Its image, likewise, or NULL */
+    size_t ulImageSize;      /* Number of bytes mapped at pvImage */
+    size_t ulSnapshots;      /* Number of snapshots still using it */
+};
+
+/* One node of a frozen tree, as laid out by FT_freezeIn */
+struct FT_FrozenNode {
+    Node_T oNNode;           /* The node itself */
+    size_t ulFirstChild;     /* Index of its first child; the rest follow it */
+    size_t ulNumChildren;    /* Number of children (0 for a file) */
+    NodeType eType;          /* FT_DIR or FT_FILE */
+};
 
-static boolean bIsInitialized = FALSE;   /* Indicates if FT is initialized */
-static Node_T oRoot = NULL;              /* The root node of the File Tree */
+/*
+  A read-only copy of a tree's shape, in breadth-first order, so that
+  the children of each directory are adjacent. The arrays are
+  parallel, and are allocated in one block along with the header.
+*/
+struct FT_Frozen {
+    size_t ulCount;          /* Number of nodes */
+    uint64_t *pulKeys;       /* The first bytes of each node's name (see FT_frozenKey) */
+    struct FT_FrozenNode *psNodes;  /* Each node's place in the tree */
+    const char **ppcNames;   /* Each node's name (see Node_getName) */
+};
+
+/* One slot of a lookup cache */
+struct FT_CacheEntry {
+    size_t ulHash;           /* Atom_hashString of the path */
+    size_t ulGeneration;     /* The cache's generation when the path was looked up */
+    Node_T oNNode;           /* The node it led to, or NULL if the slot is empty */
+};
+
+/* A lookup cache (see FT_setCacheSizeIn), for FT_findNode */
+struct FT_Cache {
+    struct FT_CacheEntry *psEntries;  /* ulSlots entries, or NULL */
+    size_t ulSlots;          /* A power of 2, or 0 if there is no cache */
+    size_t ulGeneration;     /* Bumped before any node is unlinked or replaced */
+    Node_T oNLastParent;     /* The parent of the node last looked up, or NULL */
+    size_t ulParentGeneration;  /* The generation when it was */
+#ifdef THREADSAFE
+    pthread_mutex_t sMutex;  /* Guards all of the above but ulSlots, which the tree lock does */
+#endif
+};
+
+#ifdef STATS
+/* The counts that FT_getStatsIn reports for one FT */
+struct FT_Counters {
+    size_t aulOps[FT_NUM_OPS][FT_NUM_STATUSES];  /* As in struct FT_Stats */
+    size_t ulLookups;        /* Number of path walks */
+    size_t ulNodesVisited;   /* Number of nodes those walks visited */
+    size_t ulCacheHits;      /* Lookups the cache answered from an entry */
+    size_t ulCacheParentHits;  /* Lookups it answered from the last parent */
+    size_t ulCacheMisses;    /* Lookups it could not answer */
+    size_t ulNodes;          /* Number of nodes in the tree */
+    size_t ulMaxDepth;       /* Depth of the deepest node ever inserted */
+    size_t ulMaxFanOut;      /* Most children any directory has had */
+};
+#endif
+
+/* A client's watch on a directory (see FT_watchIn) */
+struct FT_Watch {
+    FT_T oFT;                /* The FT it watches */
+    Node_T oNDir;            /* The directory, or NULL once it has been removed */
+    boolean bRecursive;      /* Whether changes below the directory's children count */
+    void (*pfNotify)(const struct FT_Event *psEvents, size_t ulCount,
+                     void *pvExtra);  /* Told of the changes */
+    void *pvExtra;           /* Passed on to pfNotify */
+    struct FT_Watch *psNextOnDir;  /* The next watch on oNDir (see Node_getWatch) */
+    struct FT_Watch *psNext; /* The next of oFT's watches */
+    size_t ulRefs;           /* One until FT_unwatch, and one per queued event */
+    size_t ulLost;           /* Events dropped since the last batch delivered */
+    boolean bEnded;          /* Set by FT_unwatch, under sWatchMutex */
+};
+
+/* The state of one File Tree */
+struct FT {
+    Node_T oRoot;            /* The root node, or NULL if the FT is empty */
+    Arena_T oArena;          /* Source of all of the tree's memory */
+    void *pvImage;           /* Image mapped by FT_loadMappedIn, or NULL */
+    size_t ulImageSize;      /* Number of bytes mapped at pvImage */
+    struct FT_Generation *psShared;  /* oArena's, while snapshots share nodes, or NULL */
+    struct FT_Frozen *psFrozen;  /* Laid out by FT_freezeIn until the next change, or NULL */
+    struct FT_Cache sCache;  /* Its lookup cache, if it has one */
+    Journal_T oJournal;      /* Where changes are logged (see FT_journalOpenIn), or NULL */
+    int iJournalError;       /* First change oJournal could not keep, SUCCESS if none */
+    boolean bDedup;          /* Whether copied contents are shared (see FT_setDedupIn) */
+    struct FT_Watch *psWatches;  /* Every watch on the FT, even those whose directory is gone */
+#ifdef THREADSAFE
+    pthread_rwlock_t sTreeLock;  /* Shared by path operations, exclusive otherwise */
+    pthread_rwlock_t sRootLock;  /* Guards oRoot as a directory's lock guards its children */
+#endif
+#ifdef STATS
+    struct FT_Counters sCounters;  /* See FT_getStatsIn */
+#endif
+};
+
+static boolean bIsInitialized = FALSE;   /* Indicates if sGlobal is initialized */
+static struct FT sGlobal;                /* The FT behind the global API */
 
 /*
-   Inserts a new directory into the FT with absolute path pcPath.
-   Returns SUCCESS if the new directory is inserted successfully.
-   Otherwise, returns:
-   * INITIALIZATION_ERROR if the FT is not in an initialized state
-   * BAD_PATH if pcPath does not represent a well-formatted path
-   * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
-   * NOT_A_DIRECTORY if a proper prefix of pcPath exists as a file
-   * ALREADY_IN_TREE if pcPath is already in the FT (as dir or file)
-   * MEMORY_ERROR if memory could not be allocated to complete request
+  Unmaps the image that the tree was loaded from, if any. Called
+  whenever the tree's arena goes, since file contents may point into
+  the image until then.
 */
-int FT_insertDir(const char *pcPath) {
-    Path_T oNewPath;
-    Node_T oCurr = NULL;
-    Node_T oNext = NULL;
-    size_t depth;
-    int result;
-    size_t i;
-    size_t j;
+static void FT_releaseImage(FT_T oFT) {
+    if (oFT->pvImage != NULL)
+        (void) munmap(oFT->pvImage, oFT->ulImageSize);
+    oFT->pvImage = NULL;
+    oFT->ulImageSize = 0;
+}
 
-    /* ------------------ STEP 1: Error Checking ------------------ */
+/* --------------------------------------------------------------------
+
+  Watches. A watch (see FT_watchIn) hangs off the directory it
+  watches, so a change finds the watches that see it by walking up
+  from the parent of what it changed, testing one pointer on each
+  ancestor, and an FT without watches does not walk at all. Events go
+  into a ring of FT_WATCH_SLOTS slots that the process's FTs share,
+  which writers claim with a compare-and-swap and take no lock for:
+  each slot carries the turn at which it is next written or read, so
+  that a writer never waits for another, only for the slot it got.
+  The notifier takes events out and delivers them in batches: in a
+  THREADSAFE build, it is a thread of the process's own, like the
+  reclaimer, which a writer wakes only if it has gone to sleep; in any
+  other, it is the call that made the change, as it leaves the FT.
+
+  An event holds a reference to its watch, so that the ring never
+  names one that has been freed. sWatchLinkMutex guards the watches'
+  links where the tree lock does not, and sWatchMutex what the
+  notifier shares with FT_unwatch and FT_watchFlush; a writer may take
+  the second while holding the first.
+*/
 
-    /* If FT is not initialized, return error */
-    if (!bIsInitialized)
-        return INITIALIZATION_ERROR;
+/* The number of events the ring holds, and the most delivered at once */
+enum { FT_WATCH_SLOTS = 4096, FT_WATCH_BATCH = 64 };
+
+/* One slot of the ring */
+struct FT_WatchSlot {
+    size_t ulTurn;           /* 2t while free for lap t's event, 2t+1 once that is in */
+    struct FT_Watch *psWatch;  /* The watch the event is for */
+    struct FT_Event sEvent;  /* The event; its paths are one malloc'd block */
+};
+
+static struct FT_WatchSlot asWatchRing[FT_WATCH_SLOTS];
+static size_t ulWatchHead = 0;          /* Slots ever claimed by writers */
+static size_t ulWatchTail = 0;          /* Slots ever emptied by the notifier */
+static boolean bWatchTaking = FALSE;    /* TRUE while events taken out are undelivered */
+static struct FT_Watch *psWatchBusy = NULL;  /* The watch whose pfNotify is running */
+#ifdef THREADSAFE
+static pthread_mutex_t sWatchLinkMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sWatchMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sWatchWork = PTHREAD_COND_INITIALIZER;  /* Something is queued */
+static pthread_cond_t sWatchIdle = PTHREAD_COND_INITIALIZER;  /* A pfNotify or batch is done */
+static pthread_t sWatchThread;          /* The notifier, once it is running */
+static boolean bWatchStarted = FALSE;   /* TRUE once it is */
+static boolean bWatchAsleep = FALSE;    /* TRUE while it waits for sWatchWork */
+#endif
+
+static void FT_watchLock(void) {
+#ifdef THREADSAFE
+    (void) pthread_mutex_lock(&sWatchMutex);
+#endif
+}
 
-    /* Attempt to create a Path_T object from the string */
-    oNewPath = Path_create(pcPath);
-    if (oNewPath == NULL)
-        return BAD_PATH;
+static void FT_watchUnlock(void) {
+#ifdef THREADSAFE
+    (void) pthread_mutex_unlock(&sWatchMutex);
+#endif
+}
 
-    /* Get the depth of the new path (how many components like a/b/c = 3) */
-    depth = Path_getDepth(oNewPath);
+static void FT_watchLinkLock(void) {
+#ifdef THREADSAFE
+    (void) pthread_mutex_lock(&sWatchLinkMutex);
+#endif
+}
 
-    /* Special case: empty path */
-    if (depth == 0) {
-        Path_free(oNewPath);
-        return BAD_PATH;
-    }
+static void FT_watchLinkUnlock(void) {
+#ifdef THREADSAFE
+    (void) pthread_mutex_unlock(&sWatchLinkMutex);
+#endif
+}
 
-    /* ------------------ STEP 2: Handle empty tree (root creation) ------------------ */
+/* Lets go of a reference to psWatch, freeing it with the last one. */
+static void FT_watchDrop(struct FT_Watch *psWatch) {
+    if (__atomic_sub_fetch(&psWatch->ulRefs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(psWatch);
+}
 
-    if (oRoot == NULL) {
-        /* If this is the very first insertion, path must be depth 1 */
-        if (depth != 1) {
-            Path_free(oNewPath);
-            return CONFLICTING_PATH;
+/*
+  Puts the event *psEvent for psWatch into the ring. Returns FALSE if
+  the ring is full.
+*/
+static boolean FT_watchPut(struct FT_Watch *psWatch,
+                           const struct FT_Event *psEvent) {
+    size_t ulHead = __atomic_load_n(&ulWatchHead, __ATOMIC_RELAXED);
+
+    for (;;) {
+        struct FT_WatchSlot *psSlot = &asWatchRing[ulHead % FT_WATCH_SLOTS];
+        size_t ulTurn = 2 * (ulHead / FT_WATCH_SLOTS);
+
+        if (__atomic_load_n(&psSlot->ulTurn, __ATOMIC_ACQUIRE) == ulTurn) {
+            /* A failed claim reloads ulHead */
+            if (__atomic_compare_exchange_n(&ulWatchHead, &ulHead, ulHead + 1,
+                                            TRUE, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                psSlot->psWatch = psWatch;
+                psSlot->sEvent = *psEvent;
+                __atomic_store_n(&psSlot->ulTurn, ulTurn + 1,
+                                 __ATOMIC_RELEASE);
+                return TRUE;
+            }
         }
-
-        /* Create the root node (parent is NULL, type is directory) */
-        result = Node_new(oNewPath, NULL, FT_DIR, &oRoot);
-        Path_free(oNewPath);
-
-        if (result != SUCCESS) {
-            return result;
+        else {
+            /* The slot still holds the last lap's event, unless someone
+               has claimed it meanwhile */
+            size_t ulSeen = ulHead;
+
+            ulHead = __atomic_load_n(&ulWatchHead, __ATOMIC_RELAXED);
+            if (ulHead == ulSeen)
+                return FALSE;
         }
-
-        return SUCCESS;
     }
+}
 
-    /* ------------------ STEP 3: Traverse the path one level at a time ------------------ */
+/* Returns TRUE if the notifier's next slot holds an event. */
+static boolean FT_watchPending(void) {
+    size_t ulTail = __atomic_load_n(&ulWatchTail, __ATOMIC_RELAXED);
 
-    oCurr = oRoot;
+    return (boolean) (__atomic_load_n(&asWatchRing[ulTail %
+                                                   FT_WATCH_SLOTS].ulTurn,
+                                      __ATOMIC_ACQUIRE) ==
+                      2 * (ulTail / FT_WATCH_SLOTS) + 1);
+}
 
-    /* Loop through each prefix of the path EXCEPT the last one */
-    for (i = 1; i < depth; i++) {
-        int prefixStatus;
-        Path_T oPrefix = NULL;
-        prefixStatus = Path_prefix(oNewPath, i, &oPrefix);
-        if (prefixStatus != SUCCESS) {
-            Path_free(oNewPath);
-            return MEMORY_ERROR;
-        }
+/*
+  Takes the next event out of the ring into *psSlot, for the notifier.
+  Returns FALSE if there is none.
+*/
+static boolean FT_watchTake(struct FT_WatchSlot *psSlot) {
+    size_t ulTail = ulWatchTail;
+    struct FT_WatchSlot *psNext = &asWatchRing[ulTail % FT_WATCH_SLOTS];
 
-        /* Ensure we successfully created the prefix */
-        if (oPrefix == NULL) {
-            Path_free(oNewPath);
-            return MEMORY_ERROR;
-        }
+    if (!FT_watchPending())
+        return FALSE;
+    *psSlot = *psNext;
+    __atomic_store_n(&psNext->ulTurn, 2 * (ulTail / FT_WATCH_SLOTS) + 2,
+                     __ATOMIC_RELEASE);
+    __atomic_store_n(&ulWatchTail, ulTail + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
 
-        /* Check if current node has a child with this path */
-        size_t numChildren = Node_getNumChildren(oCurr);
-        boolean found = FALSE;
+/*
+  Queues a copy of *psEvent for psWatch, or counts it as lost if there
+  is no room or no memory for it, and wakes the notifier if it sleeps.
+*/
+static void FT_watchPost(struct FT_Watch *psWatch,
+                         const struct FT_Event *psEvent) {
+    struct FT_Event sEvent = *psEvent;
+    size_t ulLength = strlen(psEvent->pcPath) + 1;
+    size_t ulNewLength = 0;
+    char *pcPaths;
+
+    if (psEvent->pcNewPath != NULL)
+        ulNewLength = strlen(psEvent->pcNewPath) + 1;
+    pcPaths = malloc(ulLength + ulNewLength);
+    if (pcPaths == NULL) {
+        (void) __atomic_add_fetch(&psWatch->ulLost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    memcpy(pcPaths, psEvent->pcPath, ulLength);
+    sEvent.pcPath = pcPaths;
+    if (psEvent->pcNewPath != NULL) {
+        memcpy(pcPaths + ulLength, psEvent->pcNewPath, ulNewLength);
+        sEvent.pcNewPath = pcPaths + ulLength;
+    }
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                found = TRUE;
-                break;
-            }
-        }
+    /* The watch cannot go meanwhile: FT_unwatch waits for the tree */
+    (void) __atomic_add_fetch(&psWatch->ulRefs, 1, __ATOMIC_RELAXED);
+    if (!FT_watchPut(psWatch, &sEvent)) {
+        (void) __atomic_sub_fetch(&psWatch->ulRefs, 1, __ATOMIC_RELAXED);
+        (void) __atomic_add_fetch(&psWatch->ulLost, 1, __ATOMIC_RELAXED);
+        free(pcPaths);
+        return;
+    }
 
-        Path_free(oPrefix);
+#ifdef THREADSAFE
+    /* Either this sees the notifier asleep, or it sees the event before
+       it sleeps (see FT_watchMain) */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&bWatchAsleep, __ATOMIC_RELAXED)) {
+        (void) pthread_mutex_lock(&sWatchMutex);
+        (void) pthread_cond_signal(&sWatchWork);
+        (void) pthread_mutex_unlock(&sWatchMutex);
+    }
+#endif
+}
 
-        if (!found) {
-            /* No such prefix found → missing intermediate directory */
-            Path_free(oNewPath);
-            return NO_SUCH_PATH;
-        }
+/*
+  Takes up to FT_WATCH_BATCH events out of the ring and delivers them,
+  each run of them for one watch in one call of its pfNotify, unless
+  it has been stopped. A watch that has lost events hears first how
+  many. Returns FALSE if there was nothing to deliver, or if this is a
+  pfNotify's own change, which the delivery under way then picks up.
+*/
+static boolean FT_watchDeliver(void) {
+    struct FT_WatchSlot asTaken[FT_WATCH_BATCH];
+    struct FT_Event asEvents[FT_WATCH_BATCH + 1];
+    size_t ulTaken = 0;
+    size_t i;
+    size_t j;
 
-        /* Make sure this prefix is a directory */
-        if (Node_getType(oNext) != FT_DIR) {
-            Path_free(oNewPath);
-            return NOT_A_DIRECTORY;
+    FT_watchLock();
+    if (bWatchTaking) {
+        FT_watchUnlock();
+        return FALSE;
+    }
+    bWatchTaking = TRUE;
+    FT_watchUnlock();
+
+    while (ulTaken < FT_WATCH_BATCH && FT_watchTake(&asTaken[ulTaken]))
+        ulTaken++;
+
+    for (i = 0; i < ulTaken; i = j) {
+        struct FT_Watch *psWatch = asTaken[i].psWatch;
+        size_t ulCount = 0;
+        size_t ulLost;
+
+        ulLost = __atomic_exchange_n(&psWatch->ulLost, 0, __ATOMIC_RELAXED);
+        if (ulLost > 0) {
+            asEvents[0].eOp = FT_NUM_OPS;
+            asEvents[0].pcPath = NULL;
+            asEvents[0].pcNewPath = NULL;
+            asEvents[0].ulSize = ulLost;
+            ulCount = 1;
+        }
+        for (j = i; j < ulTaken && asTaken[j].psWatch == psWatch; j++)
+            asEvents[ulCount++] = asTaken[j].sEvent;
+
+        FT_watchLock();
+        if (!psWatch->bEnded)
+            psWatchBusy = psWatch;
+        FT_watchUnlock();
+
+        if (psWatchBusy == psWatch) {
+            (*psWatch->pfNotify)(asEvents, ulCount, psWatch->pvExtra);
+            FT_watchLock();
+            psWatchBusy = NULL;
+#ifdef THREADSAFE
+            (void) pthread_cond_broadcast(&sWatchIdle);
+#endif
+            FT_watchUnlock();
         }
 
-        /* Move to next node down */
-        oCurr = oNext;
+        for (; i < j; i++) {
+            free((void *) asTaken[i].sEvent.pcPath);
+            FT_watchDrop(psWatch);
+        }
     }
 
-    /* ------------------ STEP 4: Check for conflicts at final level ------------------ */
+    FT_watchLock();
+    bWatchTaking = FALSE;
+#ifdef THREADSAFE
+    (void) pthread_cond_broadcast(&sWatchIdle);
+#endif
+    FT_watchUnlock();
+    return (boolean) (ulTaken > 0);
+}
 
-    /* Check if the current node already has a child at the final component */
-    size_t numChildren = Node_getNumChildren(oCurr);
-    for (j = 0; j < numChildren; j++) {
-        Node_T child;
-        if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-            Path_comparePath(Node_getPath(child), oNewPath) == 0) {
-            Path_free(oNewPath);
-            return ALREADY_IN_TREE;
-        }
+#ifdef THREADSAFE
+/* The notifier's thread function, which never returns. */
+static void *FT_watchMain(void *pvUnused) {
+    (void) pvUnused;
+
+    for (;;) {
+        if (FT_watchDeliver())
+            continue;
+
+        (void) pthread_mutex_lock(&sWatchMutex);
+        __atomic_store_n(&bWatchAsleep, TRUE, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!FT_watchPending())
+            (void) pthread_cond_wait(&sWatchWork, &sWatchMutex);
+        __atomic_store_n(&bWatchAsleep, FALSE, __ATOMIC_RELAXED);
+        (void) pthread_mutex_unlock(&sWatchMutex);
     }
+    return NULL;
+}
+#endif
+
+/* Starts the notifier if it is not running. Returns TRUE if it is. */
+static boolean FT_watchStart(void) {
+#ifdef THREADSAFE
+    pthread_attr_t sAttr;
+    boolean bStarted;
+
+    (void) pthread_mutex_lock(&sWatchMutex);
+    if (!bWatchStarted && pthread_attr_init(&sAttr) == 0) {
+        (void) pthread_attr_setdetachstate(&sAttr, PTHREAD_CREATE_DETACHED);
+        bWatchStarted = (boolean) (pthread_create(&sWatchThread, &sAttr,
+                                                  FT_watchMain, NULL) == 0);
+        (void) pthread_attr_destroy(&sAttr);
+    }
+    bStarted = bWatchStarted;
+    (void) pthread_mutex_unlock(&sWatchMutex);
+    return bStarted;
+#else
+    return TRUE;
+#endif
+}
 
-    /* ------------------ STEP 5: Create the new directory node ------------------ */
-
-    Node_T oNewNode;
-    result = Node_new(oNewPath, oCurr, FT_DIR, &oNewNode);
+/*
+  Delivers everything queued so far: waits for the notifier to, in a
+  THREADSAFE build, and in any other, delivers it here.
+*/
+static void FT_watchDeliverAll(void) {
+#ifdef THREADSAFE
+    size_t ulQueued = __atomic_load_n(&ulWatchHead, __ATOMIC_RELAXED);
+
+    (void) pthread_mutex_lock(&sWatchMutex);
+    while (bWatchStarted &&
+           (__atomic_load_n(&ulWatchTail, __ATOMIC_ACQUIRE) < ulQueued ||
+            bWatchTaking))
+        (void) pthread_cond_wait(&sWatchIdle, &sWatchMutex);
+    (void) pthread_mutex_unlock(&sWatchMutex);
+#else
+    while (FT_watchDeliver())
+        ;
+#endif
+}
 
-    Path_free(oNewPath);
+/*
+  Stops psWatch, which nothing links to any more, once its pfNotify
+  has returned (unless this is the notifier, calling from there), and
+  lets go of it.
+*/
+static void FT_watchEnd(struct FT_Watch *psWatch) {
+    FT_watchLock();
+    psWatch->bEnded = TRUE;
+#ifdef THREADSAFE
+    while (psWatchBusy == psWatch &&
+           !pthread_equal(pthread_self(), sWatchThread))
+        (void) pthread_cond_wait(&sWatchIdle, &sWatchMutex);
+#endif
+    FT_watchUnlock();
+    FT_watchDrop(psWatch);
+}
 
-    if (result != SUCCESS) {
-        return result;
+/*
+  Returns TRUE if psWatch sees a change to a child of directory
+  oNParent: if it is on oNParent, or recursive and on a directory
+  above it.
+*/
+static boolean FT_watchSees(const struct FT_Watch *psWatch,
+                            Node_T oNParent) {
+    boolean bDirect = TRUE;
+
+    for (; oNParent != NULL; oNParent = Node_getParent(oNParent)) {
+        if (oNParent == psWatch->oNDir)
+            return (boolean) (bDirect || psWatch->bRecursive);
+        bDirect = FALSE;
     }
+    return FALSE;
+}
 
-    /* Add new node to current node’s children */
-    if (Node_addChild(oCurr, oNewNode) != SUCCESS) {
-        Node_free(oNewNode);
-        return MEMORY_ERROR;
+/*
+  Posts *psEvent, a change to a child of directory oNParent, to every
+  watch that sees it, except those that see a change to a child of
+  oNSeen, if that is not NULL (they have been told already). For an
+  insertion, the child is the first directory it added, or the new
+  node itself. The caller holds the lock that guards oNParent's
+  children, for writing, so nothing above can go meanwhile.
+*/
+static void FT_watchNotify(FT_T oFT, Node_T oNParent,
+                           const struct FT_Event *psEvent, Node_T oNSeen) {
+    boolean bDirect = TRUE;
+    Node_T oNDir;
+
+    if (oFT->psWatches == NULL)
+        return;
+
+    for (oNDir = oNParent; oNDir != NULL; oNDir = Node_getParent(oNDir)) {
+        struct FT_Watch *psWatch;
+
+        for (psWatch = Node_getWatch(oNDir); psWatch != NULL;
+             psWatch = psWatch->psNextOnDir)
+            if ((bDirect || psWatch->bRecursive) &&
+                (oNSeen == NULL || !FT_watchSees(psWatch, oNSeen)))
+                FT_watchPost(psWatch, psEvent);
+        bDirect = FALSE;
     }
+}
 
-    return SUCCESS;
+/* Posts the change eOp, to pcPath, as FT_watchNotify does. */
+static void FT_watchChange(FT_T oFT, Node_T oNParent, enum FT_Op eOp,
+                           const char *pcPath, size_t ulSize) {
+    struct FT_Event sEvent;
 
+    if (oFT->psWatches == NULL)
+        return;
+
+    sEvent.eOp = eOp;
+    sEvent.pcPath = pcPath;
+    sEvent.pcNewPath = NULL;
+    sEvent.ulSize = ulSize;
+    FT_watchNotify(oFT, oNParent, &sEvent, NULL);
 }
 
 /*
-  Returns TRUE if the FT contains a directory with absolute path
-  pcPath and FALSE if not or if there is an error while checking.
+  Posts *psEvent to every watch on oNTop, if it is a directory, or on
+  a directory below it. If bDetach, oNTop is being removed, and the
+  watches are left on nothing, to hear nothing more.
 */
-boolean FT_containsDir(const char *pcPath) {
-    Path_T oTargetPath;
-    Node_T oCurr;
-    Node_T oNext;
-    size_t depth;
+static void FT_watchBelow(FT_T oFT, Node_T oNTop,
+                          const struct FT_Event *psEvent, boolean bDetach) {
+    struct FT_Watch *psWatch;
+
+    if (oFT->psWatches == NULL || Node_getType(oNTop) != FT_DIR)
+        return;
+
+    /* Removals elsewhere may be detaching other watches meanwhile */
+    FT_watchLinkLock();
+    for (psWatch = oFT->psWatches; psWatch != NULL;
+         psWatch = psWatch->psNext) {
+        Node_T oNDir = psWatch->oNDir;
+
+        while (oNDir != NULL && oNDir != oNTop)
+            oNDir = Node_getParent(oNDir);
+        if (oNDir == NULL)
+            continue;
+        FT_watchPost(psWatch, psEvent);
+        if (bDetach)
+            psWatch->oNDir = NULL;
+    }
+    FT_watchLinkUnlock();
+}
 
-    size_t i, j, numChildren;
+/*
+  Points the watches on oNNode, which has just taken the place of the
+  node it was copied from, at it.
+*/
+static void FT_watchRehome(Node_T oNNode) {
+    struct FT_Watch *psWatch;
+
+    if (Node_getType(oNNode) != FT_DIR)
+        return;
+    for (psWatch = Node_getWatch(oNNode); psWatch != NULL;
+         psWatch = psWatch->psNextOnDir)
+        psWatch->oNDir = oNNode;
+}
 
-    /* ------------------ STEP 1: Basic checks ------------------ */
+/* --------------------------------------------------------------------
+
+  Locking. In a THREADSAFE build, an operation on one path holds its
+  FT's tree lock shared and walks down with lock coupling: it takes
+  each directory's lock before letting go of the one above it, so it
+  never holds more than two, and it takes a write lock only on the
+  directory it changes. The lock of a directory guards its children
+  and the fields of its file children; the FT's root lock guards oRoot
+  in the same way. Operations on the whole tree hold the tree lock
+  exclusively instead, and take no other locks. In other builds these
+  helpers do nothing.
+
+  An RCU build goes further for lookups, which take no lock at all:
+  they run inside an epoch walk (see epoch.h), writers replace what
+  they change instead of editing it in place, and everything unlinked
+  is retired rather than freed. Writers still lock as above, but walk
+  inside an epoch too, so that retiring covers them as well.
+
+  A frozen tree (see FT_freezeIn) is looked up in its frozen layout,
+  which every change first thaws, so a change to one path then takes
+  the tree lock exclusively, like one to the whole tree.
+*/
 
-    /* FT must be initialized */
-    if (!bIsInitialized)
-        return FALSE;
+/* What an operation does to the FT, which decides how FT_enter locks it */
+enum FT_Access {
+    FT_LOOKUP,               /* Reads one path */
+    FT_CHANGE,               /* Changes one path */
+    FT_SCAN,                 /* Reads all of the tree, changing none of its nodes */
+    FT_WHOLE                 /* Changes all of the tree */
+};
+
+#ifdef THREADSAFE
+typedef pthread_rwlock_t *FT_Lock;
+#else
+typedef void *FT_Lock;
+#endif
+
+/* Epoch_retire callback for a frozen layout that has been thawed. */
+static void FT_freeRetiredFrozen(void *pvFrozen) {
+    free(pvFrozen);
+}
 
-    /* Create a Path_T object from the given path string */
-    oTargetPath = Path_create(pcPath);
-    if (oTargetPath == NULL)
-        return FALSE;
+/*
+  Drops oFT's frozen layout, if any, before a change. The caller holds
+  the tree lock exclusively, but lookups in an RCU build may still be
+  reading the layout, so it is retired rather than freed.
+*/
+static void FT_thaw(FT_T oFT) {
+    struct FT_Frozen *psFrozen = oFT->psFrozen;
 
-    /* A valid directory must have depth ≥ 1 */
-    depth = Path_getDepth(oTargetPath);
-    if (depth == 0) {
-        Path_free(oTargetPath);
-        return FALSE;
-    }
+    if (psFrozen == NULL)
+        return;
+    EPOCH_PUBLISH(oFT->psFrozen, NULL);
+    (void) Epoch_retire(FT_freeRetiredFrozen, psFrozen);
+}
 
-    /* If the tree is empty, nothing can be contained */
-    if (oRoot == NULL) {
-        Path_free(oTargetPath);
+/*
+  Prepares for an operation of kind eAccess on oFT, taking its tree
+  lock: exclusively for FT_SCAN and FT_WHOLE, and for FT_CHANGE while
+  snapshots share the tree, it is frozen or it has a journal, and
+  shared otherwise
+  (except for an RCU lookup). Thaws the tree for a change. Returns
+  FALSE, holding nothing, if oFT is NULL.
+*/
+static boolean FT_enter(FT_T oFT, enum FT_Access eAccess) {
+    if (oFT == NULL)
         return FALSE;
+#ifdef RCU
+    Epoch_enter();
+    if (eAccess == FT_LOOKUP)
+        return TRUE;
+#endif
+#ifdef THREADSAFE
+    if (eAccess == FT_SCAN || eAccess == FT_WHOLE)
+        (void) pthread_rwlock_wrlock(&oFT->sTreeLock);
+    else {
+        (void) pthread_rwlock_rdlock(&oFT->sTreeLock);
+
+        /* Copying what snapshots share (see FT_unshare) takes the tree,
+           and so do thawing it and logging to its journal */
+        if (eAccess == FT_CHANGE &&
+            (oFT->psShared != NULL || oFT->psFrozen != NULL ||
+             oFT->oJournal != NULL)) {
+            (void) pthread_rwlock_unlock(&oFT->sTreeLock);
+            (void) pthread_rwlock_wrlock(&oFT->sTreeLock);
+        }
     }
+#endif
+    if (eAccess == FT_CHANGE || eAccess == FT_WHOLE)
+        FT_thaw(oFT);
+    return TRUE;
+}
 
-    /* ------------------ STEP 2: Traverse the path ------------------ */
-
-    oCurr = oRoot;
+/*
+  Ends the operation of kind eAccess that FT_enter prepared for. A
+  writer in an RCU build then frees what has been retired, if enough
+  has piled up, and one in a build without threads delivers the events
+  its change made (see FT_watchDeliver).
+*/
+static void FT_leave(FT_T oFT, enum FT_Access eAccess) {
+    assert(oFT != NULL);
+#ifdef RCU
+    if (eAccess == FT_LOOKUP) {
+        Epoch_leave();
+        return;
+    }
+#endif
+#ifdef THREADSAFE
+    (void) pthread_rwlock_unlock(&oFT->sTreeLock);
+#else
+    (void) oFT;
+    if (eAccess == FT_CHANGE || eAccess == FT_WHOLE)
+        FT_watchDeliverAll();
+#endif
+#ifdef RCU
+    Epoch_leave();
+    Epoch_poll();
+#else
+    (void) eAccess;
+#endif
+}
 
-    /* Traverse from depth 1 up to full depth */
-    for (i = 1; i <= depth; i++) {
-        int status;
-        Path_T oPrefix = NULL;
-        status = Path_prefix(oTargetPath, i, &oPrefix);
-        
-        if (status != SUCCESS) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
-        
-        if (oPrefix == NULL) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
+/* Returns the lock that guards oFT's root. */
+static FT_Lock FT_rootLock(FT_T oFT) {
+#ifdef THREADSAFE
+    return &oFT->sRootLock;
+#else
+    (void) oFT;
+    return NULL;
+#endif
+}
 
-        /* Assume not found unless we find a matching child */
-        oNext = NULL;
+/* Returns the lock that guards the children of directory oNDir. */
+static FT_Lock FT_dirLock(Node_T oNDir) {
+#ifdef THREADSAFE
+    return Node_getLock(oNDir);
+#else
+    (void) oNDir;
+    return NULL;
+#endif
+}
 
-        numChildren = Node_getNumChildren(oCurr);
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                break;
-            }
-        }
+/* Takes psLock, for writing if bWrite and for reading otherwise. */
+static void FT_lock(FT_Lock psLock, boolean bWrite) {
+#ifdef THREADSAFE
+    if (bWrite)
+        (void) pthread_rwlock_wrlock(psLock);
+    else
+        (void) pthread_rwlock_rdlock(psLock);
+#else
+    (void) psLock;
+    (void) bWrite;
+#endif
+}
 
-        Path_free(oPrefix);
+/*
+  Takes psLock as FT_lock does, but only if that needs no waiting.
+  Returns TRUE if it did, as it always does in a build without locks.
+*/
+static boolean FT_tryLock(FT_Lock psLock, boolean bWrite) {
+#ifdef THREADSAFE
+    if (bWrite)
+        return (boolean) (pthread_rwlock_trywrlock(psLock) == 0);
+    return (boolean) (pthread_rwlock_tryrdlock(psLock) == 0);
+#else
+    (void) psLock;
+    (void) bWrite;
+    return TRUE;
+#endif
+}
 
-        /* If we didn't find a match, the path doesn't exist */
-        if (oNext == NULL) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
+/*
+  Lets go of psLock. A NULL psLock is a lock never taken, because the
+  caller has the whole tree to itself.
+*/
+static void FT_unlock(FT_Lock psLock) {
+#ifdef THREADSAFE
+    if (psLock != NULL)
+        (void) pthread_rwlock_unlock(psLock);
+#else
+    (void) psLock;
+#endif
+}
 
-        /* Move one level deeper */
-        oCurr = oNext;
-    }
+/*
+  Trades a read lock on psLock for a write lock. Returns TRUE if the
+  lock was let go of in between, so that whatever it guards has to be
+  looked at again, or FALSE in a build without locks.
+*/
+static boolean FT_relock(FT_Lock psLock) {
+#ifdef THREADSAFE
+    (void) pthread_rwlock_unlock(psLock);
+    (void) pthread_rwlock_wrlock(psLock);
+    return TRUE;
+#else
+    (void) psLock;
+    return FALSE;
+#endif
+}
 
-    /* ------------------ STEP 3: Check if it's a directory ------------------ */
+/* --------------------------------------------------------------------
+
+  The lookup cache answers FT_findNode from the node that the same
+  path led to before, or, for a sibling of the node last looked up,
+  from their parent, without walking down from the root. It holds no
+  reference to what it caches. Instead, every change that unlinks or
+  replaces a node (a removal, a move, or a copy of what snapshots
+  share) first bumps the cache's generation, and nothing cached in an
+  earlier generation is used. What is cached is also checked against
+  the path itself, since different paths can share a slot.
+
+  In a THREADSAFE build the cache has a mutex of its own. A lookup
+  that the cache answers takes the lock guarding its node before it
+  lets go of the mutex, so that nothing can unlink the node in
+  between; it does so only if it need not wait, since a change holding
+  that lock may be waiting for the mutex to bump the generation.
+*/
 
-    Path_free(oTargetPath);
+/* Locks and unlocks oFT's cache. */
+static void FT_cacheLock(FT_T oFT) {
+#ifdef THREADSAFE
+    (void) pthread_mutex_lock(&oFT->sCache.sMutex);
+#else
+    (void) oFT;
+#endif
+}
 
-    /* Final node exists — is it a directory? */
-    if (Node_getType(oCurr) == FT_DIR) {
-        return TRUE;
-    } else {
-        return FALSE;
-    }
+static void FT_cacheUnlock(FT_T oFT) {
+#ifdef THREADSAFE
+    (void) pthread_mutex_unlock(&oFT->sCache.sMutex);
+#else
+    (void) oFT;
+#endif
 }
 
 /*
-  Removes the FT hierarchy (subtree) at the directory with absolute
-  path pcPath. Returns SUCCESS if found and removed.
-  Otherwise, returns:
-  * INITIALIZATION_ERROR if the FT is not in an initialized state
-  * BAD_PATH if pcPath does not represent a well-formatted path
-  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
-  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
-  * NOT_A_DIRECTORY if pcPath is in the FT as a file not a directory
-  * MEMORY_ERROR if memory could not be allocated to complete request
+  Makes everything in oFT's cache stale. Called before any node is
+  unlinked or replaced, with the tree lock held.
 */
-int FT_rmDir(const char *pcPath) {
-    Path_T oTargetPath;
-    Node_T oCurr = oRoot;
-    Node_T oParent = NULL;
-    Node_T oToRemove = NULL;
-    size_t depth, i;
-    size_t j;
-    size_t numChildren;
+static void FT_cacheInvalidate(FT_T oFT) {
+    if (EPOCH_READ(oFT->sCache.ulSlots) == 0)
+        return;
+    FT_cacheLock(oFT);
+    oFT->sCache.ulGeneration++;
+    oFT->sCache.oNLastParent = NULL;
+    FT_cacheUnlock(oFT);
+}
 
+/* --------------------------------------------------------------------
 
-    /* ------------------ STEP 1: Basic validation ------------------ */
+  Checking. A CHECKER build asserts, after each change to a tree, that
+  the nodes the change touched are still valid (see checkerFT.h), in
+  time proportional to their depth rather than to the size of the
+  tree; CheckerFT_setSampleRate makes some of the checks full ones.
+  These helpers do nothing in other builds.
+*/
 
-    if (!bIsInitialized)
-        return INITIALIZATION_ERROR;
+/* Checks oFT once a change has touched it only at oNTouched. */
+static void FT_checkAfter(FT_T oFT, Node_T oNTouched) {
+#ifdef CHECKER
+    boolean bValid = CheckerFT_isValidAfter(TRUE, oFT->oRoot, oNTouched);
+
+    assert(bValid);
+    (void) bValid;
+#else
+    (void) oFT;
+    (void) oNTouched;
+#endif
+}
 
-    oTargetPath = Path_create(pcPath);
-    if (oTargetPath == NULL)
-        return BAD_PATH;
+/* Checks all of oFT, once it has been built or loaded in one go. */
+static void FT_checkTree(FT_T oFT) {
+#ifdef CHECKER
+    boolean bValid = CheckerFT_isValid(TRUE, oFT->oRoot);
 
-    depth = Path_getDepth(oTargetPath);
-    if (depth == 0) {
-        Path_free(oTargetPath);
-        return BAD_PATH;
-    }
+    assert(bValid);
+    (void) bValid;
+#else
+    (void) oFT;
+#endif
+}
 
-    if (oRoot == NULL) {
-        Path_free(oTargetPath);
-        return NO_SUCH_PATH;
-    }
+/* --------------------------------------------------------------------
 
-    /* ------------------ STEP 2: Special case – root deletion ------------------ */
+  Statistics. A STATS build counts, in each FT, the calls made on it
+  and how they ended, the nodes its path walks visit, and the size and
+  shape of its tree (see FT_getStatsIn). These helpers do nothing in
+  other builds.
+*/
 
-    /* If we're deleting the root, it must match root's path exactly */
-    if (Path_comparePath(Node_getPath(oRoot), oTargetPath) == 0) {
-        if (Node_getType(oRoot) != FT_DIR) {
-            Path_free(oTargetPath);
-            return NOT_A_DIRECTORY;
-        }
+/*
+  Counts a call of eOp on oFT that ended with iStatus, and returns
+  iStatus. Does nothing if oFT is NULL.
+*/
+static int FT_countOp(FT_T oFT, enum FT_Op eOp, int iStatus) {
+#ifdef STATS
+    if (oFT != NULL && iStatus >= 0 && iStatus < FT_NUM_STATUSES)
+        STATS_ADD(oFT->sCounters.aulOps[eOp][iStatus], 1);
+#else
+    (void) oFT;
+    (void) eOp;
+#endif
+    return iStatus;
+}
 
-        /* Free the entire tree */
-        Node_free(oRoot);
-        oRoot = NULL;
+/* Counts a walk down oFT's tree that visited ulVisited nodes. */
+static void FT_countWalk(FT_T oFT, size_t ulVisited) {
+#ifdef STATS
+    STATS_ADD(oFT->sCounters.ulLookups, 1);
+    STATS_ADD(oFT->sCounters.ulNodesVisited, ulVisited);
+#else
+    (void) oFT;
+    (void) ulVisited;
+#endif
+}
 
-        Path_free(oTargetPath);
-        return SUCCESS;
-    }
+/*
+  Counts the ulNew nodes just linked into oFT below directory oNParent
+  (NULL if they start a new root), ulDepth being the depth of the
+  deepest of them. The caller holds oNParent's lock for writing.
+*/
+static void FT_countInsert(FT_T oFT, Node_T oNParent, size_t ulNew,
+                           size_t ulDepth) {
+#ifdef STATS
+    STATS_ADD(oFT->sCounters.ulNodes, ulNew);
+    STATS_MAX(oFT->sCounters.ulMaxDepth, ulDepth);
+    if (oNParent != NULL)
+        STATS_MAX(oFT->sCounters.ulMaxFanOut,
+                  Node_getNumChildren(oNParent));
+#else
+    (void) oFT;
+    (void) oNParent;
+    (void) ulNew;
+    (void) ulDepth;
+#endif
+}
 
-    /* ------------------ STEP 3: Traverse to the target node ------------------ */
+/* Counts the removal of ulRemoved nodes from oFT. */
+static void FT_countRemove(FT_T oFT, size_t ulRemoved) {
+#ifdef STATS
+    STATS_ADD(oFT->sCounters.ulNodes, -ulRemoved);
+#else
+    (void) oFT;
+    (void) ulRemoved;
+#endif
+}
 
-    for (i = 1; i <= depth; i++) {
-        Path_T oPrefix = NULL;
-        int status = Path_prefix(oTargetPath, i, &oPrefix);
-        Node_T oNext = NULL;
-        
-        if (status != SUCCESS) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
-        
-        if (oPrefix == NULL) {
-            Path_free(oTargetPath);
-            return MEMORY_ERROR;
-        }
+#ifdef STATS
+/* Traversal functions for counting plain subtrees */
+static size_t FT_countNumChildren(void *pvNode) {
+    Node_T oNNode = pvNode;
 
-        numChildren = Node_getNumChildren(oCurr);
+    if (Node_getType(oNNode) != FT_DIR)
+        return 0;
+    return Node_getNumChildren(oNNode);
+}
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                break;
-            }
-        }
+static void *FT_countGetChild(void *pvNode, size_t ulIndex) {
+    Node_T oChild;
 
-        Path_free(oPrefix);
+    (void) Node_getChild(pvNode, ulIndex, &oChild);
+    return oChild;
+}
 
-        if (oNext == NULL) {
-            Path_free(oTargetPath);
-            return NO_SUCH_PATH;
-        }
+/*
+  Raises *pulMaxDepth and *pulMaxFanOut to the deepest depth below
+  oNNode, counting it as 1, and the widest directory of the subtree at
+  oNNode, which no one else may be changing. Leaves them be if memory
+  runs out during the walk.
+*/
+static void FT_countSubtree(Node_T oNNode, size_t *pulMaxDepth,
+                            size_t *pulMaxFanOut) {
+    struct Traversal sWalk;
+    void *pvNode;
+
+    Traversal_init(&sWalk, oNNode, TRAVERSAL_PREORDER,
+                   FT_countNumChildren, FT_countGetChild);
+    while (Traversal_next(&sWalk, &pvNode) == SUCCESS && pvNode != NULL) {
+        if (Traversal_getDepth(&sWalk) > *pulMaxDepth)
+            *pulMaxDepth = Traversal_getDepth(&sWalk);
+        if (FT_countNumChildren(pvNode) > *pulMaxFanOut)
+            *pulMaxFanOut = FT_countNumChildren(pvNode);
+    }
+    Traversal_free(&sWalk);
+}
+#endif
 
-        oParent = oCurr;
-        oCurr = oNext;
+/*
+  Counts oFT's whole tree afresh, once it has been built or loaded in
+  one go. The caller has the tree to itself.
+*/
+static void FT_countTree(FT_T oFT) {
+#ifdef STATS
+    struct Node_Totals sTotals = {0, 0, 0};
+    size_t ulMaxDepth = 0;
+    size_t ulMaxFanOut = 0;
+
+    if (oFT->oRoot != NULL) {
+        Node_getTotals(oFT->oRoot, &sTotals);
+        FT_countSubtree(oFT->oRoot, &ulMaxDepth, &ulMaxFanOut);
     }
+    STATS_SET(oFT->sCounters.ulNodes, sTotals.ulFiles + sTotals.ulDirs);
+    STATS_MAX(oFT->sCounters.ulMaxDepth, ulMaxDepth);
+    STATS_MAX(oFT->sCounters.ulMaxFanOut, ulMaxFanOut);
+#else
+    (void) oFT;
+#endif
+}
 
-    /* oCurr now points to the node we want to delete */
-    oToRemove = oCurr;
+/* --------------------------------------------------------------------
 
-    /* ------------------ STEP 4: Type check ------------------ */
+  Journaling. While an FT has a journal (see FT_journalOpenIn), each
+  change that succeeds is logged in it before the call returns, as a
+  record whose type is the change's FT_Op and whose strings are its
+  path and the contents it gave a file, or, for a move, the new path.
+  Paths are logged with their '\0', so replay can use them where they
+  lie. A change then has the tree to itself (see FT_enter), so the
+  records are in the order in which the changes were made.
+*/
 
-    if (Node_getType(oToRemove) != FT_DIR) {
-        Path_free(oTargetPath);
-        return NOT_A_DIRECTORY;
+/*
+  Logs in oFT's journal, if it has one and iStatus is SUCCESS, that eOp
+  was done to pcPath with the ulLength bytes at pvData. The change is
+  made whether or not it is kept, so a failure to keep it is not the
+  change's own status: the first one is kept in oFT->iJournalError,
+  for FT_journalSyncIn to report. Returns iStatus.
+*/
+static int FT_journal(FT_T oFT, enum FT_Op eOp, const char *pcPath,
+                      const void *pvData, size_t ulLength, int iStatus) {
+    int iLogged;
+
+    if (iStatus == SUCCESS && oFT->oJournal != NULL) {
+        iLogged = Journal_append(oFT->oJournal, (unsigned int) eOp, pcPath,
+                                 strlen(pcPath) + 1, pvData, ulLength);
+        if (iLogged != SUCCESS && oFT->iJournalError == SUCCESS)
+            oFT->iJournalError = iLogged;
     }
+    return iStatus;
+}
 
-    /* ------------------ STEP 5: Remove node from parent's children ------------------ */
+/*
+  Starts oFT's journal, if it has one and iStatus is SUCCESS, again
+  from a snapshot of the whole tree, after a change too big to log
+  entry by entry, keeping any failure to do so in oFT->iJournalError
+  as FT_journal does. Returns iStatus.
+*/
+static int FT_journalAll(FT_T oFT, int iStatus) {
+    int iLogged;
 
-    numChildren = Node_getNumChildren(oParent);
-    for (j = 0; j < numChildren; j++) {
-        Node_T child;
-        if (Node_getChild(oParent, j, &child) == SUCCESS &&
-            child == oToRemove) {
-            /* Remove child from array */
-            Node_removeChild(oParent, oCurr);
-            break;
-        }
+    if (iStatus == SUCCESS && oFT->oJournal != NULL) {
+        iLogged = Journal_checkpoint(oFT->oJournal);
+        if (iLogged != SUCCESS && oFT->iJournalError == SUCCESS)
+            oFT->iJournalError = iLogged;
     }
+    return iStatus;
+}
 
-    /* ------------------ STEP 6: Free the subtree ------------------ */
+#ifdef THREADSAFE
+/*
+  Traversal functions for FT_drain: before handing out a directory's
+  children, waits for everyone still inside the directory to move on.
+*/
+static size_t FT_drainNumChildren(void *pvNode) {
+    Node_T oNNode = pvNode;
+
+    if (Node_getType(oNNode) != FT_DIR)
+        return 0;
+    (void) pthread_rwlock_wrlock(Node_getLock(oNNode));
+    (void) pthread_rwlock_unlock(Node_getLock(oNNode));
+    return Node_getNumChildren(oNNode);
+}
 
-    Node_free(oToRemove);
+static void *FT_drainGetChild(void *pvNode, size_t ulIndex) {
+    Node_T oChild;
 
-    Path_free(oTargetPath);
-    return SUCCESS;
+    (void) Node_getChild(pvNode, ulIndex, &oChild);
+    return oChild;
 }
+#endif
 
 /*
-   Inserts a new file into the FT with absolute path pcPath, with
-   file contents pvContents of size ulLength bytes.
-   Returns SUCCESS if the new file is inserted successfully.
-   Otherwise, returns:
-   * INITIALIZATION_ERROR if the FT is not in an initialized state
-   * BAD_PATH if pcPath does not represent a well-formatted path
-   * CONFLICTING_PATH if the root exists but is not a prefix of pcPath,
-                      or if the new file would be the FT root
-   * NOT_A_DIRECTORY if a proper prefix of pcPath exists as a file
-   * ALREADY_IN_TREE if pcPath is already in the FT (as dir or file)
-   * MEMORY_ERROR if memory could not be allocated to complete request
+  Waits until no other operation is inside the subtree at oNNode, which
+  has just been unlinked, so that it can be freed. Everyone inside got
+  there through oNNode's parent and only moves downwards, so sweeping
+  each directory's lock from the top leaves them nowhere to be, and no
+  one can get back in. Returns TRUE once the subtree is private, or
+  FALSE if memory ran out before it could be swept, in which case the
+  subtree has to stay allocated until the arena goes. An RCU build
+  retires the subtree rather than freeing it, so lookups never need to
+  be waited for, but writers still do, for the subtree's totals to be
+  final (see FT_removeNode).
 */
-int FT_insertFile(const char *pcPath, void *pvContents, size_t ulLength) {
-    Path_T oNewPath;
-    Node_T oCurr = NULL;
-    Node_T oNext = NULL;
-    size_t depth, i;
-    int result;
-    size_t j;
-    size_t numChildren;
-    boolean found;
-
-    /* ------------------ STEP 1: Initialization & validation ------------------ */
-
-    if (!bIsInitialized)
-        return INITIALIZATION_ERROR;
+static boolean FT_drain(Node_T oNNode) {
+#ifdef THREADSAFE
+    struct Traversal sWalk;
+    void *pvNode;
+    int iStatus;
+
+    Traversal_init(&sWalk, oNNode, TRAVERSAL_PREORDER,
+                   FT_drainNumChildren, FT_drainGetChild);
+    while ((iStatus = Traversal_next(&sWalk, &pvNode)) == SUCCESS &&
+           pvNode != NULL)
+        ;
+    Traversal_free(&sWalk);
+    return (boolean) (iStatus == SUCCESS);
+#else
+    (void) oNNode;
+    return TRUE;
+#endif
+}
 
-    /* Parse the path string into a Path_T object */
-    oNewPath = Path_create(pcPath);
-    if (oNewPath == NULL)
-        return BAD_PATH;
+/* Epoch_retire callbacks for an unlinked subtree and a dropped arena */
+static void FT_freeRetiredSubtree(void *pvNode) {
+    (void) Node_free(pvNode);
+}
 
-    depth = Path_getDepth(oNewPath);
-    if (depth == 0) {
-        Path_free(oNewPath);
-        return BAD_PATH;
+#ifdef THREADSAFE
+/*
+  The reclaimer is a thread of the process's own, started by the first
+  FT_rmDirDeferred, that frees the subtrees handed to it one at a time,
+  so that whoever removed them need not wait. It is shared by every FT
+  of the process, and the subtrees it holds are private to it, so it
+  takes no FT's locks; those subtrees' arenas must wait for it, though.
+*/
+static pthread_mutex_t sReclaimMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sReclaimWork = PTHREAD_COND_INITIALIZER;  /* Something is queued */
+static pthread_cond_t sReclaimIdle = PTHREAD_COND_INITIALIZER;  /* Everything is freed */
+static Node_T *poNReclaimQueue = NULL;  /* Subtrees waiting to be freed */
+static size_t ulReclaimSlots = 0;       /* Number of elements allocated for it */
+static size_t ulReclaimQueued = 0;      /* Number of subtrees in it */
+static boolean bReclaimBusy = FALSE;    /* TRUE while a subtree is being freed */
+static boolean bReclaimStarted = FALSE; /* TRUE once the thread is running */
+
+/* The reclaimer's thread function, which never returns. */
+static void *FT_reclaimMain(void *pvUnused) {
+    (void) pvUnused;
+
+    (void) pthread_mutex_lock(&sReclaimMutex);
+    for (;;) {
+        Node_T oNNode;
+
+        while (ulReclaimQueued == 0)
+            (void) pthread_cond_wait(&sReclaimWork, &sReclaimMutex);
+        oNNode = poNReclaimQueue[--ulReclaimQueued];
+        bReclaimBusy = TRUE;
+        (void) pthread_mutex_unlock(&sReclaimMutex);
+
+        (void) Node_free(oNNode);
+
+        (void) pthread_mutex_lock(&sReclaimMutex);
+        bReclaimBusy = FALSE;
+        if (ulReclaimQueued == 0)
+            (void) pthread_cond_broadcast(&sReclaimIdle);
     }
+    return NULL;
+}
 
-    /* Cannot insert a file as the root */
-    if (oRoot == NULL && depth == 1) {
-        Path_free(oNewPath);
-        return CONFLICTING_PATH;
-    }
+/*
+  Starts the reclaimer if it is not running. The caller holds
+  sReclaimMutex. Returns TRUE if the reclaimer is running.
+*/
+static boolean FT_reclaimStart(void) {
+    pthread_attr_t sAttr;
+    pthread_t sThread;
 
-    /* ------------------ STEP 2: Handle first insertion (root must be a directory) ------------------ */
+    if (bReclaimStarted)
+        return TRUE;
+    if (pthread_attr_init(&sAttr) != 0)
+        return FALSE;
+    (void) pthread_attr_setdetachstate(&sAttr, PTHREAD_CREATE_DETACHED);
+    bReclaimStarted = (boolean) (pthread_create(&sThread, &sAttr,
+                                                FT_reclaimMain, NULL) == 0);
+    (void) pthread_attr_destroy(&sAttr);
+    return bReclaimStarted;
+}
 
-    if (oRoot == NULL) {
-        Path_T rootPrefix = NULL;
-        if (Path_prefix(oNewPath, 1, &rootPrefix) != SUCCESS) {
-            Path_free(oNewPath);
-            return MEMORY_ERROR;
+/*
+  Epoch_retire callback for a subtree that FT_rmDirDeferred unlinked:
+  hands it to the reclaimer, or frees it at once if the reclaimer
+  cannot be started or has no room for it.
+*/
+static void FT_reclaimLater(void *pvNode) {
+    boolean bQueued = FALSE;
+
+    (void) pthread_mutex_lock(&sReclaimMutex);
+    if (FT_reclaimStart()) {
+        if (ulReclaimQueued == ulReclaimSlots) {
+            size_t ulNewSlots = 2 * ulReclaimSlots + 16;
+            Node_T *poNNewQueue = realloc(poNReclaimQueue,
+                                          ulNewSlots * sizeof(Node_T));
+
+            if (poNNewQueue != NULL) {
+                poNReclaimQueue = poNNewQueue;
+                ulReclaimSlots = ulNewSlots;
+            }
         }
-
-        if (rootPrefix == NULL) {
-            Path_free(oNewPath);
-            return MEMORY_ERROR;
+        if (ulReclaimQueued < ulReclaimSlots) {
+            poNReclaimQueue[ulReclaimQueued++] = pvNode;
+            (void) pthread_cond_signal(&sReclaimWork);
+            bQueued = TRUE;
         }
+    }
+    (void) pthread_mutex_unlock(&sReclaimMutex);
 
-        /* Create root as a directory */
-        result = Node_new(rootPrefix, NULL, FT_DIR, &oRoot);
-        Path_free(rootPrefix);
-        if (result != SUCCESS) {
-            Path_free(oNewPath);
-            return result;
-        }
-    }
-
-    oCurr = oRoot;
-
-    /* ------------------ STEP 3: Traverse to parent of file ------------------ */
-
-    for (i = 1; i < depth; i++) {
-        Path_T oPrefix = NULL;
-        int status = Path_prefix(oNewPath, i, &oPrefix);
-
-        if (status != SUCCESS) {
-            Path_free(oNewPath);
-            return MEMORY_ERROR;
-        }
-
-        if (oPrefix == NULL) {
-            Path_free(oNewPath);
-            return MEMORY_ERROR;
-        }
-
-        found = FALSE;
-        numChildren = Node_getNumChildren(oCurr);
+    if (!bQueued)
+        (void) Node_free(pvNode);
+}
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                found = TRUE;
-                break;
-            }
-        }
+/* Waits until the reclaimer has freed everything handed to it. */
+static void FT_reclaimWait(void) {
+    (void) pthread_mutex_lock(&sReclaimMutex);
+    while (ulReclaimQueued > 0 || bReclaimBusy)
+        (void) pthread_cond_wait(&sReclaimIdle, &sReclaimMutex);
+    (void) pthread_mutex_unlock(&sReclaimMutex);
+}
+#else
+/* Without threads there is no reclaimer, so subtrees are freed at once. */
+static void FT_reclaimLater(void *pvNode) {
+    (void) Node_free(pvNode);
+}
 
-        Path_free(oPrefix);
+static void FT_reclaimWait(void) {
+}
+#endif
 
-        if (!found) {
-            Path_free(oNewPath);
-            return CONFLICTING_PATH;
-        }
+static void FT_freeRetiredArena(void *pvArena) {
+    /* The reclaimer may still be freeing nodes into it */
+    FT_reclaimWait();
+    Arena_free(pvArena);
+}
 
-        /* Check that intermediate path is a directory */
-        if (Node_getType(oNext) != FT_DIR) {
-            Path_free(oNewPath);
-            return NOT_A_DIRECTORY;
-        }
+/*
+  Frees the subtree at oNNode, which has just been unlinked, once no
+  one else can be inside it. If that cannot be arranged for lack of
+  memory, the subtree stays allocated until its arena goes.
+*/
+static void FT_freeSubtree(Node_T oNNode) {
+    if (FT_drain(oNNode))
+        (void) Epoch_retire(FT_freeRetiredSubtree, oNNode);
+}
 
-        oCurr = oNext;
-    }
+/*
+  Frees oArena, which no longer holds the tree, once no lookup can be
+  inside it. If that cannot be arranged for lack of memory, oArena is
+  never freed.
+*/
+static void FT_dropArena(Arena_T oArena) {
+    (void) Epoch_retire(FT_freeRetiredArena, oArena);
+}
 
-    /* ------------------ STEP 4: Check if file already exists ------------------ */
+/*
+  Lets go of oFT's arena and image, which no longer hold the tree:
+  frees them, or leaves them to the last of the snapshots that still
+  share them. The caller then gives oFT a new arena.
+*/
+static void FT_detachArena(FT_T oFT) {
+    struct FT_Generation *psShared = oFT->psShared;
 
-    numChildren = Node_getNumChildren(oCurr);
-    for (j = 0; j < numChildren; j++) {
-        Node_T child;
-        if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-            Path_comparePath(Node_getPath(child), oNewPath) == 0) {
-            Path_free(oNewPath);
-            return ALREADY_IN_TREE;
-        }
+    if (psShared == NULL) {
+        FT_dropArena(oFT->oArena);
+        FT_releaseImage(oFT);
+        return;
     }
 
-    /* ------------------ STEP 5: Create new file node ------------------ */
+    psShared->oArena = oFT->oArena;
+    psShared->pvImage = oFT->pvImage;
+    psShared->ulImageSize = oFT->ulImageSize;
+    oFT->pvImage = NULL;
+    oFT->ulImageSize = 0;
+    oFT->psShared = NULL;
+}
 
-    Node_T oNewNode;
-    result = Node_new(oNewPath, oCurr, FT_FILE, &oNewNode);
-    Path_free(oNewPath);
+/*
+  Makes sure that no snapshot shares *poNNode or any of its ancestors,
+  so that it can be changed in place: starting from the root, copies
+  each shared node on its path and links the copy in, which shares
+  the next node on the path in turn. Sets *poNNode to its own copy, if
+  it needed one. Returns SUCCESS, or MEMORY_ERROR, leaving whatever it
+  had copied so far in place, which changes nothing anyone can see.
+*/
+static int FT_unshare(FT_T oFT, Node_T *poNNode) {
+    Node_T *poNChain;
+    Node_T oNNode;
+    size_t ulDepth;
+    size_t i;
 
-    if (result != SUCCESS) {
-        return result;
-    }
+    assert(oFT != NULL);
+    assert(poNNode != NULL && *poNNode != NULL);
 
-    /* ------------------ STEP 6: Set file contents ------------------ */
+    if (oFT->psShared == NULL)
+        return SUCCESS;
 
-    char *copy = malloc(ulLength);
-    if (ulLength > 0 && copy == NULL) {
-        Node_free(oNewNode);
+    /* Copies take the place of nodes the cache may hold */
+    FT_cacheInvalidate(oFT);
+    ulDepth = Node_getDepth(*poNNode);
+    poNChain = malloc(ulDepth * sizeof(Node_T));
+    if (poNChain == NULL)
         return MEMORY_ERROR;
+    oNNode = *poNNode;
+    for (i = ulDepth; i > 0; i--) {
+        poNChain[i - 1] = oNNode;
+        oNNode = Node_getParent(oNNode);
     }
 
-    /* Only copy if there’s something to copy */
-    if (ulLength > 0 && pvContents != NULL) {
-        memcpy(copy, pvContents, ulLength);
-        if (!Node_setContents(oNewNode, copy)) {
-            free(copy);
-            Node_free(oNewNode);
+    for (i = 0; i < ulDepth; i++) {
+        Node_T oNCopy;
+
+        if (!Node_isShared(poNChain[i]))
+            continue;
+        if (Node_copy(poNChain[i], &oNCopy) != SUCCESS) {
+            free(poNChain);
             return MEMORY_ERROR;
         }
-    } else {
-        Node_setContents(oNewNode, NULL);
+        if (Node_replace(poNChain[i], oNCopy) != SUCCESS) {
+            (void) Node_free(oNCopy);
+            free(poNChain);
+            return MEMORY_ERROR;
+        }
+        if (i == 0)
+            EPOCH_PUBLISH(oFT->oRoot, oNCopy);
+        FT_watchRehome(oNCopy);
+
+        /* The snapshots keep what the tree lets go of here */
+        (void) Node_free(poNChain[i]);
+        poNChain[i] = oNCopy;
     }
 
-    free(copy);
+    *poNNode = poNChain[ulDepth - 1];
+    free(poNChain);
+    return SUCCESS;
+}
 
-    /* ------------------ STEP 7: Add new file node to parent ------------------ */
+/*
+  Updates the totals of the ancestors of oFT's file oNFile, whose
+  contents have just gone from ulOld to ulNew bytes. The caller holds
+  the lock that guards oNFile, whose ancestors no snapshot shares.
+*/
+static void FT_resizeFile(FT_T oFT, Node_T oNFile, size_t ulOld,
+                          size_t ulNew) {
+    struct Node_Totals sDelta = {0, 0, 0};
 
-    if (Node_addChild(oCurr, oNewNode) != SUCCESS) {
-        Node_free(oNewNode);
-        return MEMORY_ERROR;
-    }
+    assert(oNFile != NULL);
 
-    return SUCCESS;
+    sDelta.ulBytes = ulNew > ulOld ? ulNew - ulOld : ulOld - ulNew;
+    if (sDelta.ulBytes != 0)
+        Node_addTotals(Node_getParent(oNFile), &sDelta, ulNew > ulOld);
+    FT_checkAfter(oFT, oNFile);
 }
+
+/* --------------------------------------------------------------------
+
+  FT_traversePath, FT_findNode and FT_insertNode hold the only tree
+  walks in the FT: every public operation resolves its path through
+  them, one component at a time, straight from the client's string.
+  None of them allocates. FT_findNode walks a frozen tree's layout
+  instead, through FT_frozenFind.
+*/
+
 /*
-  Returns TRUE if the FT contains a file with absolute path
-  pcPath and FALSE if not or if there is an error while checking.
+  Continues a traversal from *poNCurr, the *pulMatched'th node on the
+  path under oCursor, which must be positioned at *poNCurr's component.
+  Descends as far as possible, updating *poNCurr and *pulMatched and
+  leaving oCursor as described for FT_traversePath.
 */
-boolean FT_containsFile(const char *pcPath) {
-    Path_T oTargetPath;
-    Node_T oCurr = oRoot;
-    Node_T oNext = NULL;
-    size_t depth, i;
-    size_t numChildren;
-    size_t j;
+static void FT_descend(PathCursor_T oCursor, Node_T *poNCurr,
+                       size_t *pulMatched) {
+    Node_T oCurr;
+    Node_T oNext;
 
-    /* ------------------ STEP 1: Validate state and input ------------------ */
+    assert(oCursor != NULL);
+    assert(poNCurr != NULL && *poNCurr != NULL);
+    assert(pulMatched != NULL);
 
-    if (!bIsInitialized)
-        return FALSE;
+    oCurr = *poNCurr;
 
-    /* Convert pcPath to a structured Path_T object */
-    oTargetPath = Path_create(pcPath);
-    if (oTargetPath == NULL)
-        return FALSE;
+    /* Descend one component at a time, comparing only child names */
+    while (Node_getType(oCurr) == FT_DIR && PathCursor_next(oCursor)) {
+        if (Node_getChildByName(oCurr, PathCursor_getComponent(oCursor),
+                                PathCursor_getLength(oCursor),
+                                &oNext) != SUCCESS)
+            break;
 
-    /* Get number of path components (e.g., /a/b/c → 3) */
-    depth = Path_getDepth(oTargetPath);
-    if (depth == 0) {
-        Path_free(oTargetPath);
-        return FALSE;
+        oCurr = oNext;
+        (*pulMatched)++;
     }
 
-    /* Empty tree — definitely not found */
-    if (oRoot == NULL) {
-        Path_free(oTargetPath);
-        return FALSE;
-    }
+    *poNCurr = oCurr;
+}
 
-    /* ------------------ STEP 2: Traverse path one level at a time ------------------ */
+/*
+  Traverses the FT from the root as far as possible towards the path
+  under oCursor, which must be positioned at its first component.
+  Returns SUCCESS, sets *poNFurthest to the deepest node reached (NULL
+  if the FT is empty) and sets *pulMatched to the number of path
+  components matched, leaving oCursor at the first unmatched component
+  (or at the last component, if all of them matched). The walk stops
+  early at a file, since files have no children.
+  Otherwise, returns CONFLICTING_PATH if the root is not a prefix of
+  the path, with *poNFurthest set to NULL and *pulMatched to 0.
+*/
+static int FT_traversePath(FT_T oFT, PathCursor_T oCursor,
+                           Node_T *poNFurthest, size_t *pulMatched) {
+    Node_T oCurr;
 
-    for (i = 1; i <= depth; i++) {
-        /* Get the prefix of the path at this level */
-        Path_T oPrefix = NULL;
-        int status = Path_prefix(oTargetPath, i, &oPrefix);
-        
-        if (status != SUCCESS) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
-        
-        if (oPrefix == NULL) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
+    assert(oCursor != NULL);
+    assert(poNFurthest != NULL);
+    assert(pulMatched != NULL);
 
-        /* Look for a child of oCurr with the matching path */
-        boolean found = FALSE;
-        numChildren = Node_getNumChildren(oCurr);
+    *poNFurthest = NULL;
+    *pulMatched = 0;
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                found = TRUE;
-                break;
-            }
-        }
+    /* Empty tree: nothing to match */
+    if (oFT->oRoot == NULL)
+        return SUCCESS;
 
-        Path_free(oPrefix);
+    /* The first component must name the root */
+    if (PathCursor_compareString(oCursor, Node_getName(oFT->oRoot)))
+        return CONFLICTING_PATH;
 
-        if (!found) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
+    oCurr = oFT->oRoot;
+    *pulMatched = 1;
+    FT_descend(oCursor, &oCurr, pulMatched);
 
-        oCurr = oNext;
-    }
+    *poNFurthest = oCurr;
+    return SUCCESS;
+}
+
+/*
+  Returns TRUE if a walk down the tree must lock as it goes: always for
+  a writer (bWrite), and for a reader except in an RCU build.
+*/
+static boolean FT_lookupLocks(boolean bWrite) {
+#ifdef RCU
+    return bWrite;
+#else
+    (void) bWrite;
+    return TRUE;
+#endif
+}
 
-    /* ------------------ STEP 3: Confirm that the final node is a file ------------------ */
+/*
+  Looks up the child of directory oNDir named by the ulLength
+  characters at pcName without holding oNDir's lock, which only an RCU
+  build can do. Returns SUCCESS and sets *poNChild, or NO_SUCH_PATH.
+*/
+static int FT_getUnlockedChild(Node_T oNDir, const char *pcName,
+                               size_t ulLength, Node_T *poNChild) {
+#ifdef RCU
+    return Node_getPublishedChild(oNDir, pcName, ulLength, poNChild);
+#else
+    (void) oNDir;
+    (void) pcName;
+    (void) ulLength;
+    (void) poNChild;
+    assert(FALSE);
+    return NO_SUCH_PATH;
+#endif
+}
 
-    Path_free(oTargetPath);
+/*
+  Returns the key by which a frozen layout orders the name of ulLength
+  characters at pcStr: its first 8 bytes, padded with '\0's, as a
+  big-endian number. Numeric order of keys agrees with the order of
+  names, and names shorter than 8 characters have keys of their own.
+*/
+static uint64_t FT_frozenKey(const char *pcStr, size_t ulLength) {
+    uint64_t ulKey = 0;
+    size_t i;
 
-    if (Node_getType(oCurr) == FT_FILE) {
-        return TRUE;
-    } else {
-        return FALSE;
+    for (i = 0; i < sizeof(ulKey); i++) {
+        ulKey <<= 8;
+        if (i < ulLength)
+            ulKey |= (unsigned char) pcStr[i];
     }
+    return ulKey;
 }
 
 /*
-  Removes the FT file with absolute path pcPath.
-  Returns SUCCESS if found and removed.
-  Otherwise, returns:
-  * INITIALIZATION_ERROR if the FT is not in an initialized state
-  * BAD_PATH if pcPath does not represent a well-formatted path
-  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
-  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
-  * NOT_A_FILE if pcPath is in the FT as a directory not a file
-  * MEMORY_ERROR if memory could not be allocated to complete request
+  Looks up the child named by oCursor's component among those of the
+  ulDir'th node of psFrozen, a directory. A binary search of the
+  directory's keys, which are adjacent, finds it; only a name of 8 or
+  more characters then has to be compared, with any that share its
+  key. Returns TRUE and sets *pulChild to the child's index, or
+  returns FALSE.
 */
-int FT_rmFile(const char *pcPath) {
-    Path_T oTargetPath;
-    Node_T oCurr = oRoot;
-    Node_T oParent = NULL;
-    Node_T oNext = NULL;
-    size_t depth, i, j;
-    size_t numChildren;
+static boolean FT_frozenChild(const struct FT_Frozen *psFrozen, size_t ulDir,
+                              PathCursor_T oCursor, size_t *pulChild) {
+    const char *pcName = PathCursor_getComponent(oCursor);
+    size_t ulLength = PathCursor_getLength(oCursor);
+    uint64_t ulKey = FT_frozenKey(pcName, ulLength);
+    size_t ulLow = psFrozen->psNodes[ulDir].ulFirstChild;
+    size_t ulEnd = ulLow + psFrozen->psNodes[ulDir].ulNumChildren;
+    size_t ulHigh = ulEnd;
+
+    while (ulLow < ulHigh) {
+        size_t ulMid = ulLow + (ulHigh - ulLow) / 2;
+
+        if (psFrozen->pulKeys[ulMid] < ulKey)
+            ulLow = ulMid + 1;
+        else
+            ulHigh = ulMid;
+    }
 
-    /* ------------------ STEP 1: Validate state and input ------------------ */
+    for (; ulLow < ulEnd && psFrozen->pulKeys[ulLow] == ulKey; ulLow++) {
+        const char *pcChild = psFrozen->ppcNames[ulLow];
 
-    if (!bIsInitialized)
-        return INITIALIZATION_ERROR;
+        if (ulLength < sizeof(ulKey) ||
+            (strncmp(pcChild, pcName, ulLength) == 0 &&
+             pcChild[ulLength] == '\0')) {
+            *pulChild = ulLow;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
 
-    oTargetPath = Path_create(pcPath);
-    if (oTargetPath == NULL)
-        return BAD_PATH;
+/*
+  Finds the node with the path under oCursor, which must be positioned
+  at its first component, in frozen layout psFrozen, as FT_findNode
+  does in the tree itself, and with the same statuses. Adds the number
+  of nodes visited to *pulVisited.
+*/
+static int FT_frozenFind(const struct FT_Frozen *psFrozen,
+                         PathCursor_T oCursor, Node_T *poNResult,
+                         size_t *pulVisited) {
+    size_t ulCurr = 0;
 
-    depth = Path_getDepth(oTargetPath);
-    if (depth == 0) {
-        Path_free(oTargetPath);
-        return BAD_PATH;
-    }
+    assert(psFrozen != NULL);
+    assert(poNResult != NULL);
+    assert(pulVisited != NULL);
 
-    if (oRoot == NULL) {
-        Path_free(oTargetPath);
+    if (psFrozen->ulCount == 0)
         return NO_SUCH_PATH;
+    if (PathCursor_compareString(oCursor, psFrozen->ppcNames[0]))
+        return CONFLICTING_PATH;
+    (*pulVisited)++;
+
+    while (PathCursor_next(oCursor)) {
+        if (psFrozen->psNodes[ulCurr].eType != FT_DIR)
+            return NOT_A_DIRECTORY;
+        if (!FT_frozenChild(psFrozen, ulCurr, oCursor, &ulCurr))
+            return NO_SUCH_PATH;
+        (*pulVisited)++;
     }
 
-    /* ------------------ STEP 2: Cannot delete root as a file ------------------ */
+    *poNResult = psFrozen->psNodes[ulCurr].oNNode;
+    return SUCCESS;
+}
 
-    if (Path_comparePath(Node_getPath(oRoot), oTargetPath) == 0) {
-        /* Root exists — check if it's a file (invalid) or directory */
-        if (Node_getType(oRoot) == FT_FILE) {
-            Path_free(oTargetPath);
-            return NOT_A_FILE;
-        } else {
-            Path_free(oTargetPath);
-            return CONFLICTING_PATH;
-        }
-    }
+/* The rest of the lookup cache, which only FT_findNode uses */
 
-    /* ------------------ STEP 3: Traverse path to locate file ------------------ */
+/*
+  Returns TRUE if the ulLength characters at pcPath are the absolute
+  path of oNNode, comparing one name at a time from the end.
+*/
+static boolean FT_hasPath(Node_T oNNode, const char *pcPath,
+                          size_t ulLength) {
+    for (;;) {
+        const char *pcName = Node_getName(oNNode);
+        size_t ulNameLength = Node_getNameLength(oNNode);
+
+        if (ulNameLength > ulLength ||
+            memcmp(pcPath + ulLength - ulNameLength, pcName,
+                   ulNameLength) != 0)
+            return FALSE;
+        ulLength -= ulNameLength;
 
-    for (i = 1; i <= depth; i++) {
-        Path_T oPrefix = NULL;
-        int status = Path_prefix(oTargetPath, i, &oPrefix);
-        if (status != SUCCESS) {
-            Path_free(oTargetPath);
+        oNNode = Node_getParent(oNNode);
+        if (oNNode == NULL)
+            return (boolean) (ulLength == 0);
+        if (ulLength == 0 || pcPath[--ulLength] != '/')
             return FALSE;
-        }
+    }
+}
 
-        if (oPrefix == NULL) {
-            Path_free(oTargetPath);
-            return MEMORY_ERROR;
-        }
+/*
+  Takes psLock, for writing if bWrite and for reading otherwise, for a
+  lookup that the cache answers, unless the lookup takes no locks.
+  Returns TRUE and sets *ppsHeld to what it took (NULL for nothing),
+  or returns FALSE, taking nothing, if it would have to wait.
+*/
+static boolean FT_cacheHold(FT_Lock psLock, boolean bWrite,
+                            FT_Lock *ppsHeld) {
+    *ppsHeld = NULL;
+    if (!FT_lookupLocks(bWrite))
+        return TRUE;
+    if (!FT_tryLock(psLock, bWrite))
+        return FALSE;
+    *ppsHeld = psLock;
+    return TRUE;
+}
+
+/*
+  Records in oFT's cache that pcPath, with hash ulHash, led to oNNode,
+  as looked up in generation ulGeneration, and that oNParent, the
+  directory the walk found it in (NULL for the root), is the last
+  parent. The caller holds the lock that guards oNNode; oNNode's own
+  parent pointer is not read, since a move may be rewriting it.
+*/
+static void FT_cacheFill(FT_T oFT, size_t ulHash, size_t ulGeneration,
+                         Node_T oNNode, Node_T oNParent) {
+    struct FT_Cache *psCache = &oFT->sCache;
+
+    FT_cacheLock(oFT);
+    if (psCache->ulSlots != 0) {
+        struct FT_CacheEntry *psEntry =
+            &psCache->psEntries[ulHash & (psCache->ulSlots - 1)];
+
+        psEntry->ulHash = ulHash;
+        psEntry->ulGeneration = ulGeneration;
+        psEntry->oNNode = oNNode;
+        psCache->oNLastParent = oNParent;
+        psCache->ulParentGeneration = ulGeneration;
+    }
+    FT_cacheUnlock(oFT);
+}
 
-        boolean found = FALSE;
-        numChildren = Node_getNumChildren(oCurr);
+/*
+  Looks up pcPath, ulLength characters long with hash ulHash, in oFT's
+  cache for FT_findNode: first in its slot, then among the children of
+  the last parent, if pcPath names one of them. Returns TRUE if the
+  cache has the answer, setting *piStatus to SUCCESS, and *poNResult
+  and *ppsHeld as FT_findNode does, or to NO_SUCH_PATH. Returns FALSE,
+  holding nothing, if the walk has to be made after all. Either way,
+  sets *pulGeneration to the cache's generation before the walk.
+*/
+static boolean FT_cacheFind(FT_T oFT, const char *pcPath, size_t ulLength,
+                            size_t ulHash, boolean bWrite,
+                            Node_T *poNResult, FT_Lock *ppsHeld,
+                            int *piStatus, size_t *pulGeneration) {
+    struct FT_Cache *psCache = &oFT->sCache;
+    struct FT_CacheEntry *psEntry;
+    const char *pcSlash;
+    Node_T oNParent;
+    Node_T oNChild;
+    FT_Lock psHeld;
+    size_t ulPrefix;
+    int iStatus;
+
+    FT_cacheLock(oFT);
+    *pulGeneration = psCache->ulGeneration;
+    if (psCache->ulSlots == 0) {
+        FT_cacheUnlock(oFT);
+        return FALSE;
+    }
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                found = TRUE;
-                break;
-            }
+    psEntry = &psCache->psEntries[ulHash & (psCache->ulSlots - 1)];
+    if (psEntry->oNNode != NULL && psEntry->ulHash == ulHash &&
+        psEntry->ulGeneration == psCache->ulGeneration &&
+        FT_hasPath(psEntry->oNNode, pcPath, ulLength)) {
+        oNParent = Node_getParent(psEntry->oNNode);
+        if (FT_cacheHold(oNParent == NULL ? FT_rootLock(oFT) :
+                         FT_dirLock(oNParent), bWrite, ppsHeld)) {
+            *poNResult = psEntry->oNNode;
+            psCache->oNLastParent = oNParent;
+            psCache->ulParentGeneration = psCache->ulGeneration;
+            FT_cacheUnlock(oFT);
+            STATS_ADD(oFT->sCounters.ulCacheHits, 1);
+            *piStatus = SUCCESS;
+            return TRUE;
         }
+    }
 
-        Path_free(oPrefix);
+    /* A sibling of the node last looked up is one step from their parent */
+    oNParent = psCache->oNLastParent;
+    pcSlash = strrchr(pcPath, '/');
+    ulPrefix = (size_t) (pcSlash - pcPath);
+    if (oNParent == NULL || pcSlash == NULL ||
+        psCache->ulParentGeneration != psCache->ulGeneration ||
+        !FT_hasPath(oNParent, pcPath, ulPrefix) ||
+        !FT_cacheHold(FT_dirLock(oNParent), bWrite, &psHeld)) {
+        FT_cacheUnlock(oFT);
+        STATS_ADD(oFT->sCounters.ulCacheMisses, 1);
+        return FALSE;
+    }
+    FT_cacheUnlock(oFT);
+    STATS_ADD(oFT->sCounters.ulCacheParentHits, 1);
+
+    if (FT_lookupLocks(bWrite))
+        iStatus = Node_getChildByName(oNParent, pcSlash + 1,
+                                      ulLength - ulPrefix - 1, &oNChild);
+    else
+        iStatus = FT_getUnlockedChild(oNParent, pcSlash + 1,
+                                      ulLength - ulPrefix - 1, &oNChild);
+    if (iStatus != SUCCESS) {
+        FT_unlock(psHeld);
+        *piStatus = NO_SUCH_PATH;
+        return TRUE;
+    }
 
-        if (!found) {
-            Path_free(oTargetPath);
-            return NO_SUCH_PATH;
-        }
+    FT_cacheFill(oFT, ulHash, *pulGeneration, oNChild, oNParent);
+    *poNResult = oNChild;
+    *ppsHeld = psHeld;
+    *piStatus = SUCCESS;
+    return TRUE;
+}
 
-        /* Save parent before stepping forward */
-        oParent = oCurr;
-        oCurr = oNext;
+/*
+  Traverses the FT to find the node with absolute path pcPath, under a
+  shared tree lock. Returns SUCCESS, sets *poNResult to the node and
+  sets *ppsHeld to the lock that guards it (its parent's, or the root
+  lock), which the caller then holds: for writing if bWrite and for
+  reading otherwise. (In an RCU build, or in a frozen tree, a lookup
+  takes no lock, and sets *ppsHeld to NULL.) Otherwise, holds nothing, sets *poNResult to NULL
+  and returns:
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * NOT_A_DIRECTORY if a proper prefix of pcPath exists as a file
+  * NO_SUCH_PATH if no node with pcPath exists in the hierarchy
+*/
+static int FT_findNode(FT_T oFT, const char *pcPath, boolean bWrite,
+                       Node_T *poNResult, FT_Lock *ppsHeld) {
+    struct PathCursor sCursor;
+    Node_T oCurr;
+    Node_T oNext;
+    Node_T oNParent = NULL;
+    FT_Lock psHeld = NULL;
+    boolean bLocking = FT_lookupLocks(bWrite);
+    struct FT_Frozen *psFrozen;
+    boolean bCached;
+    size_t ulHash = 0;
+    size_t ulGeneration = 0;
+    size_t ulDepth;
+    size_t ulLevel;
+    size_t ulVisited = 0;
+    int iStatus;
+
+    assert(oFT != NULL);
+    assert(pcPath != NULL);
+    assert(poNResult != NULL);
+    assert(ppsHeld != NULL);
+
+    *poNResult = NULL;
+
+    iStatus = PathCursor_init(&sCursor, pcPath);
+    if (iStatus != SUCCESS)
+        return iStatus;
+    ulDepth = PathCursor_getDepth(&sCursor);
+
+    /* While the tree is frozen nothing changes it, so nothing need lock */
+    psFrozen = EPOCH_READ(oFT->psFrozen);
+    if (psFrozen != NULL && !bWrite) {
+        iStatus = FT_frozenFind(psFrozen, &sCursor, poNResult, &ulVisited);
+        FT_countWalk(oFT, ulVisited);
+        *ppsHeld = NULL;
+        return iStatus;
     }
 
-    /* oCurr now points to the node we want to delete */
+    /* The cache, if there is one, may make the walk unnecessary */
+    bCached = (boolean) (EPOCH_READ(oFT->sCache.ulSlots) != 0);
+    if (bCached) {
+        size_t ulLength = strlen(pcPath);
 
-    /* ------------------ STEP 4: Type check ------------------ */
+        ulHash = Atom_hashString(pcPath, ulLength);
+        if (FT_cacheFind(oFT, pcPath, ulLength, ulHash, bWrite, poNResult,
+                         ppsHeld, &iStatus, &ulGeneration))
+            return iStatus;
+        iStatus = SUCCESS;
+    }
 
-    if (Node_getType(oCurr) != FT_FILE) {
-        Path_free(oTargetPath);
-        return NOT_A_FILE;
+    /* Only the lock guarding the target itself is taken for writing */
+    if (bLocking) {
+        psHeld = FT_rootLock(oFT);
+        FT_lock(psHeld, bWrite && ulDepth == 1);
     }
 
-    /* ------------------ STEP 5: Remove from parent's children ------------------ */
+    oCurr = EPOCH_READ(oFT->oRoot);
+    if (oCurr == NULL)
+        iStatus = NO_SUCH_PATH;
+    else if (PathCursor_compareString(&sCursor, Node_getName(oCurr)))
+        iStatus = CONFLICTING_PATH;
+    else
+        ulVisited = 1;
 
-    numChildren = Node_getNumChildren(oParent);
-    for (j = 0; j < numChildren; j++) {
-        Node_T child;
-        if (Node_getChild(oParent, j, &child) == SUCCESS &&
-            child == oCurr) {
-            /* Remove it from the parent's children array */
-            Node_removeChild(oParent, oCurr);
+    /* Descend one component at a time, comparing only child names */
+    for (ulLevel = 1; iStatus == SUCCESS && ulLevel < ulDepth; ulLevel++) {
+        FT_Lock psNext;
+
+        if (Node_getType(oCurr) != FT_DIR) {
+            iStatus = NOT_A_DIRECTORY;
             break;
         }
-    }
 
-    /* ------------------ STEP 6: Free the file node ------------------ */
+        (void) PathCursor_next(&sCursor);
+        if (bLocking) {
+            psNext = FT_dirLock(oCurr);
+            FT_lock(psNext, bWrite && ulLevel + 1 == ulDepth);
+            FT_unlock(psHeld);
+            psHeld = psNext;
+            iStatus = Node_getChildByName(oCurr,
+                                          PathCursor_getComponent(&sCursor),
+                                          PathCursor_getLength(&sCursor),
+                                          &oNext);
+        }
+        else
+            iStatus = FT_getUnlockedChild(oCurr,
+                                          PathCursor_getComponent(&sCursor),
+                                          PathCursor_getLength(&sCursor),
+                                          &oNext);
+        if (iStatus != SUCCESS)
+            iStatus = NO_SUCH_PATH;
+        else {
+            oNParent = oCurr;
+            oCurr = oNext;
+            ulVisited++;
+        }
+    }
+    FT_countWalk(oFT, ulVisited);
 
-    Node_free(oCurr);
-    Path_free(oTargetPath);
+    if (iStatus != SUCCESS) {
+        FT_unlock(psHeld);
+        return iStatus;
+    }
 
+    if (bCached)
+        FT_cacheFill(oFT, ulHash, ulGeneration, oCurr, oNParent);
+    *poNResult = oCurr;
+    *ppsHeld = psHeld;
     return SUCCESS;
 }
 
 /*
-  Returns the contents of the file with absolute path pcPath.
-  Returns NULL if unable to complete the request for any reason.
-
-  Note: checking for a non-NULL return is not an appropriate
-  contains check, because the contents of a file may be NULL.
+  Finishes inserting a new node of type eType at the path under
+  oCursor, once a traversal has resolved it as far as oCurr, its
+  ulMatched'th component (oCurr is NULL and ulMatched 0 for an empty
+  FT), leaving oCursor as FT_traversePath does. Creates any missing
+  ancestor directories along the way, or none of them on failure.
+  Returns SUCCESS, or one of the statuses documented for FT_insertDir
+  and FT_insertFile. If successful and poNResult is not NULL, sets
+  *poNResult to the new node, and if poNFirst is not NULL, sets
+  *poNFirst to the first node created, the new node or the topmost of
+  the directories added above it.
 */
-void *FT_getFileContents(const char *pcPath) {
-    Path_T oTargetPath;
-    Node_T oCurr = oRoot;
-    Node_T oNext = NULL;
-    size_t depth, i, j;
-    size_t numChildren;
+static int FT_insertResolved(FT_T oFT, PathCursor_T oCursor, Node_T oCurr,
+                             size_t ulMatched, NodeType eType,
+                             Node_T *poNResult, Node_T *poNFirst) {
+    Node_T oFirstNew = NULL;
+    Node_T oNDir;
+    struct Node_Totals sNew;
+    size_t ulDepth;
+    size_t ulFirstNew = ulMatched;
+    int iStatus = SUCCESS;
 
-    /* ------------------ STEP 1: Check initialization and path validity ------------------ */
+    assert(oCursor != NULL);
 
-    if (!bIsInitialized)
-        return NULL;
+    ulDepth = PathCursor_getDepth(oCursor);
 
-    oTargetPath = Path_create(pcPath);
-    if (oTargetPath == NULL)
-        return NULL;
+    if (ulMatched == ulDepth)
+        return ALREADY_IN_TREE;
 
-    depth = Path_getDepth(oTargetPath);
-    if (depth == 0) {
-        Path_free(oTargetPath);
-        return NULL;
-    }
+    if (oCurr != NULL && Node_getType(oCurr) == FT_FILE)
+        return NOT_A_DIRECTORY;
 
-    if (oRoot == NULL) {
-        Path_free(oTargetPath);
-        return NULL;
-    }
+    if (oCurr != NULL && FT_unshare(oFT, &oCurr) != SUCCESS)
+        return MEMORY_ERROR;
 
-    /* ------------------ STEP 2: Traverse the path to find the target node ------------------ */
+    /* ------------------ STEP 3: Build the rest of the path one level at a time ------------------ */
 
-    for (i = 1; i <= depth; i++) {
-        Path_T oPrefix = NULL;
-        int status = Path_prefix(oTargetPath, i, &oPrefix);
-        if (status != SUCCESS) {
-            Path_free(oTargetPath);
-            return FALSE;
-        }
-        if (oPrefix == NULL) {
-            Path_free(oTargetPath);
-            return NULL;
-        }
+    /* The traversal left the cursor on the first missing component */
+    while (ulMatched < ulDepth) {
+        Node_T oNewNode = NULL;
+        NodeType eNewType = FT_DIR;
 
-        boolean found = FALSE;
-        numChildren = Node_getNumChildren(oCurr);
+        assert(PathCursor_getLevel(oCursor) == ulMatched);
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                found = TRUE;
-                break;
-            }
-        }
+        /* Every level but the last is an intermediate directory */
+        if (ulMatched + 1 == ulDepth)
+            eNewType = eType;
 
-        Path_free(oPrefix);
+        /* Nodes are named straight from the caller's string */
+        iStatus = Node_new(oCurr, PathCursor_getComponent(oCursor),
+                           PathCursor_getLength(oCursor), eNewType,
+                           oFT->oArena, &oNewNode);
+        if (iStatus != SUCCESS)
+            break;
 
-        if (!found) {
-            Path_free(oTargetPath);
-            return NULL;
+        if (oCurr != NULL) {
+            iStatus = Node_addChild(oCurr, oNewNode);
+            if (iStatus != SUCCESS) {
+                (void) Node_free(oNewNode);
+                break;
+            }
         }
 
-        oCurr = oNext;
+        if (oFirstNew == NULL)
+            oFirstNew = oNewNode;
+        oCurr = oNewNode;
+        ulMatched++;
+        (void) PathCursor_next(oCursor);
     }
 
-    Path_free(oTargetPath);
+    /* ------------------ STEP 4: Undo partial insertions on failure ------------------ */
 
-    /* ------------------ STEP 3: Confirm it's a file and return contents ------------------ */
-
-    if (Node_getType(oCurr) != FT_FILE) {
-        return NULL;
+    if (iStatus != SUCCESS) {
+        if (oFirstNew != NULL) {
+            /* A new root has not been published, unlike anything below one */
+            if (Node_getParent(oFirstNew) == NULL)
+                (void) Node_free(oFirstNew);
+            else if (Node_removeChild(Node_getParent(oFirstNew),
+                                      oFirstNew) == SUCCESS)
+                FT_freeSubtree(oFirstNew);
+        }
+        return iStatus;
     }
 
-    /* Return pointer to the contents — may be NULL (empty file) */
-    return (void *)Node_getContents(oCurr);
+    /* Total the new chain from the bottom up, then add it all to the
+       directories above it in one pass, rather than one per level */
+    Node_getTotals(oCurr, &sNew);
+    for (oNDir = Node_getParent(oCurr); oNDir != Node_getParent(oFirstNew);
+         oNDir = Node_getParent(oNDir)) {
+        Node_addOwnTotals(oNDir, &sNew);
+        sNew.ulDirs++;
+    }
+    Node_addTotals(Node_getParent(oFirstNew), &sNew, TRUE);
+
+    if (oFT->oRoot == NULL)
+        EPOCH_PUBLISH(oFT->oRoot, oFirstNew);
+    FT_countInsert(oFT, Node_getParent(oFirstNew), ulDepth - ulFirstNew,
+                   ulDepth);
+    FT_checkAfter(oFT, oCurr);
+
+    if (poNResult != NULL)
+        *poNResult = oCurr;
+    if (poNFirst != NULL)
+        *poNFirst = oFirstNew;
+    return SUCCESS;
 }
 
 /*
-  Replaces current contents of the file with absolute path pcPath with
-  the parameter pvNewContents of size ulNewLength bytes.
-  Returns the old contents if successful. (Note: contents may be NULL.)
-  Returns NULL if unable to complete the request for any reason.
+  Inserts a new node of type eType with absolute path pcPath, creating
+  any missing ancestor directories along the way, under a shared tree
+  lock. Returns SUCCESS, or one of the statuses documented for
+  FT_insertDir and FT_insertFile. If successful, sets *poNResult to the
+  new node, *poNFirst as FT_insertResolved does, and *ppsHeld to the
+  lock of the directory it went into (or the root lock), which the
+  caller then holds for writing; otherwise holds nothing.
 */
-void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
-                             size_t ulNewLength) {
-    Path_T oTargetPath;
-    Node_T oCurr = oRoot;
-    Node_T oNext = NULL;
-    size_t depth, i, j, numChildren;
-
-    /* ------------------ STEP 1: Validate FT state and input path ------------------ */
-
-    if (!bIsInitialized)
-        return NULL;
-
-    oTargetPath = Path_create(pcPath);
-    if (oTargetPath == NULL)
-        return NULL;
-
-    depth = Path_getDepth(oTargetPath);
-    if (depth == 0) {
-        Path_free(oTargetPath);
-        return NULL;
-    }
+static int FT_insertNode(FT_T oFT, const char *pcPath, NodeType eType,
+                         Node_T *poNResult, Node_T *poNFirst,
+                         FT_Lock *ppsHeld) {
+    struct PathCursor sCursor;
+    Node_T oCurr;
+    FT_Lock psHeld;
+    size_t ulDepth;
+    size_t ulMatched = 0;
+    int iStatus;
 
-    if (oRoot == NULL) {
-        Path_free(oTargetPath);
-        return NULL;
-    }
+    assert(oFT != NULL);
+    assert(pcPath != NULL);
+    assert(poNResult != NULL);
+    assert(ppsHeld != NULL);
 
-    /* ------------------ STEP 2: Traverse tree to find the target file ------------------ */
+    /* ------------------ STEP 1: Error Checking ------------------ */
 
-    for (i = 1; i <= depth; i++) {
-        Path_T oPrefix = NULL;
-        
-        if (Path_prefix(oTargetPath, i, &oPrefix) != SUCCESS) {
-            Path_free(oTargetPath);
-            return NULL;
-        }
+    iStatus = PathCursor_init(&sCursor, pcPath);
+    if (iStatus != SUCCESS)
+        return iStatus;
+    ulDepth = PathCursor_getDepth(&sCursor);
 
-        if (oPrefix == NULL) {
-            Path_free(oTargetPath);
-            return NULL;
-        }
+    /* A file can never be the root of the FT */
+    if (eType == FT_FILE && ulDepth == 1)
+        return CONFLICTING_PATH;
 
-        boolean found = FALSE;
-        numChildren = Node_getNumChildren(oCurr);
+    /* ------------------ STEP 2: Find the closest existing ancestor ------------------ */
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                found = TRUE;
-                break;
-            }
-        }
+    psHeld = FT_rootLock(oFT);
+    FT_lock(psHeld, FALSE);
 
-        Path_free(oPrefix);
+    /* An empty FT gets its root under the root lock */
+    if (oFT->oRoot == NULL)
+        (void) FT_relock(psHeld);
+    oCurr = oFT->oRoot;
 
-        if (!found) {
-            Path_free(oTargetPath);
-            return NULL;
+    if (oCurr != NULL) {
+        if (PathCursor_compareString(&sCursor, Node_getName(oCurr))) {
+            FT_unlock(psHeld);
+            return CONFLICTING_PATH;
         }
+        ulMatched = 1;
+    }
 
+    /*
+      Each directory is read-locked to look for the next component, and
+      write-locked only if that is missing; the change of lock is made
+      while its parent is still held, so the directory cannot go away,
+      but someone else may have added the component in the meantime.
+    */
+    while (oCurr != NULL && ulMatched < ulDepth &&
+           Node_getType(oCurr) == FT_DIR) {
+        FT_Lock psCurr = FT_dirLock(oCurr);
+        Node_T oNext;
+        int iFound;
+
+        (void) PathCursor_next(&sCursor);
+        FT_lock(psCurr, FALSE);
+        iFound = Node_getChildByName(oCurr, PathCursor_getComponent(&sCursor),
+                                     PathCursor_getLength(&sCursor), &oNext);
+        if (iFound != SUCCESS && FT_relock(psCurr))
+            iFound = Node_getChildByName(oCurr,
+                                         PathCursor_getComponent(&sCursor),
+                                         PathCursor_getLength(&sCursor),
+                                         &oNext);
+        FT_unlock(psHeld);
+        psHeld = psCurr;
+
+        if (iFound != SUCCESS)
+            break;
         oCurr = oNext;
+        ulMatched++;
     }
 
-    Path_free(oTargetPath);
-
-    /* ------------------ STEP 3: Verify that the target is a file ------------------ */
-
-    if (Node_getType(oCurr) != FT_FILE) {
-        return NULL;
+    FT_countWalk(oFT, ulMatched);
+    iStatus = FT_insertResolved(oFT, &sCursor, oCurr, ulMatched, eType,
+                                poNResult, poNFirst);
+    if (iStatus != SUCCESS) {
+        FT_unlock(psHeld);
+        return iStatus;
     }
 
-    /* ------------------ STEP 4: Prepare new content ------------------ */
+    *ppsHeld = psHeld;
+    return SUCCESS;
+}
 
-    char *newContents = NULL;
-    if (ulNewLength > 0 && pvNewContents != NULL) {
-        newContents = malloc(ulNewLength);
-        if (newContents == NULL) {
-            return NULL;
+/*
+  Unlinks oNNode from its parent (or from the root, if it is the root)
+  and frees the subtree rooted at it. The caller holds psHeld, the lock
+  that guards oNNode, for writing, or the tree lock exclusively if
+  oNNode is the root; psHeld is let go of once oNNode is unlinked. If
+  bDeferred, the caller holds the tree lock exclusively whatever oNNode
+  is, and no snapshot shares the tree, so nobody can be inside the
+  subtree and it is left to the reclaimer instead. If pcPath, oNNode's
+  path, is not NULL, the watches that see the removal are told of it,
+  and those in the subtree stop (see FT_watchBelow).
+  Returns SUCCESS, or MEMORY_ERROR if oNNode could not be unlinked,
+  which only happens in an RCU build or while snapshots share it.
+*/
+static int FT_removeNode(FT_T oFT, Node_T oNNode, FT_Lock psHeld,
+                         boolean bDeferred, const char *pcPath) {
+    struct FT_Event sEvent;
+    Node_T oNParent;
+    struct Node_Totals sTotals;
+    boolean bPrivate;
+
+    assert(oNNode != NULL);
+
+    sEvent.eOp = Node_getType(oNNode) == FT_DIR ? FT_OP_RM_DIR :
+                 FT_OP_RM_FILE;
+    sEvent.pcPath = pcPath;
+    sEvent.pcNewPath = NULL;
+    sEvent.ulSize = 0;
+
+    FT_cacheInvalidate(oFT);
+    if (oNNode == oFT->oRoot) {
+        /* The whole tree is going: swap in a fresh arena and drop the old
+           one in bulk, unless there is no memory for the new one */
+        Arena_T oNewArena = Arena_new();
+
+        EPOCH_PUBLISH(oFT->oRoot, NULL);
+        if (pcPath != NULL)
+            FT_watchBelow(oFT, oNNode, &sEvent, TRUE);
+        FT_unlock(psHeld);
+        STATS_SET(oFT->sCounters.ulNodes, 0);
+        if (oNewArena != NULL) {
+            FT_detachArena(oFT);
+            oFT->oArena = oNewArena;
+            return SUCCESS;
         }
-        memcpy(newContents, pvNewContents, ulNewLength);
+        FT_freeSubtree(oNNode);
+        if (oFT->psShared == NULL)
+            FT_releaseImage(oFT);
+        return SUCCESS;
     }
 
-    /* ------------------ STEP 5: Replace contents and return old contents ------------------ */
-
-    void *oldContents = (void *)Node_getContents(oCurr);
+    oNParent = Node_getParent(oNNode);
+    if (FT_unshare(oFT, &oNParent) != SUCCESS ||
+        Node_removeChild(oNParent, oNNode) != SUCCESS) {
+        FT_unlock(psHeld);
+        return MEMORY_ERROR;
+    }
 
-    if (!Node_setContents(oCurr, newContents)) {
-        /* Failed to set — free new content buffer and fail safely */
-        free(newContents);
-        return NULL;
+    /*
+      Once everyone inside has left, the subtree's totals are final and
+      can come off its ancestors'. The parent stays locked until then,
+      so that a removal further up, which has to sweep it, cannot take
+      them off the ancestors above it a second time.
+    */
+    bPrivate = (boolean) (bDeferred || FT_drain(oNNode));
+    Node_getTotals(oNNode, &sTotals);
+    Node_addTotals(oNParent, &sTotals, FALSE);
+    FT_checkAfter(oFT, oNParent);
+
+    /* Changes inside were told of before anyone could leave */
+    if (pcPath != NULL) {
+        FT_watchNotify(oFT, oNParent, &sEvent, NULL);
+        FT_watchBelow(oFT, oNNode, &sEvent, TRUE);
     }
+    FT_unlock(psHeld);
+    FT_countRemove(oFT, sTotals.ulFiles + sTotals.ulDirs);
 
-    return oldContents;
+    /* Return the subtree's blocks to the arena's free lists */
+    if (bPrivate)
+        (void) Epoch_retire(bDeferred ? FT_reclaimLater :
+                            FT_freeRetiredSubtree, oNNode);
+    return SUCCESS;
 }
 
 /*
-  Returns SUCCESS if pcPath exists in the hierarchy,
-  Otherwise, returns:
+  Returns TRUE if the FT contains a node of type eType with absolute
+  path pcPath, and FALSE if not or if there is an error while checking.
+*/
+static boolean FT_containsNode(FT_T oFT, const char *pcPath,
+                               NodeType eType) {
+    Node_T oNFound;
+    FT_Lock psHeld;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (!FT_enter(oFT, FT_LOOKUP))
+        return FALSE;
+
+    iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound, &psHeld);
+    if (iStatus == SUCCESS) {
+        if (Node_getType(oNFound) != eType)
+            iStatus = eType == FT_DIR ? NOT_A_DIRECTORY : NOT_A_FILE;
+        FT_unlock(psHeld);
+    }
+
+    (void) FT_countOp(oFT, eType == FT_DIR ? FT_OP_CONTAINS_DIR :
+                      FT_OP_CONTAINS_FILE, iStatus);
+    FT_leave(oFT, FT_LOOKUP);
+    return (boolean) (iStatus == SUCCESS);
+}
+
+/*
+  Removes the node of type eType with absolute path pcPath, and the
+  subtree rooted at it. Returns the statuses documented for FT_rmDir
+  if eType is FT_DIR and for FT_rmFile otherwise.
+*/
+static int FT_rmNode(FT_T oFT, const char *pcPath, NodeType eType) {
+    enum FT_Access eAccess = FT_CHANGE;
+    Node_T oNFound;
+    FT_Lock psHeld;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    for (;;) {
+        if (!FT_enter(oFT, eAccess))
+            return INITIALIZATION_ERROR;
+
+        iStatus = FT_findNode(oFT, pcPath, TRUE, &oNFound, &psHeld);
+        if (iStatus != SUCCESS)
+            break;
+
+        if (Node_getType(oNFound) != eType) {
+            FT_unlock(psHeld);
+            iStatus = eType == FT_DIR ? NOT_A_DIRECTORY : NOT_A_FILE;
+            break;
+        }
+
+        /* Dropping the root drops the arena, which nobody else may be
+           using: start again with the tree to ourselves */
+        if (oNFound == oFT->oRoot && eAccess != FT_WHOLE) {
+            FT_unlock(psHeld);
+            FT_leave(oFT, eAccess);
+            eAccess = FT_WHOLE;
+            continue;
+        }
+
+        iStatus = FT_removeNode(oFT, oNFound, psHeld, FALSE, pcPath);
+        break;
+    }
+
+    (void) FT_journal(oFT, eType == FT_DIR ? FT_OP_RM_DIR : FT_OP_RM_FILE,
+                      pcPath, NULL, 0, iStatus);
+    (void) FT_countOp(oFT, eType == FT_DIR ? FT_OP_RM_DIR : FT_OP_RM_FILE,
+                      iStatus);
+    FT_leave(oFT, eAccess);
+    return iStatus;
+}
+/*--------------------------------------------------------------------*/
+
+/*
+   Inserts a new directory into the FT with absolute path pcPath.
+   Returns SUCCESS if the new directory is inserted successfully.
+   Otherwise, returns:
+   * INITIALIZATION_ERROR if the FT is not in an initialized state
+   * BAD_PATH if pcPath does not represent a well-formatted path
+   * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+   * NOT_A_DIRECTORY if a proper prefix of pcPath exists as a file
+   * ALREADY_IN_TREE if pcPath is already in the FT (as dir or file)
+   * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_insertDirIn(FT_T oFT, const char *pcPath) {
+    Node_T oNewNode;
+    Node_T oNFirst;
+    FT_Lock psHeld;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (!FT_enter(oFT, FT_CHANGE))
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_insertNode(oFT, pcPath, FT_DIR, &oNewNode, &oNFirst,
+                            &psHeld);
+    if (iStatus == SUCCESS) {
+        FT_watchChange(oFT, Node_getParent(oNFirst), FT_OP_INSERT_DIR,
+                       pcPath, 0);
+        FT_unlock(psHeld);
+    }
+
+    (void) FT_journal(oFT, FT_OP_INSERT_DIR, pcPath, NULL, 0, iStatus);
+    (void) FT_countOp(oFT, FT_OP_INSERT_DIR, iStatus);
+    FT_leave(oFT, FT_CHANGE);
+    return iStatus;
+}
+
+/*
+  Returns TRUE if the FT contains a directory with absolute path
+  pcPath and FALSE if not or if there is an error while checking.
+*/
+boolean FT_containsDirIn(FT_T oFT, const char *pcPath) {
+    return FT_containsNode(oFT, pcPath, FT_DIR);
+}
+
+/*
+  Removes the FT hierarchy (subtree) at the directory with absolute
+  path pcPath. Returns SUCCESS if found and removed.
+  Otherwise, returns:
   * INITIALIZATION_ERROR if the FT is not in an initialized state
   * BAD_PATH if pcPath does not represent a well-formatted path
-  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  * NOT_A_DIRECTORY if pcPath is in the FT as a file not a directory
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_rmDirIn(FT_T oFT, const char *pcPath) {
+    return FT_rmNode(oFT, pcPath, FT_DIR);
+}
+
+/*
+  Removes the directory with absolute path pcPath as FT_rmDirIn does,
+  but with the tree to itself, so that nobody can be inside the
+  subtree: unlinking it then takes O(depth) time, and freeing it is
+  left to the reclaimer. Returns the statuses of FT_rmDirIn.
+*/
+int FT_rmDirDeferredIn(FT_T oFT, const char *pcPath) {
+    Node_T oNFound;
+    FT_Lock psHeld;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (!FT_enter(oFT, FT_WHOLE))
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_findNode(oFT, pcPath, TRUE, &oNFound, &psHeld);
+    if (iStatus == SUCCESS && Node_getType(oNFound) != FT_DIR) {
+        FT_unlock(psHeld);
+        iStatus = NOT_A_DIRECTORY;
+    }
+    else if (iStatus == SUCCESS) {
+        /* A snapshot's nodes are freed under the tree lock, which the
+           reclaimer does not take */
+        iStatus = FT_removeNode(oFT, oNFound, psHeld,
+                                (boolean) (oFT->psShared == NULL), pcPath);
+    }
+
+    (void) FT_journal(oFT, FT_OP_RM_DIR, pcPath, NULL, 0, iStatus);
+    (void) FT_countOp(oFT, FT_OP_RM_DIR, iStatus);
+    FT_leave(oFT, FT_WHOLE);
+    return iStatus;
+}
+
+/*
+  Sets the contents of file oNNode to a copy of the ulLength bytes at
+  pvContents, which is shared with every file in the same arena that
+  holds the same bytes if bDedup is TRUE (see FT_setDedupIn).
+  Returns 1 on success, or 0 on failure.
+*/
+static int FT_copyContents(Node_T oNNode, const void *pvContents,
+                           size_t ulLength, boolean bDedup) {
+    if (bDedup)
+        return Node_internContents(oNNode, pvContents, ulLength);
+    return Node_setContents(oNNode, pvContents, ulLength);
+}
+
+/*
+  Inserts a new file with absolute path pcPath, whose contents are the
+  ulLength bytes at pvContents: a copy of them, or pvContents itself if
+  bAdopt is TRUE. Returns the statuses documented for FT_insertFile.
+*/
+static int FT_insertFileWith(FT_T oFT, const char *pcPath,
+                             void *pvContents, size_t ulLength,
+                             boolean bAdopt) {
+    Node_T oNewNode;
+    Node_T oNFirst;
+    FT_Lock psHeld;
+    int result;
+
+    assert(pcPath != NULL);
+
+    /* NULL contents make an empty file, whatever ulLength says */
+    if (pvContents == NULL)
+        ulLength = 0;
+
+    if (!FT_enter(oFT, FT_CHANGE))
+        return INITIALIZATION_ERROR;
+
+    /* ------------------ STEP 1: Create new file node ------------------ */
+
+    result = FT_insertNode(oFT, pcPath, FT_FILE, &oNewNode, &oNFirst,
+                           &psHeld);
+    if (result != SUCCESS) {
+        (void) FT_countOp(oFT, FT_OP_INSERT_FILE, result);
+        FT_leave(oFT, FT_CHANGE);
+        return result;
+    }
+
+    /* ------------------ STEP 2: Set file contents ------------------ */
+
+    if (bAdopt)
+        result = Node_adoptContents(oNewNode, pvContents, ulLength);
+    else
+        result = FT_copyContents(oNewNode, pvContents, ulLength,
+                                 oFT->bDedup);
+    if (!result) {
+        /* Should even that fail, the new file is left empty */
+        (void) FT_removeNode(oFT, oNewNode, psHeld, FALSE, NULL);
+        (void) FT_countOp(oFT, FT_OP_INSERT_FILE, MEMORY_ERROR);
+        FT_leave(oFT, FT_CHANGE);
+        return MEMORY_ERROR;
+    }
+    FT_resizeFile(oFT, oNewNode, 0, ulLength);
+    FT_watchChange(oFT, Node_getParent(oNFirst), FT_OP_INSERT_FILE, pcPath,
+                   ulLength);
+
+    FT_unlock(psHeld);
+    (void) FT_journal(oFT, FT_OP_INSERT_FILE, pcPath, pvContents, ulLength,
+                      SUCCESS);
+    (void) FT_countOp(oFT, FT_OP_INSERT_FILE, SUCCESS);
+    FT_leave(oFT, FT_CHANGE);
+    return SUCCESS;
+}
+
+/*
+   Inserts a new file into the FT with absolute path pcPath, with
+   file contents pvContents of size ulLength bytes.
+   Returns SUCCESS if the new file is inserted successfully.
+   Otherwise, returns:
+   * INITIALIZATION_ERROR if the FT is not in an initialized state
+   * BAD_PATH if pcPath does not represent a well-formatted path
+   * CONFLICTING_PATH if the root exists but is not a prefix of pcPath,
+                      or if the new file would be the FT root
+   * NOT_A_DIRECTORY if a proper prefix of pcPath exists as a file
+   * ALREADY_IN_TREE if pcPath is already in the FT (as dir or file)
+   * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_insertFileIn(FT_T oFT, const char *pcPath, void *pvContents,
+                    size_t ulLength) {
+    return FT_insertFileWith(oFT, pcPath, pvContents, ulLength, FALSE);
+}
+
+/*
+   Like FT_insertFile, but the FT takes ownership of pvContents, which
+   must have been allocated by malloc, instead of copying it. Unless
+   SUCCESS is returned, ownership stays with the caller.
+*/
+int FT_insertFileAdoptIn(FT_T oFT, const char *pcPath, void *pvContents,
+                         size_t ulLength) {
+    return FT_insertFileWith(oFT, pcPath, pvContents, ulLength, TRUE);
+}
+
+/*
+  Like FT_traversePath, but starts from the deepest of the first
+  ulChain nodes of poChain -- the nodes on the path at which the
+  previous batch entry stopped, root first -- whose name matches the
+  corresponding component under oCursor, so that the shared prefix is
+  compared name by name instead of being looked up again.
+*/
+static int FT_traverseFromChain(FT_T oFT, PathCursor_T oCursor,
+                                Node_T *poChain, size_t ulChain,
+                                Node_T *poNFurthest, size_t *pulMatched) {
+    struct PathCursor sPeek;
+    Node_T oCurr;
+
+    assert(oCursor != NULL);
+    assert(poNFurthest != NULL);
+    assert(pulMatched != NULL);
+
+    /* The chain is only trusted while it still starts at the root */
+    if (ulChain == 0 || oFT->oRoot == NULL || poChain[0] != oFT->oRoot)
+        return FT_traversePath(oFT, oCursor, poNFurthest, pulMatched);
+
+    if (PathCursor_compareString(oCursor, Node_getName(oFT->oRoot)) != 0)
+        return CONFLICTING_PATH;
+
+    oCurr = oFT->oRoot;
+    *pulMatched = 1;
+
+    /* Follow the previous path while the next component agrees */
+    while (*pulMatched < ulChain && !PathCursor_isLast(oCursor)) {
+        sPeek = *oCursor;
+        (void) PathCursor_next(&sPeek);
+        if (PathCursor_compareString(&sPeek,
+                                     Node_getName(poChain[*pulMatched])) != 0)
+            break;
+
+        *oCursor = sPeek;
+        oCurr = poChain[*pulMatched];
+        (*pulMatched)++;
+    }
+
+    FT_descend(oCursor, &oCurr, pulMatched);
+
+    *poNFurthest = oCurr;
+    return SUCCESS;
+}
+
+/*
+  Makes oNode, at depth ulDepth, the end of the chain of *pulChain
+  nodes at *ppoChain (of capacity *pulSlots), replacing entries from
+  the bottom up until reaching one that is already oNode's ancestor.
+  If the chain cannot grow, empties it instead, which only costs the
+  next entry a full traversal.
+*/
+static void FT_rememberChain(Node_T **ppoChain, size_t *pulSlots,
+                             size_t *pulChain, Node_T oNode,
+                             size_t ulDepth) {
+    size_t ulOld;
+
+    assert(ppoChain != NULL);
+    assert(pulSlots != NULL);
+    assert(pulChain != NULL);
+    assert(oNode != NULL);
+
+    if (ulDepth > *pulSlots) {
+        size_t ulNewSlots = *pulSlots == 0 ? 16 : *pulSlots;
+        Node_T *poNew;
+
+        while (ulNewSlots < ulDepth)
+            ulNewSlots *= 2;
+        poNew = realloc(*ppoChain, ulNewSlots * sizeof(Node_T));
+        if (poNew == NULL) {
+            *pulChain = 0;
+            return;
+        }
+        *ppoChain = poNew;
+        *pulSlots = ulNewSlots;
+    }
+
+    ulOld = *pulChain;
+    *pulChain = ulDepth;
+    while (ulDepth > 0) {
+        if (ulDepth <= ulOld && (*ppoChain)[ulDepth - 1] == oNode)
+            break;
+        (*ppoChain)[ulDepth - 1] = oNode;
+        oNode = Node_getParent(oNode);
+        ulDepth--;
+    }
+}
+
+/*
+  Inserts the ulCount entries of psEntries in order, each as if by
+  FT_insertDir or FT_insertFile, but resuming each traversal from the
+  deepest ancestor it shares with the previous entry; input sorted by
+  path therefore costs little more than creating the new nodes. An
+  entry that fails leaves the FT as it was and does not stop the
+  batch. If piStatuses is not NULL, sets piStatuses[i] to the status
+  of entry i. Returns the number of entries inserted.
+*/
+size_t FT_insertBatchIn(FT_T oFT, const struct FT_BatchEntry *psEntries,
+                        size_t ulCount, int *piStatuses) {
+    Node_T *poChain = NULL;
+    size_t ulSlots = 0;
+    size_t ulChain = 0;
+    size_t ulInserted = 0;
+    boolean bEntered;
+    size_t i;
+
+    assert(psEntries != NULL || ulCount == 0);
+
+    /* The chain is only worth keeping if nobody else moves it */
+    bEntered = FT_enter(oFT, FT_WHOLE);
+
+    for (i = 0; i < ulCount; i++) {
+        const struct FT_BatchEntry *psEntry = &psEntries[i];
+        NodeType eType = psEntry->bIsFile ? FT_FILE : FT_DIR;
+        size_t ulLength = eType == FT_FILE && psEntry->pvContents != NULL ?
+                          psEntry->ulLength : 0;
+        struct PathCursor sCursor;
+        Node_T oFurthest = NULL;
+        Node_T oNewNode = NULL;
+        Node_T oNFirst = NULL;
+        size_t ulMatched = 0;
+        int iStatus;
+
+        assert(psEntry->pcPath != NULL);
+
+        if (!bEntered)
+            iStatus = INITIALIZATION_ERROR;
+        else
+            iStatus = PathCursor_init(&sCursor, psEntry->pcPath);
+
+        /* A file can never be the root of the FT */
+        if (iStatus == SUCCESS && eType == FT_FILE &&
+            PathCursor_getDepth(&sCursor) == 1)
+            iStatus = CONFLICTING_PATH;
+
+        if (iStatus == SUCCESS)
+            iStatus = FT_traverseFromChain(oFT, &sCursor, poChain,
+                                           ulChain, &oFurthest, &ulMatched);
+
+        if (iStatus == SUCCESS) {
+            iStatus = FT_insertResolved(oFT, &sCursor, oFurthest,
+                                        ulMatched, eType, &oNewNode,
+                                        &oNFirst);
+
+            if (iStatus == SUCCESS && eType == FT_FILE) {
+                if (FT_copyContents(oNewNode, psEntry->pvContents,
+                                    ulLength, oFT->bDedup))
+                    FT_resizeFile(oFT, oNewNode, 0, ulLength);
+                else {
+                    (void) FT_removeNode(oFT, oNewNode, NULL, FALSE, NULL);
+                    iStatus = MEMORY_ERROR;
+                }
+            }
+            if (iStatus == SUCCESS)
+                FT_watchChange(oFT, Node_getParent(oNFirst),
+                               eType == FT_FILE ? FT_OP_INSERT_FILE :
+                               FT_OP_INSERT_DIR, psEntry->pcPath, ulLength);
+
+            /* The furthest existing node survives any failure above,
+               unless it had been copied away from a snapshot */
+            if (iStatus == SUCCESS)
+                FT_rememberChain(&poChain, &ulSlots, &ulChain, oNewNode,
+                                 PathCursor_getDepth(&sCursor));
+            else if (oFT->psShared != NULL)
+                ulChain = 0;
+            else if (oFurthest != NULL)
+                FT_rememberChain(&poChain, &ulSlots, &ulChain, oFurthest,
+                                 ulMatched);
+        }
+
+        if (iStatus == SUCCESS) {
+            (void) FT_journal(oFT, eType == FT_FILE ?
+                              FT_OP_INSERT_FILE : FT_OP_INSERT_DIR,
+                              psEntry->pcPath, psEntry->pvContents,
+                              ulLength, iStatus);
+            ulInserted++;
+        }
+        if (piStatuses != NULL)
+            piStatuses[i] = iStatus;
+    }
+
+    free(poChain);
+    if (bEntered)
+        FT_leave(oFT, FT_WHOLE);
+    return ulInserted;
+}
+
+/* A directory still collecting its children in FT_buildFromSorted */
+struct FT_OpenDir {
+    Node_T oNode;            /* The directory */
+    size_t ulFirstChild;     /* Where its children start on the staging stack */
+};
+
+/* The state of an FT_buildFromSorted pass */
+struct FT_Build {
+    Arena_T oArena;          /* Where the new tree's memory comes from */
+    Node_T oRoot;            /* The new tree's root, once created */
+    struct FT_OpenDir *psOpen;   /* The open directories, root first */
+    size_t ulOpen;
+    size_t ulOpenSlots;
+    Node_T *poNStaged;       /* Children not yet handed to their parents */
+    size_t ulStaged;
+    size_t ulStagedSlots;
+    boolean bDedup;          /* Whether contents are shared (see FT_setDedupIn) */
+};
+
+/*
+  Makes sure that the array at *ppvArray, of *pulSlots elements of
+  ulSize bytes each, has room for at least ulNeeded of them, doubling
+  it as needed. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int FT_buildReserve(void **ppvArray, size_t *pulSlots,
+                           size_t ulNeeded, size_t ulSize) {
+    size_t ulNewSlots;
+    void *pvNew;
+
+    assert(ppvArray != NULL);
+    assert(pulSlots != NULL);
+
+    if (ulNeeded <= *pulSlots)
+        return SUCCESS;
+
+    ulNewSlots = *pulSlots == 0 ? 16 : *pulSlots;
+    while (ulNewSlots < ulNeeded)
+        ulNewSlots *= 2;
+    pvNew = realloc(*ppvArray, ulNewSlots * ulSize);
+    if (pvNew == NULL)
+        return MEMORY_ERROR;
+
+    *ppvArray = pvNew;
+    *pulSlots = ulNewSlots;
+    return SUCCESS;
+}
+
+/*
+  Closes every open directory of psBuild below the first ulKeep, the
+  deepest first, handing each one its staged children in a single,
+  exactly sized array. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int FT_buildClose(struct FT_Build *psBuild, size_t ulKeep) {
+    assert(psBuild != NULL);
+
+    while (psBuild->ulOpen > ulKeep) {
+        struct FT_OpenDir *psDir = &psBuild->psOpen[--psBuild->ulOpen];
+        int iStatus;
+
+        iStatus = Node_setChildren(psDir->oNode,
+                                   psBuild->poNStaged + psDir->ulFirstChild,
+                                   psBuild->ulStaged - psDir->ulFirstChild);
+        if (iStatus != SUCCESS)
+            return iStatus;
+        psBuild->ulStaged = psDir->ulFirstChild;
+    }
+    return SUCCESS;
+}
+
+/*
+  Creates a node of type eType named by the ulLength characters at
+  pcName, as the next child of psBuild's deepest open directory (or as
+  the root), stages it, and opens it if it is a directory. Returns
+  SUCCESS and sets *poNResult to the node, or returns MEMORY_ERROR.
+*/
+static int FT_buildAdd(struct FT_Build *psBuild, const char *pcName,
+                       size_t ulLength, NodeType eType,
+                       Node_T *poNResult) {
+    Node_T oNParent = NULL;
+    int iStatus;
+
+    assert(psBuild != NULL);
+    assert(pcName != NULL);
+    assert(poNResult != NULL);
+
+    if (psBuild->ulOpen > 0)
+        oNParent = psBuild->psOpen[psBuild->ulOpen - 1].oNode;
+
+    /* Reserve first, so that a new node is never left half-recorded */
+    if (FT_buildReserve((void **) &psBuild->poNStaged,
+                        &psBuild->ulStagedSlots, psBuild->ulStaged + 1,
+                        sizeof(Node_T)) != SUCCESS ||
+        FT_buildReserve((void **) &psBuild->psOpen,
+                        &psBuild->ulOpenSlots, psBuild->ulOpen + 1,
+                        sizeof(struct FT_OpenDir)) != SUCCESS)
+        return MEMORY_ERROR;
+
+    iStatus = Node_new(oNParent, pcName, ulLength, eType, psBuild->oArena,
+                       poNResult);
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    if (oNParent != NULL)
+        psBuild->poNStaged[psBuild->ulStaged++] = *poNResult;
+    else
+        psBuild->oRoot = *poNResult;
+
+    if (eType == FT_DIR) {
+        psBuild->psOpen[psBuild->ulOpen].oNode = *poNResult;
+        psBuild->psOpen[psBuild->ulOpen].ulFirstChild = psBuild->ulStaged;
+        psBuild->ulOpen++;
+    }
+    return SUCCESS;
+}
+
+/*
+  Adds psEntry, the next entry of a sorted build, to psBuild: checks
+  it against the open directories and the last child staged, closes
+  the directories it has moved past, and creates its missing nodes.
+  Returns SUCCESS or one of the statuses of FT_buildFromSorted.
+*/
+static int FT_buildEntry(struct FT_Build *psBuild,
+                         const struct FT_BatchEntry *psEntry) {
+    struct PathCursor sCursor;
+    NodeType eType = psEntry->bIsFile ? FT_FILE : FT_DIR;
+    size_t ulDepth;
+    size_t ulMatched = 0;
+    Node_T oNNode;
+    int iStatus;
+
+    assert(psBuild != NULL);
+    assert(psEntry != NULL);
+    assert(psEntry->pcPath != NULL);
+
+    iStatus = PathCursor_init(&sCursor, psEntry->pcPath);
+    if (iStatus != SUCCESS)
+        return iStatus;
+    ulDepth = PathCursor_getDepth(&sCursor);
+
+    /* A file can never be the root of the FT */
+    if (eType == FT_FILE && ulDepth == 1)
+        return CONFLICTING_PATH;
+
+    /* Match the open directories, leaving sCursor at the first miss */
+    if (psBuild->ulOpen > 0) {
+        if (PathCursor_compareString(&sCursor,
+                                     Node_getName(psBuild->psOpen[0].oNode)) != 0)
+            return CONFLICTING_PATH;
+
+        ulMatched = 1;
+        while (ulMatched < ulDepth) {
+            (void) PathCursor_next(&sCursor);
+            if (ulMatched == psBuild->ulOpen ||
+                PathCursor_compareString(&sCursor,
+                    Node_getName(psBuild->psOpen[ulMatched].oNode)) != 0)
+                break;
+            ulMatched++;
+        }
+        if (ulMatched == ulDepth)
+            return ALREADY_IN_TREE;
+    }
+
+    iStatus = FT_buildClose(psBuild, ulMatched);
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    /* A new child must sort after its parent's previous one */
+    if (ulMatched > 0 &&
+        psBuild->ulStaged > psBuild->psOpen[ulMatched - 1].ulFirstChild) {
+        Node_T oNLast = psBuild->poNStaged[psBuild->ulStaged - 1];
+        int iCompare = PathCursor_compareString(&sCursor,
+                                                Node_getName(oNLast));
+
+        if (iCompare == 0 && Node_getType(oNLast) == FT_FILE)
+            return ulMatched + 1 < ulDepth ? NOT_A_DIRECTORY : ALREADY_IN_TREE;
+        if (iCompare <= 0)
+            return BAD_PATH;
+    }
+
+    /* Everything from here down is new */
+    for (;;) {
+        NodeType eNewType = PathCursor_isLast(&sCursor) ? eType : FT_DIR;
+
+        iStatus = FT_buildAdd(psBuild, PathCursor_getComponent(&sCursor),
+                              PathCursor_getLength(&sCursor), eNewType,
+                              &oNNode);
+        if (iStatus != SUCCESS)
+            return iStatus;
+        if (!PathCursor_next(&sCursor))
+            break;
+    }
+
+    if (eType == FT_FILE &&
+        !FT_copyContents(oNNode, psEntry->pvContents,
+                         psEntry->pvContents == NULL ? 0 : psEntry->ulLength,
+                         psBuild->bDedup))
+        return MEMORY_ERROR;
+
+    return SUCCESS;
+}
+
+/* The body of FT_buildFromSortedIn, under an exclusive tree lock. */
+static int FT_buildFromSortedLocked(FT_T oFT,
+                                    const struct FT_BatchEntry *psEntries,
+                                    size_t ulCount, size_t *pulFailed) {
+    struct FT_Build sBuild;
+    size_t i;
+    int iStatus = SUCCESS;
+
+    if (oFT->oRoot != NULL) {
+        if (pulFailed != NULL)
+            *pulFailed = ulCount;
+        return CONFLICTING_PATH;
+    }
+
+    /* Build into a fresh arena, so that a failure is discarded at once */
+    sBuild.oArena = Arena_new();
+    if (sBuild.oArena == NULL) {
+        if (pulFailed != NULL)
+            *pulFailed = ulCount;
+        return MEMORY_ERROR;
+    }
+    sBuild.oRoot = NULL;
+    sBuild.psOpen = NULL;
+    sBuild.ulOpen = 0;
+    sBuild.ulOpenSlots = 0;
+    sBuild.poNStaged = NULL;
+    sBuild.ulStaged = 0;
+    sBuild.ulStagedSlots = 0;
+    sBuild.bDedup = oFT->bDedup;
+
+    for (i = 0; i < ulCount && iStatus == SUCCESS; i++)
+        iStatus = FT_buildEntry(&sBuild, &psEntries[i]);
+    if (iStatus != SUCCESS)
+        i--;
+    else
+        iStatus = FT_buildClose(&sBuild, 0);
+
+    free(sBuild.psOpen);
+    free(sBuild.poNStaged);
+
+    if (iStatus != SUCCESS) {
+        Arena_free(sBuild.oArena);
+        if (pulFailed != NULL)
+            *pulFailed = i;
+        return iStatus;
+    }
+
+    FT_dropArena(oFT->oArena);
+    oFT->oArena = sBuild.oArena;
+    EPOCH_PUBLISH(oFT->oRoot, sBuild.oRoot);
+    FT_countTree(oFT);
+    FT_checkTree(oFT);
+    return SUCCESS;
+}
+
+/*
+  Builds the FT, which must be empty, from the ulCount entries of
+  psEntries in one streaming pass: each directory's children are
+  collected as they arrive and linked in one exactly sized array when
+  the input moves past it, so no lookups, shifts or regrowth happen
+  and the build takes time linear in the input.
+*/
+int FT_buildFromSortedIn(FT_T oFT, const struct FT_BatchEntry *psEntries,
+                         size_t ulCount, size_t *pulFailed) {
+    int iStatus;
+
+    assert(psEntries != NULL || ulCount == 0);
+
+    if (!FT_enter(oFT, FT_WHOLE))
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_buildFromSortedLocked(oFT, psEntries, ulCount, pulFailed);
+    (void) FT_journalAll(oFT, iStatus);
+
+    FT_leave(oFT, FT_WHOLE);
+    return iStatus;
+}
+
+/*
+  Returns TRUE if the FT contains a file with absolute path
+  pcPath and FALSE if not or if there is an error while checking.
+*/
+boolean FT_containsFileIn(FT_T oFT, const char *pcPath) {
+    return FT_containsNode(oFT, pcPath, FT_FILE);
+}
+
+/*
+  Removes the FT file with absolute path pcPath.
+  Returns SUCCESS if found and removed.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
   * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  * NOT_A_FILE if pcPath is in the FT as a directory not a file
   * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_rmFileIn(FT_T oFT, const char *pcPath) {
+    return FT_rmNode(oFT, pcPath, FT_FILE);
+}
+
+/*
+  Returns the contents of the file with absolute path pcPath.
+  Returns NULL if unable to complete the request for any reason.
+
+  Note: checking for a non-NULL return is not an appropriate
+  contains check, because the contents of a file may be NULL.
+*/
+void *FT_getFileContentsIn(FT_T oFT, const char *pcPath) {
+    Node_T oNFound;
+    FT_Lock psHeld;
+    void *pvContents = NULL;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (!FT_enter(oFT, FT_LOOKUP))
+        return NULL;
+
+    iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound, &psHeld);
+    if (iStatus == SUCCESS) {
+        /* Return pointer to the contents — may be NULL (empty file) */
+        if (Node_getType(oNFound) == FT_FILE)
+            pvContents = (void *)Node_getContents(oNFound);
+        else
+            iStatus = NOT_A_FILE;
+        FT_unlock(psHeld);
+    }
+
+    (void) FT_countOp(oFT, FT_OP_GET_CONTENTS, iStatus);
+    FT_leave(oFT, FT_LOOKUP);
+    return pvContents;
+}
+
+/*
+  Replaces the contents of the file with absolute path pcPath with the
+  ulNewLength bytes at pvNewContents: a copy of them, or pvNewContents
+  itself if bAdopt is TRUE. Returns the old contents, or NULL if unable
+  to complete the request (in which case nothing is adopted).
+*/
+static void *FT_replaceContentsWith(FT_T oFT, const char *pcPath,
+                                    void *pvNewContents, size_t ulNewLength,
+                                    boolean bAdopt) {
+    Node_T oCurr;
+    FT_Lock psHeld;
+    void *oldContents = NULL;
+    int result;
+
+    assert(pcPath != NULL);
+
+    if (pvNewContents == NULL)
+        ulNewLength = 0;
+
+    if (!FT_enter(oFT, FT_CHANGE))
+        return NULL;
+
+    /* ------------------ STEP 1: Find the target file ------------------ */
+
+    result = FT_findNode(oFT, pcPath, TRUE, &oCurr, &psHeld);
+    if (result != SUCCESS) {
+        (void) FT_countOp(oFT, FT_OP_REPLACE_CONTENTS, result);
+        FT_leave(oFT, FT_CHANGE);
+        return NULL;
+    }
+
+    /* ------------------ STEP 2: Replace contents and return old contents ------------------ */
+
+    if (Node_getType(oCurr) != FT_FILE)
+        (void) FT_countOp(oFT, FT_OP_REPLACE_CONTENTS, NOT_A_FILE);
+    else if (FT_unshare(oFT, &oCurr) != SUCCESS)
+        (void) FT_countOp(oFT, FT_OP_REPLACE_CONTENTS, MEMORY_ERROR);
+    else {
+        size_t ulOldLength = Node_getContentsLength(oCurr);
+
+        /* The old contents stay valid: the node keeps them until the next change */
+        oldContents = Node_getContents(oCurr);
+
+        if (bAdopt)
+            result = Node_adoptContents(oCurr, pvNewContents, ulNewLength);
+        else
+            result = FT_copyContents(oCurr, pvNewContents, ulNewLength,
+                                     oFT->bDedup);
+        if (result) {
+            FT_resizeFile(oFT, oCurr, ulOldLength, ulNewLength);
+            FT_watchChange(oFT, Node_getParent(oCurr),
+                           FT_OP_REPLACE_CONTENTS, pcPath, ulNewLength);
+            (void) FT_journal(oFT, FT_OP_REPLACE_CONTENTS, pcPath,
+                              pvNewContents, ulNewLength, SUCCESS);
+        }
+        else
+            oldContents = NULL;
+        (void) FT_countOp(oFT, FT_OP_REPLACE_CONTENTS,
+                          result ? SUCCESS : MEMORY_ERROR);
+    }
+
+    FT_unlock(psHeld);
+    FT_leave(oFT, FT_CHANGE);
+    return oldContents;
+}
+
+/*
+  Replaces current contents of the file with absolute path pcPath with
+  the parameter pvNewContents of size ulNewLength bytes.
+  Returns the old contents if successful. (Note: contents may be NULL.)
+  The old contents remain owned by the FT and stay valid until the
+  file's contents are replaced again, or the file is removed (and at
+  the latest until FT_destroy); a snapshot that holds the file keeps
+  them valid for as long as it could still return them.
+  Returns NULL if unable to complete the request for any reason.
+*/
+void *FT_replaceFileContentsIn(FT_T oFT, const char *pcPath,
+                               void *pvNewContents, size_t ulNewLength) {
+    return FT_replaceContentsWith(oFT, pcPath, pvNewContents, ulNewLength,
+                                  FALSE);
+}
+
+/*
+  Like FT_replaceFileContents, but the FT takes ownership of
+  pvNewContents, which must have been allocated by malloc, instead of
+  copying it. Ownership passes to the FT only if the replacement
+  succeeds, i.e., if FT_getFileContents(pcPath) then returns
+  pvNewContents.
+*/
+void *FT_replaceFileContentsAdoptIn(FT_T oFT, const char *pcPath,
+                                    void *pvNewContents, size_t ulNewLength) {
+    return FT_replaceContentsWith(oFT, pcPath, pvNewContents, ulNewLength,
+                                  TRUE);
+}
+
+/*
+  Resolves the path under oCursor, which must be positioned at its
+  first component, as far as its parent directory, for an operation
+  that has oFT to itself. Returns SUCCESS, sets *poNFurthest to the
+  deepest node on the path and leaves oCursor as FT_traversePath does;
+  the path exists if that is its last component. Otherwise, returns
+  CONFLICTING_PATH if the root is not a prefix of the path,
+  NOT_A_DIRECTORY if a proper prefix of it is a file, or NO_SUCH_PATH
+  if its parent is missing.
+*/
+static int FT_resolveParent(FT_T oFT, PathCursor_T oCursor,
+                            Node_T *poNFurthest) {
+    size_t ulMatched;
+    int iStatus;
+
+    iStatus = FT_traversePath(oFT, oCursor, poNFurthest, &ulMatched);
+    FT_countWalk(oFT, ulMatched);
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    if (ulMatched + 1 < PathCursor_getDepth(oCursor) ||
+        (ulMatched + 1 == PathCursor_getDepth(oCursor) &&
+         Node_getType(*poNFurthest) != FT_DIR))
+        return *poNFurthest != NULL &&
+               Node_getType(*poNFurthest) == FT_FILE ?
+               NOT_A_DIRECTORY : NO_SUCH_PATH;
+    return SUCCESS;
+}
+
+/*
+  Moves the node with absolute path pcOldPath, and the subtree rooted
+  at it, to absolute path pcNewPath, whose parent must exist. Returns
+  the statuses documented for FT_move.
+*/
+int FT_moveIn(FT_T oFT, const char *pcOldPath, const char *pcNewPath) {
+    struct PathCursor sOld;
+    struct PathCursor sNew;
+    Node_T oNNode = NULL;
+    Node_T oNNewParent = NULL;
+    Node_T oNOldParent = NULL;
+    Node_T oNAncestor;
+    struct Node_Totals sTotals;
+    struct FT_Event sEvent;
+    int iStatus;
+
+    assert(pcOldPath != NULL);
+    assert(pcNewPath != NULL);
+
+    if (!FT_enter(oFT, FT_WHOLE))
+        return INITIALIZATION_ERROR;
+
+    iStatus = PathCursor_init(&sOld, pcOldPath);
+    if (iStatus == SUCCESS)
+        iStatus = PathCursor_init(&sNew, pcNewPath);
+
+    /* The root can neither move nor be replaced */
+    if (iStatus == SUCCESS &&
+        (PathCursor_getDepth(&sOld) == 1 || PathCursor_getDepth(&sNew) == 1))
+        iStatus = CONFLICTING_PATH;
+
+    if (iStatus == SUCCESS) {
+        iStatus = FT_resolveParent(oFT, &sOld, &oNNode);
+        if (iStatus == SUCCESS &&
+            Node_getDepth(oNNode) != PathCursor_getDepth(&sOld))
+            iStatus = NO_SUCH_PATH;
+    }
+    if (iStatus == SUCCESS)
+        iStatus = FT_resolveParent(oFT, &sNew, &oNNewParent);
+
+    /* Nothing can move into its own subtree, nor onto itself */
+    if (iStatus == SUCCESS) {
+        for (oNAncestor = oNNewParent; oNAncestor != NULL;
+             oNAncestor = Node_getParent(oNAncestor))
+            if (oNAncestor == oNNode)
+                break;
+        if (oNAncestor != NULL)
+            iStatus = CONFLICTING_PATH;
+        else if (Node_getDepth(oNNewParent) == PathCursor_getDepth(&sNew))
+            iStatus = ALREADY_IN_TREE;
+    }
+
+    /* Whatever snapshots share on either side stays as they saw it.
+       Copying the old side may copy ancestors of the new parent, or
+       the new parent itself, so that is resolved again in between. */
+    if (iStatus == SUCCESS && oFT->psShared != NULL) {
+        if (FT_unshare(oFT, &oNNode) != SUCCESS)
+            iStatus = MEMORY_ERROR;
+        else {
+            (void) PathCursor_init(&sNew, pcNewPath);
+            (void) FT_resolveParent(oFT, &sNew, &oNNewParent);
+            if (FT_unshare(oFT, &oNNewParent) != SUCCESS)
+                iStatus = MEMORY_ERROR;
+        }
+    }
+
+    if (iStatus == SUCCESS) {
+        FT_cacheInvalidate(oFT);
+        oNOldParent = Node_getParent(oNNode);
+        iStatus = Node_move(oNNode, oNNewParent,
+                            PathCursor_getComponent(&sNew),
+                            PathCursor_getLength(&sNew), &oNNode);
+    }
+
+    if (iStatus == SUCCESS) {
+        /* Common ancestors lose the subtree's totals and get them back */
+        Node_getTotals(oNNode, &sTotals);
+        Node_addTotals(oNOldParent, &sTotals, FALSE);
+        Node_addTotals(oNNewParent, &sTotals, TRUE);
+        FT_countInsert(oFT, oNNewParent, 0, Node_getDepth(oNNode));
+        FT_checkAfter(oFT, oNOldParent);
+        FT_checkAfter(oFT, oNNode);
+
+        /* A watch that sees both ends hears of the move once */
+        sEvent.eOp = FT_OP_MOVE;
+        sEvent.pcPath = pcOldPath;
+        sEvent.pcNewPath = pcNewPath;
+        sEvent.ulSize = 0;
+        FT_watchRehome(oNNode);
+        FT_watchNotify(oFT, oNOldParent, &sEvent, NULL);
+        FT_watchNotify(oFT, oNNewParent, &sEvent, oNOldParent);
+        FT_watchBelow(oFT, oNNode, &sEvent, FALSE);
+    }
+
+    (void) FT_journal(oFT, FT_OP_MOVE, pcOldPath, pcNewPath,
+                      strlen(pcNewPath) + 1, iStatus);
+    (void) FT_countOp(oFT, FT_OP_MOVE, iStatus);
+    FT_leave(oFT, FT_WHOLE);
+    return iStatus;
+}
+
+/*
+  Returns SUCCESS if pcPath exists in the hierarchy,
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  * MEMORY_ERROR if memory could not be allocated to complete request
+
+  When returning SUCCESS,
+  if path is a directory: sets *pbIsFile to FALSE, *pulSize unchanged
+  if path is a file: sets *pbIsFile to TRUE, and
+                     sets *pulSize to the length of file's contents
+
+  When returning another status, *pbIsFile and *pulSize are unchanged.
+*/
+int FT_statIn(FT_T oFT, const char *pcPath, boolean *pbIsFile,
+              size_t *pulSize) {
+    Node_T oCurr;
+    FT_Lock psHeld;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (!FT_enter(oFT, FT_LOOKUP))
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_findNode(oFT, pcPath, FALSE, &oCurr, &psHeld);
+    if (iStatus == NOT_A_DIRECTORY)
+        iStatus = NO_SUCH_PATH;
+    (void) FT_countOp(oFT, FT_OP_STAT, iStatus);
+    if (iStatus != SUCCESS) {
+        FT_leave(oFT, FT_LOOKUP);
+        return iStatus;
+    }
+
+    /* ------------------ Update output values based on type ------------------ */
+
+    if (Node_getType(oCurr) == FT_FILE) {
+        if (pbIsFile != NULL) *pbIsFile = TRUE;
+        if (pulSize != NULL) *pulSize = Node_getContentsLength(oCurr);
+    } else {
+        if (pbIsFile != NULL) {
+            *pbIsFile = FALSE;
+        }
+    }
+
+    FT_unlock(psHeld);
+    FT_leave(oFT, FT_LOOKUP);
+    return SUCCESS;
+}
+
+/* Sets the counts that are not NULL from psTotals. */
+static void FT_setTotals(const struct Node_Totals *psTotals,
+                         size_t *pulFiles, size_t *pulDirs,
+                         size_t *pulBytes) {
+    assert(psTotals != NULL);
+
+    if (pulFiles != NULL) *pulFiles = psTotals->ulFiles;
+    if (pulDirs != NULL) *pulDirs = psTotals->ulDirs;
+    if (pulBytes != NULL) *pulBytes = psTotals->ulBytes;
+}
+
+/*
+  Sets *pulFiles, *pulDirs and *pulBytes, those that are not NULL, to
+  the totals of the subtree rooted at pcPath, as documented for
+  FT_statTree, in O(depth) time. Returns the statuses of FT_statIn.
+*/
+int FT_statTreeIn(FT_T oFT, const char *pcPath, size_t *pulFiles,
+                  size_t *pulDirs, size_t *pulBytes) {
+    Node_T oCurr;
+    FT_Lock psHeld;
+    struct Node_Totals sTotals;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (!FT_enter(oFT, FT_LOOKUP))
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_findNode(oFT, pcPath, FALSE, &oCurr, &psHeld);
+    if (iStatus == NOT_A_DIRECTORY)
+        iStatus = NO_SUCH_PATH;
+    (void) FT_countOp(oFT, FT_OP_STAT_TREE, iStatus);
+    if (iStatus != SUCCESS) {
+        FT_leave(oFT, FT_LOOKUP);
+        return iStatus;
+    }
+
+    Node_getTotals(oCurr, &sTotals);
+    FT_setTotals(&sTotals, pulFiles, pulDirs, pulBytes);
+
+    FT_unlock(psHeld);
+    FT_leave(oFT, FT_LOOKUP);
+    return SUCCESS;
+}
+
+/*
+  Sets up oFT as an empty FT. Returns SUCCESS, or MEMORY_ERROR if its
+  arena could not be allocated.
+*/
+static int FT_setUp(FT_T oFT) {
+    assert(oFT != NULL);
+
+    /* Every node, children array and file copy comes from one arena */
+    oFT->oArena = Arena_new();
+    if (oFT->oArena == NULL) {
+        return MEMORY_ERROR;
+    }
+
+    oFT->oRoot = NULL;
+    oFT->pvImage = NULL;
+    oFT->ulImageSize = 0;
+    oFT->psShared = NULL;
+    oFT->psFrozen = NULL;
+    oFT->sCache.psEntries = NULL;
+    oFT->sCache.ulSlots = 0;
+    oFT->sCache.ulGeneration = 0;
+    oFT->sCache.oNLastParent = NULL;
+    oFT->sCache.ulParentGeneration = 0;
+    oFT->oJournal = NULL;
+    oFT->iJournalError = SUCCESS;
+    oFT->bDedup = FALSE;
+    oFT->psWatches = NULL;
+#ifdef STATS
+    memset(&oFT->sCounters, 0, sizeof(oFT->sCounters));
+#endif
+
+#ifdef THREADSAFE
+    if (pthread_rwlock_init(&oFT->sTreeLock, NULL) != 0) {
+        Arena_free(oFT->oArena);
+        return MEMORY_ERROR;
+    }
+    if (pthread_rwlock_init(&oFT->sRootLock, NULL) != 0) {
+        (void) pthread_rwlock_destroy(&oFT->sTreeLock);
+        Arena_free(oFT->oArena);
+        return MEMORY_ERROR;
+    }
+    if (pthread_mutex_init(&oFT->sCache.sMutex, NULL) != 0) {
+        (void) pthread_rwlock_destroy(&oFT->sRootLock);
+        (void) pthread_rwlock_destroy(&oFT->sTreeLock);
+        Arena_free(oFT->oArena);
+        return MEMORY_ERROR;
+    }
+#endif
+
+    return SUCCESS;
+}
+
+/* Frees everything that oFT holds, but not oFT itself. */
+static void FT_tearDown(FT_T oFT) {
+    assert(oFT != NULL);
+    assert(oFT->psShared == NULL);
+
+    /* Anything still retired may live in the arena, so free that first */
+    Epoch_barrier();
+    FT_reclaimWait();
+
+    /* Whatever the journal still buffers goes out */
+    (void) Journal_close(oFT->oJournal);
+    oFT->oJournal = NULL;
+    oFT->iJournalError = SUCCESS;
+
+    /* Watches left are stopped; events still queued keep them alive */
+    while (oFT->psWatches != NULL) {
+        struct FT_Watch *psWatch = oFT->psWatches;
+
+        oFT->psWatches = psWatch->psNext;
+        FT_watchEnd(psWatch);
+    }
+
+    /* Free the entire tree at once by dropping its arena */
+    Arena_free(oFT->oArena);
+    oFT->oArena = NULL;
+    oFT->oRoot = NULL;
+    free(oFT->psFrozen);
+    oFT->psFrozen = NULL;
+    free(oFT->sCache.psEntries);
+    oFT->sCache.psEntries = NULL;
+    oFT->sCache.ulSlots = 0;
+    FT_releaseImage(oFT);
+#ifdef THREADSAFE
+    (void) pthread_rwlock_destroy(&oFT->sTreeLock);
+    (void) pthread_rwlock_destroy(&oFT->sRootLock);
+    (void) pthread_mutex_destroy(&oFT->sCache.sMutex);
+#endif
+}
+
+/*
+  Returns a new, empty FT that shares no state with any other, or NULL
+  if memory could not be allocated.
+*/
+FT_T FT_new(void) {
+    FT_T oFT;
+
+    oFT = malloc(sizeof(struct FT));
+    if (oFT == NULL) {
+        return NULL;
+    }
+
+    if (FT_setUp(oFT) != SUCCESS) {
+        free(oFT);
+        return NULL;
+    }
+
+    return oFT;
+}
+
+/* Frees oFT and everything in it. Does nothing if oFT is NULL. */
+void FT_free(FT_T oFT) {
+    if (oFT == NULL) {
+        return;
+    }
+
+    FT_tearDown(oFT);
+    free(oFT);
+}
+
+/*
+  Sets the FT data structure to an initialized state.
+  The data structure is initially empty.
+  Returns INITIALIZATION_ERROR if already initialized,
+  MEMORY_ERROR if its arena could not be allocated, and SUCCESS otherwise.
+*/
+int FT_init(void) {
+    int iStatus;
+
+    /* If already initialized, return error */
+    if (bIsInitialized) {
+        return INITIALIZATION_ERROR;
+    }
+
+    iStatus = FT_setUp(&sGlobal);
+    if (iStatus != SUCCESS) {
+        return iStatus;
+    }
+
+    /* Mark as initialized */
+    bIsInitialized = TRUE;
+
+    return SUCCESS;
+}
+
+/*
+  Removes all contents of the data structure and
+  returns it to an uninitialized state.
+  Returns INITIALIZATION_ERROR if not already initialized,
+  and SUCCESS otherwise.
+*/
+int FT_destroy(void) {
+    /* Check if the FT has been initialized */
+    if (!bIsInitialized) {
+        return INITIALIZATION_ERROR;
+    }
+
+    FT_tearDown(&sGlobal);
+
+    /* Mark the FT as uninitialized */
+    bIsInitialized = FALSE;
+
+    return SUCCESS;
+}
+
+/*
+  Traversal functions giving FT_toString order: each directory has two
+  slots per child, the first round taken only by files and the second
+  only by directories, so that files come first and each group stays
+  sorted by name.
+*/
+static size_t FT_orderNumChildren(void *pvNode) {
+    Node_T oNode = pvNode;
+
+    if (Node_getType(oNode) != FT_DIR)
+        return 0;
+    return 2 * Node_getNumChildren(oNode);
+}
+
+static void *FT_orderGetChild(void *pvNode, size_t ulIndex) {
+    Node_T oNode = pvNode;
+    size_t ulNumChildren = Node_getNumChildren(oNode);
+    NodeType eWanted = FT_FILE;
+    Node_T oChild;
+
+    if (ulIndex >= ulNumChildren) {
+        ulIndex -= ulNumChildren;
+        eWanted = FT_DIR;
+    }
+    (void) Node_getChild(oNode, ulIndex, &oChild);
+    if (Node_getType(oChild) != eWanted)
+        return NULL;
+    return oChild;
+}
+
+/* An iterator over the FT in FT_toString order */
+struct FT_Iter {
+    struct Traversal sWalk;  /* The pre-order walk itself */
+    Node_T oPending;         /* A node returned by sWalk but not yet by the iterator */
+    char *pcPath;            /* The current node's path, rebuilt in place */
+    size_t ulPathSize;       /* Number of bytes allocated for pcPath */
+    size_t *pulPrefix;       /* pulPrefix[d] is the path length of the latest node at depth d */
+    size_t ulPrefixSlots;    /* Number of elements allocated for pulPrefix */
+    size_t ulBase;           /* Length of the path above the walk's first node */
+};
+
+/*
+  Sets up *psIter to walk the subtree at oNStart (NULL for none), which
+  need not be the root: pcPath then starts out holding the path of its
+  parent. Returns SUCCESS, or MEMORY_ERROR if there is no memory for
+  that path. Either way, *psIter must be released.
+*/
+static int FT_iterInitAt(struct FT_Iter *psIter, Node_T oNStart) {
+    Node_T oNParent;
+
+    assert(psIter != NULL);
+
+    Traversal_init(&psIter->sWalk, oNStart, TRAVERSAL_PREORDER,
+                   FT_orderNumChildren, FT_orderGetChild);
+    psIter->oPending = NULL;
+    psIter->pcPath = NULL;
+    psIter->ulPathSize = 0;
+    psIter->pulPrefix = NULL;
+    psIter->ulPrefixSlots = 0;
+    psIter->ulBase = 0;
+
+    if (oNStart == NULL || (oNParent = Node_getParent(oNStart)) == NULL)
+        return SUCCESS;
+    psIter->ulBase = Node_getPathLength(oNParent);
+    psIter->pcPath = malloc(psIter->ulBase + 1);
+    if (psIter->pcPath == NULL)
+        return MEMORY_ERROR;
+    psIter->ulPathSize = psIter->ulBase + 1;
+    (void) Node_writePath(oNParent, psIter->pcPath);
+    return SUCCESS;
+}
+
+/* Sets up *psIter to walk the tree from the root. */
+static void FT_iterInit(FT_T oFT, struct FT_Iter *psIter) {
+    /* The root has no parent whose path would need memory */
+    (void) FT_iterInitAt(psIter, oFT->oRoot);
+}
+
+/* Frees the memory held by *psIter, but not *psIter itself. */
+static void FT_iterRelease(struct FT_Iter *psIter) {
+    assert(psIter != NULL);
+
+    Traversal_free(&psIter->sWalk);
+    free(psIter->pcPath);
+    free(psIter->pulPrefix);
+}
+
+/*
+  Writes the path of psIter->oPending, at depth ulDepth, into
+  psIter->pcPath. The parent's path is already in place, so only
+  "/name" is written. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int FT_iterBuildPath(struct FT_Iter *psIter, size_t ulDepth) {
+    const char *pcName = Node_getName(psIter->oPending);
+    size_t ulNameLength = Node_getNameLength(psIter->oPending);
+    size_t ulPrefix = psIter->ulBase;
+    size_t ulLength;
+
+    assert(ulDepth > 0);
+
+    /* Only the root's path has nothing, and so no '/', before its name */
+    if (ulDepth > 1)
+        ulPrefix = psIter->pulPrefix[ulDepth - 1];
+    ulLength = ulPrefix + (ulPrefix > 0) + ulNameLength;
+
+    /* Make room for "/name" and the '\0', and for this depth's length */
+    if (ulLength + 1 > psIter->ulPathSize) {
+        size_t ulNewSize = 2 * psIter->ulPathSize;
+        char *pcNewPath;
+
+        if (ulNewSize < ulLength + 1)
+            ulNewSize = ulLength + 1;
+        pcNewPath = realloc(psIter->pcPath, ulNewSize);
+        if (pcNewPath == NULL)
+            return MEMORY_ERROR;
+        psIter->pcPath = pcNewPath;
+        psIter->ulPathSize = ulNewSize;
+    }
+    if (ulDepth + 1 > psIter->ulPrefixSlots) {
+        size_t ulNewSlots = 2 * psIter->ulPrefixSlots + 16;
+        size_t *pulNewPrefix = realloc(psIter->pulPrefix,
+                                       ulNewSlots * sizeof(size_t));
+        if (pulNewPrefix == NULL)
+            return MEMORY_ERROR;
+        psIter->pulPrefix = pulNewPrefix;
+        psIter->ulPrefixSlots = ulNewSlots;
+    }
+
+    if (ulPrefix > 0)
+        psIter->pcPath[ulPrefix++] = '/';
+    memcpy(psIter->pcPath + ulPrefix, pcName, ulNameLength + 1);
+    psIter->pulPrefix[ulDepth] = ulLength;
+    return SUCCESS;
+}
+
+/*
+  Advances *psIter. Returns SUCCESS and sets *ppcPath, *pulLength and
+  *pbIsFile for the next node, or sets *ppcPath to NULL at the end.
+  Returns MEMORY_ERROR, without losing the walk's place, on allocation
+  failure.
+*/
+static int FT_iterStep(struct FT_Iter *psIter, const char **ppcPath,
+                       size_t *pulLength, boolean *pbIsFile) {
+    size_t ulDepth;
+    int iStatus;
+
+    assert(psIter != NULL);
+    assert(ppcPath != NULL);
+
+    *ppcPath = NULL;
+
+    if (psIter->oPending == NULL) {
+        void *pvNode;
+
+        iStatus = Traversal_next(&psIter->sWalk, &pvNode);
+        if (iStatus != SUCCESS || pvNode == NULL)
+            return iStatus;
+        psIter->oPending = pvNode;
+    }
+
+    ulDepth = Traversal_getDepth(&psIter->sWalk);
+    iStatus = FT_iterBuildPath(psIter, ulDepth);
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    *ppcPath = psIter->pcPath;
+    if (pulLength != NULL)
+        *pulLength = psIter->pulPrefix[ulDepth];
+    if (pbIsFile != NULL)
+        *pbIsFile = (boolean) (Node_getType(psIter->oPending) == FT_FILE);
+    psIter->oPending = NULL;
+    return SUCCESS;
+}
+
+/*
+  Returns a new iterator over the nodes of the FT in FT_toString order,
+  or NULL if the FT is not in an initialized state or memory could not
+  be allocated. The FT must not change while the iterator is in use.
+*/
+FT_Iter_T FT_iterNewIn(FT_T oFT) {
+    FT_Iter_T oIter;
+
+    if (oFT == NULL)
+        return NULL;
+
+    oIter = malloc(sizeof(struct FT_Iter));
+    if (oIter == NULL)
+        return NULL;
+    FT_iterInit(oFT, oIter);
+    return oIter;
+}
+
+/*
+  Advances oIter to the next node. Returns SUCCESS and sets *ppcPath to
+  that node's absolute path, and (if not NULL) *pulLength to its length
+  and *pbIsFile to whether it is a file; the path is valid until the
+  next call. At the end of the FT, returns SUCCESS and sets *ppcPath to
+  NULL. Returns MEMORY_ERROR if memory could not be allocated, in which
+  case the call may be retried.
+*/
+int FT_iterNext(FT_Iter_T oIter, const char **ppcPath, size_t *pulLength,
+                boolean *pbIsFile) {
+    assert(oIter != NULL);
+    assert(ppcPath != NULL);
+
+    return FT_iterStep(oIter, ppcPath, pulLength, pbIsFile);
+}
+
+/* Frees oIter. Does nothing if oIter is NULL. */
+void FT_iterFree(FT_Iter_T oIter) {
+    if (oIter == NULL)
+        return;
+    FT_iterRelease(oIter);
+    free(oIter);
+}
+
+/* The body of FT_visitIn, under an exclusive tree lock. */
+static int FT_visitLocked(FT_T oFT,
+                          int (*pfVisit)(const char *pcPath, size_t ulLength,
+                                         boolean bIsFile, void *pvExtra),
+                          void *pvExtra) {
+    struct FT_Iter sIter;
+    const char *pcPath;
+    size_t ulLength;
+    boolean bIsFile;
+    int iStatus;
+
+    assert(pfVisit != NULL);
+
+    /* The iterator lives on the stack: no allocation for shallow trees */
+    FT_iterInit(oFT, &sIter);
+    for (;;) {
+        iStatus = FT_iterStep(&sIter, &pcPath, &ulLength, &bIsFile);
+        if (iStatus != SUCCESS || pcPath == NULL)
+            break;
+        iStatus = (*pfVisit)(pcPath, ulLength, bIsFile, pvExtra);
+        if (iStatus != SUCCESS)
+            break;
+    }
+    FT_iterRelease(&sIter);
+    return iStatus;
+}
+
+/*
+  Calls (*pfVisit)(pcPath, ulLength, bIsFile, pvExtra) for every node in
+  the FT, in the order used by FT_toString. pcPath is the node's absolute
+  path, ulLength characters long and '\0'-terminated; it is only valid
+  during the call. pfVisit returns SUCCESS to continue the walk; any
+  other status stops it.
+  Returns SUCCESS if every node was visited. Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * the status that pfVisit returned to stop the walk
+*/
+int FT_visitIn(FT_T oFT,
+               int (*pfVisit)(const char *pcPath, size_t ulLength,
+                              boolean bIsFile, void *pvExtra),
+               void *pvExtra) {
+    int iStatus;
+
+    assert(pfVisit != NULL);
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_visitLocked(oFT, pfVisit, pvExtra);
+
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/* The characters that make a component of an FT_query pattern a glob */
+static const char acGlobChars[] = "*?[\\";
+
+/*
+  Splits pcPattern, a well-formatted FT_query pattern of ulDepth
+  components, into one new block: an array whose i'th element is its
+  i'th component, '\0'-terminated, followed by the part of pcPattern
+  before its first glob component. Returns the array, or NULL if
+  memory could not be allocated. Sets *ppcPrefix to that part of
+  pcPattern (empty if its first component is a glob) and *pulLiteral
+  to the number of components it holds.
+*/
+static const char **FT_querySplit(const char *pcPattern, size_t ulDepth,
+                                  char **ppcPrefix, size_t *pulLiteral) {
+    struct PathCursor sCursor;
+    size_t ulLength = strlen(pcPattern);
+    const char **ppcSegments;
+    char *pcCopy;
+    size_t ulPrefix = 0;
+    size_t i;
+
+    /* One block: the components, then the copy they point into, then
+       the prefix */
+    ppcSegments = malloc(ulDepth * sizeof(const char *) + 2 * (ulLength + 1));
+    if (ppcSegments == NULL)
+        return NULL;
+    pcCopy = (char *) (ppcSegments + ulDepth);
+    memcpy(pcCopy, pcPattern, ulLength + 1);
+
+    *pulLiteral = 0;
+    (void) PathCursor_init(&sCursor, pcPattern);
+    for (i = 0; i < ulDepth; i++) {
+        size_t ulOffset = (size_t) (PathCursor_getComponent(&sCursor) -
+                                    pcPattern);
+        size_t ulComponent = PathCursor_getLength(&sCursor);
+
+        pcCopy[ulOffset + ulComponent] = '\0';
+        ppcSegments[i] = pcCopy + ulOffset;
+        if (*pulLiteral == i &&
+            strcspn(ppcSegments[i], acGlobChars) == ulComponent) {
+            (*pulLiteral)++;
+            ulPrefix = ulOffset + ulComponent;
+        }
+        (void) PathCursor_next(&sCursor);
+    }
+
+    *ppcPrefix = pcCopy + ulLength + 1;
+    memcpy(*ppcPrefix, pcPattern, ulPrefix);
+    (*ppcPrefix)[ulPrefix] = '\0';
+    return ppcSegments;
+}
+
+/*
+  Calls (*pfVisit)(pcPath, ulLength, bIsFile, pvExtra) for every node
+  whose absolute path matches pcPattern, and for each node up to
+  ulMaxDepth levels below such a node, in the order used by
+  FT_toString. Each component of pcPattern is matched against one
+  component of the path, as fnmatch(3) would without flags, so '*'
+  never matches across a '/'. The part of pcPattern before its first
+  glob component is looked up as any path is, and the walk from
+  there descends only into nodes that match their component (or that
+  lie within ulMaxDepth levels of a match), so it takes time in
+  proportion to the part of the FT it reaches, not to all of it.
+  Returns SUCCESS, even if nothing matched. Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPattern is not a well-formatted path
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * the status that pfVisit returned to stop the walk
+*/
+int FT_queryIn(FT_T oFT, const char *pcPattern, size_t ulMaxDepth,
+               int (*pfVisit)(const char *pcPath, size_t ulLength,
+                              boolean bIsFile, void *pvExtra),
+               void *pvExtra) {
+    struct PathCursor sCursor;
+    struct FT_Iter sIter;
+    const char **ppcSegments;
+    char *pcPrefix;
+    Node_T oNStart = NULL;
+    FT_Lock psHeld;
+    size_t ulDepth;
+    size_t ulLiteral;
+    size_t ulStart = 0;
+    int iStatus;
+
+    assert(pcPattern != NULL);
+    assert(pfVisit != NULL);
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    iStatus = PathCursor_init(&sCursor, pcPattern);
+    if (iStatus != SUCCESS) {
+        FT_leave(oFT, FT_SCAN);
+        return iStatus;
+    }
+    ulDepth = PathCursor_getDepth(&sCursor);
+
+    ppcSegments = FT_querySplit(pcPattern, ulDepth, &pcPrefix, &ulLiteral);
+    if (ppcSegments == NULL) {
+        FT_leave(oFT, FT_SCAN);
+        return MEMORY_ERROR;
+    }
+
+    /* A literal prefix is looked up directly; a glob root is matched
+       by the walk. A prefix that is not in the FT matches nothing. */
+    if (ulLiteral == 0)
+        oNStart = oFT->oRoot;
+    else if (FT_findNode(oFT, pcPrefix, FALSE, &oNStart, &psHeld) == SUCCESS) {
+        /* The tree lock is held exclusively, so nothing else can */
+        FT_unlock(psHeld);
+        ulStart = ulLiteral - 1;
+    }
+
+    iStatus = FT_iterInitAt(&sIter, oNStart);
+    while (iStatus == SUCCESS) {
+        const char *pcPath;
+        const char *pcName;
+        size_t ulLength;
+        size_t ulLevel;
+        boolean bIsFile;
+
+        iStatus = FT_iterStep(&sIter, &pcPath, &ulLength, &bIsFile);
+        if (iStatus != SUCCESS || pcPath == NULL)
+            break;
+
+        /* ulLevel is the node's component of the path, counting from 0 */
+        ulLevel = ulStart + Traversal_getDepth(&sIter.sWalk) - 1;
+        if (ulLevel < ulDepth) {
+            pcName = strrchr(pcPath, '/');
+            pcName = pcName == NULL ? pcPath : pcName + 1;
+            if (fnmatch(ppcSegments[ulLevel], pcName, 0) != 0) {
+                Traversal_skipChildren(&sIter.sWalk);
+                continue;
+            }
+
+            /* Only on the way to a match */
+            if (ulLevel + 1 < ulDepth)
+                continue;
+        }
+
+        if (ulLevel + 1 - ulDepth == ulMaxDepth)
+            Traversal_skipChildren(&sIter.sWalk);
+        iStatus = (*pfVisit)(pcPath, ulLength, bIsFile, pvExtra);
+    }
+    FT_iterRelease(&sIter);
+
+    free(ppcSegments);
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/* The suffix written after each path, by node type */
+static const char acFileSuffix[] = " [file]\n";
+static const char acDirSuffix[] = " [dir]\n";
+
+/* Returns the length of the FT_toString line for a node, '\n' included. */
+static size_t FT_lineLength(size_t ulPathLength, boolean bIsFile) {
+    if (bIsFile)
+        return ulPathLength + sizeof(acFileSuffix) - 1;
+    return ulPathLength + sizeof(acDirSuffix) - 1;
+}
+
+/* FT_visit callback for FT_writeTo: writes one line to the FILE* pvExtra. */
+static int FT_writeLine(const char *pcPath, size_t ulLength, boolean bIsFile,
+                        void *pvExtra) {
+    FILE *psFile = pvExtra;
+
+    (void) fwrite(pcPath, 1, ulLength, psFile);
+    (void) fputs(bIsFile ? acFileSuffix : acDirSuffix, psFile);
+    return SUCCESS;
+}
+
+/*
+  Writes the FT_toString representation of the FT to psFile, one line
+  at a time, without building it in memory first.
+  Returns SUCCESS, INITIALIZATION_ERROR if the FT is not in an
+  initialized state, or MEMORY_ERROR if memory could not be allocated.
+  Errors writing to psFile are left for the caller to check with ferror.
+*/
+int FT_writeToIn(FT_T oFT, FILE *psFile) {
+    assert(psFile != NULL);
+
+    return FT_visitIn(oFT, FT_writeLine, psFile);
+}
+
+/* FT_visit callback for FT_toString: adds a line's length to *pvExtra. */
+static int FT_measureLine(const char *pcPath, size_t ulLength, boolean bIsFile,
+                          void *pvExtra) {
+    (void) pcPath;
+    *(size_t *) pvExtra += FT_lineLength(ulLength, bIsFile);
+    return SUCCESS;
+}
+
+/* FT_visit callback for FT_toString: copies a line to the cursor *pvExtra. */
+static int FT_copyLine(const char *pcPath, size_t ulLength, boolean bIsFile,
+                       void *pvExtra) {
+    char **ppcCursor = pvExtra;
+    const char *pcSuffix = bIsFile ? acFileSuffix : acDirSuffix;
+    size_t ulSuffixLength = FT_lineLength(0, bIsFile);
+
+    memcpy(*ppcCursor, pcPath, ulLength);
+    memcpy(*ppcCursor + ulLength, pcSuffix, ulSuffixLength);
+    *ppcCursor += ulLength + ulSuffixLength;
+    return SUCCESS;
+}
+
+#ifdef THREADSAFE
+/* --------------------------------------------------------------------
+
+  A THREADSAFE build spreads FT_toString of a big tree over the CPUs.
+  The lines of a subtree are adjacent in the result, so the tree is cut
+  into pieces of at most FT_PIECE_NODES nodes each: whole subtrees, and
+  the lines of the directories above them on their own. Worker threads
+  take pieces off one shared counter as they finish others, so that a
+  slow piece holds up no one else's, first measuring each, then, once
+  the pieces' offsets are known, writing each into place.
+*/
+
+enum {
+    FT_PARALLEL_NODES = 1 << 16,  /* Fewest nodes worth starting threads for */
+    FT_PIECE_NODES = 1 << 12,     /* Most nodes in a piece, unless it is one */
+    FT_MAX_WORKERS = 32           /* Most threads to spread a tree over */
+};
+
+/* Returns the number of nodes in the subtree at oNNode, in O(1) time. */
+static size_t FT_subtreeSize(Node_T oNNode) {
+    struct Node_Totals sTotals;
+
+    if (Node_getType(oNNode) == FT_FILE)
+        return 1;
+    Node_getTotals(oNNode, &sTotals);
+    return sTotals.ulFiles + sTotals.ulDirs;
+}
+
+/* One piece of the result of FT_toString */
+struct FT_Piece {
+    Node_T oNNode;           /* The piece's first node */
+    boolean bWhole;          /* TRUE for oNNode's subtree, FALSE for its line alone */
+    size_t ulLength;         /* Number of characters in the piece */
+    size_t ulOffset;         /* Where in the result the piece starts */
+};
+
+/* The work that FT_toStringParallel's threads share */
+struct FT_Parallel {
+    struct FT_Piece *psPieces;  /* The pieces, in the order of the result */
+    size_t ulCount;          /* Number of pieces */
+    size_t ulNext;           /* The next piece to take, taken atomically */
+    char *pcResult;          /* The result to write, or NULL while measuring */
+    int iStatus;             /* SUCCESS, or the first failure, set atomically */
+};
+
+/*
+  Traversal functions for cutting the tree into pieces: they descend
+  into a directory only if its subtree is too big to be a piece.
+*/
+static size_t FT_pieceNumChildren(void *pvNode) {
+    if (FT_subtreeSize(pvNode) <= FT_PIECE_NODES)
+        return 0;
+    return FT_orderNumChildren(pvNode);
+}
+
+/*
+  Returns the number of threads, counting the caller, over which to
+  spread FT_toString of oFT's tree, or 1 if it is too small for that.
+*/
+static size_t FT_parallelWorkers(FT_T oFT) {
+    long lCPUs;
+
+    if (oFT->oRoot == NULL || FT_subtreeSize(oFT->oRoot) < FT_PARALLEL_NODES)
+        return 1;
+    lCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (lCPUs < 1)
+        return 1;
+    if (lCPUs > FT_MAX_WORKERS)
+        return FT_MAX_WORKERS;
+    return (size_t) lCPUs;
+}
+
+/*
+  Measures or writes, as psParallel->pcResult says, the piece at
+  psPiece. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int FT_pieceDo(const struct FT_Parallel *psParallel,
+                      struct FT_Piece *psPiece) {
+    struct FT_Iter sIter;
+    char *pcCursor = NULL;
+    const char *pcPath;
+    size_t ulLength;
+    boolean bIsFile;
+    int iStatus;
+
+    if (psParallel->pcResult != NULL)
+        pcCursor = psParallel->pcResult + psPiece->ulOffset;
+
+    /* Only directories are ever cut off from their subtrees */
+    if (!psPiece->bWhole) {
+        ulLength = Node_getPathLength(psPiece->oNNode);
+        if (pcCursor == NULL)
+            psPiece->ulLength = FT_lineLength(ulLength, FALSE);
+        else {
+            (void) Node_writePath(psPiece->oNNode, pcCursor);
+            memcpy(pcCursor + ulLength, acDirSuffix, sizeof(acDirSuffix) - 1);
+        }
+        return SUCCESS;
+    }
+
+    iStatus = FT_iterInitAt(&sIter, psPiece->oNNode);
+    if (pcCursor == NULL)
+        psPiece->ulLength = 0;
+    while (iStatus == SUCCESS) {
+        iStatus = FT_iterStep(&sIter, &pcPath, &ulLength, &bIsFile);
+        if (iStatus != SUCCESS || pcPath == NULL)
+            break;
+        if (pcCursor == NULL)
+            (void) FT_measureLine(pcPath, ulLength, bIsFile,
+                                  &psPiece->ulLength);
+        else
+            (void) FT_copyLine(pcPath, ulLength, bIsFile, &pcCursor);
+    }
+    FT_iterRelease(&sIter);
+    return iStatus;
+}
+
+/* Thread function: does pieces of *pvParallel until none are left. */
+static void *FT_parallelWork(void *pvParallel) {
+    struct FT_Parallel *psParallel = pvParallel;
+    size_t ulPiece;
+
+    while ((ulPiece = __atomic_fetch_add(&psParallel->ulNext, 1,
+                                         __ATOMIC_RELAXED)) <
+           psParallel->ulCount) {
+        if (FT_pieceDo(psParallel, &psParallel->psPieces[ulPiece]) != SUCCESS)
+            __atomic_store_n(&psParallel->iStatus, MEMORY_ERROR,
+                             __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/*
+  Does every piece of *psParallel, using up to ulWorkers threads, the
+  calling one among them. Runs on in fewer threads if no more can be
+  started. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int FT_parallelRun(struct FT_Parallel *psParallel, size_t ulWorkers) {
+    pthread_t asThreads[FT_MAX_WORKERS];
+    size_t ulStarted = 0;
+    size_t i;
+
+    assert(ulWorkers <= FT_MAX_WORKERS);
+
+    psParallel->ulNext = 0;
+    while (ulStarted + 1 < ulWorkers &&
+           pthread_create(&asThreads[ulStarted], NULL, FT_parallelWork,
+                          psParallel) == 0)
+        ulStarted++;
+    (void) FT_parallelWork(psParallel);
+    for (i = 0; i < ulStarted; i++)
+        (void) pthread_join(asThreads[i], NULL);
+    return psParallel->iStatus;
+}
+
+/*
+  Cuts oFT's tree into pieces, in the order of the result, for
+  *psParallel. Returns SUCCESS or MEMORY_ERROR.
+*/
+static int FT_parallelCut(FT_T oFT, struct FT_Parallel *psParallel) {
+    struct Traversal sWalk;
+    size_t ulSlots = 0;
+    void *pvNode;
+    int iStatus;
+
+    psParallel->psPieces = NULL;
+    psParallel->ulCount = 0;
+
+    Traversal_init(&sWalk, oFT->oRoot, TRAVERSAL_PREORDER,
+                   FT_pieceNumChildren, FT_orderGetChild);
+    while ((iStatus = Traversal_next(&sWalk, &pvNode)) == SUCCESS &&
+           pvNode != NULL) {
+        struct FT_Piece *psPiece;
+
+        iStatus = FT_buildReserve((void **) &psParallel->psPieces, &ulSlots,
+                                  psParallel->ulCount + 1,
+                                  sizeof(struct FT_Piece));
+        if (iStatus != SUCCESS)
+            break;
+        psPiece = &psParallel->psPieces[psParallel->ulCount++];
+        psPiece->oNNode = pvNode;
+        psPiece->bWhole = (boolean) (FT_subtreeSize(pvNode) <= FT_PIECE_NODES);
+        psPiece->ulLength = 0;
+        psPiece->ulOffset = 0;
+    }
+    Traversal_free(&sWalk);
+    return iStatus;
+}
+
+/*
+  Returns FT_toString of oFT, which the caller has to itself, built by
+  ulWorkers threads, or NULL if memory could not be allocated.
+*/
+static char *FT_toStringParallel(FT_T oFT, size_t ulWorkers) {
+    struct FT_Parallel sParallel;
+    size_t ulTotalLength = 0;
+    size_t i;
+
+    sParallel.pcResult = NULL;
+    sParallel.iStatus = SUCCESS;
+    if (FT_parallelCut(oFT, &sParallel) != SUCCESS ||
+        FT_parallelRun(&sParallel, ulWorkers) != SUCCESS) {
+        free(sParallel.psPieces);
+        return NULL;
+    }
+
+    for (i = 0; i < sParallel.ulCount; i++) {
+        sParallel.psPieces[i].ulOffset = ulTotalLength;
+        ulTotalLength += sParallel.psPieces[i].ulLength;
+    }
+
+    sParallel.pcResult = malloc(ulTotalLength + 1);
+    if (sParallel.pcResult != NULL &&
+        FT_parallelRun(&sParallel, ulWorkers) != SUCCESS) {
+        free(sParallel.pcResult);
+        sParallel.pcResult = NULL;
+    }
+    if (sParallel.pcResult != NULL)
+        sParallel.pcResult[ulTotalLength] = '\0';
+
+    free(sParallel.psPieces);
+    return sParallel.pcResult;
+}
+#endif
+
+/*
+  Returns a string representation of the
+  data structure, or NULL if the structure is
+  not initialized or there is an allocation error.
+
+  The representation is depth-first with files
+  before directories at any given level, and nodes
+  of the same type ordered lexicographically.
+
+  Allocates memory for the returned string,
+  which is then owned by client!
+*/
+char *FT_toStringIn(FT_T oFT) {
+    size_t ulTotalLength = 0;
+    char *pcResult;
+    char *pcCursor;
+#ifdef THREADSAFE
+    size_t ulWorkers;
+#endif
+
+    /* Both passes must see the same tree */
+    if (!FT_enter(oFT, FT_SCAN))
+        return NULL;
+
+#ifdef THREADSAFE
+    ulWorkers = FT_parallelWorkers(oFT);
+    if (ulWorkers > 1) {
+        pcResult = FT_toStringParallel(oFT, ulWorkers);
+        FT_leave(oFT, FT_SCAN);
+        return pcResult;
+    }
+#endif
+
+    /* First pass: measure, so that the result is allocated exactly once */
+    if (FT_visitLocked(oFT, FT_measureLine, &ulTotalLength) != SUCCESS) {
+        FT_leave(oFT, FT_SCAN);
+        return NULL;
+    }
+
+    pcResult = malloc(ulTotalLength + 1);
+    if (pcResult == NULL) {
+        FT_leave(oFT, FT_SCAN);
+        return NULL;
+    }
+
+    /* Second pass: copy each line in at a running cursor */
+    pcCursor = pcResult;
+    if (FT_visitLocked(oFT, FT_copyLine, &pcCursor) != SUCCESS) {
+        FT_leave(oFT, FT_SCAN);
+        free(pcResult);
+        return NULL;
+    }
+    FT_leave(oFT, FT_SCAN);
+    assert(pcCursor == pcResult + ulTotalLength);
+    *pcCursor = '\0';
+
+    return pcResult;
+}
+
+/* --------------------------------------------------------------------
+
+  An FT image, as written by FT_save, is a header, a node table, a name
+  table and the file contents, with no padding. The node table lists
+  the nodes in breadth-first order, the root first, so that each
+  directory's children are contiguous and sorted by name; each name in
+  the name table appears only once, however many nodes share it, and
+  so do contents that files share in memory (see FT_setDedupIn). All
+  numbers are 64-bit in the writer's byte order, which FT_loadMapped
+  checks through ulVersion.
+
+-------------------------------------------------------------------- */
+
+/* The first eight bytes of every FT image */
+static const char acImageMagic[8] = "FTIMAGE";
+
+enum { FT_IMAGE_VERSION = 1 };
+
+/* The header of an FT image */
+struct FT_ImageHeader {
+    char acMagic[8];         /* acImageMagic */
+    uint64_t ulVersion;      /* FT_IMAGE_VERSION */
+    uint64_t ulNumNodes;     /* Number of entries in the node table */
+    uint64_t ulNamesSize;    /* Number of bytes in the name table */
+    uint64_t ulBlobsSize;    /* Number of bytes of file contents */
+};
+
+/* One entry of an FT image's node table */
+struct FT_ImageNode {
+    uint64_t ulParent;       /* Index of the parent (0 for the root) */
+    uint64_t ulFirstChild;   /* Index of the first child, if any */
+    uint64_t ulNumChildren;  /* Number of children (0 for a file) */
+    uint64_t ulNameOffset;   /* Where the name starts in the name table */
+    uint64_t ulNameLength;   /* Number of bytes in the name */
+    uint64_t ulBlobOffset;   /* Where a file's contents start */
+    uint64_t ulBlobLength;   /* Number of bytes in a file's contents */
+    uint64_t ulType;         /* FT_DIR or FT_FILE */
+};
+
+/*
+  A slot of one of FT_save's tables from what nodes share (interned
+  names, or file contents) to where it was placed in the image
+*/
+struct FT_OffsetSlot {
+    const void *pvKey;       /* The name or contents, or NULL if the slot is free */
+    uint64_t ulOffset;       /* Where it was placed in its section */
+};
+
+/*
+  Returns the slot of the table psSlots, of ulSlots slots (a power of
+  2), that holds pvKey, whose hash is ulHash, or else the free slot
+  where it belongs. The table must have a free slot.
+*/
+static struct FT_OffsetSlot *FT_imageSlot(struct FT_OffsetSlot *psSlots,
+                                          size_t ulSlots, const void *pvKey,
+                                          size_t ulHash) {
+    size_t ulSlot = ulHash & (ulSlots - 1);
+
+    while (psSlots[ulSlot].pvKey != NULL && psSlots[ulSlot].pvKey != pvKey)
+        ulSlot = (ulSlot + 1) & (ulSlots - 1);
+    return &psSlots[ulSlot];
+}
+
+/*
+  Lists the nodes of the FT in breadth-first order, the root first,
+  in a new array that the caller must free. Returns SUCCESS and sets
+  *ppoNOrder and *pulCount, or returns MEMORY_ERROR.
+*/
+static int FT_imageOrder(FT_T oFT, Node_T **ppoNOrder, size_t *pulCount) {
+    Node_T *poNOrder = NULL;
+    size_t ulSlots = 0;
+    size_t ulCount = 0;
+    size_t ulNext;
+
+    assert(ppoNOrder != NULL);
+    assert(pulCount != NULL);
+
+    if (oFT->oRoot != NULL) {
+        if (FT_buildReserve((void **) &poNOrder, &ulSlots, 1,
+                            sizeof(Node_T)) != SUCCESS)
+            return MEMORY_ERROR;
+        poNOrder[ulCount++] = oFT->oRoot;
+    }
+
+    /* The array doubles as the queue: append each node's children */
+    for (ulNext = 0; ulNext < ulCount; ulNext++) {
+        Node_T oNNode = poNOrder[ulNext];
+        size_t ulNumChildren;
+        size_t i;
+
+        if (Node_getType(oNNode) != FT_DIR)
+            continue;
+        ulNumChildren = Node_getNumChildren(oNNode);
+        if (FT_buildReserve((void **) &poNOrder, &ulSlots,
+                            ulCount + ulNumChildren,
+                            sizeof(Node_T)) != SUCCESS) {
+            free(poNOrder);
+            return MEMORY_ERROR;
+        }
+        for (i = 0; i < ulNumChildren; i++)
+            (void) Node_getChild(oNNode, i, &poNOrder[ulCount++]);
+    }
+
+    *ppoNOrder = poNOrder;
+    *pulCount = ulCount;
+    return SUCCESS;
+}
+
+/*
+  Fills in the node table entries at psNodes for the ulCount nodes of
+  poNOrder and sets *psHeader to match. Each distinct name is given one
+  offset, remembered in psNames, and so are each file's contents,
+  unless another file holds the same ones, remembered in psBlobs: two
+  empty tables of ulSlots slots (a power of 2 larger than ulCount).
+*/
+static void FT_imageLayout(Node_T *poNOrder, size_t ulCount,
+                           struct FT_ImageNode *psNodes,
+                           struct FT_OffsetSlot *psNames,
+                           struct FT_OffsetSlot *psBlobs, size_t ulSlots,
+                           struct FT_ImageHeader *psHeader) {
+    size_t ulNextChild = 1;
+    size_t i;
+
+    assert(poNOrder != NULL || ulCount == 0);
+    assert(ulSlots > ulCount);
+
+    memcpy(psHeader->acMagic, acImageMagic, sizeof(acImageMagic));
+    psHeader->ulVersion = FT_IMAGE_VERSION;
+    psHeader->ulNumNodes = ulCount;
+    psHeader->ulNamesSize = 0;
+    psHeader->ulBlobsSize = 0;
+
+    for (i = 0; i < ulCount; i++) {
+        Node_T oNNode = poNOrder[i];
+        struct FT_ImageNode *psNode = &psNodes[i];
+        const char *pcName = Node_getName(oNNode);
+        struct FT_OffsetSlot *psSlot;
+        size_t j;
+
+        /* Names are interned in the arena, so equal names are equal pointers */
+        psSlot = FT_imageSlot(psNames, ulSlots, pcName, Node_getNameHash(oNNode));
+        if (psSlot->pvKey == NULL) {
+            psSlot->pvKey = pcName;
+            psSlot->ulOffset = psHeader->ulNamesSize;
+            psHeader->ulNamesSize += Node_getNameLength(oNNode);
+        }
+        psNode->ulNameOffset = psSlot->ulOffset;
+        psNode->ulNameLength = Node_getNameLength(oNNode);
+
+        if (i == 0)
+            psNode->ulParent = 0;
+        psNode->ulType = Node_getType(oNNode);
+        psNode->ulFirstChild = 0;
+        psNode->ulNumChildren = 0;
+        psNode->ulBlobOffset = 0;
+        psNode->ulBlobLength = 0;
+
+        if (Node_getType(oNNode) == FT_FILE) {
+            void *pvContents = Node_getContents(oNNode);
+            uintptr_t uHash = (uintptr_t) pvContents;
+
+            psNode->ulBlobLength = Node_getContentsLength(oNNode);
+            if (psNode->ulBlobLength == 0)
+                continue;
+
+            /* Files that share contents share their pointer, whose low
+               bits are those of its alignment */
+            uHash = (uHash >> 4) * 2654435761u;
+            psSlot = FT_imageSlot(psBlobs, ulSlots, pvContents,
+                                  (size_t) (uHash ^ (uHash >> 16)));
+            if (psSlot->pvKey == NULL) {
+                psSlot->pvKey = pvContents;
+                psSlot->ulOffset = psHeader->ulBlobsSize;
+                psHeader->ulBlobsSize += psNode->ulBlobLength;
+            }
+            psNode->ulBlobOffset = psSlot->ulOffset;
+            continue;
+        }
+
+        /* Children follow in the same order that FT_imageOrder used */
+        psNode->ulNumChildren = Node_getNumChildren(oNNode);
+        if (psNode->ulNumChildren > 0)
+            psNode->ulFirstChild = ulNextChild;
+        for (j = 0; j < psNode->ulNumChildren; j++)
+            psNodes[ulNextChild + j].ulParent = i;
+        ulNextChild += psNode->ulNumChildren;
+    }
+    assert(ulCount == 0 || ulNextChild == ulCount);
+}
+
+/*
+  Writes the image of the nodes at poNOrder, described by psHeader and
+  psNodes, to psFile. Returns SUCCESS or IO_ERROR.
+*/
+static int FT_imageWrite(FILE *psFile, Node_T *poNOrder,
+                         const struct FT_ImageHeader *psHeader,
+                         const struct FT_ImageNode *psNodes) {
+    size_t ulCount = psHeader->ulNumNodes;
+    uint64_t ulNamesWritten = 0;
+    uint64_t ulBlobsWritten = 0;
+    size_t i;
+
+    if (fwrite(psHeader, sizeof(*psHeader), 1, psFile) != 1)
+        return IO_ERROR;
+    if (ulCount > 0 &&
+        fwrite(psNodes, sizeof(*psNodes), ulCount, psFile) != ulCount)
+        return IO_ERROR;
+
+    /* A name is written where its first user put it */
+    for (i = 0; i < ulCount; i++) {
+        if (psNodes[i].ulNameOffset != ulNamesWritten)
+            continue;
+        if (fwrite(Node_getName(poNOrder[i]), 1, psNodes[i].ulNameLength,
+                   psFile) != psNodes[i].ulNameLength)
+            return IO_ERROR;
+        ulNamesWritten += psNodes[i].ulNameLength;
+    }
+    assert(ulNamesWritten == psHeader->ulNamesSize);
+
+    /* So are contents, unless they are empty */
+    for (i = 0; i < ulCount; i++) {
+        size_t ulLength = psNodes[i].ulBlobLength;
+
+        if (ulLength == 0 || psNodes[i].ulBlobOffset != ulBlobsWritten)
+            continue;
+        if (fwrite(Node_getContents(poNOrder[i]), 1, ulLength,
+                   psFile) != ulLength)
+            return IO_ERROR;
+        ulBlobsWritten += ulLength;
+    }
+    assert(ulBlobsWritten == psHeader->ulBlobsSize);
+
+    return SUCCESS;
+}
+
+/* The body of FT_saveIn, under an exclusive tree lock. */
+static int FT_saveLocked(FT_T oFT, const char *pcFile) {
+    struct FT_ImageHeader sHeader;
+    struct FT_ImageNode *psNodes = NULL;
+    struct FT_OffsetSlot *psNames = NULL;
+    struct FT_OffsetSlot *psBlobs = NULL;
+    Node_T *poNOrder = NULL;
+    size_t ulCount = 0;
+    size_t ulSlots = 16;
+    FILE *psFile;
+    int iStatus;
+
+    iStatus = FT_imageOrder(oFT, &poNOrder, &ulCount);
+    if (iStatus != SUCCESS)
+        goto done;
+
+    /* Keep the name and contents tables at most half full */
+    while (ulSlots <= 2 * ulCount)
+        ulSlots *= 2;
+    psNames = calloc(ulSlots, sizeof(struct FT_OffsetSlot));
+    psBlobs = calloc(ulSlots, sizeof(struct FT_OffsetSlot));
+    psNodes = malloc((ulCount > 0 ? ulCount : 1) *
+                     sizeof(struct FT_ImageNode));
+    if (psNames == NULL || psBlobs == NULL || psNodes == NULL) {
+        iStatus = MEMORY_ERROR;
+        goto done;
+    }
+    FT_imageLayout(poNOrder, ulCount, psNodes, psNames, psBlobs, ulSlots,
+                   &sHeader);
+
+    psFile = fopen(pcFile, "wb");
+    if (psFile == NULL) {
+        iStatus = IO_ERROR;
+        goto done;
+    }
+    iStatus = FT_imageWrite(psFile, poNOrder, &sHeader, psNodes);
+    if (fclose(psFile) != 0)
+        iStatus = IO_ERROR;
+    if (iStatus != SUCCESS)
+        (void) remove(pcFile);
+
+done:
+    free(psNames);
+    free(psBlobs);
+    free(psNodes);
+    free(poNOrder);
+    return iStatus;
+}
+
+/*
+  Saves the FT to the file named pcFile in the compact binary format
+  that FT_loadMapped reads, replacing the file if it exists: the image
+  is written beside it, to pcFile with ".tmp" appended, and renamed
+  over it, so that an image mapped from pcFile is never written into.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * IO_ERROR if the file could not be written; it is then left as it was
+*/
+int FT_saveIn(FT_T oFT, const char *pcFile) {
+    char *pcTemp;
+    int iStatus;
+
+    assert(pcFile != NULL);
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    /* Truncating a file the FT has mapped would pull its pages away */
+    pcTemp = malloc(strlen(pcFile) + sizeof(".tmp"));
+    if (pcTemp == NULL) {
+        FT_leave(oFT, FT_SCAN);
+        return MEMORY_ERROR;
+    }
+    strcpy(pcTemp, pcFile);
+    strcat(pcTemp, ".tmp");
+
+    iStatus = FT_saveLocked(oFT, pcTemp);
+    if (iStatus == SUCCESS && rename(pcTemp, pcFile) != 0) {
+        (void) remove(pcTemp);
+        iStatus = IO_ERROR;
+    }
+    free(pcTemp);
+
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/*
+  Returns TRUE if the ulSize bytes at pucImage are a well-formed FT
+  image: its sections fit the file exactly, every name and blob lies
+  within its section, names are valid path components sorted within
+  each directory, and the parent and child links describe one tree in
+  breadth-first order.
+*/
+static boolean FT_imageCheck(const unsigned char *pucImage, size_t ulSize) {
+    const struct FT_ImageHeader *psHeader;
+    const struct FT_ImageNode *psNodes;
+    const char *pcNames;
+    uint64_t ulNumNodes;
+    uint64_t ulNextChild = 1;
+    uint64_t ulRest;
+    uint64_t i;
+
+    if (ulSize < sizeof(*psHeader))
+        return FALSE;
+    psHeader = (const struct FT_ImageHeader *) pucImage;
+    if (memcmp(psHeader->acMagic, acImageMagic, sizeof(acImageMagic)) != 0 ||
+        psHeader->ulVersion != FT_IMAGE_VERSION)
+        return FALSE;
+
+    /* Check the section sizes without overflowing */
+    ulNumNodes = psHeader->ulNumNodes;
+    ulRest = ulSize - sizeof(*psHeader);
+    if (ulNumNodes > ulRest / sizeof(struct FT_ImageNode))
+        return FALSE;
+    ulRest -= ulNumNodes * sizeof(struct FT_ImageNode);
+    if (psHeader->ulNamesSize > ulRest ||
+        psHeader->ulBlobsSize != ulRest - psHeader->ulNamesSize)
+        return FALSE;
+
+    psNodes = (const struct FT_ImageNode *) (psHeader + 1);
+    pcNames = (const char *) (psNodes + ulNumNodes);
+
+    for (i = 0; i < ulNumNodes; i++) {
+        const struct FT_ImageNode *psNode = &psNodes[i];
+        uint64_t j;
+
+        if (psNode->ulNameLength == 0 ||
+            psNode->ulNameLength > psHeader->ulNamesSize ||
+            psNode->ulNameOffset > psHeader->ulNamesSize - psNode->ulNameLength)
+            return FALSE;
+        if (memchr(pcNames + psNode->ulNameOffset, '/',
+                   psNode->ulNameLength) != NULL ||
+            memchr(pcNames + psNode->ulNameOffset, '\0',
+                   psNode->ulNameLength) != NULL)
+            return FALSE;
+
+        if (psNode->ulType == FT_FILE) {
+            /* Files are leaves and never the root */
+            if (i == 0 || psNode->ulNumChildren != 0 ||
+                psNode->ulBlobLength > psHeader->ulBlobsSize ||
+                psNode->ulBlobOffset >
+                psHeader->ulBlobsSize - psNode->ulBlobLength)
+                return FALSE;
+            continue;
+        }
+        if (psNode->ulType != FT_DIR || psNode->ulBlobLength != 0)
+            return FALSE;
+        if (psNode->ulNumChildren == 0)
+            continue;
+
+        /* Children come next in breadth-first order, and point back */
+        if (psNode->ulFirstChild != ulNextChild ||
+            psNode->ulNumChildren > ulNumNodes - ulNextChild)
+            return FALSE;
+        for (j = ulNextChild; j < ulNextChild + psNode->ulNumChildren; j++) {
+            const struct FT_ImageNode *psPrev = &psNodes[j - 1];
+            const struct FT_ImageNode *psChild = &psNodes[j];
+            size_t ulShorter;
+            int iCompare;
+
+            if (psChild->ulParent != i)
+                return FALSE;
+            if (j == ulNextChild)
+                continue;
+
+            /* Siblings must be in strictly increasing strcmp order */
+            ulShorter = psPrev->ulNameLength < psChild->ulNameLength ?
+                psPrev->ulNameLength : psChild->ulNameLength;
+            if (ulShorter > psHeader->ulNamesSize ||
+                psPrev->ulNameOffset > psHeader->ulNamesSize - ulShorter ||
+                psChild->ulNameOffset > psHeader->ulNamesSize - ulShorter)
+                return FALSE;
+            iCompare = memcmp(pcNames + psPrev->ulNameOffset,
+                              pcNames + psChild->ulNameOffset, ulShorter);
+            if (iCompare > 0 ||
+                (iCompare == 0 &&
+                 psPrev->ulNameLength >= psChild->ulNameLength))
+                return FALSE;
+        }
+        ulNextChild += psNode->ulNumChildren;
+    }
+
+    return (boolean) (ulNumNodes == 0 || ulNextChild == ulNumNodes);
+}
+
+/*
+  Builds a tree in a new arena from the well-formed image at pucImage.
+  File contents are not copied: they point into the image. Returns
+  SUCCESS and sets *poArena and *poNRoot, or returns MEMORY_ERROR.
+*/
+static int FT_imageBuild(unsigned char *pucImage, Arena_T *poArena,
+                         Node_T *poNRoot) {
+    const struct FT_ImageHeader *psHeader;
+    const struct FT_ImageNode *psNodes;
+    const char *pcNames;
+    unsigned char *pucBlobs;
+    Node_T *poNNodes;
+    Arena_T oNewArena;
+    size_t ulCount;
+    size_t i;
+    int iStatus = SUCCESS;
+
+    psHeader = (const struct FT_ImageHeader *) pucImage;
+    ulCount = psHeader->ulNumNodes;
+    psNodes = (const struct FT_ImageNode *) (psHeader + 1);
+    pcNames = (const char *) (psNodes + ulCount);
+    pucBlobs = (unsigned char *) pcNames + psHeader->ulNamesSize;
+
+    assert(ulCount > 0);
+
+    oNewArena = Arena_new();
+    poNNodes = malloc(ulCount * sizeof(Node_T));
+    if (oNewArena == NULL || poNNodes == NULL) {
+        Arena_free(oNewArena);
+        free(poNNodes);
+        return MEMORY_ERROR;
+    }
+
+    /* Parents precede their children, so one pass creates every node */
+    for (i = 0; i < ulCount && iStatus == SUCCESS; i++) {
+        const struct FT_ImageNode *psNode = &psNodes[i];
+
+        iStatus = Node_new(i == 0 ? NULL : poNNodes[psNode->ulParent],
+                           pcNames + psNode->ulNameOffset,
+                           psNode->ulNameLength, (NodeType) psNode->ulType,
+                           oNewArena, &poNNodes[i]);
+        if (iStatus == SUCCESS && psNode->ulBlobLength > 0)
+            (void) Node_borrowContents(poNNodes[i],
+                                       pucBlobs + psNode->ulBlobOffset,
+                                       psNode->ulBlobLength);
+    }
+
+    /* Each directory's children are already contiguous and sorted;
+       children come last, so going backwards totals them first */
+    for (i = ulCount; i > 0 && iStatus == SUCCESS; i--) {
+        if (psNodes[i - 1].ulNumChildren > 0)
+            iStatus = Node_setChildren(poNNodes[i - 1],
+                                       poNNodes + psNodes[i - 1].ulFirstChild,
+                                       psNodes[i - 1].ulNumChildren);
+    }
+
+    if (iStatus != SUCCESS) {
+        Arena_free(oNewArena);
+        free(poNNodes);
+        return iStatus;
+    }
+
+    *poArena = oNewArena;
+    *poNRoot = poNNodes[0];
+    free(poNNodes);
+    return SUCCESS;
+}
+
+/* The body of FT_loadMappedIn, under an exclusive tree lock. */
+static int FT_loadMappedLocked(FT_T oFT, const char *pcFile) {
+    struct stat sStat;
+    unsigned char *pucImage;
+    Arena_T oNewArena;
+    Node_T oNewRoot;
+    size_t ulSize;
+    int iFd;
+    int iStatus;
+
+    if (oFT->oRoot != NULL)
+        return CONFLICTING_PATH;
+
+    iFd = open(pcFile, O_RDONLY);
+    if (iFd < 0)
+        return IO_ERROR;
+    if (fstat(iFd, &sStat) != 0 || sStat.st_size <= 0 ||
+        (uintmax_t) sStat.st_size > (size_t) -1) {
+        (void) close(iFd);
+        return IO_ERROR;
+    }
+    ulSize = (size_t) sStat.st_size;
+
+    /* A private writable mapping keeps client writes out of the file */
+    pucImage = mmap(NULL, ulSize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    iFd, 0);
+    (void) close(iFd);
+    if (pucImage == MAP_FAILED)
+        return IO_ERROR;
+
+    if (!FT_imageCheck(pucImage, ulSize)) {
+        (void) munmap(pucImage, ulSize);
+        return IO_ERROR;
+    }
+
+    /* An empty FT needs nothing from its image */
+    if (((struct FT_ImageHeader *) pucImage)->ulNumNodes == 0) {
+        (void) munmap(pucImage, ulSize);
+        return SUCCESS;
+    }
+
+    iStatus = FT_imageBuild(pucImage, &oNewArena, &oNewRoot);
+    if (iStatus != SUCCESS) {
+        (void) munmap(pucImage, ulSize);
+        return iStatus;
+    }
+
+    FT_dropArena(oFT->oArena);
+    oFT->oArena = oNewArena;
+    EPOCH_PUBLISH(oFT->oRoot, oNewRoot);
+    oFT->pvImage = pucImage;
+    oFT->ulImageSize = ulSize;
+    FT_countTree(oFT);
+    FT_checkTree(oFT);
+    return SUCCESS;
+}
+
+/*
+  Loads the FT, which must be initialized and empty, from the file
+  named pcFile, which FT_save wrote. The file is mapped into memory
+  rather than read, and file contents are used in place: a page of it
+  is copied only if a client writes into the contents that it holds.
+  The mapping lasts until FT_destroy or the removal of the root.
+*/
+int FT_loadMappedIn(FT_T oFT, const char *pcFile) {
+    int iStatus;
+
+    assert(pcFile != NULL);
+
+    if (!FT_enter(oFT, FT_WHOLE))
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_loadMappedLocked(oFT, pcFile);
+    (void) FT_journalAll(oFT, iStatus);
+
+    FT_leave(oFT, FT_WHOLE);
+    return iStatus;
+}
+
+/* --------------------------------------------------------------------
+
+  A journal (see journal.h) has an image of the tree as its base, and
+  logs the changes made since, as described under "Journaling" above.
+  FT_recoverIn loads the image and replays the changes, handing each
+  run of inserts to FT_insertBatchIn in one go.
+
+-------------------------------------------------------------------- */
+
+/* Journal_open's pfWriteBase: saves oFT (pvFT), whose tree lock is held. */
+static int FT_journalWriteImage(const char *pcTemp, void *pvFT) {
+    return FT_saveLocked(pvFT, pcTemp);
+}
+
+/*
+  Starts a journal of oFT's changes in the file named pcJournal, after
+  an image of the tree as it is now in the file named pcSnapshot,
+  closing the journal it had, if any. The journal is compacted into a
+  new image whenever it reaches ulCompactBytes bytes, and changes are
+  written and synced ulGroup at a time.
+*/
+int FT_journalOpenIn(FT_T oFT, const char *pcSnapshot, const char *pcJournal,
+                     size_t ulGroup, size_t ulCompactBytes) {
+    Journal_T oJournal;
+    int iStatus;
+
+    assert(pcSnapshot != NULL);
+    assert(pcJournal != NULL);
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    /* What the old journal still buffers is in the new image anyway */
+    (void) Journal_close(oFT->oJournal);
+    oFT->oJournal = NULL;
+    oFT->iJournalError = SUCCESS;
+    iStatus = Journal_open(pcSnapshot, pcJournal, ulGroup, ulCompactBytes,
+                           FT_journalWriteImage, oFT, &oJournal);
+    if (iStatus == SUCCESS)
+        oFT->oJournal = oJournal;
+
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/*
+  Writes and syncs the changes that oFT's journal still buffers.
+  Returns SUCCESS, or the first error the journal has met since
+  FT_journalOpenIn.
+*/
+int FT_journalSyncIn(FT_T oFT) {
+    int iStatus = SUCCESS;
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    if (oFT->oJournal != NULL)
+        iStatus = Journal_sync(oFT->oJournal);
+    if (oFT->iJournalError != SUCCESS)
+        iStatus = oFT->iJournalError;
+
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/* Syncs oFT's journal as FT_journalSyncIn does, and closes it. */
+int FT_journalCloseIn(FT_T oFT) {
+    int iStatus;
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    iStatus = Journal_close(oFT->oJournal);
+    if (oFT->iJournalError != SUCCESS)
+        iStatus = oFT->iJournalError;
+    oFT->oJournal = NULL;
+    oFT->iJournalError = SUCCESS;
+
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/*
+  Replays a logged replacement of the contents of the file at pcPath by
+  the ulLength bytes at pvContents. Returns SUCCESS if the file then
+  has those contents, which FT_replaceFileContentsIn does not tell
+  when the old ones were NULL, or else the reason it does not.
+*/
+static int FT_replayReplace(FT_T oFT, const char *pcPath, void *pvContents,
+                            size_t ulLength) {
+    boolean bIsFile;
+    size_t ulSize;
+    int iStatus;
+
+    if (FT_replaceFileContentsIn(oFT, pcPath, pvContents, ulLength) != NULL)
+        return SUCCESS;
+
+    iStatus = FT_statIn(oFT, pcPath, &bIsFile, &ulSize);
+    if (iStatus != SUCCESS)
+        return iStatus;
+    if (!bIsFile)
+        return NOT_A_FILE;
+    if (ulSize != ulLength ||
+        (ulLength > 0 &&
+         memcmp(FT_getFileContentsIn(oFT, pcPath), pvContents, ulLength) != 0))
+        return MEMORY_ERROR;
+    return SUCCESS;
+}
+
+/*
+  Applies to oFT the changes that oReader hands out, gathering each run
+  of inserts into one FT_insertBatchIn call. Returns SUCCESS, or the
+  status of the first change that does not apply as it did when it was
+  logged (IO_ERROR for a record that no change could have logged).
+*/
+static int FT_replay(FT_T oFT, Journal_Reader_T oReader) {
+    struct FT_BatchEntry *psBatch = NULL;
+    int *piStatuses = NULL;
+    size_t ulBatchSlots = 0;
+    size_t ulStatusSlots = 0;
+    size_t ulBatched = 0;
+    int iStatus = SUCCESS;
+
+    for (;;) {
+        unsigned int uType = 0;
+        void *pvFirst = NULL;
+        void *pvSecond = NULL;
+        size_t ulFirst = 0;
+        size_t ulSecond = 0;
+        boolean bMore;
+        size_t i;
+
+        bMore = Journal_readerNext(oReader, &uType, &pvFirst, &ulFirst,
+                                   &pvSecond, &ulSecond);
+
+        /* Every path was logged with its '\0' */
+        if (bMore &&
+            (ulFirst == 0 || ((char *) pvFirst)[ulFirst - 1] != '\0' ||
+             (uType == FT_OP_MOVE &&
+              (ulSecond == 0 || ((char *) pvSecond)[ulSecond - 1] != '\0')))) {
+            iStatus = IO_ERROR;
+            break;
+        }
+
+        if (bMore &&
+            (uType == FT_OP_INSERT_DIR || uType == FT_OP_INSERT_FILE)) {
+            if (FT_buildReserve((void **) &psBatch, &ulBatchSlots,
+                                ulBatched + 1,
+                                sizeof(struct FT_BatchEntry)) != SUCCESS) {
+                iStatus = MEMORY_ERROR;
+                break;
+            }
+            psBatch[ulBatched].pcPath = pvFirst;
+            psBatch[ulBatched].bIsFile =
+                (boolean) (uType == FT_OP_INSERT_FILE);
+            psBatch[ulBatched].pvContents = pvSecond;
+            psBatch[ulBatched].ulLength = ulSecond;
+            ulBatched++;
+            continue;
+        }
+
+        /* Anything else, and the end, come after the inserts before them */
+        if (ulBatched > 0) {
+            if (FT_buildReserve((void **) &piStatuses, &ulStatusSlots,
+                                ulBatched, sizeof(int)) != SUCCESS) {
+                iStatus = MEMORY_ERROR;
+                break;
+            }
+            if (FT_insertBatchIn(oFT, psBatch, ulBatched,
+                                 piStatuses) != ulBatched) {
+                for (i = 0; piStatuses[i] == SUCCESS; i++)
+                    ;
+                iStatus = piStatuses[i];
+                break;
+            }
+            ulBatched = 0;
+        }
+        if (!bMore)
+            break;
+
+        if (uType == FT_OP_RM_DIR)
+            iStatus = FT_rmDirIn(oFT, pvFirst);
+        else if (uType == FT_OP_RM_FILE)
+            iStatus = FT_rmFileIn(oFT, pvFirst);
+        else if (uType == FT_OP_REPLACE_CONTENTS)
+            iStatus = FT_replayReplace(oFT, pvFirst, pvSecond, ulSecond);
+        else if (uType == FT_OP_MOVE)
+            iStatus = FT_moveIn(oFT, pvFirst, pvSecond);
+        else
+            iStatus = IO_ERROR;
+        if (iStatus != SUCCESS)
+            break;
+    }
+
+    free(psBatch);
+    free(piStatuses);
+    return iStatus;
+}
+
+/*
+  Rebuilds oFT, which must be empty and have no journal, from the image
+  in the file named pcSnapshot and the changes that the journal in the
+  file named pcJournal logged after it, as FT_journalOpenIn left them.
+*/
+int FT_recoverIn(FT_T oFT, const char *pcSnapshot, const char *pcJournal) {
+    Journal_Reader_T oReader;
+    struct stat sStat;
+    int iStatus = SUCCESS;
+
+    assert(pcSnapshot != NULL);
+    assert(pcJournal != NULL);
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+    if (oFT->oRoot != NULL || oFT->oJournal != NULL)
+        iStatus = CONFLICTING_PATH;
+    FT_leave(oFT, FT_SCAN);
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    /* With no image, there is nothing to recover, unless there is a
+       journal, which Journal_readerNew then rejects */
+    if (stat(pcSnapshot, &sStat) == 0)
+        iStatus = FT_loadMappedIn(oFT, pcSnapshot);
+    else if (errno != ENOENT)
+        iStatus = IO_ERROR;
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    iStatus = Journal_readerNew(pcSnapshot, pcJournal, &oReader);
+    if (iStatus != SUCCESS || oReader == NULL)
+        return iStatus;
+    iStatus = FT_replay(oFT, oReader);
+    Journal_readerFree(oReader);
+    return iStatus;
+}
+
+/*
+  Lays out oFT's tree in a new frozen layout, from poNOrder, its ulCount
+  nodes in breadth-first order, in which each directory's children
+  follow one another. Returns the layout, or NULL if memory could not
+  be allocated.
+*/
+static struct FT_Frozen *FT_frozenLayout(Node_T *poNOrder, size_t ulCount) {
+    struct FT_Frozen *psFrozen;
+    size_t ulNextChild = 1;
+    size_t i;
+
+    assert(poNOrder != NULL || ulCount == 0);
+
+    /* The header's size is a multiple of 8, so the keys come aligned */
+    psFrozen = malloc(sizeof(struct FT_Frozen) +
+                      ulCount * (sizeof(uint64_t) +
+                                 sizeof(struct FT_FrozenNode) +
+                                 sizeof(const char *)));
+    if (psFrozen == NULL)
+        return NULL;
+    psFrozen->ulCount = ulCount;
+    psFrozen->pulKeys = (uint64_t *) (psFrozen + 1);
+    psFrozen->psNodes = (struct FT_FrozenNode *) (psFrozen->pulKeys + ulCount);
+    psFrozen->ppcNames = (const char **) (psFrozen->psNodes + ulCount);
+
+    for (i = 0; i < ulCount; i++) {
+        Node_T oNNode = poNOrder[i];
+        struct FT_FrozenNode *psNode = &psFrozen->psNodes[i];
+        const char *pcName = Node_getName(oNNode);
+
+        psFrozen->pulKeys[i] = FT_frozenKey(pcName, Node_getNameLength(oNNode));
+        psFrozen->ppcNames[i] = pcName;
+        psNode->oNNode = oNNode;
+        psNode->eType = Node_getType(oNNode);
+        psNode->ulFirstChild = 0;
+        psNode->ulNumChildren = 0;
+
+        /* Children follow in the same order that FT_imageOrder used */
+        if (psNode->eType == FT_DIR) {
+            psNode->ulNumChildren = Node_getNumChildren(oNNode);
+            psNode->ulFirstChild = ulNextChild;
+            ulNextChild += psNode->ulNumChildren;
+        }
+    }
+    assert(ulCount == 0 || ulNextChild == ulCount);
+    return psFrozen;
+}
+
+/*
+  Freezes oFT, as documented for FT_freeze. Lookups that are already
+  running meanwhile still walk the tree itself.
+*/
+int FT_freezeIn(FT_T oFT) {
+    Node_T *poNOrder;
+    size_t ulCount;
+    struct FT_Frozen *psFrozen;
+    int iStatus;
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    if (oFT->psFrozen != NULL) {
+        FT_leave(oFT, FT_SCAN);
+        return SUCCESS;
+    }
+
+    iStatus = FT_imageOrder(oFT, &poNOrder, &ulCount);
+    if (iStatus == SUCCESS) {
+        psFrozen = FT_frozenLayout(poNOrder, ulCount);
+        free(poNOrder);
+        if (psFrozen == NULL)
+            iStatus = MEMORY_ERROR;
+        else
+            EPOCH_PUBLISH(oFT->psFrozen, psFrozen);
+    }
+
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/*
+  Gives oFT a lookup cache of ulSlots entries, as documented for
+  FT_setCacheSize. Lookups in an RCU build may be using the old cache
+  meanwhile, so it is swapped under the cache's mutex.
+*/
+int FT_setCacheSizeIn(FT_T oFT, size_t ulSlots) {
+    struct FT_CacheEntry *psEntries = NULL;
+    struct FT_CacheEntry *psOld;
+    size_t ulRounded = 0;
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
+
+    if (ulSlots != 0) {
+        for (ulRounded = 1; ulRounded < ulSlots; ulRounded *= 2)
+            if (ulRounded > SIZE_MAX / 2 / sizeof(struct FT_CacheEntry)) {
+                FT_leave(oFT, FT_SCAN);
+                return MEMORY_ERROR;
+            }
+        psEntries = calloc(ulRounded, sizeof(struct FT_CacheEntry));
+        if (psEntries == NULL) {
+            FT_leave(oFT, FT_SCAN);
+            return MEMORY_ERROR;
+        }
+    }
+
+    FT_cacheLock(oFT);
+    psOld = oFT->sCache.psEntries;
+    oFT->sCache.psEntries = psEntries;
+    EPOCH_PUBLISH(oFT->sCache.ulSlots, ulRounded);
+    oFT->sCache.ulGeneration++;
+    oFT->sCache.oNLastParent = NULL;
+    FT_cacheUnlock(oFT);
+    free(psOld);
 
-  When returning SUCCESS,
-  if path is a directory: sets *pbIsFile to FALSE, *pulSize unchanged
-  if path is a file: sets *pbIsFile to TRUE, and
-                     sets *pulSize to the length of file's contents
+    FT_leave(oFT, FT_SCAN);
+    return SUCCESS;
+}
 
-  When returning another status, *pbIsFile and *pulSize are unchanged.
+/*
+  Makes oFT share the contents it copies, as documented for
+  FT_setDedup. The contents are interned in the tree's arena (see
+  Arena_intern), so they go with the rest of the tree, and a file
+  that drops them drops a reference.
 */
-int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize) {
-    Path_T oTargetPath;
-    size_t depth, i, j, numChildren;
-    Path_T tempPrefix, oPrefix;
-    Node_T oNext, oCurr;
+int FT_setDedupIn(FT_T oFT, boolean bDedup) {
+    /* Changes take the tree lock at least shared, so none is copying */
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
 
-    /* ------------------ STEP 1: Validate global state and input path ------------------ */
+    oFT->bDedup = bDedup;
 
-    if (!bIsInitialized)
-        return INITIALIZATION_ERROR;
+    FT_leave(oFT, FT_SCAN);
+    return SUCCESS;
+}
+
+/* --------------------------------------------------------------------
+
+  Snapshots. A snapshot holds a reference to the root it was taken at,
+  so everything it can reach is shared with the tree until the tree
+  changes it: each change first copies the shared nodes on its path
+  (see FT_unshare), leaving the originals to the snapshot. Nothing a
+  snapshot can reach ever changes, so reading one takes no lock.
+
+-------------------------------------------------------------------- */
 
-    oTargetPath = Path_create(pcPath);
-    if (oTargetPath == NULL)
-        return BAD_PATH;
+/* A read-only view of an FT as it was when it was taken */
+struct FT_Snapshot {
+    FT_T oFT;                /* The FT it was taken from */
+    Node_T oRoot;            /* The FT's root then, or NULL if it was empty */
+    struct FT_Generation *psGeneration;  /* What oRoot is allocated from, or NULL */
+};
 
-    depth = Path_getDepth(oTargetPath);
-    if (depth == 0) {
-        Path_free(oTargetPath);
-        return BAD_PATH;
+/*
+  Returns a snapshot of oFT as it is now, which costs the same however
+  big oFT is, or NULL if oFT is NULL or memory could not be allocated.
+*/
+FT_Snapshot_T FT_snapshotIn(FT_T oFT) {
+    FT_Snapshot_T oSnapshot;
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return NULL;
+
+    oSnapshot = malloc(sizeof(struct FT_Snapshot));
+    if (oSnapshot != NULL && oFT->oRoot != NULL && oFT->psShared == NULL) {
+        oFT->psShared = malloc(sizeof(struct FT_Generation));
+        if (oFT->psShared == NULL) {
+            free(oSnapshot);
+            oSnapshot = NULL;
+        }
+        else {
+            oFT->psShared->oArena = NULL;
+            oFT->psShared->pvImage = NULL;
+            oFT->psShared->ulImageSize = 0;
+            oFT->psShared->ulSnapshots = 0;
+        }
     }
 
-    if (oRoot == NULL) {
-        Path_free(oTargetPath);
-        return NO_SUCH_PATH;
+    if (oSnapshot != NULL) {
+        oSnapshot->oFT = oFT;
+        oSnapshot->oRoot = oFT->oRoot;
+        oSnapshot->psGeneration = NULL;
+        if (oFT->oRoot != NULL) {
+            Node_share(oFT->oRoot);
+            oSnapshot->psGeneration = oFT->psShared;
+            oFT->psShared->ulSnapshots++;
+        }
     }
 
-    /* ------------------ STEP 2: Handle potential conflict at root ------------------ */
+    FT_leave(oFT, FT_SCAN);
+    return oSnapshot;
+}
 
-    Path_T rootPath = Node_getPath(oRoot);
-    tempPrefix = NULL;
-    if (Path_prefix(oTargetPath, 1, &tempPrefix) != SUCCESS ||
-        Path_comparePath(tempPrefix, rootPath) != 0) {
-            Path_free(tempPrefix);
-            Path_free(oTargetPath);
-            return CONFLICTING_PATH;
+/*
+  Frees oSnapshot, and whatever only it still holds. Does nothing if
+  oSnapshot is NULL.
+*/
+void FT_snapshotFree(FT_Snapshot_T oSnapshot) {
+    struct FT_Generation *psGeneration;
+    FT_T oFT;
+
+    if (oSnapshot == NULL)
+        return;
+
+    oFT = oSnapshot->oFT;
+    psGeneration = oSnapshot->psGeneration;
+    (void) FT_enter(oFT, FT_SCAN);
+
+    if (psGeneration == oFT->psShared && psGeneration != NULL) {
+        /* Still the tree's arena: give back what the tree dropped */
+        FT_freeSubtree(oSnapshot->oRoot);
+        if (--psGeneration->ulSnapshots == 0) {
+            oFT->psShared = NULL;
+            free(psGeneration);
         }
-    
-    Path_free(tempPrefix);
-    Path_free(oTargetPath);
-    return CONFLICTING_PATH;
+    }
+    else if (psGeneration != NULL && --psGeneration->ulSnapshots == 0) {
+        /* The tree has moved on, so the whole arena can go */
+        FT_dropArena(psGeneration->oArena);
+        if (psGeneration->pvImage != NULL)
+            (void) munmap(psGeneration->pvImage, psGeneration->ulImageSize);
+        free(psGeneration);
+    }
+
+    FT_leave(oFT, FT_SCAN);
+    free(oSnapshot);
+}
 
+/*
+  Looks for the node with absolute path pcPath in oSnapshot. Returns
+  SUCCESS and sets *poNResult to it, or sets *poNResult to NULL and
+  returns the statuses documented for FT_findNode.
+*/
+static int FT_snapshotFind(FT_Snapshot_T oSnapshot, const char *pcPath,
+                           Node_T *poNResult) {
+    struct PathCursor sCursor;
+    Node_T oCurr;
+    size_t ulMatched = 1;
+    int iStatus;
 
-    /* ------------------ STEP 3: Traverse to target node ------------------ */
+    assert(oSnapshot != NULL);
+    assert(pcPath != NULL);
+    assert(poNResult != NULL);
 
-    for (i = 1; i <= depth; i++) {
-        Path_prefix(oTargetPath, i, &oPrefix);
-        if (oPrefix == NULL) {
-            Path_free(oTargetPath);
-            return MEMORY_ERROR;
-        }
+    *poNResult = NULL;
 
-        boolean found = FALSE;
-        numChildren = Node_getNumChildren(oCurr);
+    iStatus = PathCursor_init(&sCursor, pcPath);
+    if (iStatus != SUCCESS)
+        return iStatus;
 
-        for (j = 0; j < numChildren; j++) {
-            Node_T child;
-            if (Node_getChild(oCurr, j, &child) == SUCCESS &&
-                Path_comparePath(Node_getPath(child), oPrefix) == 0) {
-                oNext = child;
-                found = TRUE;
-                break;
-            }
-        }
+    oCurr = oSnapshot->oRoot;
+    if (oCurr == NULL)
+        return NO_SUCH_PATH;
+    if (PathCursor_compareString(&sCursor, Node_getName(oCurr)))
+        return CONFLICTING_PATH;
 
-        Path_free(oPrefix);
+    FT_descend(&sCursor, &oCurr, &ulMatched);
+    if (ulMatched < PathCursor_getDepth(&sCursor))
+        return Node_getType(oCurr) == FT_FILE ? NOT_A_DIRECTORY : NO_SUCH_PATH;
 
-        if (!found) {
-            Path_free(oTargetPath);
-            return NO_SUCH_PATH;
-        }
+    *poNResult = oCurr;
+    return SUCCESS;
+}
 
-        oCurr = oNext;
-    }
+/*
+  Returns TRUE if oSnapshot contains a directory with absolute path
+  pcPath, and FALSE if not, if there is an error while checking, or if
+  oSnapshot is NULL.
+*/
+boolean FT_snapshotContainsDir(FT_Snapshot_T oSnapshot, const char *pcPath) {
+    Node_T oNFound;
+
+    assert(pcPath != NULL);
 
-    Path_free(oTargetPath);
+    return (boolean) (oSnapshot != NULL &&
+                      FT_snapshotFind(oSnapshot, pcPath, &oNFound) == SUCCESS &&
+                      Node_getType(oNFound) == FT_DIR);
+}
 
-    /* ------------------ STEP 4: Update output values based on type ------------------ */
+/*
+  Returns TRUE if oSnapshot contains a file with absolute path pcPath,
+  and FALSE if not, if there is an error while checking, or if
+  oSnapshot is NULL.
+*/
+boolean FT_snapshotContainsFile(FT_Snapshot_T oSnapshot, const char *pcPath) {
+    Node_T oNFound;
 
-    if (Node_getType(oCurr) == FT_FILE) {
+    assert(pcPath != NULL);
+
+    return (boolean) (oSnapshot != NULL &&
+                      FT_snapshotFind(oSnapshot, pcPath, &oNFound) == SUCCESS &&
+                      Node_getType(oNFound) == FT_FILE);
+}
+
+/*
+  Returns the contents that the file with absolute path pcPath had
+  when oSnapshot was taken, or NULL if unable to complete the request
+  for any reason.
+*/
+void *FT_snapshotGetFileContents(FT_Snapshot_T oSnapshot,
+                                 const char *pcPath) {
+    Node_T oNFound;
+
+    assert(pcPath != NULL);
+
+    if (oSnapshot == NULL ||
+        FT_snapshotFind(oSnapshot, pcPath, &oNFound) != SUCCESS ||
+        Node_getType(oNFound) != FT_FILE)
+        return NULL;
+    return Node_getContents(oNFound);
+}
+
+/*
+  Like FT_stat, but looks pcPath up in oSnapshot. Returns
+  INITIALIZATION_ERROR if oSnapshot is NULL.
+*/
+int FT_snapshotStat(FT_Snapshot_T oSnapshot, const char *pcPath,
+                    boolean *pbIsFile, size_t *pulSize) {
+    Node_T oNFound;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (oSnapshot == NULL)
+        return INITIALIZATION_ERROR;
+
+    iStatus = FT_snapshotFind(oSnapshot, pcPath, &oNFound);
+    if (iStatus == NOT_A_DIRECTORY)
+        iStatus = NO_SUCH_PATH;
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    if (Node_getType(oNFound) == FT_FILE) {
         if (pbIsFile != NULL) *pbIsFile = TRUE;
-        if (pulSize != NULL) {
-            const char *contents = Node_getContents(oCurr);
-            if (contents != NULL) {
-                *pulSize = strlen(contents);
-            } else {
-                *pulSize = 0;
-            }
-        }
+        if (pulSize != NULL) *pulSize = Node_getContentsLength(oNFound);
     } else {
         if (pbIsFile != NULL) {
             *pbIsFile = FALSE;
         }
-        return SUCCESS;
-
     }
+    return SUCCESS;
 }
 
 /*
-  Sets the FT data structure to an initialized state.
-  The data structure is initially empty.
-  Returns INITIALIZATION_ERROR if already initialized,
-  and SUCCESS otherwise.
+  Like FT_statTree, but looks pcPath up in oSnapshot. Returns
+  INITIALIZATION_ERROR if oSnapshot is NULL.
 */
-int FT_init(void) {
-    /* If already initialized, return error */
-    if (bIsInitialized) {
+int FT_snapshotStatTree(FT_Snapshot_T oSnapshot, const char *pcPath,
+                        size_t *pulFiles, size_t *pulDirs,
+                        size_t *pulBytes) {
+    Node_T oNFound;
+    struct Node_Totals sTotals;
+    int iStatus;
+
+    assert(pcPath != NULL);
+
+    if (oSnapshot == NULL)
         return INITIALIZATION_ERROR;
-    }
 
-    /* Mark as initialized and reset root */
-    bIsInitialized = TRUE;
-    oRoot = NULL;
+    iStatus = FT_snapshotFind(oSnapshot, pcPath, &oNFound);
+    if (iStatus == NOT_A_DIRECTORY)
+        iStatus = NO_SUCH_PATH;
+    if (iStatus != SUCCESS)
+        return iStatus;
+
+    Node_getTotals(oNFound, &sTotals);
+    FT_setTotals(&sTotals, pulFiles, pulDirs, pulBytes);
+    return SUCCESS;
+}
+
+/* A pair of nodes at the same path whose children FT_diff is merging */
+struct FT_DiffFrame {
+    Node_T oOld;             /* The old side's directory, or NULL */
+    Node_T oNew;             /* The new side's directory, or NULL */
+    size_t ulOldNext;        /* Index of oOld's next child to merge */
+    size_t ulNewNext;        /* Index of oNew's next child to merge */
+    size_t ulPathLength;     /* Length of the pair's path */
+    Node_T oNAdded;          /* Added at the path once oOld's children are removed, or NULL */
+};
+
+/* The state of an FT_diff walk */
+struct FT_Diff {
+    struct FT_DiffFrame *psFrames;  /* Pairs still being merged, outermost first */
+    size_t ulFrames;
+    size_t ulFrameSlots;
+    char *pcPath;            /* The current path, rebuilt in place */
+    size_t ulPathSize;       /* Number of bytes allocated for pcPath */
+    int (*pfDiff)(enum FT_Change eChange, const char *pcPath,
+                  size_t ulLength, boolean bIsFile, void *pvExtra);
+    void *pvExtra;
+};
+
+/* Returns the number of children of oNNode, which may be NULL or a file. */
+static size_t FT_diffNumChildren(Node_T oNNode) {
+    if (oNNode == NULL || Node_getType(oNNode) != FT_DIR)
+        return 0;
+    return Node_getNumChildren(oNNode);
+}
+
+/* Returns TRUE if files oNOld and oNNew have different contents. */
+static boolean FT_diffContents(Node_T oNOld, Node_T oNNew) {
+    size_t ulLength = Node_getContentsLength(oNOld);
+
+    if (Node_getContentsLength(oNNew) != ulLength)
+        return TRUE;
+    if (ulLength == 0 || Node_getContents(oNOld) == Node_getContents(oNNew))
+        return FALSE;
+    return (boolean) (memcmp(Node_getContents(oNOld), Node_getContents(oNNew),
+                             ulLength) != 0);
+}
+
+/*
+  Pushes a frame on psDiff's stack to merge the children of oOld and
+  oNew, either of which may be NULL, at the path of length ulLength,
+  and then to report oNAdded there, if it is not NULL. Returns SUCCESS
+  or MEMORY_ERROR.
+*/
+static int FT_diffPush(struct FT_Diff *psDiff, Node_T oOld, Node_T oNew,
+                       Node_T oNAdded, size_t ulLength) {
+    struct FT_DiffFrame *psFrame;
 
+    if (FT_buildReserve((void **) &psDiff->psFrames, &psDiff->ulFrameSlots,
+                        psDiff->ulFrames + 1,
+                        sizeof(struct FT_DiffFrame)) != SUCCESS)
+        return MEMORY_ERROR;
+    psFrame = &psDiff->psFrames[psDiff->ulFrames];
+    psFrame->oOld = oOld;
+    psFrame->oNew = oNew;
+    psFrame->ulOldNext = 0;
+    psFrame->ulNewNext = 0;
+    psFrame->ulPathLength = ulLength;
+    psFrame->oNAdded = oNAdded;
+    psDiff->ulFrames++;
     return SUCCESS;
 }
 
 /*
-  Removes all contents of the data structure and
-  returns it to an uninitialized state.
-  Returns INITIALIZATION_ERROR if not already initialized,
-  and SUCCESS otherwise.
+  Reports oNNew, at the path of length ulLength at the start of
+  psDiff->pcPath, as added, and pushes a frame to report its children
+  too, if it is a directory. Returns SUCCESS, MEMORY_ERROR, or the
+  status with which psDiff->pfDiff stopped the walk.
 */
-int FT_destroy(void) {
-    /* Check if the FT has been initialized */
-    if (!bIsInitialized) {
-        return INITIALIZATION_ERROR;
+static int FT_diffAdded(struct FT_Diff *psDiff, size_t ulLength,
+                        Node_T oNNew) {
+    boolean bNewDir = (boolean) (Node_getType(oNNew) == FT_DIR);
+    int iStatus;
+
+    /* The walk below a removed node may have written past the path */
+    psDiff->pcPath[ulLength] = '\0';
+    iStatus = (*psDiff->pfDiff)(FT_ADDED, psDiff->pcPath, ulLength,
+                                (boolean) !bNewDir, psDiff->pvExtra);
+    if (iStatus != SUCCESS || !bNewDir)
+        return iStatus;
+    return FT_diffPush(psDiff, NULL, oNNew, NULL, ulLength);
+}
+
+/*
+  Compares oNOld and oNNew, either of which may be NULL, which have the
+  same name and the path of length ulDirLength in psDiff->pcPath as
+  their parent (0 for roots). Reports how they differ and pushes a
+  frame to merge their children, if either is a directory that
+  differs. A node whose type changed is reported removed, along with
+  everything that was below it, before the node that took its place is
+  reported added, along with everything below that. Returns SUCCESS,
+  MEMORY_ERROR, or the status with which psDiff->pfDiff stopped the
+  walk.
+*/
+static int FT_diffPair(struct FT_Diff *psDiff, size_t ulDirLength,
+                       Node_T oNOld, Node_T oNNew) {
+    const char *pcName;
+    size_t ulNameLength;
+    size_t ulLength;
+    boolean bOldDir;
+    boolean bNewDir;
+    int iStatus = SUCCESS;
+
+    assert(psDiff != NULL);
+    assert(oNOld != NULL || oNNew != NULL);
+
+    /* Shared: nothing below can differ either */
+    if (oNOld == oNNew)
+        return SUCCESS;
+
+    pcName = Node_getName(oNOld != NULL ? oNOld : oNNew);
+    ulLength = Node_getNameLength(oNOld != NULL ? oNOld : oNNew);
+    ulNameLength = ulLength;
+    if (ulDirLength > 0)
+        ulLength += ulDirLength + 1;
+    if (FT_buildReserve((void **) &psDiff->pcPath, &psDiff->ulPathSize,
+                        ulLength + 1, sizeof(char)) != SUCCESS)
+        return MEMORY_ERROR;
+    if (ulDirLength > 0)
+        psDiff->pcPath[ulDirLength] = '/';
+    strcpy(psDiff->pcPath + ulLength - ulNameLength, pcName);
+
+    bOldDir = (boolean) (oNOld != NULL && Node_getType(oNOld) == FT_DIR);
+    bNewDir = (boolean) (oNNew != NULL && Node_getType(oNNew) == FT_DIR);
+
+    if (oNOld != NULL && oNNew != NULL && bOldDir == bNewDir) {
+        if (!bOldDir)
+            return FT_diffContents(oNOld, oNNew) ?
+                   (*psDiff->pfDiff)(FT_MODIFIED, psDiff->pcPath, ulLength,
+                                     TRUE, psDiff->pvExtra) : SUCCESS;
+        return FT_diffPush(psDiff, oNOld, oNNew, NULL, ulLength);
     }
 
-    /* If there's a root node, free the entire tree */
-    if (oRoot != NULL) {
-        Node_free(oRoot);
-        oRoot = NULL;
+    if (oNOld != NULL) {
+        iStatus = (*psDiff->pfDiff)(FT_REMOVED, psDiff->pcPath, ulLength,
+                                    (boolean) !bOldDir, psDiff->pvExtra);
+        if (iStatus != SUCCESS)
+            return iStatus;
+        /* What took its place waits until the old children are gone */
+        if (bOldDir)
+            return FT_diffPush(psDiff, oNOld, NULL, oNNew, ulLength);
     }
+    if (oNNew != NULL)
+        iStatus = FT_diffAdded(psDiff, ulLength, oNNew);
+    return iStatus;
+}
 
-    /* Mark the FT as uninitialized */
-    bIsInitialized = FALSE;
+/*
+  Merges the children of the pairs on psDiff's stack, sorted by name as
+  they are, until the stack is empty. Returns SUCCESS, MEMORY_ERROR, or
+  the status with which psDiff->pfDiff stopped the walk.
+*/
+static int FT_diffMerge(struct FT_Diff *psDiff) {
+    int iStatus = SUCCESS;
+
+    assert(psDiff != NULL);
+
+    while (iStatus == SUCCESS && psDiff->ulFrames > 0) {
+        struct FT_DiffFrame *psTop = &psDiff->psFrames[psDiff->ulFrames - 1];
+        Node_T oNOld = NULL;
+        Node_T oNNew = NULL;
+        int iCompare;
+
+        if (psTop->ulOldNext < FT_diffNumChildren(psTop->oOld))
+            (void) Node_getChild(psTop->oOld, psTop->ulOldNext, &oNOld);
+        if (psTop->ulNewNext < FT_diffNumChildren(psTop->oNew))
+            (void) Node_getChild(psTop->oNew, psTop->ulNewNext, &oNNew);
+        if (oNOld == NULL && oNNew == NULL) {
+            psDiff->ulFrames--;
+            if (psTop->oNAdded != NULL)
+                iStatus = FT_diffAdded(psDiff, psTop->ulPathLength,
+                                       psTop->oNAdded);
+            continue;
+        }
 
-    return SUCCESS;
+        /* Take the smaller name, or both if they are the same */
+        if (oNOld == NULL)
+            iCompare = 1;
+        else if (oNNew == NULL)
+            iCompare = -1;
+        else
+            iCompare = Node_compare(oNOld, oNNew);
+        if (iCompare <= 0)
+            psTop->ulOldNext++;
+        else
+            oNOld = NULL;
+        if (iCompare >= 0)
+            psTop->ulNewNext++;
+        else
+            oNNew = NULL;
+
+        /* Pushing may move the stack, so psTop is not used after this */
+        iStatus = FT_diffPair(psDiff, psTop->ulPathLength, oNOld, oNNew);
+    }
+    return iStatus;
 }
 
 /*
-  Returns a string representation of the
-  data structure, or NULL if the structure is
-  not initialized or there is an allocation error.
+  Reports the differences between oOld and oNew to pfDiff, merging the
+  sorted children of each pair of directories at the same path and
+  skipping whatever the two share.
+*/
+int FT_diff(FT_Snapshot_T oOld, FT_Snapshot_T oNew,
+            int (*pfDiff)(enum FT_Change eChange, const char *pcPath,
+                          size_t ulLength, boolean bIsFile, void *pvExtra),
+            void *pvExtra) {
+    struct FT_Diff sDiff;
+    Node_T oNOldRoot;
+    Node_T oNNewRoot;
+    int iStatus = SUCCESS;
+
+    assert(pfDiff != NULL);
+
+    if (oOld == NULL || oNew == NULL)
+        return INITIALIZATION_ERROR;
 
-  The representation is depth-first with files
-  before directories at any given level, and nodes
-  of the same type ordered lexicographically.
+    sDiff.psFrames = NULL;
+    sDiff.ulFrames = 0;
+    sDiff.ulFrameSlots = 0;
+    sDiff.pcPath = NULL;
+    sDiff.ulPathSize = 0;
+    sDiff.pfDiff = pfDiff;
+    sDiff.pvExtra = pvExtra;
+
+    /* Roots with different names are as unrelated as any two nodes */
+    oNOldRoot = oOld->oRoot;
+    oNNewRoot = oNew->oRoot;
+    if (oNOldRoot != NULL && oNNewRoot != NULL &&
+        Node_compare(oNOldRoot, oNNewRoot) == 0)
+        iStatus = FT_diffPair(&sDiff, 0, oNOldRoot, oNNewRoot);
+    else if (oNOldRoot != NULL) {
+        iStatus = FT_diffPair(&sDiff, 0, oNOldRoot, NULL);
+        if (iStatus == SUCCESS)
+            iStatus = FT_diffMerge(&sDiff);
+        oNOldRoot = NULL;
+    }
+    if (iStatus == SUCCESS && oNOldRoot == NULL && oNNewRoot != NULL)
+        iStatus = FT_diffPair(&sDiff, 0, NULL, oNNewRoot);
+    if (iStatus == SUCCESS)
+        iStatus = FT_diffMerge(&sDiff);
+
+    free(sDiff.psFrames);
+    free(sDiff.pcPath);
+    return iStatus;
+}
 
-  Allocates memory for the returned string,
-  which is then owned by client!
+/*
+  Fills in *psStats with oFT's counts so far, and the process's counts
+  of path and DynArray work; see FT_getStats. Takes no lock beyond a
+  lookup's, so the counts are read while other calls add to them.
 */
+int FT_getStatsIn(FT_T oFT, struct FT_Stats *psStats) {
+    struct Path_Stats sPathStats;
+    struct DynArray_Stats sDynArrayStats;
 
-static int compareNodes(const void *p1, const void *p2) {
-    /* Comparison function for qsort to sort nodes lexicographically by path */
-    const Node_T *node1 = (const Node_T *)p1;
-    const Node_T *node2 = (const Node_T *)p2;
-    return Node_compare(*node1, *node2);
-}
+    assert(psStats != NULL);
 
-/* Helper: recursively builds string representation (depth-first traversal) */
-static boolean FT_traverseToString(Node_T oNode, DynArray_T oLines) {
-    char *s = Node_toString(oNode);
-    size_t i; 
+    if (!FT_enter(oFT, FT_LOOKUP))
+        return INITIALIZATION_ERROR;
 
-    if (s == NULL) return FALSE;
+    memset(psStats, 0, sizeof(*psStats));
+#ifdef STATS
+    {
+        size_t i;
+        size_t j;
 
-    if (!DynArray_add(oLines, s)) {
-        free(s);
-        return FALSE;
+        for (i = 0; i < FT_NUM_OPS; i++)
+            for (j = 0; j < FT_NUM_STATUSES; j++)
+                psStats->aulOps[i][j] =
+                    STATS_READ(oFT->sCounters.aulOps[i][j]);
     }
+    psStats->ulLookups = STATS_READ(oFT->sCounters.ulLookups);
+    psStats->ulNodesVisited = STATS_READ(oFT->sCounters.ulNodesVisited);
+    psStats->ulCacheHits = STATS_READ(oFT->sCounters.ulCacheHits);
+    psStats->ulCacheParentHits =
+        STATS_READ(oFT->sCounters.ulCacheParentHits);
+    psStats->ulCacheMisses = STATS_READ(oFT->sCounters.ulCacheMisses);
+    psStats->ulNodes = STATS_READ(oFT->sCounters.ulNodes);
+    psStats->ulMaxDepth = STATS_READ(oFT->sCounters.ulMaxDepth);
+    psStats->ulMaxFanOut = STATS_READ(oFT->sCounters.ulMaxFanOut);
+#endif
+
+    Path_getStats(&sPathStats);
+    psStats->ulPathNews = sPathStats.ulNews;
+    psStats->ulPathPrefixes = sPathStats.ulPrefixes;
+    DynArray_getStats(&sDynArrayStats);
+    psStats->ulDynArrayGrows = sDynArrayStats.uGrows;
+    psStats->ulDynArrayBytesMoved = sDynArrayStats.uBytesMoved;
+
+    FT_leave(oFT, FT_LOOKUP);
+    return SUCCESS;
+}
 
-    /* Get children and separate into file and dir lists */
-    size_t numChildren = Node_getNumChildren(oNode);
-    DynArray_T fileChildren = DynArray_new(0);
-    DynArray_T dirChildren = DynArray_new(0);
+/*
+  Checks all of oFT, which it has to itself meanwhile, as documented for
+  FT_check.
+*/
+boolean FT_checkIn(FT_T oFT) {
+    boolean bValid;
 
-    if (fileChildren == NULL || dirChildren == NULL) {
-        DynArray_free(fileChildren);
-        DynArray_free(dirChildren);
-        return FALSE;
-    }
+    if (!FT_enter(oFT, FT_SCAN))
+        return TRUE;
 
-    for (i = 0; i < numChildren; i++) {
-        Node_T child;
-        if (Node_getChild(oNode, i, &child) == SUCCESS) {
-            if (Node_getType(child) == FT_FILE) {
-                DynArray_add(fileChildren, child);
-            } else {
-                DynArray_add(dirChildren, child);
-            }
-        }
-    }
+    bValid = CheckerFT_isValid(TRUE, oFT->oRoot);
 
-    /* Sort each list lexicographically */
-    qsort(fileChildren, DynArray_getLength(fileChildren),
-          sizeof(Node_T), compareNodes);
+    FT_leave(oFT, FT_SCAN);
+    return bValid;
+}
 
-    qsort(dirChildren, DynArray_getLength(dirChildren),
-          sizeof(Node_T), compareNodes);
+/*
+  Starts watching the directory of oFT with absolute path pcPath, as
+  documented for FT_watch. A watch is linked in with the tree to
+  itself, so the writers that walk past it take no lock for it.
+*/
+int FT_watchIn(FT_T oFT, const char *pcPath, boolean bRecursive,
+               void (*pfNotify)(const struct FT_Event *psEvents,
+                                size_t ulCount, void *pvExtra),
+               void *pvExtra, FT_Watch_T *poWatch) {
+    struct FT_Watch *psWatch = NULL;
+    Node_T oNFound;
+    FT_Lock psHeld;
+    int iStatus;
+
+    assert(pcPath != NULL);
+    assert(pfNotify != NULL);
+    assert(poWatch != NULL);
+
+    if (!FT_enter(oFT, FT_SCAN))
+        return INITIALIZATION_ERROR;
 
-    /* Recursively process files first, then directories */
-    for (i = 0; i < DynArray_getLength(fileChildren); i++) {
-        Node_T child = DynArray_get(fileChildren, i);
-        if (!FT_traverseToString(child, oLines)) {
-            DynArray_free(fileChildren);
-            DynArray_free(dirChildren);
-            return FALSE;
-        }
+    iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound, &psHeld);
+    if (iStatus == SUCCESS) {
+        FT_unlock(psHeld);
+        if (Node_getType(oNFound) != FT_DIR)
+            iStatus = NOT_A_DIRECTORY;
+    }
+    if (iStatus == SUCCESS) {
+        psWatch = malloc(sizeof(struct FT_Watch));
+        if (psWatch == NULL || !FT_watchStart())
+            iStatus = MEMORY_ERROR;
     }
 
-    for (i = 0; i < DynArray_getLength(dirChildren); i++) {
-        Node_T child = DynArray_get(dirChildren, i);
-        if (!FT_traverseToString(child, oLines)) {
-            DynArray_free(fileChildren);
-            DynArray_free(dirChildren);
-            return FALSE;
+    if (iStatus == SUCCESS) {
+        psWatch->oFT = oFT;
+        psWatch->oNDir = oNFound;
+        psWatch->bRecursive = bRecursive;
+        psWatch->pfNotify = pfNotify;
+        psWatch->pvExtra = pvExtra;
+        psWatch->psNextOnDir = Node_getWatch(oNFound);
+        psWatch->ulRefs = 1;
+        psWatch->ulLost = 0;
+        psWatch->bEnded = FALSE;
+        Node_setWatch(oNFound, psWatch);
+
+        FT_watchLinkLock();
+        psWatch->psNext = oFT->psWatches;
+        oFT->psWatches = psWatch;
+        FT_watchLinkUnlock();
+        *poWatch = psWatch;
+    }
+    else
+        free(psWatch);
+
+    FT_leave(oFT, FT_SCAN);
+    return iStatus;
+}
+
+/*
+  Stops oWatch, as documented for FT_unwatch: unlinks it with the tree
+  to itself, then lets go of the tree before waiting for its pfNotify,
+  which may be using the tree.
+*/
+void FT_unwatch(FT_Watch_T oWatch) {
+    struct FT_Watch **ppsLink;
+    FT_T oFT;
+
+    if (oWatch == NULL)
+        return;
+    oFT = oWatch->oFT;
+
+    (void) FT_enter(oFT, FT_SCAN);
+    if (oWatch->oNDir != NULL) {
+        struct FT_Watch *psFirst = Node_getWatch(oWatch->oNDir);
+
+        if (psFirst == oWatch)
+            Node_setWatch(oWatch->oNDir, oWatch->psNextOnDir);
+        else {
+            while (psFirst->psNextOnDir != oWatch)
+                psFirst = psFirst->psNextOnDir;
+            psFirst->psNextOnDir = oWatch->psNextOnDir;
         }
     }
 
-    DynArray_free(fileChildren);
-    DynArray_free(dirChildren);
-    return TRUE;
+    FT_watchLinkLock();
+    for (ppsLink = &oFT->psWatches; *ppsLink != oWatch;
+         ppsLink = &(*ppsLink)->psNext)
+        ;
+    *ppsLink = oWatch->psNext;
+    FT_watchLinkUnlock();
+    FT_leave(oFT, FT_SCAN);
+
+    FT_watchEnd(oWatch);
+}
+
+/* Waits for every event queued so far, as documented for FT_watchFlush. */
+void FT_watchFlush(void) {
+    FT_watchDeliverAll();
+}
+
+/* --------------------------------------------------------------------
+
+  The global API: each function runs its "In" counterpart on sGlobal,
+  or on NULL, which every "In" function treats as an uninitialized FT,
+  while sGlobal is not initialized.
+
+-------------------------------------------------------------------- */
+
+/* Returns the FT behind the global API, or NULL if it is uninitialized. */
+static FT_T FT_global(void) {
+    return bIsInitialized ? &sGlobal : NULL;
+}
+
+int FT_insertDir(const char *pcPath) {
+    return FT_insertDirIn(FT_global(), pcPath);
+}
+
+boolean FT_containsDir(const char *pcPath) {
+    return FT_containsDirIn(FT_global(), pcPath);
+}
+
+int FT_rmDir(const char *pcPath) {
+    return FT_rmDirIn(FT_global(), pcPath);
+}
+
+int FT_rmDirDeferred(const char *pcPath) {
+    return FT_rmDirDeferredIn(FT_global(), pcPath);
+}
+
+int FT_insertFile(const char *pcPath, void *pvContents, size_t ulLength) {
+    return FT_insertFileIn(FT_global(), pcPath, pvContents, ulLength);
+}
+
+int FT_insertFileAdopt(const char *pcPath, void *pvContents,
+                       size_t ulLength) {
+    return FT_insertFileAdoptIn(FT_global(), pcPath, pvContents, ulLength);
+}
+
+size_t FT_insertBatch(const struct FT_BatchEntry *psEntries,
+                      size_t ulCount, int *piStatuses) {
+    return FT_insertBatchIn(FT_global(), psEntries, ulCount, piStatuses);
+}
+
+int FT_buildFromSorted(const struct FT_BatchEntry *psEntries,
+                       size_t ulCount, size_t *pulFailed) {
+    return FT_buildFromSortedIn(FT_global(), psEntries, ulCount, pulFailed);
+}
+
+boolean FT_containsFile(const char *pcPath) {
+    return FT_containsFileIn(FT_global(), pcPath);
+}
+
+int FT_rmFile(const char *pcPath) {
+    return FT_rmFileIn(FT_global(), pcPath);
+}
+
+void *FT_getFileContents(const char *pcPath) {
+    return FT_getFileContentsIn(FT_global(), pcPath);
+}
+
+void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
+                             size_t ulNewLength) {
+    return FT_replaceFileContentsIn(FT_global(), pcPath, pvNewContents,
+                                    ulNewLength);
+}
+
+void *FT_replaceFileContentsAdopt(const char *pcPath, void *pvNewContents,
+                                  size_t ulNewLength) {
+    return FT_replaceFileContentsAdoptIn(FT_global(), pcPath, pvNewContents,
+                                         ulNewLength);
+}
+
+int FT_move(const char *pcOldPath, const char *pcNewPath) {
+    return FT_moveIn(FT_global(), pcOldPath, pcNewPath);
+}
+
+int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize) {
+    return FT_statIn(FT_global(), pcPath, pbIsFile, pulSize);
+}
+
+int FT_statTree(const char *pcPath, size_t *pulFiles, size_t *pulDirs,
+                size_t *pulBytes) {
+    return FT_statTreeIn(FT_global(), pcPath, pulFiles, pulDirs, pulBytes);
+}
+
+FT_Iter_T FT_iterNew(void) {
+    return FT_iterNewIn(FT_global());
+}
+
+int FT_visit(int (*pfVisit)(const char *pcPath, size_t ulLength,
+                            boolean bIsFile, void *pvExtra),
+             void *pvExtra) {
+    return FT_visitIn(FT_global(), pfVisit, pvExtra);
+}
+
+int FT_query(const char *pcPattern, size_t ulMaxDepth,
+             int (*pfVisit)(const char *pcPath, size_t ulLength,
+                            boolean bIsFile, void *pvExtra),
+             void *pvExtra) {
+    return FT_queryIn(FT_global(), pcPattern, ulMaxDepth, pfVisit, pvExtra);
+}
+
+int FT_writeTo(FILE *psFile) {
+    return FT_writeToIn(FT_global(), psFile);
 }
 
 char *FT_toString(void) {
-    size_t totalLength, numLines;
-    size_t i;
-    if (!bIsInitialized || oRoot == NULL)
-        return NULL;
+    return FT_toStringIn(FT_global());
+}
 
-    DynArray_T oLines = DynArray_new(0);
-    if (oLines == NULL)
-        return NULL;
+int FT_save(const char *pcFile) {
+    return FT_saveIn(FT_global(), pcFile);
+}
 
-    if (!FT_traverseToString(oRoot, oLines)) {
-        /* Error occurred — cleanup */
-        size_t len = DynArray_getLength(oLines);
-        for (i = 0; i < len; i++) {
-            char *line = DynArray_get(oLines, i);
-            free(line);
-        }
-        DynArray_free(oLines);
-        return NULL;
-    }
+int FT_loadMapped(const char *pcFile) {
+    return FT_loadMappedIn(FT_global(), pcFile);
+}
 
-    /* Compute total length of final string (including newlines + null) */
-    totalLength = 1;
-    numLines = DynArray_getLength(oLines);
-    for (i = 0; i < numLines; i++) {
-        char *line = DynArray_get(oLines, i);
-        totalLength += strlen(line) + 1;
-    }
+int FT_journalOpen(const char *pcSnapshot, const char *pcJournal,
+                   size_t ulGroup, size_t ulCompactBytes) {
+    return FT_journalOpenIn(FT_global(), pcSnapshot, pcJournal, ulGroup,
+                            ulCompactBytes);
+}
 
-    char *result = malloc(totalLength);
-    if (result == NULL) {
-        for (i = 0; i < numLines; i++)
-            free(DynArray_get(oLines, i));
-        DynArray_free(oLines);
-        return NULL;
-    }
+int FT_journalSync(void) {
+    return FT_journalSyncIn(FT_global());
+}
 
-    /* Build the result string */
-    result[0] = '\0';
-    for (i = 0; i < numLines; i++) {
-        strcat(result, DynArray_get(oLines, i));
-        strcat(result, "\n");
-        free(DynArray_get(oLines, i));
-    }
+int FT_journalClose(void) {
+    return FT_journalCloseIn(FT_global());
+}
+
+int FT_recover(const char *pcSnapshot, const char *pcJournal) {
+    return FT_recoverIn(FT_global(), pcSnapshot, pcJournal);
+}
+
+int FT_freeze(void) {
+    return FT_freezeIn(FT_global());
+}
+
+int FT_setCacheSize(size_t ulSlots) {
+    return FT_setCacheSizeIn(FT_global(), ulSlots);
+}
+
+int FT_setDedup(boolean bDedup) {
+    return FT_setDedupIn(FT_global(), bDedup);
+}
+
+FT_Snapshot_T FT_snapshot(void) {
+    return FT_snapshotIn(FT_global());
+}
+
+int FT_getStats(struct FT_Stats *psStats) {
+    return FT_getStatsIn(FT_global(), psStats);
+}
+
+int FT_watch(const char *pcPath, boolean bRecursive,
+             void (*pfNotify)(const struct FT_Event *psEvents,
+                              size_t ulCount, void *pvExtra),
+             void *pvExtra, FT_Watch_T *poWatch) {
+    return FT_watchIn(FT_global(), pcPath, bRecursive, pfNotify, pvExtra,
+                      poWatch);
+}
 
-    DynArray_free(oLines);
-    return result;
-}
\ No newline at end of file
+boolean FT_check(void) {
+    return FT_checkIn(FT_global());
+}
@@ -10,9 +10,37 @@
   A File Tree is a representation of a hierarchy of directories and
   files: the File Tree is rooted at a directory, directories
   may be internal nodes or leaves, and files are always leaves.
+
+  Compiled with THREADSAFE (and linked with -pthread), an FT may be
+  used from several threads at once. Lookups (FT_containsDir,
+  FT_containsFile, FT_getFileContents, FT_stat, FT_statTree) run in
+  parallel with each other and with changes elsewhere in the tree:
+  inserts, removals and content replacements lock only the directory
+  they change, and the directories above it only in passing. The
+  other operations have the whole FT to themselves while they run, so
+  a pfVisit callback must not call back into the same FT. Still the
+  caller's to keep apart: FT_init, FT_destroy, FT_new and FT_free
+  from everything else on that FT, iterators from any change to the
+  FT, and the use of returned contents from the removal of their file.
+
+  Compiled with RCU as well, lookups take no locks at all: they walk
+  the tree while it changes, and whatever a change unlinks is freed
+  only once every lookup that might still see it has finished. A busy
+  FT_rmDir thus no longer holds up readers of the subtree it removes.
+
+  Each FT interns the names of its nodes in its own arena, apart from
+  the process-wide atom table (see atom.h) that paths share, so that
+  an FT's names go with it and FTs stay independent of each other.
+  Nodes of one FT with the same name thus share one copy of it, and
+  compare equal names by pointer, but a name that is also a component
+  of a live path is kept twice, once in each table. In a directory
+  with many children, a lookup hashes its path's component as the
+  atom table does, and compares it only with children whose names
+  hash the same; elsewhere it compares the characters themselves.
 */
 
 #include <stddef.h>
+#include <stdio.h>
 #include "a4def.h"
 
 /*
@@ -47,10 +75,21 @@ boolean FT_containsDir(const char *pcPath);
 */
 int FT_rmDir(const char *pcPath);
 
+/*
+  Removes the directory with absolute path pcPath as FT_rmDir does,
+  and returns the same statuses, but has the whole FT to itself while
+  it unlinks the subtree, which takes time proportional to the depth
+  of pcPath rather than to the size of the subtree. In a THREADSAFE
+  build the subtree is then freed on a background thread; otherwise,
+  or while snapshots share the FT, it is freed before returning.
+*/
+int FT_rmDirDeferred(const char *pcPath);
+
 
 /*
    Inserts a new file into the FT with absolute path pcPath, with
-   file contents pvContents of size ulLength bytes.
+   file contents pvContents of size ulLength bytes. The FT stores a
+   copy of the contents; they may contain '\0' bytes.
    Returns SUCCESS if the new file is inserted successfully.
    Otherwise, returns:
    * INITIALIZATION_ERROR if the FT is not in an initialized state
@@ -64,6 +103,60 @@ int FT_rmDir(const char *pcPath);
 int FT_insertFile(const char *pcPath, void *pvContents,
                   size_t ulLength);
 
+/*
+   Like FT_insertFile, but the FT takes ownership of pvContents, which
+   must have been allocated by malloc, instead of copying it: the FT
+   frees it when the file is removed or the FT is destroyed. Unless
+   SUCCESS is returned, ownership stays with the caller.
+*/
+int FT_insertFileAdopt(const char *pcPath, void *pvContents,
+                       size_t ulLength);
+
+/* One entry of an FT_insertBatch request */
+struct FT_BatchEntry {
+   /* the absolute path to insert */
+   const char *pcPath;
+   /* TRUE to insert a file, FALSE to insert a directory */
+   boolean bIsFile;
+   /* for a file, the ulLength bytes of contents to copy (may be NULL) */
+   void *pvContents;
+   size_t ulLength;
+};
+
+/*
+   Inserts the ulCount entries of psEntries in order, each exactly as
+   FT_insertDir or FT_insertFile would, but resuming each traversal
+   from the deepest directory it shares with the previous entry, so
+   that input sorted by path is inserted with few lookups. A failed
+   entry leaves the FT unchanged and does not stop the batch.
+   If piStatuses is not NULL, sets piStatuses[i] to the status that
+   FT_insertDir or FT_insertFile would have returned for entry i.
+   Returns the number of entries inserted successfully.
+*/
+size_t FT_insertBatch(const struct FT_BatchEntry *psEntries,
+                      size_t ulCount, int *piStatuses);
+
+/*
+   Builds the FT, which must be initialized and empty, from the ulCount
+   entries of psEntries in time linear in their number. The entries
+   must be sorted component by component: all of a directory's
+   descendants come before its next sibling, and siblings appear in
+   strcmp order of their names. Missing ancestor
+   directories are created as FT_insertDir would.
+   Returns SUCCESS if every entry was inserted. Otherwise leaves the FT
+   as it was, sets *pulFailed (if pulFailed is not NULL) to the index of
+   the offending entry, or to ulCount if none was at fault, and returns:
+   * INITIALIZATION_ERROR if the FT is not in an initialized state
+   * CONFLICTING_PATH if the FT is not empty, if an entry does not share
+                      the first entry's root, or if a file would be the root
+   * BAD_PATH if a path is not well-formatted or is out of order
+   * NOT_A_DIRECTORY if a proper prefix of a path is a file
+   * ALREADY_IN_TREE if a path appears twice
+   * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_buildFromSorted(const struct FT_BatchEntry *psEntries,
+                       size_t ulCount, size_t *pulFailed);
+
 /*
   Returns TRUE if the FT contains a file with absolute path
   pcPath and FALSE if not or if there is an error while checking.
@@ -96,11 +189,47 @@ void *FT_getFileContents(const char *pcPath);
   Replaces current contents of the file with absolute path pcPath with
   the parameter pvNewContents of size ulNewLength bytes.
   Returns the old contents if successful. (Note: contents may be NULL.)
+  The old contents remain owned by the FT and stay valid until the
+  file's contents are replaced again, or the file is removed (and at
+  the latest until FT_destroy); a snapshot that holds the file keeps
+  them valid for as long as it could still return them.
   Returns NULL if unable to complete the request for any reason.
 */
 void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
                              size_t ulNewLength);
 
+/*
+  Like FT_replaceFileContents, but the FT takes ownership of
+  pvNewContents, which must have been allocated by malloc, instead of
+  copying it. Ownership passes to the FT only if the replacement
+  succeeds, i.e., if FT_getFileContents(pcPath) then returns
+  pvNewContents.
+*/
+void *FT_replaceFileContentsAdopt(const char *pcPath, void *pvNewContents,
+                                  size_t ulNewLength);
+
+/*
+  Moves the file or directory with absolute path pcOldPath, along with
+  everything below it, to absolute path pcNewPath, as rename(2) would.
+  The node is relinked under its new parent rather than copied, so the
+  move takes time proportional to the depth of the two paths, however
+  large the subtree. In a THREADSAFE build it has the FT to itself and
+  is atomic: no other operation sees the subtree at both paths, nor at
+  neither (save an RCU lookup, which may briefly find it at both).
+  Returns SUCCESS if the node was moved. Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if either path does not represent a well-formatted path
+  * CONFLICTING_PATH if the root is not a prefix of either path, if
+                     either path is the root's, or if pcNewPath is
+                     pcOldPath or lies below it
+  * NO_SUCH_PATH if pcOldPath, or the parent of pcNewPath, does not
+                 exist in the FT
+  * NOT_A_DIRECTORY if a proper prefix of either path exists as a file
+  * ALREADY_IN_TREE if pcNewPath is already in the FT (as dir or file)
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_move(const char *pcOldPath, const char *pcNewPath);
+
 /*
   Returns SUCCESS if pcPath exists in the hierarchy,
   Otherwise, returns:
@@ -113,23 +242,39 @@ void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
   When returning SUCCESS,
   if path is a directory: sets *pbIsFile to FALSE, *pulSize unchanged
   if path is a file: sets *pbIsFile to TRUE, and
-                     sets *pulSize to the length of file's contents
+                     sets *pulSize to the length of file's contents,
+                     in time independent of that length
 
   When returning another status, *pbIsFile and *pulSize are unchanged.
 */
 int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize);
 
+/*
+  Like FT_stat, but describes the whole subtree rooted at pcPath, as
+  du would: sets *pulFiles, *pulDirs and *pulBytes, those that are not
+  NULL, to the number of files and directories in it (pcPath itself
+  included) and to the total length of its files' contents. Every
+  directory keeps these totals up to date as the tree changes, so the
+  answer takes time proportional to the depth of pcPath, however large
+  its subtree. Returns the statuses documented for FT_stat, leaving
+  the counts unchanged unless it returns SUCCESS.
+*/
+int FT_statTree(const char *pcPath, size_t *pulFiles, size_t *pulDirs,
+                size_t *pulBytes);
+
 /*
   Sets the FT data structure to an initialized state.
   The data structure is initially empty.
   Returns INITIALIZATION_ERROR if already initialized,
+  MEMORY_ERROR if memory could not be allocated,
   and SUCCESS otherwise.
 */
 int FT_init(void);
 
 /*
   Removes all contents of the data structure and
-  returns it to an uninitialized state.
+  returns it to an uninitialized state. All of the tree's memory is
+  released at once, in time independent of the number of nodes.
   Returns INITIALIZATION_ERROR if not already initialized,
   and SUCCESS otherwise.
 */
@@ -146,12 +291,518 @@ int FT_destroy(void);
 
   Allocates memory for the returned string,
   which is then owned by client!
+
+  In a THREADSAFE build, a large FT is written out by several threads
+  at once, each taking a run of whole subtrees.
 */
 char *FT_toString(void);
 
-int Node_addChild(Node_T oParent, Node_T oChild);
+/*
+  Calls (*pfVisit)(pcPath, ulLength, bIsFile, pvExtra) for every node in
+  the FT, in the order used by FT_toString. pcPath is the node's absolute
+  path, ulLength characters long and '\0'-terminated; it is only valid
+  during the call. pfVisit returns SUCCESS to continue the walk; any
+  other status stops it.
+  Returns SUCCESS if every node was visited. Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * the status that pfVisit returned to stop the walk
+*/
+int FT_visit(int (*pfVisit)(const char *pcPath, size_t ulLength,
+                            boolean bIsFile, void *pvExtra),
+             void *pvExtra);
+
+/*
+  Calls (*pfVisit)(pcPath, ulLength, bIsFile, pvExtra), as FT_visit
+  does, for every node whose absolute path matches pcPattern, and for
+  each node up to ulMaxDepth levels below such a node, in the order
+  used by FT_toString. Each component of pcPattern is matched against
+  one component of the path, as fnmatch(3) would without flags: so
+  "r/logs/2026-*" matches the children of r/logs whose names start
+  with "2026-", but not their children, since '*' never matches
+  across a '/'. The part of pcPattern before its first
+  glob component is looked up as any path is, and the walk from there
+  descends only into nodes that match their component (or that lie
+  within ulMaxDepth levels of a match), so it takes time in proportion
+  to the part of the FT it reaches, not to all of it.
+  Returns SUCCESS, even if nothing matched. Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPattern is not a well-formatted path
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * the status that pfVisit returned to stop the walk
+*/
+int FT_query(const char *pcPattern, size_t ulMaxDepth,
+             int (*pfVisit)(const char *pcPath, size_t ulLength,
+                            boolean bIsFile, void *pvExtra),
+             void *pvExtra);
+
+/* An FT_Iter_T pages through the FT one node at a time. */
+typedef struct FT_Iter *FT_Iter_T;
+
+/*
+  Returns a new iterator over the nodes of the FT in FT_toString order,
+  or NULL if the FT is not in an initialized state or memory could not
+  be allocated. The FT must not change while the iterator is in use.
+*/
+FT_Iter_T FT_iterNew(void);
+
+/*
+  Advances oIter to the next node. Returns SUCCESS and sets *ppcPath to
+  that node's absolute path, and (if not NULL) *pulLength to its length
+  and *pbIsFile to whether it is a file; the path is valid until the
+  next call. At the end of the FT, returns SUCCESS and sets *ppcPath to
+  NULL. Returns MEMORY_ERROR if memory could not be allocated, in which
+  case the call may be retried.
+*/
+int FT_iterNext(FT_Iter_T oIter, const char **ppcPath, size_t *pulLength,
+                boolean *pbIsFile);
+
+/* Frees oIter. Does nothing if oIter is NULL. */
+void FT_iterFree(FT_Iter_T oIter);
+
+/*
+  Writes the FT_toString representation of the FT to psFile, one line
+  at a time, without building it in memory first.
+  Returns SUCCESS, INITIALIZATION_ERROR if the FT is not in an
+  initialized state, or MEMORY_ERROR if memory could not be allocated.
+  Errors writing to psFile are left for the caller to check with ferror.
+*/
+int FT_writeTo(FILE *psFile);
+
+/*
+  Saves the FT to the file named pcFile in a compact binary image: a
+  table of nodes linked to their parents and first children, a table
+  of distinct names, and the file contents back to back, each only
+  once however many files share it (see FT_setDedup). Replaces the
+  file if it exists, by writing the image to pcFile with ".tmp"
+  appended and renaming that over pcFile, so saving to the file the FT
+  was loaded from (see FT_loadMapped) is safe.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * IO_ERROR if the file could not be written; it is then left as it was
+*/
+int FT_save(const char *pcFile);
+
+/*
+  Loads the FT, which must be initialized and empty, from the image
+  that FT_save wrote to the file named pcFile. The image is mapped
+  into memory, not read, and file contents are used where they lie
+  in it, so loading costs one pass over the node table. Writing into
+  returned contents changes only the FT's private copy of the image.
+  The mapping stays in place until FT_destroy or the root's removal,
+  and the file must not be truncated or written into meanwhile, which
+  would take the tree's names and contents away from under it:
+  replace it only as FT_save does, by renaming a new file over it.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * CONFLICTING_PATH if the FT is not empty
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * IO_ERROR if the file could not be mapped or is not a valid image
+*/
+int FT_loadMapped(const char *pcFile);
+
+/*
+  Starts logging each change to the FT that succeeds (each insert,
+  removal, move and replacement of contents) to an append-only journal
+  in the file named pcJournal, after saving the FT as FT_save does to
+  the file named pcSnapshot. Both files are replaced, and the journal
+  open until now, if any, is closed. Changes are written and synced
+  ulGroup at a time, with one write and one fsync (each on its own if
+  ulGroup is 0 or 1), so a crash loses at most the last ulGroup - 1;
+  FT_journalSync writes them out sooner. Whenever the journal reaches
+  ulCompactBytes bytes (never, if ulCompactBytes is 0), it is
+  compacted: the FT is saved to pcSnapshot again and the journal
+  starts again, empty. Both files are first written under their names
+  with ".tmp" added, and renamed into place, so a crash at any moment
+  leaves a pair that FT_recover can use. FT_buildFromSorted and
+  FT_loadMapped are not logged, but compact the journal instead.
+  In a THREADSAFE build, each change has the FT to itself while a
+  journal is open, as it does while snapshots share the FT, and the
+  change that completes a group writes and syncs it before letting the
+  FT go, so every other thread waits out that fsync (and any
+  compaction) too; a larger ulGroup makes those waits rarer.
+  Returns SUCCESS, or, with no journal open:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * IO_ERROR if either file could not be written
+*/
+int FT_journalOpen(const char *pcSnapshot, const char *pcJournal,
+                   size_t ulGroup, size_t ulCompactBytes);
+
+/*
+  Writes and syncs the changes that the journal still buffers.
+  Returns SUCCESS if every change since FT_journalOpen has been kept,
+  or if no journal is open, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR or IO_ERROR if some change could not be kept; the
+    journal then keeps none after it, until FT_journalOpen starts
+    it again
+*/
+int FT_journalSync(void);
+
+/*
+  Syncs the journal as FT_journalSync does, closes it, and returns
+  what FT_journalSync would have. FT_destroy closes it as well.
+*/
+int FT_journalClose(void);
+
+/*
+  Rebuilds the FT, which must be initialized and empty and have no
+  journal open, as it was when the last change that its journal kept
+  was made: loads the image in the file named pcSnapshot as
+  FT_loadMapped does, then replays the changes that the journal in the
+  file named pcJournal logged after it, handing each run of inserts to
+  FT_insertBatch. A change that a crash cut short ends the journal. An
+  FT with neither file is left empty. Nothing else may change the FT
+  meanwhile; FT_journalOpen with the same files then goes on logging.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * CONFLICTING_PATH if the FT is not empty or has a journal open
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * IO_ERROR if either file could not be read, or is not one that
+             FT_journalOpen wrote
+  * the status of a change that could not be replayed as it was made,
+    in which case the FT is left with the changes before it
+*/
+int FT_recover(const char *pcSnapshot, const char *pcJournal);
+
+/*
+  Lays out the shape of the FT, as it is now, for fast lookups: in one
+  block, in breadth-first order, so that the children of a directory
+  are adjacent and their names can be searched without visiting the
+  children themselves. Until the FT next changes, FT_containsDir,
+  FT_containsFile, FT_getFileContents, FT_stat and FT_statTree look
+  paths up there, taking no lock on the way. The first change after
+  that drops the layout, and takes the FT to itself to do so, as
+  FT_move does. Freezing takes time and memory linear in the size of
+  the FT; freezing an FT that is already frozen does nothing.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_freeze(void);
+
+/*
+  Gives the FT a lookup cache of ulSlots entries, rounded up to a
+  power of 2, in place of any it had, or takes its cache away if
+  ulSlots is 0, as it is to begin with. The cache maps the paths
+  looked up most recently to their nodes, and remembers the directory
+  the last lookup ended in, so that looking up the same path again,
+  or a sibling of the last one, need not walk down from the root.
+  Every removal and move makes everything cached stale, so the cache
+  pays off where lookups far outnumber those. In a THREADSAFE build
+  each lookup takes the cache's mutex, which RCU lookups otherwise
+  never wait for. A frozen FT (see FT_freeze) does not use its cache.
+  Returns SUCCESS, or:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated; the FT keeps the
+                 cache it had
+*/
+int FT_setCacheSize(size_t ulSlots);
+
+/*
+  Makes the FT share the copies it makes of file contents (those given
+  to FT_insertFile, FT_replaceFileContents, FT_insertBatch and
+  FT_buildFromSorted) among the files holding the same bytes if bDedup
+  is TRUE, or stops if bDedup is FALSE, as it is to begin with.
+  Each copy is looked up by a hash of its bytes, so storing contents
+  the FT already holds costs a hash and a comparison instead of memory,
+  and FT_save writes them once. Contents that are shared must not be
+  written into; contents that were adopted or loaded with FT_loadMapped
+  are never shared this way, nor are those copied before the call. As
+  ever, the old contents that FT_replaceFileContents returns stay
+  valid.
+  Returns SUCCESS, or INITIALIZATION_ERROR if the FT is not in an
+  initialized state.
+*/
+int FT_setDedup(boolean bDedup);
+
+/*
+  An FT_Snapshot_T is a read-only view of the FT as it was at one point
+  in time. It shares all of its nodes with the FT, which copies only
+  the ones on the path to whatever it changes afterwards, so reading a
+  snapshot is as fast as reading the FT and never waits for it.
+*/
+typedef struct FT_Snapshot *FT_Snapshot_T;
+
+/*
+  Returns a snapshot of the FT as it is now, taken in constant time,
+  or NULL if the FT is not in an initialized state or memory could not
+  be allocated. A snapshot must be freed before the FT is destroyed;
+  contents returned by FT_replaceFileContents stay valid for as long
+  as a snapshot of the file could still return them.
+*/
+FT_Snapshot_T FT_snapshot(void);
+
+/* Frees oSnapshot. Does nothing if oSnapshot is NULL. */
+void FT_snapshotFree(FT_Snapshot_T oSnapshot);
+
+/*
+  Each function below does what the function of the same name without
+  "snapshot" does, but to the FT as it was when oSnapshot was taken,
+  without taking any lock. A NULL oSnapshot is treated as an FT that
+  is not in an initialized state.
+*/
+boolean FT_snapshotContainsDir(FT_Snapshot_T oSnapshot, const char *pcPath);
+boolean FT_snapshotContainsFile(FT_Snapshot_T oSnapshot, const char *pcPath);
+void *FT_snapshotGetFileContents(FT_Snapshot_T oSnapshot,
+                                 const char *pcPath);
+int FT_snapshotStat(FT_Snapshot_T oSnapshot, const char *pcPath,
+                    boolean *pbIsFile, size_t *pulSize);
+int FT_snapshotStatTree(FT_Snapshot_T oSnapshot, const char *pcPath,
+                        size_t *pulFiles, size_t *pulDirs,
+                        size_t *pulBytes);
+
+/* How a path differs between the two sides of an FT_diff */
+enum FT_Change {
+   /* only on the new side */
+   FT_ADDED,
+   /* only on the old side */
+   FT_REMOVED,
+   /* a file on both sides, with different contents */
+   FT_MODIFIED
+};
+
+/*
+  Calls (*pfDiff)(eChange, pcPath, ulLength, bIsFile, pvExtra) for each
+  path at which oNew differs from oOld, depth first in order of name.
+  Every node of an added or removed subtree is reported, and a path
+  that changed between file and directory is reported removed, with
+  everything that was below it, before it is reported added, with
+  everything now below it, so that applying the changes in order
+  replays the diff. pcPath and pfDiff's return value are as for
+  FT_visit. Parts of the two that are still shared are skipped without
+  looking inside, so between snapshots of the same FT the cost follows
+  the amount of change rather than the size of the tree.
+  Returns SUCCESS if every difference was reported. Otherwise, returns:
+  * INITIALIZATION_ERROR if oOld or oNew is NULL
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * the status that pfDiff returned to stop the walk
+*/
+int FT_diff(FT_Snapshot_T oOld, FT_Snapshot_T oNew,
+            int (*pfDiff)(enum FT_Change eChange, const char *pcPath,
+                          size_t ulLength, boolean bIsFile, void *pvExtra),
+            void *pvExtra);
 
-int Node_removeChild(Node_T oParent, Node_T oChild);
+/* The operations that FT_getStats counts calls of */
+enum FT_Op {
+   FT_OP_INSERT_DIR,
+   /* FT_insertFile and FT_insertFileAdopt */
+   FT_OP_INSERT_FILE,
+   FT_OP_CONTAINS_DIR,
+   FT_OP_CONTAINS_FILE,
+   /* FT_rmDir and FT_rmDirDeferred */
+   FT_OP_RM_DIR,
+   FT_OP_RM_FILE,
+   FT_OP_GET_CONTENTS,
+   /* FT_replaceFileContents and FT_replaceFileContentsAdopt */
+   FT_OP_REPLACE_CONTENTS,
+   FT_OP_STAT,
+   FT_OP_STAT_TREE,
+   FT_OP_MOVE,
+   FT_NUM_OPS
+};
 
+/* The number of statuses in a4def.h */
+enum { FT_NUM_STATUSES = IO_ERROR + 1 };
+
+/* What FT_getStats reports */
+struct FT_Stats {
+   /* aulOps[eOp][iStatus] is the number of calls of eOp that ended
+      with iStatus; a call that returns a boolean or a pointer ends
+      with the status its lookup did, NOT_A_DIRECTORY or NOT_A_FILE
+      if that found the wrong type, or SUCCESS */
+   size_t aulOps[FT_NUM_OPS][FT_NUM_STATUSES];
+   /* the number of paths walked down the tree, and of nodes visited
+      by those walks in all */
+   size_t ulLookups;
+   size_t ulNodesVisited;
+   /* the number of lookups the cache (see FT_setCacheSize) answered
+      from a path looked up before, those it answered from the last
+      directory looked up in, and those it left to a walk */
+   size_t ulCacheHits;
+   size_t ulCacheParentHits;
+   size_t ulCacheMisses;
+   /* the number of nodes in the FT now */
+   size_t ulNodes;
+   /* the depth of the deepest node and the number of children of the
+      widest directory the FT has had, which removals do not lower;
+      FT_move counts only the depth of the node it moves, not of those
+      below it */
+   size_t ulMaxDepth;
+   size_t ulMaxFanOut;
+   /* for the whole process: paths allocated by Path_new, and by
+      Path_prefix or Path_dup */
+   size_t ulPathNews;
+   size_t ulPathPrefixes;
+   /* for the whole process: times a DynArray grew its array, and
+      bytes of elements that DynArray_addAt and DynArray_removeAt
+      shifted */
+   size_t ulDynArrayGrows;
+   size_t ulDynArrayBytesMoved;
+};
+
+/*
+  Fills in *psStats with the FT's counts so far. They are kept only in
+  a build with -DSTATS, at the cost of a few (atomic, in a THREADSAFE
+  build) additions per call, and are all 0 in any other. Calls made
+  while the FT is not in an initialized state are not counted, and
+  the counts start again from 0 at FT_init.
+  Returns SUCCESS, or INITIALIZATION_ERROR if the FT is not in an
+  initialized state.
+*/
+int FT_getStats(struct FT_Stats *psStats);
+
+/* A change that a watch is told of (see FT_watch) */
+struct FT_Event {
+   /* FT_OP_INSERT_DIR, FT_OP_INSERT_FILE, FT_OP_RM_DIR, FT_OP_RM_FILE,
+      FT_OP_REPLACE_CONTENTS or FT_OP_MOVE; or FT_NUM_OPS if events
+      for the watch were dropped, in which case ulSize is how many */
+   enum FT_Op eOp;
+   /* the absolute path that was changed, as the call that changed it
+      gave it, and for FT_OP_MOVE the path it moved to (otherwise
+      NULL); both are NULL for FT_NUM_OPS */
+   const char *pcPath;
+   const char *pcNewPath;
+   /* the length of a file's contents after FT_OP_INSERT_FILE or
+      FT_OP_REPLACE_CONTENTS, and otherwise 0 */
+   size_t ulSize;
+};
+
+/* An FT_Watch_T is a client's interest in the changes to a directory */
+typedef struct FT_Watch *FT_Watch_T;
+
+/*
+  Starts watching the directory with absolute path pcPath: from then
+  on, every change to one of its children, or to anything below it if
+  bRecursive is TRUE, is told of by calling
+  (*pfNotify)(psEvents, ulCount, pvExtra), with ulCount events in the
+  order the changes were made; the events stay valid until pfNotify
+  returns. An insertion that also adds the directories above the new
+  node is a change to the first of them. Removing or moving the
+  directory, or one above it, is told of too, and once the directory
+  has been removed the watch hears nothing more.
+  Events are queued in a ring of fixed size, without a lock, and
+  delivered from it in batches: in a THREADSAFE build, by a thread of
+  the process's own that all FTs share, and in any other, before the
+  call that made the change returns. A change to an FT without watches
+  costs one test more, and one to an FT with watches a look at each
+  directory above it. If the ring is full, events are dropped, and the
+  next batch delivered to the watch starts by saying how many.
+  pfNotify may call any FT function but FT_watchFlush.
+  Returns SUCCESS and sets *poWatch to the new watch, or returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  * NOT_A_DIRECTORY if pcPath is in the FT as a file not a directory
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_watch(const char *pcPath, boolean bRecursive,
+             void (*pfNotify)(const struct FT_Event *psEvents,
+                              size_t ulCount, void *pvExtra),
+             void *pvExtra, FT_Watch_T *poWatch);
+
+/*
+  Stops oWatch and frees it: once this returns, its pfNotify is not
+  running, unless this was called from there, and is not called again.
+  Events still queued for it are dropped. Does nothing if oWatch is
+  NULL. Destroying an FT stops the watches left on it, which must not
+  be passed here afterwards.
+*/
+void FT_unwatch(FT_Watch_T oWatch);
+
+/*
+  Returns once every event queued so far, by any FT, has been
+  delivered.
+*/
+void FT_watchFlush(void);
+
+/*
+  Checks every node of the FT against the invariants the FT keeps (see
+  checkerFT.h). Returns TRUE if they all hold, or if the FT is not in
+  an initialized state, and otherwise prints an explanation to stderr
+  and returns FALSE. Takes time linear in the size of the FT, which it
+  has to itself meanwhile, so in a THREADSAFE build a thread of its own
+  may call it at whatever rate the cost allows, while others work on
+  the FT. A build with -DCHECKER instead checks, after each change,
+  just the nodes the change touched.
+*/
+boolean FT_check(void);
+
+/*
+  An FT_T is a File Tree object of its own. Any number of them may
+  exist at once, independent of each other and of the global FT that
+  the functions above work on, so that, e.g., each thread can own one.
+*/
+typedef struct FT *FT_T;
+
+/*
+  Returns a new, empty FT_T, which is ready for use without an init
+  call, or NULL if memory could not be allocated.
+*/
+FT_T FT_new(void);
+
+/* Frees oFT and everything in it. Does nothing if oFT is NULL. */
+void FT_free(FT_T oFT);
+
+/*
+  Each function below does what the global function of the same name,
+  without "In", does, but to the FT oFT. A NULL oFT is treated as an
+  FT that is not in an initialized state.
+*/
+int FT_insertDirIn(FT_T oFT, const char *pcPath);
+boolean FT_containsDirIn(FT_T oFT, const char *pcPath);
+int FT_rmDirIn(FT_T oFT, const char *pcPath);
+int FT_rmDirDeferredIn(FT_T oFT, const char *pcPath);
+int FT_insertFileIn(FT_T oFT, const char *pcPath, void *pvContents,
+                    size_t ulLength);
+int FT_insertFileAdoptIn(FT_T oFT, const char *pcPath, void *pvContents,
+                         size_t ulLength);
+size_t FT_insertBatchIn(FT_T oFT, const struct FT_BatchEntry *psEntries,
+                        size_t ulCount, int *piStatuses);
+int FT_buildFromSortedIn(FT_T oFT, const struct FT_BatchEntry *psEntries,
+                         size_t ulCount, size_t *pulFailed);
+boolean FT_containsFileIn(FT_T oFT, const char *pcPath);
+int FT_rmFileIn(FT_T oFT, const char *pcPath);
+void *FT_getFileContentsIn(FT_T oFT, const char *pcPath);
+void *FT_replaceFileContentsIn(FT_T oFT, const char *pcPath,
+                               void *pvNewContents, size_t ulNewLength);
+void *FT_replaceFileContentsAdoptIn(FT_T oFT, const char *pcPath,
+                                    void *pvNewContents, size_t ulNewLength);
+int FT_moveIn(FT_T oFT, const char *pcOldPath, const char *pcNewPath);
+int FT_statIn(FT_T oFT, const char *pcPath, boolean *pbIsFile,
+              size_t *pulSize);
+int FT_statTreeIn(FT_T oFT, const char *pcPath, size_t *pulFiles,
+                  size_t *pulDirs, size_t *pulBytes);
+FT_Iter_T FT_iterNewIn(FT_T oFT);
+int FT_visitIn(FT_T oFT,
+               int (*pfVisit)(const char *pcPath, size_t ulLength,
+                              boolean bIsFile, void *pvExtra),
+               void *pvExtra);
+int FT_queryIn(FT_T oFT, const char *pcPattern, size_t ulMaxDepth,
+               int (*pfVisit)(const char *pcPath, size_t ulLength,
+                              boolean bIsFile, void *pvExtra),
+               void *pvExtra);
+int FT_writeToIn(FT_T oFT, FILE *psFile);
+char *FT_toStringIn(FT_T oFT);
+int FT_saveIn(FT_T oFT, const char *pcFile);
+int FT_loadMappedIn(FT_T oFT, const char *pcFile);
+int FT_journalOpenIn(FT_T oFT, const char *pcSnapshot, const char *pcJournal,
+                     size_t ulGroup, size_t ulCompactBytes);
+int FT_journalSyncIn(FT_T oFT);
+int FT_journalCloseIn(FT_T oFT);
+int FT_recoverIn(FT_T oFT, const char *pcSnapshot, const char *pcJournal);
+int FT_freezeIn(FT_T oFT);
+int FT_setCacheSizeIn(FT_T oFT, size_t ulSlots);
+int FT_setDedupIn(FT_T oFT, boolean bDedup);
+FT_Snapshot_T FT_snapshotIn(FT_T oFT);
+int FT_getStatsIn(FT_T oFT, struct FT_Stats *psStats);
+int FT_watchIn(FT_T oFT, const char *pcPath, boolean bRecursive,
+               void (*pfNotify)(const struct FT_Event *psEvents,
+                                size_t ulCount, void *pvExtra),
+               void *pvExtra, FT_Watch_T *poWatch);
+boolean FT_checkIn(FT_T oFT);
 
 #endif
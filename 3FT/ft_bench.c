@@ -0,0 +1,25 @@
+/*--------------------------------------------------------------------*/
+/* ft_bench.c                                                         */
+/*--------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include "ft.h"
+#include "bench.h"
+
+/* Returns TRUE if pcPath is in the FT, as a directory or a file. */
+static boolean FT_benchContains(const char *pcPath) {
+   boolean bIsFile;
+   size_t ulSize;
+
+   return (boolean) (FT_stat(pcPath, &bIsFile, &ulSize) == SUCCESS);
+}
+
+/* Runs the benchmark workloads named on the command line on the FT. */
+int main(int argc, char *argv[]) {
+   static const struct Bench_Ops sOps = {
+      "FT", FT_init, FT_destroy, FT_insertDir, FT_insertFile,
+      FT_benchContains, FT_rmDir, 0
+   };
+
+   return Bench_main(argc, argv, &sOps);
+}
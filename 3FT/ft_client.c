@@ -10,15 +10,85 @@
 #include <string.h>
 #include "ft.h"
 
+/* What the callbacks below are told, one line per call */
+static char acLog[1000];
+
+/* Appends cMark, then pcPath, then a newline, to acLog. */
+static void logPath(char cMark, const char *pcPath) {
+  size_t ulUsed = strlen(acLog);
+
+  assert(ulUsed + strlen(pcPath) + 3 <= sizeof(acLog));
+  sprintf(acLog + ulUsed, "%c%s\n", cMark, pcPath);
+}
+
+/* FT_diff callback: logs each change as "+path", "-path" or "~path". */
+static int logChange(enum FT_Change eChange, const char *pcPath,
+                     size_t ulLength, boolean bIsFile, void *pvExtra) {
+  static const char acMarks[] = {'+', '-', '~'};
+
+  assert(strlen(pcPath) == ulLength);
+  (void) bIsFile;
+  (void) pvExtra;
+  logPath(acMarks[eChange], pcPath);
+  return SUCCESS;
+}
+
+/*
+  FT_watch callback: logs each event as its path after a mark for its
+  operation, and for a move the new path after a '>' too.
+*/
+static void logEvents(const struct FT_Event *psEvents, size_t ulCount,
+                      void *pvExtra) {
+  size_t i;
+
+  (void) pvExtra;
+  for (i = 0; i < ulCount; i++) {
+    switch (psEvents[i].eOp) {
+    case FT_OP_INSERT_DIR: logPath('D', psEvents[i].pcPath); break;
+    case FT_OP_INSERT_FILE: logPath('F', psEvents[i].pcPath); break;
+    case FT_OP_RM_DIR: logPath('d', psEvents[i].pcPath); break;
+    case FT_OP_RM_FILE: logPath('f', psEvents[i].pcPath); break;
+    case FT_OP_REPLACE_CONTENTS: logPath('~', psEvents[i].pcPath); break;
+    case FT_OP_MOVE:
+      logPath('M', psEvents[i].pcPath);
+      logPath('>', psEvents[i].pcNewPath);
+      break;
+    default: logPath('!', ""); break;
+    }
+  }
+}
+
+/* FT_watch callback: counts the events in *(size_t *) pvExtra. */
+static void countEvents(const struct FT_Event *psEvents, size_t ulCount,
+                        void *pvExtra) {
+  (void) psEvents;
+  *(size_t *) pvExtra += ulCount;
+}
+
+/* FT_query callback: logs each match as "fpath" or "dpath". */
+static int logMatch(const char *pcPath, size_t ulLength,
+                    boolean bIsFile, void *pvExtra) {
+  assert(strlen(pcPath) == ulLength);
+  (void) pvExtra;
+  logPath(bIsFile ? 'f' : 'd', pcPath);
+  return SUCCESS;
+}
+
 /* Tests the FT implementation with an assortment of checks.
    Prints the status of the data structure along the way to stderr.
    Returns 0. */
 int main(void) {
   enum {ARRLEN = 1000};
   char* temp;
+  char* temp2;
   boolean bIsFile;
   size_t l;
   char arr[ARRLEN];
+  FT_Snapshot_T oSnap;
+  FT_Snapshot_T oSnapNew;
+  FT_Watch_T oWatch;
+  FT_Watch_T oWatchChildren;
+  void *pvBuf;
   arr[0] = '\0';
 
   /* Before the data structure is initialized:
@@ -235,6 +305,706 @@ int main(void) {
   fprintf(stderr, "Checkpoint 4.5:\n%s\n", temp);
   free(temp);
 
+  /* a snapshot goes on seeing the FT as it was when it was taken,
+     even once the root it shares has been removed */
+  assert(FT_rmDir("1root") == SUCCESS);
+  assert(FT_snapshotContainsDir(NULL, "1root") == FALSE);
+  assert(FT_insertDir("1root/2dir") == SUCCESS);
+  assert(FT_insertFile("1root/2dir/3f", "old", strlen("old")+1) ==
+         SUCCESS);
+  assert((oSnap = FT_snapshot()) != NULL);
+  assert(!strcmp(FT_replaceFileContents("1root/2dir/3f", "newer",
+                                        strlen("newer")+1), "old"));
+  assert(FT_insertFile("1root/2new", NULL, 0) == SUCCESS);
+  assert(!strcmp(FT_getFileContents("1root/2dir/3f"), "newer"));
+  assert(!strcmp(FT_snapshotGetFileContents(oSnap, "1root/2dir/3f"),
+                 "old"));
+  assert(FT_containsFile("1root/2new") == TRUE);
+  assert(FT_snapshotContainsFile(oSnap, "1root/2new") == FALSE);
+  assert(FT_snapshotContainsDir(oSnap, "1root/2dir") == TRUE);
+  bIsFile = FALSE;
+  assert(FT_snapshotStat(oSnap, "1root/2dir/3f", &bIsFile, &l) ==
+         SUCCESS);
+  assert(bIsFile == TRUE);
+  assert(l == strlen("old")+1);
+  assert(FT_stat("1root/2dir/3f", &bIsFile, &l) == SUCCESS);
+  assert(l == strlen("newer")+1);
+  assert(FT_rmDir("1root") == SUCCESS);
+  assert(FT_containsDir("1root/2dir") == FALSE);
+  assert(FT_snapshotContainsDir(oSnap, "1root/2dir") == TRUE);
+  assert(!strcmp(FT_snapshotGetFileContents(oSnap, "1root/2dir/3f"),
+                 "old"));
+  FT_snapshotFree(oSnap);
+  FT_snapshotFree(NULL);
+  assert((temp = FT_toString()) != NULL);
+  assert(!strcmp(temp,""));
+  free(temp);
+
+  /* a diff between two snapshots reports, in order of path, what was
+     added, removed or modified, a change of type as both (all that
+     was below the path removed before it is added back), and nothing
+     for what the two still share */
+  assert(FT_insertDir("1root/2a/3same") == SUCCESS);
+  assert(FT_insertDir("1root/2b") == SUCCESS);
+  assert(FT_insertFile("1root/2c", "x", strlen("x")+1) == SUCCESS);
+  assert(FT_insertFile("1root/2e", NULL, 0) == SUCCESS);
+  assert(FT_insertFile("1root/2f/3m", NULL, 0) == SUCCESS);
+  assert(FT_insertDir("1root/2f/3n") == SUCCESS);
+  assert((oSnap = FT_snapshot()) != NULL);
+  assert(FT_rmDir("1root/2b") == SUCCESS);
+  assert(FT_replaceFileContents("1root/2c", "y", strlen("y")+1) != NULL);
+  assert(FT_insertFile("1root/2d/3e", NULL, 0) == SUCCESS);
+  assert(FT_rmFile("1root/2e") == SUCCESS);
+  assert(FT_insertFile("1root/2e/3k/4l", NULL, 0) == SUCCESS);
+  assert(FT_insertFile("1root/2e/3j", NULL, 0) == SUCCESS);
+  assert(FT_rmDir("1root/2f") == SUCCESS);
+  assert(FT_insertFile("1root/2f", "z", strlen("z")+1) == SUCCESS);
+  assert((oSnapNew = FT_snapshot()) != NULL);
+  acLog[0] = '\0';
+  assert(FT_diff(oSnap, oSnapNew, logChange, NULL) == SUCCESS);
+  assert(!strcmp(acLog, "-1root/2b\n~1root/2c\n+1root/2d\n"
+                        "+1root/2d/3e\n-1root/2e\n+1root/2e\n"
+                        "+1root/2e/3j\n+1root/2e/3k\n+1root/2e/3k/4l\n"
+                        "-1root/2f\n-1root/2f/3m\n-1root/2f/3n\n"
+                        "+1root/2f\n"));
+  acLog[0] = '\0';
+  assert(FT_diff(oSnapNew, oSnap, logChange, NULL) == SUCCESS);
+  assert(!strcmp(acLog, "+1root/2b\n~1root/2c\n-1root/2d\n"
+                        "-1root/2d/3e\n-1root/2e\n-1root/2e/3j\n"
+                        "-1root/2e/3k\n-1root/2e/3k/4l\n+1root/2e\n"
+                        "-1root/2f\n+1root/2f\n+1root/2f/3m\n"
+                        "+1root/2f/3n\n"));
+  acLog[0] = '\0';
+  assert(FT_diff(oSnap, oSnap, logChange, NULL) == SUCCESS);
+  assert(!strcmp(acLog, ""));
+  assert(FT_diff(NULL, oSnap, logChange, NULL) == INITIALIZATION_ERROR);
+  FT_snapshotFree(oSnap);
+  FT_snapshotFree(oSnapNew);
+  assert(FT_rmDir("1root") == SUCCESS);
+
+  /* a move relinks the whole subtree, but not below itself nor onto
+     a name already taken, and a snapshot taken before it still sees
+     the subtree at its old path */
+  assert(FT_insertFile("1root/2a/3f", "abc", strlen("abc")+1) == SUCCESS);
+  assert(FT_insertDir("1root/2b") == SUCCESS);
+  assert(FT_move("1root/2a", "1root/2a/3g") == CONFLICTING_PATH);
+  assert(FT_move("1root/2a", "1root/2a") == CONFLICTING_PATH);
+  assert(FT_move("1root", "1other") == CONFLICTING_PATH);
+  assert(FT_move("1root/2a", "1root/2b") == ALREADY_IN_TREE);
+  assert(FT_move("1root/2a/3f", "1root/2b") == ALREADY_IN_TREE);
+  assert(FT_move("1root/2x", "1root/2y") == NO_SUCH_PATH);
+  assert(FT_move("1root/2a", "1root/2x/3y") == NO_SUCH_PATH);
+  assert(FT_move("1root/2a/3f", "1root/2a/3g") == SUCCESS);
+  assert(FT_containsFile("1root/2a/3f") == FALSE);
+  assert(FT_containsFile("1root/2a/3g") == TRUE);
+  assert(!strcmp((char*)FT_getFileContents("1root/2a/3g"), "abc"));
+  assert((oSnap = FT_snapshot()) != NULL);
+  assert(FT_move("1root/2a", "1root/2b/3c") == SUCCESS);
+  assert(FT_containsDir("1root/2a") == FALSE);
+  assert(FT_containsFile("1root/2b/3c/3g") == TRUE);
+  assert((temp = FT_toString()) != NULL);
+  assert(!strcmp(temp, "1root [dir]\n1root/2b [dir]\n"
+                      "1root/2b/3c [dir]\n1root/2b/3c/3g [file]\n"));
+  free(temp);
+  assert(FT_snapshotContainsFile(oSnap, "1root/2a/3g") == TRUE);
+  assert(FT_snapshotContainsDir(oSnap, "1root/2b/3c") == FALSE);
+  assert((oSnapNew = FT_snapshot()) != NULL);
+  acLog[0] = '\0';
+  assert(FT_diff(oSnap, oSnapNew, logChange, NULL) == SUCCESS);
+  assert(!strcmp(acLog, "-1root/2a\n-1root/2a/3g\n"
+                        "+1root/2b/3c\n+1root/2b/3c/3g\n"));
+  FT_snapshotFree(oSnap);
+  FT_snapshotFree(oSnapNew);
+  assert(FT_rmDir("1root") == SUCCESS);
+
+  /* a query visits, in FT_toString order, what matches each component
+     of the pattern, and what lies up to ulMaxDepth levels below that */
+  assert(FT_insertFile("1root/2logs/3a-1", NULL, 0) == SUCCESS);
+  assert(FT_insertFile("1root/2logs/3a-2/4deep/5deeper", NULL, 0)
+         == SUCCESS);
+  assert(FT_insertFile("1root/2logs/3b", NULL, 0) == SUCCESS);
+  assert(FT_insertFile("1root/2other/3a-9", NULL, 0) == SUCCESS);
+  acLog[0] = '\0';
+  assert(FT_query("1root/2logs/3a-*", 0, logMatch, NULL) == SUCCESS);
+  assert(!strcmp(acLog, "f1root/2logs/3a-1\nd1root/2logs/3a-2\n"));
+  acLog[0] = '\0';
+  assert(FT_query("1root/2logs/3a-*", 1, logMatch, NULL) == SUCCESS);
+  assert(!strcmp(acLog, "f1root/2logs/3a-1\nd1root/2logs/3a-2\n"
+                        "d1root/2logs/3a-2/4deep\n"));
+  acLog[0] = '\0';
+  assert(FT_query("1root/2logs/3a-*", 5, logMatch, NULL) == SUCCESS);
+  assert(!strcmp(acLog, "f1root/2logs/3a-1\nd1root/2logs/3a-2\n"
+                        "d1root/2logs/3a-2/4deep\n"
+                        "f1root/2logs/3a-2/4deep/5deeper\n"));
+  acLog[0] = '\0';
+  assert(FT_query("1root/*/3a-?", 0, logMatch, NULL) == SUCCESS);
+  assert(!strcmp(acLog, "f1root/2logs/3a-1\nd1root/2logs/3a-2\n"
+                        "f1root/2other/3a-9\n"));
+  acLog[0] = '\0';
+  assert(FT_query("1root/2logs/3z*", 2, logMatch, NULL) == SUCCESS);
+  assert(FT_query("1root/2none/*", 2, logMatch, NULL) == SUCCESS);
+  assert(!strcmp(acLog, ""));
+  assert(FT_query("1root//3a-*", 0, logMatch, NULL) == BAD_PATH);
+  assert(FT_rmDir("1root") == SUCCESS);
+
+  /* a journal closed without compacting, along with the image it
+     follows, gives back the tree as its last change left it */
+  assert(FT_insertFile("1root/2a/3f", "one", strlen("one")+1) == SUCCESS);
+  assert(FT_insertDir("1root/2b") == SUCCESS);
+  assert(FT_journalOpen("ft_client.snap", "ft_client.jnl", 4, 0)
+         == SUCCESS);
+  assert(FT_insertFile("1root/2b/3g", "two", strlen("two")+1) == SUCCESS);
+  assert(FT_replaceFileContents("1root/2a/3f", "three", strlen("three")+1)
+         != NULL);
+  assert(FT_move("1root/2a", "1root/2c") == SUCCESS);
+  assert(FT_rmDir("1root/2b") == SUCCESS);
+  assert(FT_insertDir("1root/2d") == SUCCESS);
+  assert(FT_journalSync() == SUCCESS);
+  assert(FT_insertFile("1root/2d/3h", NULL, 0) == SUCCESS);
+  assert(FT_journalClose() == SUCCESS);
+  assert(FT_journalSync() == SUCCESS);
+  assert((temp = FT_toString()) != NULL);
+  assert(FT_destroy() == SUCCESS);
+  assert(FT_init() == SUCCESS);
+  assert(FT_recover("ft_client.snap", "ft_client.jnl") == SUCCESS);
+  assert((temp2 = FT_toString()) != NULL);
+  assert(!strcmp(temp, temp2));
+  free(temp);
+  free(temp2);
+  assert(!strcmp((char*)FT_getFileContents("1root/2c/3f"), "three"));
+  assert(FT_recover("ft_client.snap", "ft_client.jnl") == CONFLICTING_PATH);
+  assert(FT_rmDir("1root") == SUCCESS);
+  assert(remove("ft_client.snap") == 0);
+  assert(remove("ft_client.jnl") == 0);
+  assert(FT_recover("ft_client.snap", "ft_client.jnl") == SUCCESS);
+  assert((temp = FT_toString()) != NULL);
+  assert(!strcmp(temp,""));
+  free(temp);
+
+  /* shared contents stay with a file that still holds them, and the
+     old ones stay valid until they are replaced again */
+  assert(FT_setDedup(TRUE) == SUCCESS);
+  assert(FT_insertFile("1root/2a", "same", strlen("same")+1) == SUCCESS);
+  assert(FT_insertFile("1root/2b", "same", strlen("same")+1) == SUCCESS);
+  assert(FT_getFileContents("1root/2a") == FT_getFileContents("1root/2b"));
+  assert((temp = FT_replaceFileContents("1root/2a", "other",
+                                        strlen("other")+1)) != NULL);
+  assert(!strcmp(temp, "same"));
+  assert(!strcmp((char*)FT_replaceFileContents("1root/2a", "same",
+                                               strlen("same")+1),
+                 "other"));
+  assert(FT_replaceFileContents("1root/2a", "last", strlen("last")+1)
+         == FT_getFileContents("1root/2b"));
+  assert(!strcmp((char*)FT_getFileContents("1root/2b"), "same"));
+  assert(FT_rmFile("1root/2b") == SUCCESS);
+  assert(!strcmp((char*)FT_getFileContents("1root/2a"), "last"));
+  assert(FT_setDedup(FALSE) == SUCCESS);
+  assert(FT_rmDir("1root") == SUCCESS);
+
+  /* a recursive watch hears of every change below its directory, in
+     order, and of the directory's own removal, and then nothing more;
+     one that is not recursive hears only of changes to children */
+  assert(FT_insertDir("1root/2w") == SUCCESS);
+  assert(FT_watch("1root/2w", TRUE, logEvents, NULL, &oWatch) == SUCCESS);
+  l = 0;
+  assert(FT_watch("1root/2w", FALSE, countEvents, &l, &oWatchChildren)
+         == SUCCESS);
+  acLog[0] = '\0';
+  assert(FT_insertFile("1root/2w/3a/4f", "x", strlen("x")+1) == SUCCESS);
+  assert(FT_replaceFileContents("1root/2w/3a/4f", "y", strlen("y")+1)
+         != NULL);
+  assert(FT_move("1root/2w/3a", "1root/2w/3b") == SUCCESS);
+  assert(FT_insertFile("1root/2other", NULL, 0) == SUCCESS);
+  assert(FT_rmFile("1root/2w/3b/4f") == SUCCESS);
+  assert(FT_rmDir("1root/2w/3b") == SUCCESS);
+  FT_watchFlush();
+  assert(!strcmp(acLog, "F1root/2w/3a/4f\n~1root/2w/3a/4f\n"
+                        "M1root/2w/3a\n>1root/2w/3b\n"
+                        "f1root/2w/3b/4f\nd1root/2w/3b\n"));
+  assert(l == 3);
+  acLog[0] = '\0';
+  assert(FT_rmDir("1root/2w") == SUCCESS);
+  assert(FT_insertDir("1root/2w/3c") == SUCCESS);
+  FT_watchFlush();
+  assert(!strcmp(acLog, "d1root/2w\n"));
+  assert(l == 4);
+  FT_unwatch(oWatch);
+  FT_unwatch(oWatchChildren);
+  FT_unwatch(NULL);
+  assert(FT_watch("1root/2other", TRUE, logEvents, NULL, &oWatch)
+         == NOT_A_DIRECTORY);
+  assert(FT_watch("1root/2none", TRUE, logEvents, NULL, &oWatch)
+         == NO_SUCH_PATH);
+  assert(FT_rmDir("1root") == SUCCESS);
+
+
+  /* contents are kept byte for byte, '\0's and all, and an adopted
+     buffer is the FT's only if the call that took it succeeded */
+  assert(FT_insertFile("1root/2bin", "a\0b", 3) == SUCCESS);
+  assert(FT_stat("1root/2bin", &bIsFile, &l) == SUCCESS);
+  assert(bIsFile == TRUE);
+  assert(l == 3);
+  assert(!memcmp(FT_getFileContents("1root/2bin"), "a\0b", 3));
+  assert(!memcmp(FT_replaceFileContents("1root/2bin", "\0\0", 2),
+                 "a\0b", 3));
+  assert(FT_stat("1root/2bin", &bIsFile, &l) == SUCCESS);
+  assert(l == 2);
+  assert(!memcmp(FT_getFileContents("1root/2bin"), "\0\0", 2));
+  assert((pvBuf = malloc(4)) != NULL);
+  memcpy(pvBuf, "x\0yz", 4);
+  assert(FT_insertFileAdopt("1root/2own", pvBuf, 4) == SUCCESS);
+  assert(FT_getFileContents("1root/2own") == pvBuf);
+  assert(FT_stat("1root/2own", &bIsFile, &l) == SUCCESS);
+  assert(l == 4);
+  assert((pvBuf = malloc(2)) != NULL);
+  assert(FT_insertFileAdopt("1root/2own", pvBuf, 2) == ALREADY_IN_TREE);
+  assert(FT_insertFileAdopt("1other/2own", pvBuf, 2) == CONFLICTING_PATH);
+  assert(FT_insertFileAdopt("1root/2bin/3own", pvBuf, 2)
+         == NOT_A_DIRECTORY);
+  assert(FT_replaceFileContentsAdopt("1root/2none", pvBuf, 2) == NULL);
+  assert(FT_replaceFileContentsAdopt("1root", pvBuf, 2) == NULL);
+  free(pvBuf);
+  assert((pvBuf = malloc(2)) != NULL);
+  memcpy(pvBuf, "\0q", 2);
+  assert(!memcmp(FT_replaceFileContentsAdopt("1root/2own", pvBuf, 2),
+                 "x\0yz", 4));
+  assert(FT_getFileContents("1root/2own") == pvBuf);
+  assert(FT_stat("1root/2own", &bIsFile, &l) == SUCCESS);
+  assert(l == 2);
+  assert(FT_rmFile("1root/2own") == SUCCESS);
+  assert(FT_rmDir("1root") == SUCCESS);
+
+
+  /* a batch inserts each entry as FT_insertDir or FT_insertFile
+     would, and an entry that fails is skipped, not the batch */
+  {
+    struct FT_BatchEntry asBatch[] = {
+      {"1root/2b", FALSE, NULL, 0},
+      {"1root/2b/3f", TRUE, "ab", 2},
+      {"1root/2a/3g", TRUE, NULL, 0},
+      {"1root/2b/3d", FALSE, NULL, 0}
+    };
+    struct FT_BatchEntry asConflicts[] = {
+      {"1root/2c", FALSE, NULL, 0},
+      {"1root/2b/3f", FALSE, NULL, 0},
+      {"1root/2b/3f/4x", TRUE, NULL, 0},
+      {"1other/2x", FALSE, NULL, 0},
+      {"1root//2x", FALSE, NULL, 0},
+      {"1root/2c/3h", TRUE, "c", 1}
+    };
+    int aiStatuses[6];
+
+    assert(FT_insertBatch(asBatch, 4, aiStatuses) == 4);
+    assert(aiStatuses[0] == SUCCESS && aiStatuses[1] == SUCCESS &&
+           aiStatuses[2] == SUCCESS && aiStatuses[3] == SUCCESS);
+    assert(!memcmp(FT_getFileContents("1root/2b/3f"), "ab", 2));
+    assert(FT_insertBatch(asConflicts, 6, aiStatuses) == 2);
+    assert(aiStatuses[0] == SUCCESS);
+    assert(aiStatuses[1] == ALREADY_IN_TREE);
+    assert(aiStatuses[2] == NOT_A_DIRECTORY);
+    assert(aiStatuses[3] == CONFLICTING_PATH);
+    assert(aiStatuses[4] == BAD_PATH);
+    assert(aiStatuses[5] == SUCCESS);
+    assert(FT_insertBatch(asConflicts, 2, NULL) == 0);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, "1root [dir]\n1root/2a [dir]\n"
+                         "1root/2a/3g [file]\n1root/2b [dir]\n"
+                         "1root/2b/3f [file]\n1root/2b/3d [dir]\n"
+                         "1root/2c [dir]\n1root/2c/3h [file]\n"));
+    free(temp);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+  assert(FT_insertBatch(NULL, 0, NULL) == 0);
+
+
+  /* building from sorted entries matches inserting them one by one,
+     and a rejected build leaves the FT empty */
+  {
+    struct FT_BatchEntry asSorted[] = {
+      {"1root", FALSE, NULL, 0},
+      {"1root/2a", FALSE, NULL, 0},
+      {"1root/2a/3c", TRUE, "cc", 2},
+      {"1root/2b/3d", FALSE, NULL, 0},
+      {"1root/2b/3d/4f", TRUE, NULL, 0},
+      {"1root/2b/3e", TRUE, "e", 1}
+    };
+    struct FT_BatchEntry asUnsorted[] = {
+      {"1root/2b", FALSE, NULL, 0},
+      {"1root/2a", FALSE, NULL, 0}
+    };
+    struct FT_BatchEntry asDuplicate[] = {
+      {"1root/2a", FALSE, NULL, 0},
+      {"1root/2a/3c", TRUE, NULL, 0},
+      {"1root/2a/3c", TRUE, NULL, 0}
+    };
+    size_t ulFailed;
+
+    ulFailed = 99;
+    assert(FT_buildFromSorted(asUnsorted, 2, &ulFailed) == BAD_PATH);
+    assert(ulFailed == 1);
+    assert(FT_containsDir("1root") == FALSE);
+    assert(FT_buildFromSorted(asDuplicate, 3, &ulFailed)
+           == ALREADY_IN_TREE);
+    assert(ulFailed == 2);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, ""));
+    free(temp);
+
+    ulFailed = 99;
+    assert(FT_buildFromSorted(asSorted, 6, &ulFailed) == SUCCESS);
+    assert(ulFailed == 99);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, "1root [dir]\n1root/2a [dir]\n"
+                         "1root/2a/3c [file]\n1root/2b [dir]\n"
+                         "1root/2b/3e [file]\n1root/2b/3d [dir]\n"
+                         "1root/2b/3d/4f [file]\n"));
+    free(temp);
+    assert(FT_stat("1root/2a/3c", &bIsFile, &l) == SUCCESS);
+    assert(bIsFile == TRUE && l == 2);
+    assert(!memcmp(FT_getFileContents("1root/2b/3e"), "e", 1));
+
+    /* a build only starts from an empty FT, which no entry is at
+       fault for, and the existing tree is kept */
+    assert(FT_buildFromSorted(asUnsorted, 2, &ulFailed)
+           == CONFLICTING_PATH);
+    assert(ulFailed == 2);
+    assert(FT_containsFile("1root/2b/3d/4f") == TRUE);
+    assert(FT_insertDir("1root/2b/3d/4g") == SUCCESS);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+
+
+  /* an image saved and mapped back gives the same tree, writes after
+     loading stay out of the file, and a damaged image is refused */
+  {
+    FILE *psFile;
+    char acImage[ARRLEN];
+    size_t ulImage;
+    char *pcBefore;
+
+    assert(FT_insertFile("1root/2a/3b", "a\0b", 3) == SUCCESS);
+    assert(FT_insertFile("1root/2a/3c", "a\0b", 3) == SUCCESS);
+    assert(FT_insertFile("1root/2d", NULL, 0) == SUCCESS);
+    assert(FT_insertDir("1root/2e/3f") == SUCCESS);
+    assert((pcBefore = FT_toString()) != NULL);
+    assert(FT_save("ft_client.img") == SUCCESS);
+    assert(FT_loadMapped("ft_client.img") == CONFLICTING_PATH);
+    assert(FT_rmDir("1root") == SUCCESS);
+
+    assert(FT_loadMapped("ft_client.img") == SUCCESS);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, pcBefore));
+    free(temp);
+    assert(FT_stat("1root/2a/3c", &bIsFile, &l) == SUCCESS);
+    assert(bIsFile == TRUE && l == 3);
+    assert(!memcmp(FT_getFileContents("1root/2a/3b"), "a\0b", 3));
+    assert(!memcmp(FT_getFileContents("1root/2a/3c"), "a\0b", 3));
+    assert(FT_getFileContents("1root/2d") == NULL);
+
+    /* write into the mapped contents, and change the tree, then load
+       the file again to see that it still holds the saved tree */
+    temp = FT_getFileContents("1root/2a/3b");
+    temp[0] = 'z';
+    assert(!memcmp(FT_getFileContents("1root/2a/3b"), "z\0b", 3));
+    assert(!memcmp(FT_getFileContents("1root/2a/3c"), "a\0b", 3));
+    assert(!memcmp(FT_replaceFileContents("1root/2a/3c", "new", 3),
+                   "a\0b", 3));
+    assert(FT_rmDir("1root/2e") == SUCCESS);
+    assert(FT_insertFile("1root/2g", "g", 1) == SUCCESS);
+    assert(FT_rmDir("1root") == SUCCESS);
+    assert(FT_loadMapped("ft_client.img") == SUCCESS);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, pcBefore));
+    free(temp);
+    assert(!memcmp(FT_getFileContents("1root/2a/3b"), "a\0b", 3));
+    assert(!memcmp(FT_getFileContents("1root/2a/3c"), "a\0b", 3));
+    assert(FT_rmDir("1root") == SUCCESS);
+    free(pcBefore);
+
+    /* a truncated image, one with a damaged header, and a missing
+       file all fail to load and leave the FT empty */
+    assert((psFile = fopen("ft_client.img", "rb")) != NULL);
+    ulImage = fread(acImage, 1, ARRLEN, psFile);
+    fclose(psFile);
+    assert(ulImage > 16 && ulImage < ARRLEN);
+    assert((psFile = fopen("ft_client.img", "wb")) != NULL);
+    assert(fwrite(acImage, 1, ulImage / 2, psFile) == ulImage / 2);
+    fclose(psFile);
+    assert(FT_loadMapped("ft_client.img") == IO_ERROR);
+    acImage[0] ^= 0x5a;
+    assert((psFile = fopen("ft_client.img", "wb")) != NULL);
+    assert(fwrite(acImage, 1, ulImage, psFile) == ulImage);
+    fclose(psFile);
+    assert(FT_loadMapped("ft_client.img") == IO_ERROR);
+    assert(remove("ft_client.img") == 0);
+    assert(FT_loadMapped("ft_client.img") == IO_ERROR);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, ""));
+    free(temp);
+    assert(FT_insertDir("1root") == SUCCESS);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+
+
+  /* FT_T objects are independent of each other and of the global
+     FT, and a NULL one acts as an uninitialized FT */
+  {
+    FT_T oFT1;
+    FT_T oFT2;
+    size_t ulFiles, ulDirs, ulBytes;
+
+    assert((oFT1 = FT_new()) != NULL);
+    assert((oFT2 = FT_new()) != NULL);
+    assert((temp = FT_toStringIn(oFT1)) != NULL);
+    assert(!strcmp(temp, ""));
+    free(temp);
+    assert(FT_insertDirIn(oFT1, "1root/2a") == SUCCESS);
+    assert(FT_insertFileIn(oFT2, "1other/2b", "b", 1) == SUCCESS);
+    assert(FT_insertDirIn(oFT1, "1other") == CONFLICTING_PATH);
+    assert(FT_containsDirIn(oFT1, "1root/2a") == TRUE);
+    assert(FT_containsDirIn(oFT2, "1root/2a") == FALSE);
+    assert(FT_containsFileIn(oFT2, "1other/2b") == TRUE);
+    assert(FT_containsFile("1other/2b") == FALSE);
+    assert(FT_insertDir("1root/2z") == SUCCESS);
+    assert(FT_containsDirIn(oFT1, "1root/2z") == FALSE);
+    assert((temp = FT_toStringIn(oFT1)) != NULL);
+    assert(!strcmp(temp, "1root [dir]\n1root/2a [dir]\n"));
+    free(temp);
+    assert((temp = FT_toStringIn(oFT2)) != NULL);
+    assert(!strcmp(temp, "1other [dir]\n1other/2b [file]\n"));
+    free(temp);
+    FT_free(oFT1);
+    assert(FT_containsFileIn(oFT2, "1other/2b") == TRUE);
+    assert(FT_containsDir("1root/2z") == TRUE);
+    FT_free(oFT2);
+
+    assert(FT_insertDirIn(NULL, "1root") == INITIALIZATION_ERROR);
+    assert(FT_insertFileIn(NULL, "1root/2f", NULL, 0)
+           == INITIALIZATION_ERROR);
+    assert(FT_rmDirIn(NULL, "1root") == INITIALIZATION_ERROR);
+    assert(FT_rmFileIn(NULL, "1root/2f") == INITIALIZATION_ERROR);
+    assert(FT_moveIn(NULL, "1root/2a", "1root/2b") == INITIALIZATION_ERROR);
+    assert(FT_statIn(NULL, "1root", &bIsFile, &l) == INITIALIZATION_ERROR);
+    assert(FT_statTreeIn(NULL, "1root", &ulFiles, &ulDirs, &ulBytes)
+           == INITIALIZATION_ERROR);
+    assert(FT_containsDirIn(NULL, "1root") == FALSE);
+    assert(FT_containsFileIn(NULL, "1root/2f") == FALSE);
+    assert(FT_getFileContentsIn(NULL, "1root/2f") == NULL);
+    assert(FT_replaceFileContentsIn(NULL, "1root/2f", "x", 1) == NULL);
+    assert(FT_toStringIn(NULL) == NULL);
+    assert(FT_iterNewIn(NULL) == NULL);
+    assert(FT_snapshotIn(NULL) == NULL);
+    assert(FT_checkIn(NULL) == TRUE);
+    FT_free(NULL);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+
+
+  /* subtree totals follow inserts, replacements, moves and removals */
+  {
+    size_t ulFiles, ulDirs, ulBytes;
+
+    assert(FT_insertFile("1root/2a/3b", "bbb", 3) == SUCCESS);
+    assert(FT_insertFile("1root/2a/3c", "ccccc", 5) == SUCCESS);
+    assert(FT_insertDir("1root/2d/3e") == SUCCESS);
+    assert(FT_insertFile("1root/2f", "ff", 2) == SUCCESS);
+    assert(FT_statTree("1root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+    assert(ulFiles == 3 && ulDirs == 4 && ulBytes == 10);
+    assert(FT_statTree("1root/2a", &ulFiles, &ulDirs, &ulBytes)
+           == SUCCESS);
+    assert(ulFiles == 2 && ulDirs == 1 && ulBytes == 8);
+    assert(FT_statTree("1root/2a/3c", &ulFiles, &ulDirs, &ulBytes)
+           == SUCCESS);
+    assert(ulFiles == 1 && ulDirs == 0 && ulBytes == 5);
+    assert(FT_statTree("1root/2a/3x", &ulFiles, &ulDirs, &ulBytes)
+           == NO_SUCH_PATH);
+    assert(ulFiles == 1 && ulDirs == 0 && ulBytes == 5);
+
+    assert(!memcmp(FT_replaceFileContents("1root/2a/3b",
+                                          "bbbbbbbbbb", 10), "bbb", 3));
+    assert(FT_statTree("1root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+    assert(ulFiles == 3 && ulDirs == 4 && ulBytes == 17);
+    assert(FT_statTree("1root/2a", NULL, NULL, &ulBytes) == SUCCESS);
+    assert(ulBytes == 15);
+
+    /* a move across directories shifts its totals from the old
+       ancestors to the new ones, and leaves the root's alone */
+    assert(FT_move("1root/2a/3c", "1root/2d/3e/3c") == SUCCESS);
+    assert(FT_statTree("1root/2a", &ulFiles, &ulDirs, &ulBytes)
+           == SUCCESS);
+    assert(ulFiles == 1 && ulDirs == 1 && ulBytes == 10);
+    assert(FT_statTree("1root/2d", &ulFiles, &ulDirs, &ulBytes)
+           == SUCCESS);
+    assert(ulFiles == 1 && ulDirs == 2 && ulBytes == 5);
+    assert(FT_move("1root/2a", "1root/2d/3e/3a") == SUCCESS);
+    assert(FT_statTree("1root/2d", &ulFiles, &ulDirs, &ulBytes)
+           == SUCCESS);
+    assert(ulFiles == 2 && ulDirs == 3 && ulBytes == 15);
+    assert(FT_statTree("1root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+    assert(ulFiles == 3 && ulDirs == 4 && ulBytes == 17);
+
+    assert(FT_rmDir("1root/2d/3e") == SUCCESS);
+    assert(FT_statTree("1root/2d", &ulFiles, &ulDirs, &ulBytes)
+           == SUCCESS);
+    assert(ulFiles == 0 && ulDirs == 1 && ulBytes == 0);
+    assert(FT_statTree("1root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+    assert(ulFiles == 1 && ulDirs == 2 && ulBytes == 2);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+
+
+  /* a frozen FT answers lookups as it did before freezing, and
+     changes after freezing are seen at once */
+  {
+    size_t ulFiles, ulDirs, ulBytes;
+    char *pcBefore;
+
+    assert(FT_insertFile("1root/2a/3b", "bb", 2) == SUCCESS);
+    assert(FT_insertFile("1root/2a/3c", NULL, 0) == SUCCESS);
+    assert(FT_insertDir("1root/2d/3e/4f") == SUCCESS);
+    assert(FT_insertDir("1root/2g") == SUCCESS);
+    assert((pcBefore = FT_toString()) != NULL);
+    assert(FT_stat("1root/2a/3b/4x", &bIsFile, &l) == NO_SUCH_PATH);
+    assert(FT_stat("1other", &bIsFile, &l) == CONFLICTING_PATH);
+    assert(FT_freeze() == SUCCESS);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, pcBefore));
+    free(temp);
+    assert(FT_containsDir("1root/2d/3e/4f") == TRUE);
+    assert(FT_containsDir("1root/2a/3b") == FALSE);
+    assert(FT_containsDir("1root/2h") == FALSE);
+    assert(FT_containsFile("1root/2a/3b") == TRUE);
+    assert(FT_containsFile("1root/2a/3bb") == FALSE);
+    assert(FT_containsFile("1root/2a/3b/4x") == FALSE);
+    assert(!memcmp(FT_getFileContents("1root/2a/3b"), "bb", 2));
+    assert(FT_getFileContents("1root/2a/3c") == NULL);
+    assert(FT_stat("1root/2a/3b", &bIsFile, &l) == SUCCESS);
+    assert(bIsFile == TRUE && l == 2);
+    assert(FT_stat("1root/2a/3b/4x", &bIsFile, &l) == NO_SUCH_PATH);
+    assert(FT_stat("1other", &bIsFile, &l) == CONFLICTING_PATH);
+    assert(FT_stat("1root/2z", &bIsFile, &l) == NO_SUCH_PATH);
+    assert(FT_statTree("1root", &ulFiles, &ulDirs, &ulBytes) == SUCCESS);
+    assert(ulFiles == 2 && ulDirs == 6 && ulBytes == 2);
+
+    assert(FT_freeze() == SUCCESS);
+    assert(FT_freeze() == SUCCESS);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, pcBefore));
+    free(temp);
+    assert(FT_containsFile("1root/2a/3b") == TRUE);
+    free(pcBefore);
+
+    /* each change drops the layout, and a fresh freeze sees it */
+    assert(FT_insertFile("1root/2g/3h", "h", 1) == SUCCESS);
+    assert(FT_containsFile("1root/2g/3h") == TRUE);
+    assert(FT_statTree("1root", &ulFiles, NULL, &ulBytes) == SUCCESS);
+    assert(ulFiles == 3 && ulBytes == 3);
+    assert(FT_freeze() == SUCCESS);
+    assert(FT_rmDir("1root/2d/3e") == SUCCESS);
+    assert(FT_containsDir("1root/2d/3e/4f") == FALSE);
+    assert(FT_containsDir("1root/2d") == TRUE);
+    assert(FT_freeze() == SUCCESS);
+    assert(FT_move("1root/2a", "1root/2g/3a") == SUCCESS);
+    assert(FT_containsFile("1root/2a/3b") == FALSE);
+    assert(!memcmp(FT_getFileContents("1root/2g/3a/3b"), "bb", 2));
+    assert(FT_freeze() == SUCCESS);
+    assert(!memcmp(FT_replaceFileContents("1root/2g/3h", "i", 1), "h", 1));
+    assert(!memcmp(FT_getFileContents("1root/2g/3h"), "i", 1));
+    assert(FT_freeze() == SUCCESS);
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, "1root [dir]\n1root/2d [dir]\n1root/2g [dir]\n"
+                         "1root/2g/3h [file]\n1root/2g/3a [dir]\n"
+                         "1root/2g/3a/3b [file]\n1root/2g/3a/3c [file]\n"));
+    free(temp);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+  assert(FT_freeze() == SUCCESS);
+
+
+  /* a deferred removal takes the path away at once, and its name can
+     be used again while the old subtree may still be being freed */
+  {
+    size_t ulFiles, ulDirs;
+    int i;
+
+    for (i = 0; i < 100; i++) {
+      sprintf(arr, "1root/2big/3d%d/4f", i);
+      assert(FT_insertFile(arr, arr, strlen(arr) + 1) == SUCCESS);
+    }
+    assert(FT_insertFile("1root/2file", NULL, 0) == SUCCESS);
+    assert(FT_rmDirDeferred("1root/2file") == NOT_A_DIRECTORY);
+    assert(FT_rmDirDeferred("1root/2none") == NO_SUCH_PATH);
+    assert(FT_rmDirDeferred("1other") == CONFLICTING_PATH);
+
+    assert(FT_rmDirDeferred("1root/2big") == SUCCESS);
+    assert(FT_containsDir("1root/2big") == FALSE);
+    assert(FT_containsFile("1root/2big/3d7/4f") == FALSE);
+    assert(FT_statTree("1root", &ulFiles, &ulDirs, NULL) == SUCCESS);
+    assert(ulFiles == 1 && ulDirs == 1);
+    assert(FT_rmDirDeferred("1root/2big") == NO_SUCH_PATH);
+    assert(FT_insertFile("1root/2big/3d7/4f", "new", 3) == SUCCESS);
+    assert(!memcmp(FT_getFileContents("1root/2big/3d7/4f"), "new", 3));
+    assert((temp = FT_toString()) != NULL);
+    assert(!strcmp(temp, "1root [dir]\n1root/2file [file]\n"
+                         "1root/2big [dir]\n1root/2big/3d7 [dir]\n"
+                         "1root/2big/3d7/4f [file]\n"));
+    free(temp);
+
+    /* the root itself may go the same way; whatever is still being
+       freed when the FT is destroyed is freed by FT_destroy */
+    assert(FT_rmDirDeferred("1root") == SUCCESS);
+    assert(FT_containsDir("1root") == FALSE);
+    for (i = 0; i < 100; i++) {
+      sprintf(arr, "1root/2big/3d%d", i);
+      assert(FT_insertDir(arr) == SUCCESS);
+    }
+    assert(FT_rmDirDeferred("1root/2big") == SUCCESS);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+
+
+  /* whatever the cache size, a path that was looked up and then
+     removed or moved is not found again from the cache */
+  {
+    size_t aulSizes[] = {0, 1, 64};
+    size_t i;
+
+    for (i = 0; i < sizeof(aulSizes) / sizeof(aulSizes[0]); i++) {
+      assert(FT_setCacheSize(aulSizes[i]) == SUCCESS);
+      assert(FT_insertFile("1root/2a/3b", "b", 1) == SUCCESS);
+      assert(FT_insertDir("1root/2a/3c") == SUCCESS);
+      assert(FT_insertFile("1root/2d/3e", "e", 1) == SUCCESS);
+
+      assert(FT_containsDir("1root/2a/3c") == TRUE);
+      assert(FT_containsFile("1root/2a/3b") == TRUE);
+      assert(FT_rmDir("1root/2a") == SUCCESS);
+      assert(FT_containsFile("1root/2a/3b") == FALSE);
+      assert(FT_containsDir("1root/2a/3c") == FALSE);
+      assert(FT_containsDir("1root/2a") == FALSE);
+      assert(FT_insertFile("1root/2a", "a", 1) == SUCCESS);
+      assert(FT_containsDir("1root/2a") == FALSE);
+      assert(FT_containsFile("1root/2a") == TRUE);
+
+      assert(!memcmp(FT_getFileContents("1root/2d/3e"), "e", 1));
+      assert(FT_containsDir("1root/2d") == TRUE);
+      assert(FT_move("1root/2d", "1root/2f") == SUCCESS);
+      assert(FT_getFileContents("1root/2d/3e") == NULL);
+      assert(FT_containsFile("1root/2d/3e") == FALSE);
+      assert(FT_containsDir("1root/2d") == FALSE);
+      assert(!memcmp(FT_getFileContents("1root/2f/3e"), "e", 1));
+      assert(FT_rmFile("1root/2f/3e") == SUCCESS);
+      assert(FT_stat("1root/2f/3e", &bIsFile, &l) == NO_SUCH_PATH);
+      assert(FT_rmDir("1root") == SUCCESS);
+      assert(FT_containsDir("1root") == FALSE);
+      assert(FT_insertDir("1root") == SUCCESS);
+      assert(FT_containsFile("1root/2a") == FALSE);
+      assert(FT_rmDir("1root") == SUCCESS);
+    }
+    assert(FT_setCacheSize(0) == SUCCESS);
+    assert(FT_insertDir("1root") == SUCCESS);
+  }
+  assert(FT_rmDir("1root") == SUCCESS);
+
   assert(FT_destroy() == SUCCESS);
   assert(FT_destroy() == INITIALIZATION_ERROR);
   assert(FT_containsDir("1root") == FALSE);
@@ -3,98 +3,509 @@
 /* A node representing either a file or directory in a File Tree      */
 /*--------------------------------------------------------------------*/
 
-#include <stddef.h>
+#ifdef THREADSAFE
+/* pthread rwlocks are POSIX, not C99 */
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "a4def.h"
+#include "atom.h"
 #include "path.h"
-#include "nodeFT.h"
 #include "dynarray.h"
+#include "arena.h"
+#include "traversal.h"
+#include "epoch.h"
+#include "nodeFT.h"
 
-/* A Node_T is a pointer to a node in the File Tree. */
-struct node {
-    Path_T oPPath;
-    Node_T oNParent;
-    DynArray_T oChildren;
-    NodeType eType;
-    char *pcContents; /* Only for files, NULL for directories */
-};
+/*
+  A directory switches from binary search to a hash index over its
+  children once it holds this many of them, and drops the index again
+  when it shrinks below half of it.
+*/
+enum { INDEX_THRESHOLD = 32 };
 
-/* Enum to indicate node type (file or directory). */
-enum { FT_DIR, FT_FILE } NodeType;
+/*
+  How many children a directory's children array holds in the block
+  of the array itself, before it needs a separate one. Most
+  directories have no more than this.
+*/
+enum { INLINE_CHILDREN = 4 };
 
 /*
-  Creates a new node in the File Tree with path oPPath, parent oNParent, and type.
-  Returns an int SUCCESS status and sets *poNResult to the new node if successful.
-  Otherwise:
-  - MEMORY_ERROR on allocation failure
-  - CONFLICTING_PATH if oNParent’s path is not an ancestor of oPPath
-  - NO_SUCH_PATH if oPPath depth is 0, or parent/child relationship is invalid
-  - ALREADY_IN_TREE if a sibling with the same path already exists
+  A slot of a directory's hash index. The child's hash is kept beside
+  it, so that a probe passes over other children without visiting
+  them; a slot is free if oNChild is NULL.
 */
-#include <assert.h>
-#include <stdlib.h>
-#include <string.h>
-#include "nodeFT.h"
-#include "dynarray.h"
+struct NodeSlot {
+    size_t ulHash;           /* Node_nameHash of the child's name */
+    Node_T oNChild;          /* The child, or NULL */
+};
+
+/*
+  Contents that a file node holds, and how they are let go of: a node
+  that shares them with the node it was copied from (see Node_copy)
+  holds that node instead, which releases them.
+*/
+struct NodeContents {
+    void *pvContents;        /* The file's bytes, or NULL if it is empty */
+    size_t ulLength;         /* Number of bytes in pvContents */
+    void *pvAdopted;         /* Arena handle if pvContents was adopted, or NULL */
+    Node_T oNOwner;          /* The node that releases pvContents, if not this one, or NULL */
+    boolean bBorrowed;       /* TRUE if pvContents belongs to no one here */
+    boolean bInterned;       /* TRUE if pvContents came from Arena_intern */
+};
 
 /* Internal structure of a node in the File Tree */
 struct node {
-    Path_T oPPath;           /* The absolute path of the node */
+    const char *pcName;      /* The node's name (see Node_internName); the path is rebuilt from ancestors */
     Node_T oNParent;         /* Pointer to parent node (NULL for root) */
-    DynArray_T oChildren;    /* Array of child nodes (only for directories) */
     NodeType eType;          /* FT_FILE or FT_DIR */
-    char *pcContents;        /* String contents (only for files) */
+    Arena_T oArena;          /* Source of all of this node's memory */
+    size_t ulRefs;           /* Parents, snapshots and copies that hold the node (see Node_share) */
+    union {                  /* Selected by eType */
+        struct {
+            DynArray_T oChildren;  /* Child nodes sorted by name (see Node_getPublishedChild) */
+            struct NodeSlot *psIndex;  /* Open-addressing hash index of oChildren, or NULL */
+            size_t ulIndexSlots;   /* Number of slots in psIndex (a power of 2) */
+            struct Node_Totals sBelow;  /* What the directory's descendants hold */
+            void *pvWatch;         /* The FT's watches on the directory (see Node_setWatch), or NULL */
+#ifdef THREADSAFE
+            pthread_rwlock_t sLock;  /* Guards the children (see Node_getLock) */
+#endif
+        } sDir;
+        struct {
+            struct NodeContents sNow;   /* The file's contents */
+            struct NodeContents sPrev;  /* What they were before they were last replaced */
+        } sFile;
+    } u;
 };
 
 /*
-  Creates a new node in the File Tree with path oPPath, parent oNParent, and type.
-  Returns an int SUCCESS status and sets *poNResult to the new node if successful.
-  Otherwise:
-  - MEMORY_ERROR on allocation failure
-  - CONFLICTING_PATH if oNParent’s path is not an ancestor of oPPath
-  - NO_SUCH_PATH if oPPath depth is 0, or parent/child relationship is invalid
-  - ALREADY_IN_TREE if a sibling with the same path already exists
+  Reference counts change only under the tree's exclusive lock, except
+  when an RCU build frees a retired subtree, so they are atomic there.
 */
-int Node_new(Path_T oPPath, Node_T oNParent, NodeType eType, Node_T *poNResult) {
-    /* Index where the child would be inserted (or found) in parent’s DynArray */
-    size_t ulChildID;
+#ifdef THREADSAFE
+#define NODE_HOLD(oNNode) \
+    ((void) __atomic_add_fetch(&(oNNode)->ulRefs, 1, __ATOMIC_RELAXED))
+#define NODE_DROP(oNNode) \
+    __atomic_sub_fetch(&(oNNode)->ulRefs, 1, __ATOMIC_ACQ_REL)
+#define NODE_REFS(oNNode) __atomic_load_n(&(oNNode)->ulRefs, __ATOMIC_ACQUIRE)
+#else
+#define NODE_HOLD(oNNode) ((void) (oNNode)->ulRefs++)
+#define NODE_DROP(oNNode) (--(oNNode)->ulRefs)
+#define NODE_REFS(oNNode) ((oNNode)->ulRefs)
+#endif
 
-    /* Ensure that the output parameter is valid */
-    assert(poNResult != NULL);
+/*
+  Totals change under a directory's lock rather than the tree's, so
+  writers in different directories may update a common ancestor's at
+  once; they are atomic in a THREADSAFE build.
+*/
+#ifdef THREADSAFE
+#define NODE_ADD(ulTotal, ulAmount) \
+    ((void) __atomic_add_fetch(&(ulTotal), (ulAmount), __ATOMIC_RELAXED))
+#define NODE_SUB(ulTotal, ulAmount) \
+    ((void) __atomic_sub_fetch(&(ulTotal), (ulAmount), __ATOMIC_RELAXED))
+#define NODE_LOAD(ulTotal) __atomic_load_n(&(ulTotal), __ATOMIC_RELAXED)
+#else
+#define NODE_ADD(ulTotal, ulAmount) ((void) ((ulTotal) += (ulAmount)))
+#define NODE_SUB(ulTotal, ulAmount) ((void) ((ulTotal) -= (ulAmount)))
+#define NODE_LOAD(ulTotal) (ulTotal)
+#endif
 
-    /* Check if the path has depth 0 (invalid in this tree structure) */
-    if (Path_getDepth(oPPath) == 0)
-        return NO_SUCH_PATH;
+/*
+  A node's name as its arena interns it, with its length and hash, so
+  that the nodes of one tree share each name they have in common, and
+  the name goes when the last of them does, or with the arena.
+*/
+struct NodeAtom {
+    size_t ulHash;           /* Atom_hashString of the name */
+    size_t ulLength;         /* Number of characters in the name */
+    char acName[];           /* The name itself, '\0'-terminated */
+};
 
-    if (oNParent == NULL) {
-        /* If this is the root node, its path must be at depth 1 */
-        if (Path_getDepth(oPPath) != 1)
-            return NO_SUCH_PATH;
-    } else {
-        /* Get the parent’s path to perform relationship checks */
-        Path_T oParentPath = Node_getPath(oNParent);
+/* Names up to this long are put together on the stack to be interned */
+enum { NAME_BUFFER_WORDS = 16 };
+
+/* A child name that is not necessarily '\0'-terminated */
+struct NodeName {
+    const char *pcName;      /* Start of the name */
+    size_t ulLength;         /* Number of characters in the name */
+};
+
+/* Returns the interned block whose name begins at pcName. */
+static struct NodeAtom *Node_nameAtom(const char *pcName) {
+    assert(pcName != NULL);
+
+    return (struct NodeAtom *) (pcName - offsetof(struct NodeAtom, acName));
+}
+
+/* Returns the number of bytes of the interned block of pcName. */
+static size_t Node_nameSize(const char *pcName) {
+    return offsetof(struct NodeAtom, acName) + Node_nameAtom(pcName)->ulLength + 1;
+}
+
+/* Returns the length of the interned name pcName, in O(1) time. */
+static size_t Node_nameLength(const char *pcName) {
+    return Node_nameAtom(pcName)->ulLength;
+}
+
+/* Returns the hash of the interned name pcName, in O(1) time. */
+static size_t Node_nameHash(const char *pcName) {
+    return Node_nameAtom(pcName)->ulHash;
+}
+
+/*
+  Returns oArena's interned copy of the ulLength characters at pcName,
+  taking a reference to it, or NULL if memory could not be allocated.
+  Equal names of one arena are the same pointer.
+*/
+static const char *Node_internName(Arena_T oArena, const char *pcName,
+                                   size_t ulLength) {
+    size_t aulBuffer[NAME_BUFFER_WORDS];
+    struct NodeAtom *psAtom = (struct NodeAtom *) aulBuffer;
+    size_t ulSize = offsetof(struct NodeAtom, acName) + ulLength + 1;
+    struct NodeAtom *psInterned;
+
+    assert(oArena != NULL);
+    assert(pcName != NULL);
+
+    if (ulSize > sizeof(aulBuffer)) {
+        psAtom = malloc(ulSize);
+        if (psAtom == NULL)
+            return NULL;
+    }
+    psAtom->ulHash = Atom_hashString(pcName, ulLength);
+    psAtom->ulLength = ulLength;
+    memcpy(psAtom->acName, pcName, ulLength);
+    psAtom->acName[ulLength] = '\0';
+
+    psInterned = Arena_intern(oArena, psAtom, ulSize);
+    if (psAtom != (struct NodeAtom *) aulBuffer)
+        free(psAtom);
+    return psInterned == NULL ? NULL : psInterned->acName;
+}
+
+/* Takes another reference to pcName, which oArena interned. */
+static void Node_holdName(Arena_T oArena, const char *pcName) {
+    void *pvInterned;
+
+    /* Found, so nothing is allocated and nothing can fail */
+    pvInterned = Arena_intern(oArena, Node_nameAtom(pcName),
+                              Node_nameSize(pcName));
+    assert(pvInterned == Node_nameAtom(pcName));
+    (void) pvInterned;
+}
+
+/* Drops a reference to pcName, which oArena interned. */
+static void Node_releaseName(Arena_T oArena, const char *pcName) {
+    Arena_releaseInterned(oArena, Node_nameAtom(pcName));
+}
+
+/* DynArray_Allocator functions that carve children arrays from an arena */
+static void *Node_arenaAlloc(void *pvPool, size_t ulSize) {
+    return Arena_alloc(pvPool, ulSize);
+}
+
+static void *Node_arenaResize(void *pvPool, void *pvBlock,
+                              size_t ulOldSize, size_t ulNewSize) {
+    return Arena_resize(pvPool, pvBlock, ulOldSize, ulNewSize);
+}
+
+static void Node_arenaFree(void *pvPool, void *pvBlock, size_t ulSize) {
+    Arena_release(pvPool, pvBlock, ulSize);
+}
+
+static const struct DynArray_Allocator Node_arenaAllocator = {
+    Node_arenaAlloc, Node_arenaResize, Node_arenaFree
+};
+
+/*
+  Compares oNNode's name with psName lexicographically, for use with
+  DynArray_bsearch over a sorted children array.
+  Returns <0, 0, or >0 if oNNode's name is "less than", "equal to", or
+  "greater than" psName, respectively.
+*/
+static int Node_compareName(Node_T oNNode, const struct NodeName *psName) {
+    const char *pcNodeName;
+    int iCompare;
+
+    assert(oNNode != NULL);
+    assert(psName != NULL);
+
+    pcNodeName = oNNode->pcName;
+    iCompare = strncmp(pcNodeName, psName->pcName, psName->ulLength);
+    if (iCompare != 0)
+        return iCompare;
+
+    /* Equal through psName's length: a longer node name is greater */
+    return (int) (unsigned char) pcNodeName[psName->ulLength];
+}
+
+/* Places oNChild in the first free slot of its probe sequence. */
+static void Node_indexPut(Node_T oNParent, Node_T oNChild) {
+    size_t ulMask;
+    size_t ulHash;
+    size_t ulSlot;
+
+    assert(oNParent != NULL);
+    assert(oNChild != NULL);
+    assert(oNParent->u.sDir.psIndex != NULL);
+
+    /* Interned names keep their hashes */
+    ulMask = oNParent->u.sDir.ulIndexSlots - 1;
+    ulHash = Node_nameHash(oNChild->pcName);
+    ulSlot = ulHash & ulMask;
+    while (oNParent->u.sDir.psIndex[ulSlot].oNChild != NULL)
+        ulSlot = (ulSlot + 1) & ulMask;
+    oNParent->u.sDir.psIndex[ulSlot].ulHash = ulHash;
+    oNParent->u.sDir.psIndex[ulSlot].oNChild = oNChild;
+}
+
+/*
+  Rebuilds oNParent's hash index with enough slots to keep it at most
+  half full after one more insertion. Returns SUCCESS, or MEMORY_ERROR
+  (leaving any existing index untouched) on allocation failure.
+*/
+static int Node_indexRebuild(Node_T oNParent) {
+    size_t ulNumChildren;
+    size_t ulSlots = 2 * INDEX_THRESHOLD;
+    struct NodeSlot *psNewIndex;
+    size_t i;
+
+    assert(oNParent != NULL);
+
+    ulNumChildren = DynArray_getLength(oNParent->u.sDir.oChildren);
+    while (ulSlots < 2 * (ulNumChildren + 1))
+        ulSlots *= 2;
+
+    psNewIndex = Arena_alloc(oNParent->oArena,
+                             ulSlots * sizeof(struct NodeSlot));
+    if (psNewIndex == NULL)
+        return MEMORY_ERROR;
+    memset(psNewIndex, 0, ulSlots * sizeof(struct NodeSlot));
+
+    Arena_release(oNParent->oArena, oNParent->u.sDir.psIndex,
+                  oNParent->u.sDir.ulIndexSlots * sizeof(struct NodeSlot));
+    oNParent->u.sDir.psIndex = psNewIndex;
+    oNParent->u.sDir.ulIndexSlots = ulSlots;
+    for (i = 0; i < ulNumChildren; i++)
+        Node_indexPut(oNParent, DynArray_get(oNParent->u.sDir.oChildren, i));
+
+    return SUCCESS;
+}
+
+/*
+  Removes oNChild from oNParent's hash index, shifting later entries of
+  the same probe run back so that no tombstones are needed.
+*/
+static void Node_indexRemove(Node_T oNParent, Node_T oNChild) {
+    struct NodeSlot *psIndex;
+    size_t ulMask;
+    size_t ulHole;
+    size_t ulSlot;
+
+    assert(oNParent != NULL);
+    assert(oNChild != NULL);
+    assert(oNParent->u.sDir.psIndex != NULL);
+
+    psIndex = oNParent->u.sDir.psIndex;
+    ulMask = oNParent->u.sDir.ulIndexSlots - 1;
+    for (ulHole = 0; psIndex[ulHole].oNChild != oNChild; ulHole++)
+        assert(ulHole < ulMask);
+
+    ulSlot = ulHole;
+    for (;;) {
+        size_t ulHome;
+
+        ulSlot = (ulSlot + 1) & ulMask;
+        if (psIndex[ulSlot].oNChild == NULL)
+            break;
+
+        /* Move the entry back only if its home slot is not in (hole, slot] */
+        ulHome = psIndex[ulSlot].ulHash & ulMask;
+        if (((ulSlot - ulHome) & ulMask) >= ((ulSlot - ulHole) & ulMask)) {
+            psIndex[ulHole] = psIndex[ulSlot];
+            ulHole = ulSlot;
+        }
+    }
+    psIndex[ulHole].oNChild = NULL;
+}
+
+/*
+  Makes sure that oNParent's hash index, if it needs one, has room for
+  one more child while staying at most half full, creating the index
+  once the directory is large enough. Returns SUCCESS, or MEMORY_ERROR
+  (leaving any existing index untouched) on allocation failure.
+*/
+static int Node_indexReserve(Node_T oNParent) {
+    size_t ulNumChildren = DynArray_getLength(oNParent->u.sDir.oChildren);
+
+    if (oNParent->u.sDir.psIndex == NULL &&
+        ulNumChildren + 1 < INDEX_THRESHOLD)
+        return SUCCESS;
+    if (2 * (ulNumChildren + 1) <= oNParent->u.sDir.ulIndexSlots)
+        return SUCCESS;
+    return Node_indexRebuild(oNParent);
+}
+
+/*
+  Takes oNChild, which has just left oNParent's children array, out of
+  oNParent's hash index, or drops the index if oNParent is now small
+  enough for binary search alone.
+*/
+static void Node_indexUnlink(Node_T oNParent, Node_T oNChild) {
+    if (oNParent->u.sDir.psIndex == NULL)
+        return;
+
+    if (DynArray_getLength(oNParent->u.sDir.oChildren) < INDEX_THRESHOLD / 2) {
+        Arena_release(oNParent->oArena, oNParent->u.sDir.psIndex,
+                      oNParent->u.sDir.ulIndexSlots * sizeof(struct NodeSlot));
+        oNParent->u.sDir.psIndex = NULL;
+        oNParent->u.sDir.ulIndexSlots = 0;
+    }
+    else
+        Node_indexRemove(oNParent, oNChild);
+}
+
+#ifdef RCU
+/* Epoch_retire callback for a children array that has been replaced. */
+static void Node_freeRetiredArray(void *pvArray) {
+    DynArray_free(pvArray);
+}
+
+/*
+  Returns a copy of children array oOld, allocated from oArena, that
+  has oNChild at index ulChildID -- inserted there if bInsert, or in
+  place of the child there otherwise -- or, if oNChild is NULL, the
+  child at ulChildID taken out. Returns NULL on allocation failure.
+*/
+static DynArray_T Node_editChildren(DynArray_T oOld, Arena_T oArena,
+                                    size_t ulChildID, Node_T oNChild,
+                                    boolean bInsert) {
+    DynArray_T oNew;
+    size_t ulOldLength = DynArray_getLength(oOld);
+    size_t ulNewLength = ulOldLength;
+    size_t ulFrom;
+    size_t ulTo = 0;
+
+    if (oNChild == NULL)
+        ulNewLength--;
+    else if (bInsert)
+        ulNewLength++;
+
+    oNew = DynArray_newInlineIn(ulNewLength, INLINE_CHILDREN,
+                                &Node_arenaAllocator, oArena);
+    if (oNew == NULL)
+        return NULL;
+
+    for (ulFrom = 0; ulFrom <= ulOldLength; ulFrom++) {
+        if (ulFrom == ulChildID && oNChild != NULL)
+            (void) DynArray_set(oNew, ulTo++, oNChild);
+        if (ulFrom == ulOldLength)
+            break;
+        if (ulFrom != ulChildID || (oNChild != NULL && bInsert))
+            (void) DynArray_set(oNew, ulTo++, DynArray_get(oOld, ulFrom));
+    }
+    assert(ulTo == ulNewLength);
+    return oNew;
+}
+
+/*
+  Makes oNew, a children array that no one else can reach yet, the
+  children array of oParent. Readers without a lock see either the
+  old array or the new one, never one halfway through a change; the
+  old one is retired rather than freed.
+*/
+static void Node_publishChildren(Node_T oParent, DynArray_T oNew) {
+    DynArray_T oOld = oParent->u.sDir.oChildren;
+
+    EPOCH_PUBLISH(oParent->u.sDir.oChildren, oNew);
+
+    /* If it cannot be retired, the old array waits for the arena */
+    (void) Epoch_retire(Node_freeRetiredArray, oOld);
+}
+
+/*
+  Replaces oParent's children array with a copy edited as by
+  Node_editChildren, and publishes it. Returns SUCCESS, or
+  MEMORY_ERROR (changing nothing) on allocation failure.
+*/
+static int Node_replaceChildren(Node_T oParent, size_t ulChildID,
+                                Node_T oNChild, boolean bInsert) {
+    DynArray_T oNew = Node_editChildren(oParent->u.sDir.oChildren,
+                                        oParent->oArena, ulChildID,
+                                        oNChild, bInsert);
+
+    if (oNew == NULL)
+        return MEMORY_ERROR;
+    Node_publishChildren(oParent, oNew);
+    return SUCCESS;
+}
+#endif
+
+/* Empties *psContents, which holds nothing to release. */
+static void Node_clearContents(struct NodeContents *psContents) {
+    assert(psContents != NULL);
+
+    psContents->pvContents = NULL;
+    psContents->ulLength = 0;
+    psContents->pvAdopted = NULL;
+    psContents->oNOwner = NULL;
+    psContents->bBorrowed = FALSE;
+    psContents->bInterned = FALSE;
+}
+
+/*
+  Creates a new node in the File Tree named by the ulLength characters
+  at pcName (which need not be '\0'-terminated), with parent oNParent
+  (NULL for the root) and type eType. A node stores only its interned
+  name; its absolute path is rebuilt on demand from its ancestors.
+  Returns an int SUCCESS status and sets *poNResult to the new node if successful.
+  Otherwise, sets *poNResult to NULL and returns:
+  - MEMORY_ERROR on allocation failure
+  - NOT_A_DIRECTORY if oNParent is a file
+  - ALREADY_IN_TREE if a sibling with the same name already exists
+*/
+int Node_new(Node_T oNParent, const char *pcName, size_t ulLength,
+             NodeType eType, Arena_T oArena, Node_T *poNResult) {
+    Node_T oNResult;
+    Node_T oNSibling;
+
+    /* Ensure that the parameters are valid */
+    assert(pcName != NULL);
+    assert(oArena != NULL);
+    assert(oNParent == NULL || oNParent->oArena == oArena);
+    assert(poNResult != NULL);
 
-        /* Child’s path must be exactly one level deeper than parent’s */
-        if (Path_getDepth(oPPath) != Path_getDepth(oParentPath) + 1)
-            return NO_SUCH_PATH;
+    *poNResult = NULL;
 
-        /* Child’s path must start with the parent’s path as a prefix */
-        if (!Path_prefix(oParentPath, oPPath))
-            return CONFLICTING_PATH;
+    if (oNParent != NULL) {
+        /* Only directories can have children */
+        if (Node_getType(oNParent) != FT_DIR)
+            return NOT_A_DIRECTORY;
 
-        /* Check if this path already exists as a child under this parent */
-        if (Node_hasChild(oNParent, oPPath, &ulChildID))
+        /* Check if this name already exists as a child under this parent */
+        if (Node_getChildByName(oNParent, pcName, ulLength,
+                                &oNSibling) == SUCCESS)
             return ALREADY_IN_TREE;
     }
 
     /* Allocate memory for the new node structure */
-    Node_T oNResult = malloc(sizeof(struct node));
+    oNResult = Arena_alloc(oArena, sizeof(struct node));
     if (oNResult == NULL)
         return MEMORY_ERROR;
+    oNResult->oArena = oArena;
+    oNResult->ulRefs = 1;
 
-    /* Deep copy the provided path so it’s owned by the node */
-    oNResult->oPPath = Path_copy(oPPath);
-    if (oNResult->oPPath == NULL) {
-        free(oNResult); /* Clean up partial allocation */
+    /* Intern the name: the node shares it with every equal name in its arena */
+    oNResult->pcName = Node_internName(oArena, pcName, ulLength);
+    if (oNResult->pcName == NULL) {
+        Arena_release(oArena, oNResult, sizeof(struct node)); /* Clean up partial allocation */
         return MEMORY_ERROR;
     }
 
@@ -105,28 +516,37 @@ int Node_new(Path_T oPPath, Node_T oNParent, NodeType eType, Node_T *poNResult)
     oNResult->eType = eType;
 
     if (eType == FT_DIR) {
+        /* Small directories start without a hash index */
+        oNResult->u.sDir.psIndex = NULL;
+        oNResult->u.sDir.ulIndexSlots = 0;
+        oNResult->u.sDir.sBelow.ulFiles = 0;
+        oNResult->u.sDir.sBelow.ulDirs = 0;
+        oNResult->u.sDir.sBelow.ulBytes = 0;
+        oNResult->u.sDir.pvWatch = NULL;
+
         /* If it's a directory, initialize an empty children array */
-        oNResult->oChildren = DynArray_new(0);
-        if (oNResult->oChildren == NULL) {
-            Path_free(oNResult->oPPath);
-            free(oNResult);
+        oNResult->u.sDir.oChildren = DynArray_newInlineIn(0, INLINE_CHILDREN,
+                                                          &Node_arenaAllocator,
+                                                          oArena);
+        if (oNResult->u.sDir.oChildren == NULL) {
+            Node_releaseName(oArena, oNResult->pcName);
+            Arena_release(oArena, oNResult, sizeof(struct node));
             return MEMORY_ERROR;
         }
 
-        /* Directories do not store content */
-        oNResult->pcContents = NULL;
-
-    } else {
-        /* If it's a file, it has no children, so set to NULL */
-        oNResult->oChildren = NULL;
-
-        /* Allocate a 1-byte string (empty file contents) */
-        oNResult->pcContents = calloc(1, sizeof(char));  // ensures null-terminated
-        if (oNResult->pcContents == NULL) {
-            Path_free(oNResult->oPPath);
-            free(oNResult);
+#ifdef THREADSAFE
+        if (pthread_rwlock_init(&oNResult->u.sDir.sLock, NULL) != 0) {
+            DynArray_free(oNResult->u.sDir.oChildren);
+            Node_releaseName(oArena, oNResult->pcName);
+            Arena_release(oArena, oNResult, sizeof(struct node));
             return MEMORY_ERROR;
         }
+#endif
+
+    } else {
+        /* A new file is empty: no bytes and nothing to allocate */
+        Node_clearContents(&oNResult->u.sFile.sNow);
+        Node_clearContents(&oNResult->u.sFile.sPrev);
     }
 
     /* Store the pointer to the created node in the caller-provided location */
@@ -138,65 +558,416 @@ int Node_new(Path_T oPPath, Node_T oNParent, NodeType eType, Node_T *poNResult)
 
 
 /*
-  Frees all memory allocated for the subtree rooted at oNNode.
-  Deletes this node and all its descendants.
+  Lets go of *psContents, which file node oNNode holds: returns them to
+  oNNode's arena, or drops oNNode's reference to the node that they
+  belong to, and empties *psContents.
+*/
+static void Node_releaseSlot(Node_T oNNode, struct NodeContents *psContents) {
+    assert(oNNode != NULL);
+    assert(psContents != NULL);
+
+    if (psContents->oNOwner != NULL)
+        (void) Node_free(psContents->oNOwner);
+    else if (psContents->bInterned)
+        Arena_releaseInterned(oNNode->oArena, psContents->pvContents);
+    else if (psContents->pvAdopted != NULL)
+        Arena_releaseAdopted(oNNode->oArena, psContents->pvAdopted);
+    else if (!psContents->bBorrowed)
+        Arena_release(oNNode->oArena, psContents->pvContents,
+                      psContents->ulLength);
+    Node_clearContents(psContents);
+}
+
+/* Returns everything that file node oNNode holds to its arena. */
+static void Node_releaseContents(Node_T oNNode) {
+    struct NodeContents sNow;
+
+    assert(oNNode != NULL);
+    assert(Node_getType(oNNode) == FT_FILE);
+
+    Node_releaseSlot(oNNode, &oNNode->u.sFile.sPrev);
+    sNow = oNNode->u.sFile.sNow;
+    EPOCH_PUBLISH(oNNode->u.sFile.sNow.pvContents, NULL);
+    EPOCH_PUBLISH(oNNode->u.sFile.sNow.ulLength, 0);
+    Node_releaseSlot(oNNode, &sNow);
+    Node_clearContents(&oNNode->u.sFile.sNow);
+}
+
+/*
+  Gives file node oNNode the ulLength bytes at pvContents as its
+  contents, released according to pvAdopted, bBorrowed and bInterned
+  (see struct NodeContents). The old contents become the previous
+  ones, which stay valid until the next change, or until oNNode is
+  freed, while those they replace are released: the caller of
+  FT_replaceFileContents is the only one who may still have them, and
+  a snapshot that shares them holds the node they belong to.
+*/
+static void Node_putContents(Node_T oNNode, void *pvContents,
+                             size_t ulLength, void *pvAdopted,
+                             boolean bBorrowed, boolean bInterned) {
+    struct NodeContents *psNow;
+
+    assert(oNNode != NULL);
+    assert(Node_getType(oNNode) == FT_FILE);
+
+    psNow = &oNNode->u.sFile.sNow;
+    Node_releaseSlot(oNNode, &oNNode->u.sFile.sPrev);
+    oNNode->u.sFile.sPrev = *psNow;
+
+    EPOCH_PUBLISH(psNow->pvContents, pvContents);
+    EPOCH_PUBLISH(psNow->ulLength, ulLength);
+    psNow->pvAdopted = pvAdopted;
+    psNow->oNOwner = NULL;
+    psNow->bBorrowed = bBorrowed;
+    psNow->bInterned = bInterned;
+}
+
+/* Traversal functions: a node's child slots are its children, if any */
+static size_t Node_traversalNumChildren(void *pvNode) {
+    Node_T oNNode = pvNode;
+
+    if (Node_getType(oNNode) != FT_DIR)
+        return 0;
+    return DynArray_getLength(oNNode->u.sDir.oChildren);
+}
+
+/* Drops the parent's reference to each child, skipping those still held */
+static void *Node_traversalGetChild(void *pvNode, size_t ulIndex) {
+    Node_T oNNode = pvNode;
+    Node_T oNChild = DynArray_get(oNNode->u.sDir.oChildren, ulIndex);
+
+    if (NODE_DROP(oNChild) != 0)
+        return NULL;
+    return oNChild;
+}
+
+/*
+  Lets go of one reference to the subtree rooted at oNNode. Deletes
+  each node in it whose last reference that was, along with its
+  own references to its children; a node that is not shared (see
+  Node_share) goes with its whole subtree.
   Returns the number of nodes freed.
 */
 size_t Node_free(Node_T oNNode) {
+    struct Traversal sWalk;
+    void *pvNode;
     size_t ulTotalFreed = 0;  // Counter for number of nodes freed
 
     /* Sanity check: node must not be NULL */
     if (oNNode == NULL)
         return 0;
 
-    /* If the node is a directory, recursively free all its children */
-    if (Node_getType(oNNode) == FT_DIR) {
-        size_t ulNumChildren = Node_getNumChildren(oNNode);
+    /* A snapshot still holds it, and with it everything below */
+    if (NODE_DROP(oNNode) != 0)
+        return 0;
 
-        /* Loop through each child in the directory */
-        for (size_t i = 0; i < ulNumChildren; i++) {
-            Node_T oChild;
+    /*
+      Post-order hands back each node after all of its descendants, so
+      it can be freed on the spot; the explicit stack means a deep tree
+      cannot overflow the call stack. If even that stack cannot grow,
+      the rest of the subtree is left to be reclaimed with its arena.
+    */
+    Traversal_init(&sWalk, oNNode, TRAVERSAL_POSTORDER,
+                   Node_traversalNumChildren, Node_traversalGetChild);
+    while (Traversal_next(&sWalk, &pvNode) == SUCCESS && pvNode != NULL) {
+        Node_T oNDone = pvNode;
+
+        if (Node_getType(oNDone) == FT_DIR) {
+            /* Free the dynamic array of children and its index */
+            DynArray_free(oNDone->u.sDir.oChildren);
+            Arena_release(oNDone->oArena, oNDone->u.sDir.psIndex,
+                          oNDone->u.sDir.ulIndexSlots *
+                              sizeof(struct NodeSlot));
+#ifdef THREADSAFE
+            (void) pthread_rwlock_destroy(&oNDone->u.sDir.sLock);
+#endif
+        }
 
-            /* Retrieve the child node at index i */
-            int status = Node_getChild(oNNode, i, &oChild);
+        /* If the node is a file, free its contents */
+        else
+            Node_releaseContents(oNDone);
 
-            /* Sanity check: continue only if child exists */
-            if (status == SUCCESS && oChild != NULL) {
-                /* Recursively free this child and all of its descendants */
-                ulTotalFreed += Node_free(oChild);
-            }
+        /* Let go of the node's name */
+        Node_releaseName(oNDone->oArena, oNDone->pcName);
+
+        /* Free the node structure itself */
+        Arena_release(oNDone->oArena, oNDone, sizeof(struct node));
+        ulTotalFreed++;
+    }
+    Traversal_free(&sWalk);
+
+    return ulTotalFreed;
+}
+
+/*
+  Takes another reference to the subtree rooted at oNNode, for a
+  snapshot that shares it with the tree. A node with more than one
+  reference must not be changed; see Node_copy.
+*/
+void Node_share(Node_T oNNode) {
+    assert(oNNode != NULL);
+
+    NODE_HOLD(oNNode);
+}
+
+/* Returns TRUE if anything besides its parent holds oNNode. */
+boolean Node_isShared(Node_T oNNode) {
+    assert(oNNode != NULL);
+
+    return (boolean) (NODE_REFS(oNNode) > 1);
+}
+
+/*
+  Creates a node that looks just like oNNode, for its parent to use in
+  its place (see Node_replace) so that whoever shares oNNode does not
+  see the change about to be made. A directory's copy takes a new
+  reference to each of oNNode's children. A file's copy shares its
+  contents, which go on belonging to oNNode (or to the node oNNode
+  shares them with), and holds that node until it lets go of them; it
+  also takes over oNNode's previous contents.
+  Returns SUCCESS and sets *poNResult to the copy, or sets *poNResult
+  to NULL and returns MEMORY_ERROR.
+*/
+int Node_copy(Node_T oNNode, Node_T *poNResult) {
+    Node_T oNCopy;
+    size_t ulNumChildren;
+    size_t i;
+
+    assert(oNNode != NULL);
+    assert(poNResult != NULL);
+
+    *poNResult = NULL;
+
+    oNCopy = Arena_alloc(oNNode->oArena, sizeof(struct node));
+    if (oNCopy == NULL)
+        return MEMORY_ERROR;
+    *oNCopy = *oNNode;
+    oNCopy->ulRefs = 1;
+    Node_holdName(oNNode->oArena, oNNode->pcName);
+
+    if (oNNode->eType == FT_FILE) {
+        struct NodeContents *psNow = &oNCopy->u.sFile.sNow;
+
+        /* The contents stay oNNode's (or its owner's), which the copy holds */
+        if (psNow->pvContents != NULL) {
+            if (psNow->oNOwner == NULL)
+                psNow->oNOwner = oNNode;
+            NODE_HOLD(psNow->oNOwner);
         }
 
-        /* Free the dynamic array of children itself */
-        DynArray_free(oNNode->oChildren);
+        /* Only whoever replaced them can have the previous contents */
+        Node_clearContents(&oNNode->u.sFile.sPrev);
+        *poNResult = oNCopy;
+        return SUCCESS;
+    }
+
+    ulNumChildren = DynArray_getLength(oNNode->u.sDir.oChildren);
+    oNCopy->u.sDir.psIndex = NULL;
+    oNCopy->u.sDir.ulIndexSlots = 0;
+    oNCopy->u.sDir.oChildren = DynArray_newInlineIn(ulNumChildren,
+                                                    INLINE_CHILDREN,
+                                                    &Node_arenaAllocator,
+                                                    oNNode->oArena);
+    if (oNCopy->u.sDir.oChildren == NULL) {
+        Node_releaseName(oNNode->oArena, oNNode->pcName);
+        Arena_release(oNNode->oArena, oNCopy, sizeof(struct node));
+        return MEMORY_ERROR;
+    }
+    for (i = 0; i < ulNumChildren; i++)
+        (void) DynArray_set(oNCopy->u.sDir.oChildren, i,
+                            DynArray_get(oNNode->u.sDir.oChildren, i));
+
+    if (oNNode->u.sDir.psIndex != NULL &&
+        Node_indexRebuild(oNCopy) != SUCCESS) {
+        DynArray_free(oNCopy->u.sDir.oChildren);
+        Node_releaseName(oNNode->oArena, oNNode->pcName);
+        Arena_release(oNNode->oArena, oNCopy, sizeof(struct node));
+        return MEMORY_ERROR;
     }
 
-    /* If the node is a file, free its contents */
-    else if (Node_getType(oNNode) == FT_FILE) {
-        free(oNNode->pcContents);
-        oNNode->pcContents = NULL;  // Clear pointer (not required but good practice)
+#ifdef THREADSAFE
+    if (pthread_rwlock_init(&oNCopy->u.sDir.sLock, NULL) != 0) {
+        Arena_release(oNNode->oArena, oNCopy->u.sDir.psIndex,
+                      oNCopy->u.sDir.ulIndexSlots * sizeof(struct NodeSlot));
+        DynArray_free(oNCopy->u.sDir.oChildren);
+        Node_releaseName(oNNode->oArena, oNNode->pcName);
+        Arena_release(oNNode->oArena, oNCopy, sizeof(struct node));
+        return MEMORY_ERROR;
     }
+#endif
+
+    for (i = 0; i < ulNumChildren; i++)
+        NODE_HOLD((Node_T) DynArray_get(oNCopy->u.sDir.oChildren, i));
+
+    *poNResult = oNCopy;
+    return SUCCESS;
+}
+
+/*
+  Puts oNCopy, which Node_copy made from oNOld, in oNOld's place among
+  its parent's children, and makes it the parent of its own children.
+  The parent's reference to oNOld passes to the caller; if oNOld is
+  the root, the caller must put oNCopy in its place itself. Returns
+  SUCCESS, or MEMORY_ERROR (changing nothing) on allocation failure.
+*/
+int Node_replace(Node_T oNOld, Node_T oNCopy) {
+    Node_T oNParent;
+    size_t i;
+
+    assert(oNOld != NULL);
+    assert(oNCopy != NULL);
+    assert(oNOld->pcName == oNCopy->pcName);
+
+    oNParent = oNOld->oNParent;
+    if (oNParent != NULL) {
+        struct NodeName sName;
+        size_t ulChildID;
+
+        sName.pcName = oNOld->pcName;
+        sName.ulLength = Node_nameLength(oNOld->pcName);
+        if (!DynArray_bsearch(oNParent->u.sDir.oChildren, &sName, &ulChildID,
+                              (int (*)(const void *, const void *)) Node_compareName))
+            assert(FALSE);
+
+#ifdef RCU
+        if (Node_replaceChildren(oNParent, ulChildID, oNCopy, FALSE) != SUCCESS)
+            return MEMORY_ERROR;
+#else
+        (void) DynArray_set(oNParent->u.sDir.oChildren, ulChildID, oNCopy);
+#endif
+
+        if (oNParent->u.sDir.psIndex != NULL) {
+            /* Same name, so the same probe sequence */
+            size_t ulMask = oNParent->u.sDir.ulIndexSlots - 1;
+            size_t ulSlot = Node_nameHash(oNOld->pcName) & ulMask;
+
+            while (oNParent->u.sDir.psIndex[ulSlot].oNChild != oNOld)
+                ulSlot = (ulSlot + 1) & ulMask;
+            oNParent->u.sDir.psIndex[ulSlot].oNChild = oNCopy;
+        }
+    }
+
+    /* Whoever shares oNOld only walks down, never up */
+    if (oNCopy->eType == FT_DIR)
+        for (i = 0; i < DynArray_getLength(oNCopy->u.sDir.oChildren); i++)
+            ((Node_T) DynArray_get(oNCopy->u.sDir.oChildren, i))->oNParent =
+                oNCopy;
+    return SUCCESS;
+}
+
+/*
+  Returns oNNode's name, i.e., the last component of its absolute path.
+  The name is interned in oNNode's arena, so that the nodes of one
+  arena with equal names return the same pointer.
+*/
+const char *Node_getName(Node_T oNNode) {
+    assert(oNNode != NULL);
+
+    return oNNode->pcName;
+}
+
+/* Returns the length of Node_getName(oNNode), in O(1) time. */
+size_t Node_getNameLength(Node_T oNNode) {
+    assert(oNNode != NULL);
+
+    return Node_nameLength(oNNode->pcName);
+}
+
+/*
+  Returns the hash of Node_getName(oNNode), which is Atom_hashString of
+  its characters, in O(1) time.
+*/
+size_t Node_getNameHash(Node_T oNNode) {
+    assert(oNNode != NULL);
+
+    return Node_nameHash(oNNode->pcName);
+}
+
+/* Returns the depth of oNNode: 1 for the root, 2 for its children, ... */
+size_t Node_getDepth(Node_T oNNode) {
+    size_t ulDepth = 0;
+
+    assert(oNNode != NULL);
+
+    /* Count the levels on the way up to the root */
+    for (; oNNode != NULL; oNNode = oNNode->oNParent)
+        ulDepth++;
+    return ulDepth;
+}
 
-    /* Free the Path_T associated with this node */
-    Path_free(oNNode->oPPath);
-    oNNode->oPPath = NULL;
+/*
+  Returns the length (not including trailing '\0') of the string
+  representation of oNNode's absolute path.
+*/
+size_t Node_getPathLength(Node_T oNNode) {
+    size_t ulLength;
 
-    /* Free the node structure itself */
-    free(oNNode);
-    oNNode = NULL;
+    assert(oNNode != NULL);
 
-    /* Count this node as freed and return the total */
-    return ulTotalFreed + 1;
+    /* Each ancestor contributes its name plus one '/' delimiter */
+    ulLength = Node_nameLength(oNNode->pcName);
+    for (oNNode = oNNode->oNParent; oNNode != NULL; oNNode = oNNode->oNParent)
+        ulLength += Node_nameLength(oNNode->pcName) + 1;
+    return ulLength;
 }
 
-/* Returns the absolute path associated with oNNode. */
-Path_T Node_getPath(Node_T oNNode) {
-    /* Assert that the node is not NULL to avoid dereferencing a bad pointer */
+/*
+  Writes the string representation of oNNode's absolute path,
+  followed by '\0', into pcBuf, which must have room for
+  Node_getPathLength(oNNode) + 1 characters.
+  Returns a pointer to the terminating '\0' in pcBuf.
+*/
+char *Node_writePath(Node_T oNNode, char *pcBuf) {
+    char *pcEnd;
+    char *pcInsert;
+
     assert(oNNode != NULL);
+    assert(pcBuf != NULL);
+
+    /* Fill the buffer from the back, walking from oNNode up to the root */
+    pcEnd = pcBuf + Node_getPathLength(oNNode);
+    *pcEnd = '\0';
+    pcInsert = pcEnd;
+    for (;;) {
+        size_t ulLength = Node_nameLength(oNNode->pcName);
+
+        pcInsert -= ulLength;
+        memcpy(pcInsert, oNNode->pcName, ulLength);
+
+        oNNode = oNNode->oNParent;
+        if (oNNode == NULL)
+            break;
+        *--pcInsert = '/';
+    }
+
+    assert(pcInsert == pcBuf);
+    return pcEnd;
+}
+
+/*
+  Rebuilds the absolute path of oNNode as a new Path_T object, owned by
+  the caller. Returns SUCCESS and sets *poPResult to the path, or sets
+  *poPResult to NULL and returns MEMORY_ERROR on allocation failure.
+*/
+int Node_newPath(Node_T oNNode, Path_T *poPResult) {
+    char *pcPath;
+    int iStatus;
+
+    assert(oNNode != NULL);
+    assert(poPResult != NULL);
+
+    pcPath = malloc(Node_getPathLength(oNNode) + 1);
+    if (pcPath == NULL) {
+        *poPResult = NULL;
+        return MEMORY_ERROR;
+    }
 
-    /* Return the internal Path_T stored in the node structure */
-    return oNNode->oPPath;
+    (void) Node_writePath(oNNode, pcPath);
+    iStatus = Path_new(pcPath, poPResult);
+    free(pcPath);
+    return iStatus;
 }
+
 /* Returns the parent of oNNode, or NULL if it is the root. */
 Node_T Node_getParent(Node_T oNNode) {
     /* Ensure the input node is valid (non-NULL) */
@@ -214,7 +985,7 @@ size_t Node_getNumChildren(Node_T oNParent) {
     assert(Node_getType(oNParent) == FT_DIR);
 
     /* Return the number of child nodes stored in the DynArray */
-    return DynArray_getLength(oNParent->oChildren);
+    return DynArray_getLength(oNParent->u.sDir.oChildren);
 }
 
 /*
@@ -224,6 +995,8 @@ size_t Node_getNumChildren(Node_T oNParent) {
   - NO_SUCH_PATH if index is invalid
 */
 int Node_getChild(Node_T oNParent, size_t ulChildID, Node_T *poNResult) {
+    size_t numChildren;
+
     /* Validate input pointers */
     assert(oNParent != NULL);
     assert(poNResult != NULL);
@@ -232,7 +1005,7 @@ int Node_getChild(Node_T oNParent, size_t ulChildID, Node_T *poNResult) {
     assert(Node_getType(oNParent) == FT_DIR);
 
     /* Get the number of children for bounds checking */
-    size_t numChildren = DynArray_getLength(oNParent->oChildren);
+    numChildren = DynArray_getLength(oNParent->u.sDir.oChildren);
 
     /* Check if the index is valid */
     if (ulChildID >= numChildren) {
@@ -241,45 +1014,120 @@ int Node_getChild(Node_T oNParent, size_t ulChildID, Node_T *poNResult) {
     }
 
     /* Retrieve the child node at the given index */
-    *poNResult = DynArray_get(oNParent->oChildren, ulChildID);
+    *poNResult = DynArray_get(oNParent->u.sDir.oChildren, ulChildID);
 
     /* Return success status */
     return SUCCESS;
 }
 
 /*
-  Checks whether oNParent has a child matching path oPPath.
+  Checks whether oNParent has a child matching path oPPath, comparing
+  only the last component of oPPath against the children's names.
   Sets *pulChildID to the child's index if found, or where it would be inserted.
   Returns TRUE if found, FALSE otherwise.
 */
-boolean Node_hasChild(Node_T oNParent, Path_T oPPath) {
-    size_t numChildren;
-    size_t i;
+boolean Node_hasChild(Node_T oNParent, Path_T oPPath, size_t *pulChildID) {
+    struct NodeName sName;
 
     /* Validate input pointers */
     assert(oNParent != NULL);
     assert(oPPath != NULL);
+    assert(pulChildID != NULL);
     assert(Node_getType(oNParent) == FT_DIR);  // Only directories have children
 
-    /* Get the number of children in this directory */
-    numChildren = DynArray_getLength(oNParent->oChildren);
+    /* Children are sorted by name, so binary search on the last component */
+    sName.pcName = Path_getComponent(oPPath, Path_getDepth(oPPath) - 1);
+    sName.ulLength = Atom_length(sName.pcName);
 
-    /* Loop through each child node and compare its path */
-    for (i = 0; i < numChildren; i++) {
-        Node_T child = DynArray_get(oNParent->oChildren, i);
-        assert(child != NULL);  // Defensive check
+    return (boolean) DynArray_bsearch(oNParent->u.sDir.oChildren, &sName, pulChildID,
+                     (int (*)(const void *, const void *)) Node_compareName);
+}
+
+/*
+  Looks up the child of oNParent whose name (last path component) is
+  the ulLength characters at pcName, which need not be '\0'-terminated.
+  Returns:
+  - SUCCESS and sets *poNResult to the child if found
+  - NO_SUCH_PATH and sets *poNResult to NULL otherwise
+  Large directories answer from a hash index in expected O(1) time;
+  smaller ones binary search their sorted children.
+*/
+int Node_getChildByName(Node_T oNParent, const char *pcName,
+                        size_t ulLength, Node_T *poNResult) {
+    struct NodeName sName;
+    size_t ulChildID;
+
+    /* Validate input pointers */
+    assert(oNParent != NULL);
+    assert(pcName != NULL);
+    assert(poNResult != NULL);
+    assert(Node_getType(oNParent) == FT_DIR);  // Only directories have children
 
-        /* Compare the paths using Path_compare() */
-        if (Path_compare(Node_getPath(child), oPPath) == 0) {
-            return TRUE;  // Found a match
+    sName.pcName = pcName;
+    sName.ulLength = ulLength;
+    *poNResult = NULL;
+
+    if (oNParent->u.sDir.psIndex != NULL) {
+        /* Probe from the name's home slot until a match or an empty slot */
+        size_t ulHash = Atom_hashString(pcName, ulLength);
+        size_t ulMask = oNParent->u.sDir.ulIndexSlots - 1;
+        size_t ulSlot = ulHash & ulMask;
+        const struct NodeSlot *psSlot;
+
+        /* Only a child whose hash matches is visited, to compare names */
+        while ((psSlot = &oNParent->u.sDir.psIndex[ulSlot])->oNChild != NULL) {
+            if (psSlot->ulHash == ulHash &&
+                Node_compareName(psSlot->oNChild, &sName) == 0) {
+                *poNResult = psSlot->oNChild;
+                return SUCCESS;
+            }
+            ulSlot = (ulSlot + 1) & ulMask;
         }
+        return NO_SUCH_PATH;
     }
 
-    /* No matching child was found */
-    return FALSE;
+    if (!DynArray_bsearch(oNParent->u.sDir.oChildren, &sName, &ulChildID,
+                          (int (*)(const void *, const void *)) Node_compareName))
+        return NO_SUCH_PATH;
+
+    *poNResult = DynArray_get(oNParent->u.sDir.oChildren, ulChildID);
+    return SUCCESS;
+}
+
+#ifdef RCU
+/*
+  Like Node_getChildByName, for a caller that holds no lock: binary
+  searches the children array last published, and never the hash
+  index, which writers change in place.
+*/
+int Node_getPublishedChild(Node_T oNParent, const char *pcName,
+                           size_t ulLength, Node_T *poNResult) {
+    struct NodeName sName;
+    DynArray_T oChildren;
+    size_t ulChildID;
+
+    assert(oNParent != NULL);
+    assert(pcName != NULL);
+    assert(poNResult != NULL);
+    assert(Node_getType(oNParent) == FT_DIR);
+
+    sName.pcName = pcName;
+    sName.ulLength = ulLength;
+    *poNResult = NULL;
+
+    oChildren = EPOCH_READ(oNParent->u.sDir.oChildren);
+    if (!DynArray_bsearch(oChildren, &sName, &ulChildID,
+                          (int (*)(const void *, const void *)) Node_compareName))
+        return NO_SUCH_PATH;
+
+    *poNResult = DynArray_get(oChildren, ulChildID);
+    return SUCCESS;
 }
+#endif
+
 /*
-  Compares two nodes' paths lexicographically.
+  Compares two sibling nodes' names lexicographically, which orders
+  them the same way as their absolute paths.
   Returns < 0, 0, or > 0 depending on order.
 */
 int Node_compare(Node_T oNFirst, Node_T oNSecond) {
@@ -287,15 +1135,10 @@ int Node_compare(Node_T oNFirst, Node_T oNSecond) {
     assert(oNFirst != NULL);
     assert(oNSecond != NULL);
 
-    /* Get the paths associated with both nodes */
-    Path_T pFirst = Node_getPath(oNFirst);
-    Path_T pSecond = Node_getPath(oNSecond);
-
-    assert(pFirst != NULL);
-    assert(pSecond != NULL);
-
-    /* Use Path_compare to determine the ordering */
-    return Path_compare(pFirst, pSecond);
+    /* Equal names of one arena are the same block */
+    if (oNFirst->pcName == oNSecond->pcName)
+        return 0;
+    return strcmp(oNFirst->pcName, oNSecond->pcName);
 }
 
 /*
@@ -304,14 +1147,14 @@ int Node_compare(Node_T oNFirst, Node_T oNSecond) {
   Returns NULL on memory allocation failure.
 */
 char *Node_toString(Node_T oNNode) {
-    assert(oNNode != NULL);
+    const char *typeStr;
+    size_t len;
+    char *result;
+    char *pcEnd;
 
-    /* Get the string representation of the path */
-    char *pathStr = Path_toString(Node_getPath(oNNode));
-    if (pathStr == NULL) return NULL;
+    assert(oNNode != NULL);
 
     /* Get the type string explicitly (no ternary operator) */
-    const char *typeStr;
     if (Node_getType(oNNode) == FT_FILE) {
         typeStr = "file";
     } else {
@@ -319,20 +1162,17 @@ char *Node_toString(Node_T oNNode) {
     }
 
     /* Compute total length: path + " [type]" + null terminator */
-    size_t len = strlen(pathStr) + strlen(" [file]") + 1;
+    len = Node_getPathLength(oNNode) + strlen(" [file]") + 1;
 
     /* Allocate memory for the final string */
-    char *result = malloc(len);
+    result = malloc(len);
     if (result == NULL) {
-        free(pathStr);
         return NULL;
     }
 
-    /* Format the string */
-    sprintf(result, "%s [%s]", pathStr, typeStr);
-
-    /* Clean up path string */
-    free(pathStr);
+    /* Rebuild the path from the ancestors, then append the type */
+    pcEnd = Node_writePath(oNNode, result);
+    sprintf(pcEnd, " [%s]", typeStr);
 
     return result;
 }
@@ -349,49 +1189,168 @@ NodeType Node_getType(Node_T oNNode) {
     return oNNode->eType;
 }
 
+#ifdef THREADSAFE
+/* Returns the lock of directory oNNode. */
+pthread_rwlock_t *Node_getLock(Node_T oNNode) {
+    assert(oNNode != NULL);
+    assert(Node_getType(oNNode) == FT_DIR);
+
+    return &oNNode->u.sDir.sLock;
+}
+#endif
+
+/* Sets what the FT keeps on directory oNNode for its watches. */
+void Node_setWatch(Node_T oNNode, void *pvWatch) {
+    assert(oNNode != NULL);
+    assert(Node_getType(oNNode) == FT_DIR);
+
+    oNNode->u.sDir.pvWatch = pvWatch;
+}
+
+/* Returns what the FT keeps on directory oNNode for its watches. */
+void *Node_getWatch(Node_T oNNode) {
+    assert(oNNode != NULL);
+    assert(Node_getType(oNNode) == FT_DIR);
+
+    return oNNode->u.sDir.pvWatch;
+}
+
 /*
-  Sets the contents of a file node.
-  Overwrites existing contents if present.
+  Sets the contents of file node oNNode to a copy of the ulLength bytes
+  at pvContents (which may be NULL if ulLength is 0). The old contents
+  are kept as the node's previous contents, since callers may still
+  hold them (FT_replaceFileContents returns them), and those they
+  replace are released.
   Returns:
   - 1 on success
   - 0 on failure or if node is not a file
 */
-int Node_setContents(Node_T oNNode, const char *pcContents) {
+int Node_setContents(Node_T oNNode, const void *pvContents, size_t ulLength) {
+    void *pvNewContents = NULL;
+
     /* Ensure the input node is valid */
     assert(oNNode != NULL);
+    assert(pvContents != NULL || ulLength == 0);
 
     /* Only file nodes are allowed to have contents */
     if (Node_getType(oNNode) != FT_FILE) {
         return 0;
     }
 
-    /* Treat NULL content as an empty string */
-    if (pcContents == NULL) {
-        pcContents = "";
+    /* Copy exactly ulLength bytes, which may include '\0's */
+    if (ulLength > 0) {
+        pvNewContents = Arena_alloc(oNNode->oArena, ulLength);
+        if (pvNewContents == NULL) {
+            return 0;  // Allocation failed
+        }
+        memcpy(pvNewContents, pvContents, ulLength);
     }
 
-    /* Allocate memory for the new contents (+1 for null terminator) */
-    char *newContents = malloc(strlen(pcContents) + 1);
-    if (newContents == NULL) {
-        return 0;  // Allocation failed
+    /* Update the node with the new contents */
+    Node_putContents(oNNode, pvNewContents, ulLength, NULL, FALSE, FALSE);
+
+    return 1;  // Success
+}
+
+/*
+  Sets the contents of file node oNNode to the ulLength bytes at
+  pvContents (which may be NULL if ulLength is 0), as
+  Node_setContents does, but shares them with any other node of the
+  same arena whose contents are the same bytes (see Arena_intern):
+  only the first copy is allocated. The contents must then not be
+  written to. Once new contents replace these, they are the node's
+  previous contents, as for Node_setContents, and the node keeps its
+  reference until they are released in turn, or it is freed.
+  Returns:
+  - 1 on success
+  - 0 on failure or if node is not a file
+*/
+int Node_internContents(Node_T oNNode, const void *pvContents,
+                        size_t ulLength) {
+    void *pvShared = NULL;
+
+    assert(oNNode != NULL);
+    assert(pvContents != NULL || ulLength == 0);
+
+    if (Node_getType(oNNode) != FT_FILE) {
+        return 0;
     }
 
-    /* Copy the new contents into the allocated memory */
-    strcpy(newContents, pcContents);
+    if (ulLength > 0) {
+        pvShared = Arena_intern(oNNode->oArena, pvContents, ulLength);
+        if (pvShared == NULL) {
+            return 0;
+        }
+    }
 
-    /* Free the old contents if any */
-    free(oNNode->pcContents);
+    Node_putContents(oNNode, pvShared, ulLength, NULL, FALSE,
+                     (boolean) (pvShared != NULL));
 
-    /* Update the node with the new contents */
-    oNNode->pcContents = newContents;
+    return 1;
+}
 
-    return 1;  // Success
+/*
+  Sets the contents of file node oNNode to the ulLength bytes at
+  pvContents without copying them. pvContents must have come from
+  malloc (or be NULL); the node's arena takes ownership of it and frees
+  it when the node releases it or the arena is freed, whichever comes
+  first.
+  The old contents are kept as with Node_setContents.
+  Returns:
+  - 1 on success
+  - 0 on failure (ownership then stays with the caller) or if node is
+    not a file
+*/
+int Node_adoptContents(Node_T oNNode, void *pvContents, size_t ulLength) {
+    void *pvAdopted = NULL;
+
+    assert(oNNode != NULL);
+    assert(pvContents != NULL || ulLength == 0);
+
+    if (Node_getType(oNNode) != FT_FILE) {
+        return 0;
+    }
+
+    /* Register the buffer so that it is freed along with the tree */
+    if (pvContents != NULL) {
+        pvAdopted = Arena_adopt(oNNode->oArena, pvContents);
+        if (pvAdopted == NULL) {
+            return 0;
+        }
+    }
+
+    Node_putContents(oNNode, pvContents, ulLength, pvAdopted, FALSE, FALSE);
+
+    return 1;
+}
+
+/*
+  Sets the contents of file node oNNode to the ulLength bytes at
+  pvContents without copying them or taking ownership: the caller must
+  keep them valid for as long as the node's arena lives, and the node
+  never releases them.
+  Returns:
+  - 1 on success
+  - 0 if node is not a file
+*/
+int Node_borrowContents(Node_T oNNode, void *pvContents, size_t ulLength) {
+    assert(oNNode != NULL);
+    assert(pvContents != NULL || ulLength == 0);
+
+    if (Node_getType(oNNode) != FT_FILE) {
+        return 0;
+    }
+
+    Node_putContents(oNNode, pvContents, ulLength, NULL, TRUE, FALSE);
+
+    return 1;
 }
 
 /*
-  Returns the contents of a file node, or NULL if the node is not a file.
+  Returns the contents of a file node, or NULL if the node is not a file
+  or the file is empty.
 */
-const char *Node_getContents(Node_T oNNode) {
+void *Node_getContents(Node_T oNNode) {
     /* Ensure the node is not NULL */
     assert(oNNode != NULL);
 
@@ -400,21 +1359,410 @@ const char *Node_getContents(Node_T oNNode) {
         return NULL;
     }
 
-    /* Return the pointer to the contents string (may be empty) */
-    return oNNode->pcContents;
+    return EPOCH_READ(oNNode->u.sFile.sNow.pvContents);
+}
+
+/*
+  Returns the number of bytes in a file node's contents, or 0 if the node
+  is not a file.
+*/
+size_t Node_getContentsLength(Node_T oNNode) {
+    assert(oNNode != NULL);
+
+    if (Node_getType(oNNode) != FT_FILE) {
+        return 0;
+    }
+
+    /* Stored explicitly, so no scan over the contents is needed */
+    return EPOCH_READ(oNNode->u.sFile.sNow.ulLength);
+}
+
+/*
+  Links oChild into oParent's children, which are kept sorted by name.
+  Returns SUCCESS, or MEMORY_ERROR on allocation failure.
+*/
+int Node_addChild(Node_T oParent, Node_T oChild) {
+    struct NodeName sName;
+    size_t ulChildID;
+
+    assert(oParent != NULL && oChild != NULL);
+    assert(Node_getType(oParent) == FT_DIR);
+
+    /* Find the child's sorted slot; it must not be there already */
+    sName.pcName = oChild->pcName;
+    sName.ulLength = Node_nameLength(oChild->pcName);
+    if (DynArray_bsearch(oParent->u.sDir.oChildren, &sName, &ulChildID,
+                         (int (*)(const void *, const void *)) Node_compareName))
+        return ALREADY_IN_TREE;
+
+    if (Node_indexReserve(oParent) != SUCCESS)
+        return MEMORY_ERROR;
+
+#ifdef RCU
+    if (Node_replaceChildren(oParent, ulChildID, oChild, TRUE) != SUCCESS)
+        return MEMORY_ERROR;
+#else
+    if (!DynArray_addAt(oParent->u.sDir.oChildren, ulChildID, oChild))
+        return MEMORY_ERROR;
+#endif
+
+    if (oParent->u.sDir.psIndex != NULL)
+        Node_indexPut(oParent, oChild);
+    return SUCCESS;
+}
+
+/*
+  Makes the ulCount nodes at poNChildren, which must be sorted by name
+  without duplicates and have oParent as their parent, the children of
+  oParent, which must have none yet and must not be reachable from any
+  tree that others may be reading. The children array (and the hash
+  index, for a large directory) is allocated once at its final size.
+  Returns SUCCESS, or MEMORY_ERROR (leaving oParent childless).
+*/
+int Node_setChildren(Node_T oParent, Node_T *poNChildren, size_t ulCount) {
+    DynArray_T oNewChildren;
+    DynArray_T oOldChildren;
+    size_t i;
+
+    assert(oParent != NULL);
+    assert(poNChildren != NULL || ulCount == 0);
+    assert(Node_getType(oParent) == FT_DIR);
+    assert(DynArray_getLength(oParent->u.sDir.oChildren) == 0);
+
+    if (ulCount == 0)
+        return SUCCESS;
+
+    oNewChildren = DynArray_newInlineIn(ulCount, INLINE_CHILDREN,
+                                        &Node_arenaAllocator,
+                                        oParent->oArena);
+    if (oNewChildren == NULL)
+        return MEMORY_ERROR;
+    for (i = 0; i < ulCount; i++) {
+        assert(poNChildren[i]->oNParent == oParent);
+        assert(i == 0 || Node_compare(poNChildren[i - 1], poNChildren[i]) < 0);
+        (void) DynArray_set(oNewChildren, i, poNChildren[i]);
+    }
+
+    oOldChildren = oParent->u.sDir.oChildren;
+    oParent->u.sDir.oChildren = oNewChildren;
+
+    if (ulCount >= INDEX_THRESHOLD && Node_indexRebuild(oParent) != SUCCESS) {
+        oParent->u.sDir.oChildren = oOldChildren;
+        DynArray_free(oNewChildren);
+        return MEMORY_ERROR;
+    }
+
+    /* Nothing else can reach the children yet: sum them up directly */
+    for (i = 0; i < ulCount; i++) {
+        struct Node_Totals sChild;
+
+        Node_getTotals(poNChildren[i], &sChild);
+        oParent->u.sDir.sBelow.ulFiles += sChild.ulFiles;
+        oParent->u.sDir.sBelow.ulDirs += sChild.ulDirs;
+        oParent->u.sDir.sBelow.ulBytes += sChild.ulBytes;
+    }
+
+    DynArray_free(oOldChildren);
+    return SUCCESS;
 }
 
+/*
+  Unlinks oChild from oParent's children, leaving the totals alone.
+  Returns SUCCESS, or NO_SUCH_PATH if oChild is not a child of oParent.
+  In an RCU build, may also return MEMORY_ERROR, leaving oChild linked.
+*/
 int Node_removeChild(Node_T oParent, Node_T oChild) {
+    struct NodeName sName;
+    size_t ulChildID;
+#ifndef RCU
+    boolean bIndexed = (boolean) (oParent->u.sDir.psIndex != NULL);
+#endif
+
     assert(oParent != NULL && oChild != NULL);
-    size_t numChildren = DynArray_getLength(oParent->oChildren);
-    for (size_t i = 0; i < numChildren; i++) {
-        Node_T child = DynArray_get(oParent->oChildren, i);
-        if (child == oChild) {
-            DynArray_removeAt(oParent->oChildren, i);
-            return SUCCESS;
+    assert(Node_getType(oParent) == FT_DIR);
+
+    sName.pcName = oChild->pcName;
+    sName.ulLength = Node_nameLength(oChild->pcName);
+    if (!DynArray_bsearch(oParent->u.sDir.oChildren, &sName, &ulChildID,
+                          (int (*)(const void *, const void *)) Node_compareName) ||
+        DynArray_get(oParent->u.sDir.oChildren, ulChildID) != oChild)
+        return NO_SUCH_PATH;
+
+#ifdef RCU
+    if (Node_replaceChildren(oParent, ulChildID, NULL, FALSE) != SUCCESS)
+        return MEMORY_ERROR;
+#else
+    (void) DynArray_removeAt(oParent->u.sDir.oChildren, ulChildID);
+#endif
+
+    Node_indexUnlink(oParent, oChild);
+
+#ifndef RCU
+    /*
+      A directory that has shrunk back below the index gives back the
+      room it grew. (Readers of an RCU build may still be in the array.)
+    */
+    if (bIndexed && oParent->u.sDir.psIndex == NULL)
+        DynArray_shrinkToFit(oParent->u.sDir.oChildren);
+#endif
+    return SUCCESS;
+}
+
+#ifdef RCU
+/*
+  Frees just the structure and the name of oNNode, a node that
+  Node_renamedCopy copied; the copy owns everything else. Also an
+  Epoch_retire callback.
+*/
+static void Node_freeHusk(void *pvNode) {
+    Node_T oNHusk = pvNode;
+
+#ifdef THREADSAFE
+    if (oNHusk->eType == FT_DIR)
+        (void) pthread_rwlock_destroy(&oNHusk->u.sDir.sLock);
+#endif
+    Node_releaseName(oNHusk->oArena, oNHusk->pcName);
+    Arena_release(oNHusk->oArena, oNHusk, sizeof(struct node));
+}
+
+/*
+  Creates a copy of oNNode named pcName that takes over everything
+  oNNode holds but its name, for a move that renames it (see
+  Node_move), and the caller's reference to pcName. Returns the copy,
+  or NULL on allocation failure.
+*/
+static Node_T Node_renamedCopy(Node_T oNNode, const char *pcName) {
+    Node_T oNCopy;
+
+    oNCopy = Arena_alloc(oNNode->oArena, sizeof(struct node));
+    if (oNCopy == NULL)
+        return NULL;
+    *oNCopy = *oNNode;
+    oNCopy->pcName = pcName;
+
+    /* Whatever else still holds oNNode (see Node_move) goes on doing so */
+    oNCopy->ulRefs = 1;
+
+#ifdef THREADSAFE
+    if (oNCopy->eType == FT_DIR &&
+        pthread_rwlock_init(&oNCopy->u.sDir.sLock, NULL) != 0) {
+        Arena_release(oNNode->oArena, oNCopy, sizeof(struct node));
+        return NULL;
+    }
+#endif
+    return oNCopy;
+}
+#endif
+
+/*
+  Moves oNNode, which nothing but its parent may hold, from among its
+  parent's children to those of directory oNNewParent, renamed to the
+  ulLength characters at pcName (which need not be '\0'-terminated),
+  leaving the totals alone. oNNewParent must not be in oNNode's
+  subtree, and must not be oNNode's parent unless the name changes.
+  In place, this takes time linear in the number of children of the
+  two parents. An RCU build, though, must not rename a node that
+  lookups may be comparing names with, so it moves a copy instead,
+  which becomes the parent of oNNode's children, and retires oNNode.
+  Returns SUCCESS and sets *poNResult to the moved node. Otherwise,
+  changes nothing, sets *poNResult to NULL and returns:
+  - ALREADY_IN_TREE if oNNewParent already has a child of that name
+  - MEMORY_ERROR on allocation failure
+*/
+int Node_move(Node_T oNNode, Node_T oNNewParent, const char *pcName,
+              size_t ulLength, Node_T *poNResult) {
+    Node_T oNOldParent;
+    Node_T oNMoved = oNNode;
+    const char *pcNewName;
+    struct NodeName sName;
+    size_t ulOldID;
+    size_t ulNewID;
+#ifdef RCU
+    DynArray_T oNewChildren;
+    DynArray_T oOldChildren = NULL;
+    size_t i;
+#endif
+
+    assert(oNNode != NULL);
+    assert(oNNewParent != NULL);
+    assert(Node_getType(oNNewParent) == FT_DIR);
+    assert(pcName != NULL);
+    assert(poNResult != NULL);
+#ifndef RCU
+    /* In an RCU build, a freed snapshot may hold it until it is reclaimed */
+    assert(NODE_REFS(oNNode) == 1);
+#endif
+
+    *poNResult = NULL;
+    oNOldParent = oNNode->oNParent;
+    assert(oNOldParent != NULL);
+
+    sName.pcName = pcName;
+    sName.ulLength = ulLength;
+    if (DynArray_bsearch(oNNewParent->u.sDir.oChildren, &sName, &ulNewID,
+                         (int (*)(const void *, const void *)) Node_compareName))
+        return ALREADY_IN_TREE;
+
+    sName.pcName = oNNode->pcName;
+    sName.ulLength = Node_nameLength(oNNode->pcName);
+    if (!DynArray_bsearch(oNOldParent->u.sDir.oChildren, &sName, &ulOldID,
+                          (int (*)(const void *, const void *)) Node_compareName))
+        assert(FALSE);
+
+    /* A move within one directory does not change its number of children */
+    if (oNNewParent != oNOldParent && Node_indexReserve(oNNewParent) != SUCCESS)
+        return MEMORY_ERROR;
+
+    pcNewName = Node_internName(oNNode->oArena, pcName, ulLength);
+    if (pcNewName == NULL)
+        return MEMORY_ERROR;
+    assert(oNNewParent != oNOldParent || pcNewName != oNNode->pcName);
+
+    /* The node already holds its name if it keeps it */
+    if (pcNewName == oNNode->pcName)
+        Node_releaseName(oNNode->oArena, pcNewName);
+
+#ifdef RCU
+    if (pcNewName != oNNode->pcName) {
+        oNMoved = Node_renamedCopy(oNNode, pcNewName);
+        if (oNMoved == NULL) {
+            Node_releaseName(oNNode->oArena, pcNewName);
+            return MEMORY_ERROR;
         }
     }
-    return NO_SUCH_PATH;
+
+    /*
+      Both arrays are made before either is published, so that nothing
+      can fail halfway. A lookup running meanwhile finds the node at
+      its old path or its new one, or both, but always at least one.
+    */
+    oNewChildren = Node_editChildren(oNNewParent->u.sDir.oChildren,
+                                     oNNewParent->oArena, ulNewID, oNMoved,
+                                     TRUE);
+    if (oNewChildren != NULL && oNNewParent == oNOldParent) {
+        DynArray_T oBoth = oNewChildren;
+
+        oNewChildren = Node_editChildren(oBoth, oNNewParent->oArena,
+                                         ulOldID + (ulNewID <= ulOldID),
+                                         NULL, FALSE);
+        DynArray_free(oBoth);
+    }
+    else if (oNewChildren != NULL) {
+        oOldChildren = Node_editChildren(oNOldParent->u.sDir.oChildren,
+                                         oNOldParent->oArena, ulOldID,
+                                         NULL, FALSE);
+        if (oOldChildren == NULL) {
+            DynArray_free(oNewChildren);
+            oNewChildren = NULL;
+        }
+    }
+    if (oNewChildren == NULL) {
+        if (oNMoved != oNNode)
+            Node_freeHusk(oNMoved);
+        return MEMORY_ERROR;
+    }
+
+    EPOCH_PUBLISH(oNMoved->oNParent, oNNewParent);
+    Node_publishChildren(oNNewParent, oNewChildren);
+    if (oOldChildren != NULL)
+        Node_publishChildren(oNOldParent, oOldChildren);
+#else
+    if (oNNewParent != oNOldParent) {
+        if (!DynArray_addAt(oNNewParent->u.sDir.oChildren, ulNewID, oNNode)) {
+            if (pcNewName != oNNode->pcName)
+                Node_releaseName(oNNode->oArena, pcNewName);
+            return MEMORY_ERROR;
+        }
+        (void) DynArray_removeAt(oNOldParent->u.sDir.oChildren, ulOldID);
+    }
+    else {
+        /* The array cannot need to grow for what it just gave up */
+        (void) DynArray_removeAt(oNOldParent->u.sDir.oChildren, ulOldID);
+        (void) DynArray_addAt(oNNewParent->u.sDir.oChildren,
+                              ulNewID - (ulNewID > ulOldID), oNNode);
+    }
+    oNNode->oNParent = oNNewParent;
+    if (pcNewName != oNNode->pcName) {
+        Node_releaseName(oNNode->oArena, oNNode->pcName);
+        oNNode->pcName = pcNewName;
+    }
+#endif
+
+    Node_indexUnlink(oNOldParent, oNNode);
+    if (oNNewParent->u.sDir.psIndex != NULL)
+        Node_indexPut(oNNewParent, oNMoved);
+
+#ifdef RCU
+    if (oNMoved != oNNode) {
+        /* Whoever is still inside oNNode only walks down, never up */
+        if (oNMoved->eType == FT_DIR)
+            for (i = 0; i < DynArray_getLength(oNMoved->u.sDir.oChildren); i++)
+                ((Node_T) DynArray_get(oNMoved->u.sDir.oChildren, i))->oNParent =
+                    oNMoved;
+
+        /* If it cannot be retired, oNNode waits for the arena */
+        (void) Epoch_retire(Node_freeHusk, oNNode);
+    }
+#endif
+
+    *poNResult = oNMoved;
+    return SUCCESS;
 }
 
+/*
+  Sets *psTotals to what the subtree rooted at oNNode holds, oNNode
+  included, in O(1) time.
+*/
+void Node_getTotals(Node_T oNNode, struct Node_Totals *psTotals) {
+    assert(oNNode != NULL);
+    assert(psTotals != NULL);
 
+    if (oNNode->eType == FT_FILE) {
+        psTotals->ulFiles = 1;
+        psTotals->ulDirs = 0;
+        psTotals->ulBytes = Node_getContentsLength(oNNode);
+        return;
+    }
+    psTotals->ulFiles = NODE_LOAD(oNNode->u.sDir.sBelow.ulFiles);
+    psTotals->ulDirs = NODE_LOAD(oNNode->u.sDir.sBelow.ulDirs) + 1;
+    psTotals->ulBytes = NODE_LOAD(oNNode->u.sDir.sBelow.ulBytes);
+}
+
+/*
+  Adds *psTotals to what directory oNDir and each of its ancestors
+  hold below them, or takes them away if bAdd is FALSE.
+*/
+void Node_addTotals(Node_T oNDir, const struct Node_Totals *psTotals,
+                    boolean bAdd) {
+    assert(psTotals != NULL);
+
+    for (; oNDir != NULL; oNDir = oNDir->oNParent) {
+        struct Node_Totals *psBelow = &oNDir->u.sDir.sBelow;
+
+        assert(oNDir->eType == FT_DIR);
+        if (bAdd)
+            Node_addOwnTotals(oNDir, psTotals);
+        else {
+            NODE_SUB(psBelow->ulFiles, psTotals->ulFiles);
+            NODE_SUB(psBelow->ulDirs, psTotals->ulDirs);
+            NODE_SUB(psBelow->ulBytes, psTotals->ulBytes);
+        }
+    }
+}
+
+/*
+  Adds *psTotals to what directory oNDir holds below it, but not to
+  what its ancestors do.
+*/
+void Node_addOwnTotals(Node_T oNDir, const struct Node_Totals *psTotals) {
+    struct Node_Totals *psBelow;
+
+    assert(oNDir != NULL);
+    assert(oNDir->eType == FT_DIR);
+    assert(psTotals != NULL);
+
+    psBelow = &oNDir->u.sDir.sBelow;
+    NODE_ADD(psBelow->ulFiles, psTotals->ulFiles);
+    NODE_ADD(psBelow->ulDirs, psTotals->ulDirs);
+    NODE_ADD(psBelow->ulBytes, psTotals->ulBytes);
+}
@@ -9,6 +9,10 @@
 #include <stddef.h>
 #include "a4def.h"
 #include "path.h"
+#include "arena.h"
+#ifdef THREADSAFE
+#include <pthread.h>
+#endif
 
 /* A Node_T is a pointer to a node in the File Tree. */
 typedef struct node *Node_T;
@@ -17,25 +21,103 @@ typedef struct node *Node_T;
 typedef enum { FT_DIR, FT_FILE } NodeType;
 
 /*
-  Creates a new node in the File Tree with path oPPath, parent oNParent, and type.
+  Creates a new node in the File Tree named by the ulLength characters
+  at pcName (which need not be '\0'-terminated), with parent oNParent
+  (NULL for the root) and type eType. A node stores only its interned
+  name; its absolute path is rebuilt on demand from its ancestors.
+  All of the node's memory comes from oArena, which must be the arena
+  of oNParent if oNParent is not NULL.
   Returns an int SUCCESS status and sets *poNResult to the new node if successful.
-  Otherwise:
+  Otherwise, sets *poNResult to NULL and returns:
   - MEMORY_ERROR on allocation failure
-  - CONFLICTING_PATH if oNParent’s path is not an ancestor of oPPath
-  - NO_SUCH_PATH if oPPath depth is 0, or parent/child relationship is invalid
-  - ALREADY_IN_TREE if a sibling with the same path already exists
+  - NOT_A_DIRECTORY if oNParent is a file
+  - ALREADY_IN_TREE if a sibling with the same name already exists
 */
-int Node_new(Path_T oPPath, Node_T oNParent, NodeType type, Node_T *poNResult);
+int Node_new(Node_T oNParent, const char *pcName, size_t ulLength,
+             NodeType eType, Arena_T oArena, Node_T *poNResult);
 
 /*
   Frees all memory allocated for the subtree rooted at oNNode.
-  Deletes this node and all its descendants.
+  Deletes this node and all its descendants, returning their memory
+  to the node's arena for reuse. To discard a whole tree, it is
+  cheaper to Arena_free its arena without calling Node_free.
+  What Node_share shares is only let go of: a node is deleted with its
+  last reference.
   Returns the number of nodes freed.
 */
 size_t Node_free(Node_T oNNode);
 
-/* Returns the absolute path associated with oNNode. */
-Path_T Node_getPath(Node_T oNNode);
+/*
+  Takes another reference to the subtree rooted at oNNode, for a
+  snapshot that shares it with the tree. A node with more than one
+  reference must not be changed; see Node_copy.
+*/
+void Node_share(Node_T oNNode);
+
+/* Returns TRUE if anything besides its parent holds oNNode. */
+boolean Node_isShared(Node_T oNNode);
+
+/*
+  Creates a node that looks just like oNNode, for its parent to use in
+  its place (see Node_replace). A directory's copy takes a new
+  reference to each of oNNode's children; a file's copy shares its
+  contents, holding the node they belong to until it lets go of them,
+  and takes over oNNode's previous contents (see Node_setContents).
+  Returns SUCCESS and sets *poNResult to the copy, or sets *poNResult
+  to NULL and returns MEMORY_ERROR.
+*/
+int Node_copy(Node_T oNNode, Node_T *poNResult);
+
+/*
+  Puts oNCopy, which Node_copy made from oNOld, in oNOld's place among
+  its parent's children, and makes it the parent of its own children.
+  The parent's reference to oNOld passes to the caller; if oNOld is
+  the root, the caller must put oNCopy in its place itself. Returns
+  SUCCESS, or MEMORY_ERROR (changing nothing) on allocation failure.
+*/
+int Node_replace(Node_T oNOld, Node_T oNCopy);
+
+/*
+  Returns oNNode's name, i.e., the last component of its absolute path.
+  The name is interned in oNNode's arena along with its length and
+  hash: the nodes of one arena with equal names return the same
+  pointer, and the name is freed with the last of them, or with the
+  arena.
+*/
+const char *Node_getName(Node_T oNNode);
+
+/* Returns the length of Node_getName(oNNode), in O(1) time. */
+size_t Node_getNameLength(Node_T oNNode);
+
+/*
+  Returns the hash of Node_getName(oNNode), which is Atom_hashString of
+  its characters, in O(1) time.
+*/
+size_t Node_getNameHash(Node_T oNNode);
+
+/* Returns the depth of oNNode: 1 for the root, 2 for its children, ... */
+size_t Node_getDepth(Node_T oNNode);
+
+/*
+  Returns the length (not including trailing '\0') of the string
+  representation of oNNode's absolute path.
+*/
+size_t Node_getPathLength(Node_T oNNode);
+
+/*
+  Writes the string representation of oNNode's absolute path,
+  followed by '\0', into pcBuf, which must have room for
+  Node_getPathLength(oNNode) + 1 characters.
+  Returns a pointer to the terminating '\0' in pcBuf.
+*/
+char *Node_writePath(Node_T oNNode, char *pcBuf);
+
+/*
+  Rebuilds the absolute path of oNNode as a new Path_T object, owned by
+  the caller. Returns SUCCESS and sets *poPResult to the path, or sets
+  *poPResult to NULL and returns MEMORY_ERROR on allocation failure.
+*/
+int Node_newPath(Node_T oNNode, Path_T *poPResult);
 
 /* Returns the parent of oNNode, or NULL if it is the root. */
 Node_T Node_getParent(Node_T oNNode);
@@ -52,14 +134,56 @@ size_t Node_getNumChildren(Node_T oNParent);
 int Node_getChild(Node_T oNParent, size_t ulChildID, Node_T *poNResult);
 
 /*
-  Checks whether oNParent has a child matching path oPPath.
+  Checks whether oNParent has a child matching path oPPath, comparing
+  only the last component of oPPath against the children's names.
   Sets *pulChildID to the child's index if found, or where it would be inserted.
   Returns TRUE if found, FALSE otherwise.
 */
 boolean Node_hasChild(Node_T oNParent, Path_T oPPath, size_t *pulChildID);
 
 /*
-  Compares two nodes' paths lexicographically.
+  Looks up the child of oNParent whose name (last path component) is
+  the ulLength characters at pcName, which need not be '\0'-terminated.
+  Returns:
+  - SUCCESS and sets *poNResult to the child if found
+  - NO_SUCH_PATH and sets *poNResult to NULL otherwise
+  Large directories answer from a hash index in expected O(1) time;
+  smaller ones binary search their sorted children.
+*/
+int Node_getChildByName(Node_T oNParent, const char *pcName,
+                        size_t ulLength, Node_T *poNResult);
+
+#ifdef RCU
+/*
+  Like Node_getChildByName, but safe to call without holding oNParent's
+  lock, inside an epoch walk (see epoch.h). In an RCU build, changes to
+  a children array replace it with a new one instead of editing it,
+  and the old one is freed only after such walks are over; the search
+  is a binary search of the array, even in a large directory.
+*/
+int Node_getPublishedChild(Node_T oNParent, const char *pcName,
+                           size_t ulLength, Node_T *poNResult);
+#endif
+
+/*
+  Links oChild into oParent's children, which are kept sorted by name.
+  Returns SUCCESS, ALREADY_IN_TREE if oParent already has a child with
+  oChild's name, or MEMORY_ERROR on allocation failure.
+*/
+int Node_addChild(Node_T oParent, Node_T oChild);
+
+/*
+  Makes the ulCount nodes at poNChildren, sorted by name and already
+  parented to oParent, the children of childless directory oParent,
+  sizing its children array exactly, and adds up their totals into
+  oParent's. Returns SUCCESS, or MEMORY_ERROR (leaving oParent
+  childless).
+*/
+int Node_setChildren(Node_T oParent, Node_T *poNChildren, size_t ulCount);
+
+/*
+  Compares two sibling nodes' names lexicographically, which orders
+  them the same way as their absolute paths.
   Returns < 0, 0, or > 0 depending on order.
 */
 int Node_compare(Node_T oNFirst, Node_T oNSecond);
@@ -78,21 +202,144 @@ char *Node_toString(Node_T oNNode);
 */
 NodeType Node_getType(Node_T oNNode);
 
+#ifdef THREADSAFE
+/*
+  Returns the lock of directory oNNode, which the FT holds while it
+  reads or changes oNNode's children, including the fields of its file
+  children. Node_new initializes it and Node_free destroys it; nodeFT
+  never takes it itself.
+*/
+pthread_rwlock_t *Node_getLock(Node_T oNNode);
+#endif
+
 /*
-  Sets the contents of a file node.
-  Overwrites existing contents if present.
+  Sets pvWatch as what the FT keeps on directory oNNode for its
+  watches (see FT_watch), or NULL, and Node_getWatch returns it; nodeFT
+  never looks at it. Node_new starts it at NULL, and Node_copy and
+  Node_move hand it on to the node they make. It may be set on a node
+  that snapshots share, since they never read it.
+*/
+void Node_setWatch(Node_T oNNode, void *pvWatch);
+
+void *Node_getWatch(Node_T oNNode);
+
+/*
+  Sets the contents of a file node to a copy of the ulLength bytes at
+  pvContents, which may include '\0's (pvContents may be NULL if
+  ulLength is 0). Overwrites existing contents if present. The old
+  contents become the node's previous contents, which stay valid until
+  it is given new contents again or is freed; the previous contents
+  before them are released.
   Returns:
   - 1 on success
   - 0 on failure or if node is not a file
 */
-int Node_setContents(Node_T oNNode, const char *pcContents);
+int Node_setContents(Node_T oNNode, const void *pvContents, size_t ulLength);
+
+/*
+  Like Node_setContents, but takes ownership of pvContents, which must
+  have been allocated by malloc, instead of copying it. The buffer is
+  freed when the node releases it (see above) or its arena is freed,
+  whichever comes first.
+  On failure, ownership of pvContents stays with the caller.
+*/
+int Node_adoptContents(Node_T oNNode, void *pvContents, size_t ulLength);
+
+/*
+  Like Node_setContents, but shares the copy with every other node of
+  the same arena that holds the same bytes, through Arena_intern, so
+  that they must not be written to. The node keeps its reference for
+  as long as these are its contents or its previous contents (see
+  Node_setContents), and drops it when they are released or the node
+  is freed; the block goes with its last reference.
+*/
+int Node_internContents(Node_T oNNode, const void *pvContents,
+                        size_t ulLength);
+
+/*
+  Sets the contents of file node oNNode to the ulLength bytes at
+  pvContents without copying them or taking ownership; the caller
+  keeps them valid for the lifetime of the node's arena.
+  Returns 1 on success, 0 if node is not a file.
+*/
+int Node_borrowContents(Node_T oNNode, void *pvContents, size_t ulLength);
+
+/*
+  Returns the contents of a file node, or NULL if the node is not a file
+  or the file is empty.
+*/
+void *Node_getContents(Node_T oNNode);
 
 /*
-  Returns the contents of a file node, or NULL if the node is not a file.
+  Returns the number of bytes in a file node's contents, in O(1) time,
+  or 0 if the node is not a file.
 */
-const char *Node_getContents(Node_T oNNode);
+size_t Node_getContentsLength(Node_T oNNode);
 
+/*
+  Unlinks oChild from oParent's children, leaving the totals alone.
+  Returns SUCCESS, or NO_SUCH_PATH if oChild is not a child of oParent.
+  In an RCU build, may also return MEMORY_ERROR, leaving oChild linked.
+*/
 int Node_removeChild(Node_T oParent, Node_T oChild);
 
+/*
+  Moves oNNode, which nothing but its parent may hold, from among its
+  parent's children to those of directory oNNewParent, renamed to the
+  ulLength characters at pcName (which need not be '\0'-terminated),
+  leaving the totals alone. oNNewParent must not be in oNNode's
+  subtree, and must not be oNNode's parent unless the name changes.
+  In place, this takes time linear in the number of children of the
+  two parents. An RCU build, though, must not rename a node that
+  lookups may be comparing names with, so it moves a copy instead,
+  which becomes the parent of oNNode's children, and retires oNNode.
+  Returns SUCCESS and sets *poNResult to the moved node. Otherwise,
+  changes nothing, sets *poNResult to NULL and returns:
+  - ALREADY_IN_TREE if oNNewParent already has a child of that name
+  - MEMORY_ERROR on allocation failure
+*/
+int Node_move(Node_T oNNode, Node_T oNNewParent, const char *pcName,
+              size_t ulLength, Node_T *poNResult);
+
+/* What a subtree holds */
+struct Node_Totals {
+    size_t ulFiles;          /* Number of files */
+    size_t ulDirs;           /* Number of directories */
+    size_t ulBytes;          /* Number of bytes of file contents */
+};
+
+/*
+  Each directory keeps the totals of what its descendants hold, so that
+  they can be read in O(1). Only Node_new and Node_setChildren set them;
+  for any other change (linking or unlinking a child, or changing a
+  file's length) the caller brings them up to date with Node_addTotals
+  (or Node_addOwnTotals).
+  In a THREADSAFE build they may be updated and read at once from
+  different threads, and each reads whole, though the three may come
+  from different moments.
+*/
+
+/*
+  Sets *psTotals to what the subtree rooted at oNNode holds, oNNode
+  included, in O(1) time.
+*/
+void Node_getTotals(Node_T oNNode, struct Node_Totals *psTotals);
+
+/*
+  Adds *psTotals to what directory oNDir and each of its ancestors
+  hold below them, or takes them away if bAdd is FALSE; does nothing
+  if oNDir is NULL. Costs O(depth of oNDir).
+*/
+void Node_addTotals(Node_T oNDir, const struct Node_Totals *psTotals,
+                    boolean bAdd);
+
+/*
+  Adds *psTotals to what directory oNDir holds below it, leaving its
+  ancestors be: for totalling a new chain of directories from the
+  bottom up before hooking its totals onto the tree with
+  Node_addTotals.
+*/
+void Node_addOwnTotals(Node_T oNDir, const struct Node_Totals *psTotals);
+
 #endif
 
@@ -0,0 +1 @@
+../0shared/pathcursor.c
\ No newline at end of file
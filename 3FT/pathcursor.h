@@ -0,0 +1 @@
+../0shared/pathcursor.h
\ No newline at end of file
@@ -0,0 +1 @@
+../0shared/traversal.c
\ No newline at end of file